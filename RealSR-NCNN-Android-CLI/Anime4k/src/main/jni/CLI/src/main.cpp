@@ -217,6 +217,23 @@ static void benchmark(const int pID, const int dID)
     double CPUScoreHD = Anime4KCPP::benchmark<Anime4KCPP::CPU::ACNet, 1280, 720>();
     double CPUScoreFHD = Anime4KCPP::benchmark<Anime4KCPP::CPU::ACNet, 1920, 1080>();
 
+    // the CPU kernels are picked at build time (scalar, Eigen3, AVX2, NEON), compare builds by these scores
+    double CPUScoreHDN[4];
+    {
+        cv::Mat testImg = cv::Mat::zeros(cv::Size(1920, 1080), CV_8UC1);
+        cv::randu(testImg, cv::Scalar::all(0), cv::Scalar::all(255));
+
+        for (int level = 0; level < 4; level++)
+        {
+            Anime4KCPP::Parameters parameters;
+            parameters.HDN = level != 0;
+            parameters.HDNLevel = level;
+
+            Anime4KCPP::CPU::ACNet ac(parameters);
+            CPUScoreHDN[level] = Anime4KCPP::benchmark(ac, testImg, testImg, testImg);
+        }
+    }
+
 #ifdef ENABLE_OPENCL
     double OpenCLScoreDVD = Anime4KCPP::benchmark<Anime4KCPP::OpenCL::ACNet, 720, 480>(pID, dID, Anime4KCPP::CNNType::ACNetHDNL0);
     double OpenCLScoreHD = Anime4KCPP::benchmark<Anime4KCPP::OpenCL::ACNet, 1280, 720>(pID, dID, Anime4KCPP::CNNType::ACNetHDNL0);
@@ -245,6 +262,13 @@ static void benchmark(const int pID, const int dID)
         << " HD(720P->1440P): " << CPUScoreHD << " FPS\n"
         << " FHD(1080P->2160P): " << CPUScoreFHD << " FPS\n" << std::endl;
 
+    std::cout
+        << "CPU HDN score: (FHD, " << Anime4KCPP::CoreInfo::CPUOptimizationMode() << ")\n"
+        << " HDN level 0: " << CPUScoreHDN[0] << " FPS\n"
+        << " HDN level 1: " << CPUScoreHDN[1] << " FPS\n"
+        << " HDN level 2: " << CPUScoreHDN[2] << " FPS\n"
+        << " HDN level 3: " << CPUScoreHDN[3] << " FPS\n" << std::endl;
+
 #ifdef ENABLE_OPENCL
     std::cout
         << "OpenCL score: (pID = " << pID << ", dID = " << dID << ")\n"
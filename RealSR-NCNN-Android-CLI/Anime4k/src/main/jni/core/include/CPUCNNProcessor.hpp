@@ -13,9 +13,11 @@ namespace Anime4KCPP::CPU
 class Anime4KCPP::CPU::CNNProcessor
 {
 protected:
-    void conv1To8(const cv::Mat& img, const float* kernels, const float* biases, cv::Mat& tmpMat);
-    void conv8To8(const float* kernels, const float* biases, cv::Mat& tmpMat);
-    void convTranspose8To1(cv::Mat& img, const float* kernels, cv::Mat& tmpMat);
+    //conv1To8, 8 conv8To8 and convTranspose8To1 fused, dst is 2x of src
+    void processLayers(const cv::Mat& src, cv::Mat& dst,
+        const float* kernelsL1, const float* biasL1,
+        const float (*kernels)[9 * 8 * 8], const float (*biases)[8],
+        const float* kernelsL10);
 };
 
 #endif // !ENABLE_OPENCV_DNN
@@ -13,7 +13,7 @@ namespace Parallel = tbb;
 #elif defined(USE_OPENMP)
 #include <omp.h>
 #else
-#include "ThreadPool.hpp"
+#include "WorkStealingPool.hpp"
 #endif
 #endif // !DISABLE_PARALLEL
 
@@ -45,22 +45,15 @@ inline void Anime4KCPP::Utils::parallelFor(const IndexType first, const IndexTyp
     }
 #else // Built-in parallel library
     static const std::size_t threadNum = supportedThreads();
-    if (threadNum > 1)
+    if (threadNum > 1 && last - first > 1)
     {
-        std::vector<std::future<void>> taskList;
-        taskList.reserve(static_cast<std::size_t>(last) - static_cast<std::size_t>(first));
-
-        static Anime4KCPP::Utils::ThreadPool pool(threadNum);
-
-        for (IndexType i = first; i < last; i++)
-        {
-            taskList.emplace_back(pool.exec(
-                [&func](IndexType i) {
+        Anime4KCPP::Utils::WorkStealingPool::shared().run(static_cast<std::size_t>(last - first),
+            [first, &func](const std::size_t begin, const std::size_t end) {
+                for (IndexType i = first + static_cast<IndexType>(begin); i < first + static_cast<IndexType>(end); i++)
+                {
                     func(i);
-                }, i));
-        }
-
-        std::for_each(taskList.begin(), taskList.end(), std::mem_fn(&std::future<void>::wait));
+                }
+            });
     }
     else
     {
@@ -9,9 +9,8 @@
 #include <future>
 #include <functional>
 #include <memory>
-#include <queue>
-#include <unordered_map>
 #include <utility>
+#include <vector>
 #include <cstddef>
 
 #include <opencv2/opencv.hpp>
@@ -52,6 +51,7 @@ public:
     //get the specifying video property from VideoCapture
     double get(int p);
     double getProgress() noexcept;
+    //take the next decoded frame, the processor calls it once per call after acquire
     void read(Frame& frame);
     void write(const Frame& frame);
     void release();
@@ -65,6 +65,26 @@ public:
     void setProgress(double p) noexcept;
     void setTotalFrameCount(std::size_t count) noexcept;
 protected:
+    //frame n stays in slot n % slots.size() from decoding until it is written, the decoded
+    //buffer is refilled in place by frame n + slots.size()
+    struct Slot
+    {
+        cv::Mat raw;
+        cv::Mat dst;
+        bool ready = false;
+    };
+
+    //size the ring reorder buffer and rewind the frame counters
+    void initSlots(std::size_t count);
+    //decode until the end of the video, waits while the writer is a whole ring behind
+    void readFrames();
+    //write the processed frames in order until the last decoded one
+    void writeFrames();
+    //run the processor on decoded frames until none is left
+    void work();
+    //wait for a decoded frame no processor has claimed yet, false at the end or on stop
+    bool acquire();
+
     std::size_t threads = 0;
     std::size_t limit = 0;
     std::function<void()> processor;
@@ -72,13 +92,22 @@ protected:
     cv::VideoWriter writer;
     std::size_t totalFrameCountOverride = 0;
 
-    std::queue<Frame> rawFrames;
-    std::unordered_map<std::size_t, cv::Mat> frameMap;
+    std::vector<Slot> slots;
+    //guarded by mtxRead
+    std::size_t decoded = 0;
+    std::size_t claimed = 0;
+    std::size_t taken = 0;
+    bool readDone = false;
+    //guarded by mtxWrite
+    std::size_t written = 0;
+    std::size_t frameTotal = 0;
+    bool totalKnown = false;
 
     std::mutex mtxRead;
     std::condition_variable cndRead;
     std::mutex mtxWrite;
     std::condition_variable cndWrite;
+    std::condition_variable cndSlot;
 
     std::atomic<double> progress;
     std::unique_ptr<std::promise<void>> pausePromise;
@@ -14,8 +14,6 @@ class Anime4KCPP::Video::VideoIOThreads :public VideoIO
 {
 public:
     void process() override;
-private:
-    std::atomic<std::size_t> finished;
 };
 
 #endif // ENABLE_VIDEO
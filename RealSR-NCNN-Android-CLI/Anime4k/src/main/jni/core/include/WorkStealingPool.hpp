@@ -0,0 +1,246 @@
+#ifndef ANIME4KCPP_CORE_WORK_STEALING_POOL_HPP
+#define ANIME4KCPP_CORE_WORK_STEALING_POOL_HPP
+
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <cstddef>
+
+namespace Anime4KCPP::Utils
+{
+    class WorkStealingPool;
+}
+
+//Pool for parallel loops. A loop is cut into chunks of a few indices, every thread of the loop,
+//the calling one included, starts with its own share of chunks and steals half of what is left
+//of another share when its own runs out. The caller works on its loop until no chunk is left,
+//then waits once for the threads still running one, so loops may run in loops.
+class Anime4KCPP::Utils::WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(std::size_t workerCount);
+    ~WorkStealingPool();
+
+    //one pool of supportedThreads - 1 workers for all loops
+    static WorkStealingPool& shared();
+
+    //func(begin, end) for all chunks of [0, count)
+    template<typename F>
+    void run(std::size_t count, F&& func);
+
+private:
+    struct Share
+    {
+        std::mutex mtx;
+        std::size_t begin = 0;
+        std::size_t end = 0;
+    };
+
+    struct Job
+    {
+        void (*body)(void* func, std::size_t begin, std::size_t end);
+        void* func;
+        std::size_t count;
+        std::size_t grain;
+        std::size_t chunks;
+        std::unique_ptr<Share[]> shares;
+        std::atomic<std::size_t> claimed{ 0 };
+
+        std::mutex mtx;
+        std::condition_variable cnd;
+        std::size_t users = 0;
+        std::exception_ptr error;
+    };
+
+    void work(Job& job, std::size_t slot);
+    bool take(Job& job, std::size_t slot, std::size_t& chunk);
+    Job* pending();
+
+    std::vector<std::thread> threads;
+    std::list<Job*> jobs;
+    std::condition_variable cnd;
+    std::mutex mtx;
+    bool stop;
+};
+
+inline Anime4KCPP::Utils::WorkStealingPool::WorkStealingPool(const std::size_t workerCount)
+    :stop(false)
+{
+    threads.reserve(workerCount);
+
+    //slot 0 of every job is its caller
+    for (std::size_t i = 0; i < workerCount; i++)
+        threads.emplace_back([this, slot = i + 1]()
+            {
+                for (;;)
+                {
+                    Job* job = nullptr;
+                    {
+                        std::unique_lock<std::mutex> lock(mtx);
+                        cnd.wait(lock, [&]
+                            {
+                                return stop || (job = pending()) != nullptr;
+                            });
+
+                        if (stop)
+                            return;
+
+                        const std::lock_guard<std::mutex> jobLock(job->mtx);
+                        job->users++;
+                    }
+
+                    work(*job, slot);
+
+                    //the caller may free the job once users is 0, notify before unlocking
+                    const std::lock_guard<std::mutex> jobLock(job->mtx);
+                    job->users--;
+                    job->cnd.notify_all();
+                }
+            });
+}
+
+inline Anime4KCPP::Utils::WorkStealingPool::~WorkStealingPool()
+{
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        stop = true;
+    }
+    cnd.notify_all();
+    std::for_each(threads.begin(), threads.end(), std::mem_fn(&std::thread::join));
+}
+
+inline Anime4KCPP::Utils::WorkStealingPool& Anime4KCPP::Utils::WorkStealingPool::shared()
+{
+    static WorkStealingPool pool(std::max(std::thread::hardware_concurrency(), 1u) - 1);
+    return pool;
+}
+
+template<typename F>
+inline void Anime4KCPP::Utils::WorkStealingPool::run(const std::size_t count, F&& func)
+{
+    if (count == 0)
+        return;
+
+    const std::size_t slots = threads.size() + 1;
+
+    Job job;
+    job.body = [](void* f, const std::size_t begin, const std::size_t end) {
+        (*static_cast<std::remove_reference_t<F>*>(f))(begin, end);
+    };
+    job.func = const_cast<void*>(static_cast<const void*>(std::addressof(func)));
+    job.count = count;
+    //about 4 chunks per thread, enough to even out rows of different cost
+    job.grain = std::max<std::size_t>(count / (slots * 4), 1);
+    job.chunks = (count + job.grain - 1) / job.grain;
+    job.shares = std::make_unique<Share[]>(slots);
+    for (std::size_t i = 0; i < slots; i++)
+    {
+        job.shares[i].begin = job.chunks * i / slots;
+        job.shares[i].end = job.chunks * (i + 1) / slots;
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        jobs.push_back(&job);
+    }
+    cnd.notify_all();
+
+    work(job, 0);
+
+    //all chunks are taken, no more workers may join
+    {
+        const std::lock_guard<std::mutex> lock(mtx);
+        jobs.remove(&job);
+    }
+
+    {
+        std::unique_lock<std::mutex> lock(job.mtx);
+        job.cnd.wait(lock, [&job]
+            {
+                return job.users == 0;
+            });
+    }
+
+    if (job.error)
+        std::rethrow_exception(job.error);
+}
+
+inline void Anime4KCPP::Utils::WorkStealingPool::work(Job& job, const std::size_t slot)
+{
+    std::size_t chunk;
+    while (take(job, slot, chunk))
+    {
+        const std::size_t begin = chunk * job.grain;
+        const std::size_t end = std::min(begin + job.grain, job.count);
+
+        try
+        {
+            job.body(job.func, begin, end);
+        }
+        catch (...)
+        {
+            const std::lock_guard<std::mutex> lock(job.mtx);
+            if (!job.error)
+                job.error = std::current_exception();
+        }
+    }
+}
+
+inline bool Anime4KCPP::Utils::WorkStealingPool::take(Job& job, const std::size_t slot, std::size_t& chunk)
+{
+    const std::size_t slots = threads.size() + 1;
+    Share& own = job.shares[slot];
+
+    {
+        const std::lock_guard<std::mutex> lock(own.mtx);
+        if (own.begin < own.end)
+        {
+            chunk = own.begin++;
+            job.claimed++;
+            return true;
+        }
+    }
+
+    //stolen chunks move under both locks, a share that looks empty never hides untaken chunks
+    for (std::size_t i = 1; i < slots; i++)
+    {
+        Share& victim = job.shares[(slot + i) % slots];
+
+        const std::scoped_lock lock(own.mtx, victim.mtx);
+        const std::size_t left = victim.end - victim.begin;
+        if (left == 0)
+            continue;
+
+        const std::size_t stolen = (left + 1) / 2;
+        victim.end -= stolen;
+        own.begin = victim.end;
+        own.end = victim.end + stolen;
+
+        chunk = own.begin++;
+        job.claimed++;
+        return true;
+    }
+
+    return false;
+}
+
+//a job with chunks nobody has taken yet, called with mtx held
+inline Anime4KCPP::Utils::WorkStealingPool::Job* Anime4KCPP::Utils::WorkStealingPool::pending()
+{
+    for (Job* job : jobs)
+    {
+        if (job->claimed < job->chunks)
+            return job;
+    }
+    return nullptr;
+}
+
+#endif // !ANIME4KCPP_CORE_WORK_STEALING_POOL_HPP
@@ -57,21 +57,14 @@ void Anime4KCPP::CPU::ACNetHDN::process(const cv::Mat& src, cv::Mat& dst, int sc
 
 #else
 
-#define ACNET_PROCESS_IMPL                         \
-    cv::Mat tmpMat, tmp = src;                     \
-    for (int i = 0; i < scaleTimes; i++)           \
-    {                                              \
-        conv1To8(tmp, kernelsL1, biasL1, tmpMat);  \
-        conv8To8(kernels[0], biases[0], tmpMat);   \
-        conv8To8(kernels[1], biases[1], tmpMat);   \
-        conv8To8(kernels[2], biases[2], tmpMat);   \
-        conv8To8(kernels[3], biases[3], tmpMat);   \
-        conv8To8(kernels[4], biases[4], tmpMat);   \
-        conv8To8(kernels[5], biases[5], tmpMat);   \
-        conv8To8(kernels[6], biases[6], tmpMat);   \
-        conv8To8(kernels[7], biases[7], tmpMat);   \
-        convTranspose8To1(tmp, kernelsL10, tmpMat);\
-    }                                              \
+#define ACNET_PROCESS_IMPL                                                      \
+    cv::Mat tmp = src;                                                          \
+    for (int i = 0; i < scaleTimes; i++)                                        \
+    {                                                                           \
+        cv::Mat out;                                                            \
+        processLayers(tmp, out, kernelsL1, biasL1, kernels, biases, kernelsL10);\
+        tmp = out;                                                              \
+    }                                                                           \
     dst = tmp;
 
 void Anime4KCPP::CPU::ACNetHDNL0::process(const cv::Mat& src, cv::Mat& dst, int scaleTimes)
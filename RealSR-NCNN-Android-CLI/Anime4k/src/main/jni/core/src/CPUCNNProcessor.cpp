@@ -1,9 +1,14 @@
 #ifndef ENABLE_OPENCV_DNN
 
+#include <algorithm>
+#include <cmath>
 #include <limits>
+#include <vector>
 
 #ifdef USE_RYZEN
 #include <immintrin.h>
+#elif defined(USE_NEON)
+#include <arm_neon.h>
 #elif defined(USE_EIGEN3)
 #define EIGEN_DONT_PARALLELIZE
 #include <Eigen/Core>
@@ -14,74 +19,26 @@
 
 namespace Anime4KCPP::CPU::detail
 {
-#ifdef USE_RYZEN
+#if defined(USE_RYZEN) || defined(USE_NEON)
     using StorageType = std::uint16_t;
 #else
     using StorageType = float;
 #endif
 
-    template<typename T, typename F>
-    static void changEachPixel1ToN(const cv::Mat& src, F&& callBack, cv::Mat& tmpMat, int outChannels)
+    //All ten layers run in tiles, line by line. Every 3x3 layer keeps the last three lines of its
+    //output, a line goes through all layers while it is still in cache and the 8 channel feature
+    //maps of the whole image never exist. Tiles are as wide as the lines of all layers fit in
+    //tileBufferSize, and overlap by the 9 pixels the 9 convolution layers see.
+    static constexpr int tilePadding = 9;
+    static constexpr int lineLayers = 9;
+    static constexpr std::size_t tileBufferSize = 256 * 1024;
+    static constexpr int minTileRows = 64;
+
+    //the trained kernels hold subnormal floats, on x86 every multiply with one takes a microcode
+    //assist. Their products are far below anything that reaches the output, so they become zero
+    static inline float flushSubnormal(const float v)
     {
-        const int h = src.rows, w = src.cols;
-        const int jMAX = w * outChannels;
-#ifdef USE_RYZEN
-        tmpMat.create(h, w, CV_16UC(outChannels));
-#else
-        tmpMat.create(h, w, CV_32FC(outChannels));
-#endif
-        const std::size_t srcStep = src.step;
-        const std::size_t step = tmpMat.step;
-
-        Anime4KCPP::Utils::parallelFor(0, h,
-            [&](const int i) {
-                T* lineData = reinterpret_cast<T*>(src.data + static_cast<std::size_t>(i) * srcStep);
-                StorageType* tmpLineData = reinterpret_cast<StorageType*>(tmpMat.data + static_cast<std::size_t>(i) * step);
-                for (int j = 0; j < jMAX; j += outChannels)
-                    callBack(i, j, tmpLineData + j, lineData);
-            });
-    }
-
-    template<typename F>
-    static void changEachPixelNToN(F&& callBack, cv::Mat& tmpMat)
-    {
-        const int h = tmpMat.rows, w = tmpMat.cols;
-        const int channels = tmpMat.channels();
-        const int jMAX = w * channels;
-        const std::size_t step = tmpMat.step;
-
-        cv::Mat tmp;
-        tmp.create(h, w, tmpMat.type());
-
-        Anime4KCPP::Utils::parallelFor(0, h,
-            [&](const int i) {
-                StorageType* lineData = reinterpret_cast<StorageType*>(tmpMat.data + static_cast<std::size_t>(i) * step);
-                StorageType* tmpLineData = reinterpret_cast<StorageType*>(tmp.data + static_cast<std::size_t>(i) * step);
-                for (int j = 0; j < jMAX; j += channels)
-                    callBack(i, j, tmpLineData + j, lineData);
-            });
-
-        tmpMat = tmp;
-    }
-
-    template<typename T, typename F>
-    static void changEachPixelNTo1(cv::Mat& img, F&& callBack, const cv::Mat& tmpMat)
-    {
-        const int h = 2 * tmpMat.rows, w = 2 * tmpMat.cols;
-        img.create(h, w, cv::DataType<T>::type);
-
-        const int jMAX = w;
-        const std::size_t channels = tmpMat.channels();
-        const std::size_t step = tmpMat.step;
-        const std::size_t dstStep = img.step;
-
-        Anime4KCPP::Utils::parallelFor(0, h,
-            [&](const int i) {
-                StorageType* lineData = reinterpret_cast<StorageType*>(tmpMat.data + static_cast<std::size_t>(i >> 1) * step);
-                T* tmpLineData = reinterpret_cast<T*>(img.data + static_cast<std::size_t>(i) * dstStep);
-                for (int j = 0; j < jMAX; j++)
-                    callBack(i, j, tmpLineData + j, lineData + static_cast<std::size_t>(j >> 1) * channels);
-            });
+        return std::abs(v) < std::numeric_limits<float>::min() ? 0.0f : v;
     }
 
     template<typename T, std::enable_if_t<std::is_integral<T>::value>* = nullptr>
@@ -112,220 +69,163 @@ namespace Anime4KCPP::CPU::detail
         return v < 0.0f ? 0.0f : (1.0f < v ? 1.0f : v);
     }
 
-    template<typename T>
-    static void conv1To8Impl(const cv::Mat& img, const float* kernels, const float* biases, cv::Mat& tmpMat)
+#ifdef USE_NEON
+    //8 half floats to float
+    static inline void loadHalf8(const StorageType* src, float32x4_t& lo, float32x4_t& hi)
     {
-        const int channels = 8;
-        const int srcChannels = img.channels();
-        const std::size_t lineStep = img.step1();
-        detail::changEachPixel1ToN<T>(img, [&](const int i, const int j, StorageType* outMat, T* curLine) {
-            const int orgJ = j / channels * srcChannels;
-            const int jp = orgJ < (img.cols - 1)* srcChannels ? srcChannels : 0;
-            const int jn = orgJ > 0 ? -srcChannels : 0;
-
-            const T* const pLineData = i < img.rows - 1 ? curLine + lineStep : curLine;
-            const T* const cLineData = curLine;
-            const T* const nLineData = i > 0 ? curLine - lineStep : curLine;
-
-            const T* tl = nLineData + orgJ + jn, * const tc = nLineData + orgJ, * const tr = nLineData + orgJ + jp;
-            const T* ml = cLineData + orgJ + jn, * const mc = cLineData + orgJ, * const mr = cLineData + orgJ + jp;
-            const T* bl = pLineData + orgJ + jn, * const bc = pLineData + orgJ, * const br = pLineData + orgJ + jp;
-
-            const float tln = norm<T>(tl[Y]);
-            const float tcn = norm<T>(tc[Y]);
-            const float trn = norm<T>(tr[Y]);
-            const float mln = norm<T>(ml[Y]);
-            const float mcn = norm<T>(mc[Y]);
-            const float mrn = norm<T>(mr[Y]);
-            const float bln = norm<T>(bl[Y]);
-            const float bcn = norm<T>(bc[Y]);
-            const float brn = norm<T>(br[Y]);
+        const float16x8_t in = vreinterpretq_f16_u16(vld1q_u16(src));
+        lo = vcvt_f32_f16(vget_low_f16(in));
+        hi = vcvt_high_f32_f16(in);
+    }
 
-#ifdef USE_RYZEN
-            const float* const kptr = kernels;
-            const float* const bptr = biases;
-
-            __m256 out0 = _mm256_loadu_ps(bptr);
-            __m256 out1 = _mm256_setzero_ps();
-            __m256 out2 = _mm256_setzero_ps();
-
-            const __m256 r0 = _mm256_broadcast_ss(&tln);
-            const __m256 r1 = _mm256_broadcast_ss(&tcn);
-            const __m256 r2 = _mm256_broadcast_ss(&trn);
-            const __m256 r3 = _mm256_broadcast_ss(&mln);
-            const __m256 r4 = _mm256_broadcast_ss(&mcn);
-            const __m256 r5 = _mm256_broadcast_ss(&mrn);
-            const __m256 r6 = _mm256_broadcast_ss(&bln);
-            const __m256 r7 = _mm256_broadcast_ss(&bcn);
-            const __m256 r8 = _mm256_broadcast_ss(&brn);
-
-            const __m256 k0 = _mm256_loadu_ps(kptr);
-            const __m256 k1 = _mm256_loadu_ps(kptr + 8);
-            const __m256 k2 = _mm256_loadu_ps(kptr + 16);
-            const __m256 k3 = _mm256_loadu_ps(kptr + 24);
-            const __m256 k4 = _mm256_loadu_ps(kptr + 32);
-            const __m256 k5 = _mm256_loadu_ps(kptr + 40);
-            const __m256 k6 = _mm256_loadu_ps(kptr + 48);
-            const __m256 k7 = _mm256_loadu_ps(kptr + 56);
-            const __m256 k8 = _mm256_loadu_ps(kptr + 64);
-
-            out0 = _mm256_fmadd_ps(r0, k0, out0);
-            out1 = _mm256_fmadd_ps(r1, k1, out1);
-            out2 = _mm256_fmadd_ps(r2, k2, out2);
-            out0 = _mm256_fmadd_ps(r3, k3, out0);
-            out1 = _mm256_fmadd_ps(r4, k4, out1);
-            out2 = _mm256_fmadd_ps(r5, k5, out2);
-            out0 = _mm256_fmadd_ps(r6, k6, out0);
-            out1 = _mm256_fmadd_ps(r7, k7, out1);
-            out2 = _mm256_fmadd_ps(r8, k8, out2);
-
-            out0 = _mm256_max_ps(_mm256_add_ps(out2, _mm256_add_ps(out0, out1)), _mm256_setzero_ps());
-
-            _mm_storeu_si128(reinterpret_cast<__m128i*>(outMat), _mm256_cvtps_ph(out0, 0));
-#elif defined(USE_EIGEN3)
-            float* const kptr = const_cast<float*>(kernels);
-            float* const bptr = const_cast<float*>(biases);
-
-            Eigen::Array<float, 8, 1> out = Eigen::Map<Eigen::Array<float, 8, 1>>(bptr, 8);
-
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k0(kptr, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k1(kptr + 8, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k2(kptr + 16, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k3(kptr + 24, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k4(kptr + 32, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k5(kptr + 40, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k6(kptr + 48, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k7(kptr + 56, 8);
-            const Eigen::Map<Eigen::Array<float, 8, 1>> k8(kptr + 64, 8);
-
-            auto t0 = tln * k0;
-            auto t1 = tcn * k1;
-            auto t2 = trn * k2;
-            auto t3 = mln * k3;
-            auto t4 = mcn * k4;
-            auto t5 = mrn * k5;
-            auto t6 = bln * k6;
-            auto t7 = bcn * k7;
-            auto t8 = brn * k8;
+    //ReLU, then 8 floats to half float
+    static inline void storeHalf8(StorageType* dst, const float32x4_t lo, const float32x4_t hi)
+    {
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        const float16x8_t out = vcvt_high_f16_f32(vcvt_f16_f32(vmaxq_f32(lo, zero)), vmaxq_f32(hi, zero));
+        vst1q_u16(dst, vreinterpretq_u16_f16(out));
+    }
+#endif // USE_NEON
 
-            out += (t0 + t1 + t2 + t3 + t4 + t5 + t6 + t7 + t8);
+    //kernels and biases of one conv8To8 layer
+    struct Conv8To8Weights
+    {
+#if defined(USE_NEON) && defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+        //armv8.2 computes in half float, kernels are converted once per layer
+        Conv8To8Weights(const float* kernels, const float* biases)
+        {
+            for (std::size_t i = 0; i < 72; i++)
+                this->kernels[i] = vcvt_high_f16_f32(vcvt_f16_f32(vld1q_f32(kernels + i * 8)), vld1q_f32(kernels + i * 8 + 4));
+            this->biases = vcvt_high_f16_f32(vcvt_f16_f32(vld1q_f32(biases)), vld1q_f32(biases + 4));
+        }
 
-            Eigen::Map<Eigen::Array<StorageType, 8, 1>>(outMat, 8) = out.max(0.0f);
+        float16x8_t kernels[72];
+        float16x8_t biases;
 #else
-            const float* const kptr = kernels;
-            const float* const bptr = biases;
-
-            const float* const k0 = kptr;
-            const float* const k1 = kptr + 8;
-            const float* const k2 = kptr + 16;
-            const float* const k3 = kptr + 24;
-            const float* const k4 = kptr + 32;
-            const float* const k5 = kptr + 40;
-            const float* const k6 = kptr + 48;
-            const float* const k7 = kptr + 56;
-            const float* const k8 = kptr + 64;
-
-            alignas(32) float out[8];
-            std::copy_n(bptr, 8, out);
-
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += tln * k0[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += tcn * k1[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += trn * k2[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += mln * k3[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += mcn * k4[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += mrn * k5[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += bln * k6[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += bcn * k7[i];
-            for (std::size_t i = 0; i < 8; i++)
-                out[i] += brn * k8[i];
+        Conv8To8Weights(const float* kernels, const float* biases)
+        {
+            std::transform(kernels, kernels + 9 * 8 * 8, this->kernels, flushSubnormal);
+            std::transform(biases, biases + 8, this->biases, flushSubnormal);
+        }
 
-            for (std::size_t i = 0; i < 8; i++)
-                outMat[i] = std::max(out[i], 0.0f);
-#endif // USE_RYZEN
-            }, tmpMat, 8);
-    }
+        float kernels[9 * 8 * 8];
+        float biases[8];
+#endif
+    };
 
-    template<typename T>
-    static void convTranspose8To1Impl(cv::Mat& img, const float* kernels, cv::Mat& tmpMat)
+    //in holds tl, tc, tr, ml, mc, mr, bl, bc, br
+    static inline void conv1To8Pixel(const float* const in, const float* kernels, const float* biases, StorageType* outMat)
     {
-        detail::changEachPixelNTo1<T>(img, [&](const std::ptrdiff_t i, const std::ptrdiff_t j, T* outMat, StorageType* inMat) {
-            //180 degree rotation for kernel
-            //0 1  to  3 2
-            //2 3      1 0
-            const std::ptrdiff_t index = ((i & 1) << 1) + (j & 1);
 #ifdef USE_RYZEN
-            const __m256 in = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(inMat)));
-            const __m256 k0 = _mm256_loadu_ps(kernels + index * 8);
-            const __m256 r0 = _mm256_dp_ps(in, k0, 0xf1);
-            const __m128 r1 = _mm256_extractf128_ps(r0, 0x01);
-            const __m128 r2 = _mm256_castps256_ps128(r0);
-            const __m128 r3 = _mm_add_ps(r1, r2);
-
-            const float luma = _mm_cvtss_f32(r3);
-#elif defined(USE_EIGEN3)
-            float* const kptr = const_cast<float*>(kernels + index * 8);
+        const float* const kptr = kernels;
+        const float* const bptr = biases;
 
-            const float luma =
-                Eigen::Map<Eigen::Matrix<StorageType, 8, 1>>(inMat)
-                .dot(Eigen::Map<Eigen::Matrix<float, 8, 1>>(kptr));
-#else
-            const float* const kptr = kernels + index * 8;
+        __m256 out0 = _mm256_loadu_ps(bptr);
+        __m256 out1 = _mm256_setzero_ps();
+        __m256 out2 = _mm256_setzero_ps();
 
-            float luma = 0;
-            for (std::size_t i = 0; i < 8; i++)
-                luma += kptr[i] * inMat[i];
-#endif
-            * outMat = unnorm<T>(luma);
-            }, tmpMat);
-    }
-}
+        const __m256 r0 = _mm256_broadcast_ss(in);
+        const __m256 r1 = _mm256_broadcast_ss(in + 1);
+        const __m256 r2 = _mm256_broadcast_ss(in + 2);
+        const __m256 r3 = _mm256_broadcast_ss(in + 3);
+        const __m256 r4 = _mm256_broadcast_ss(in + 4);
+        const __m256 r5 = _mm256_broadcast_ss(in + 5);
+        const __m256 r6 = _mm256_broadcast_ss(in + 6);
+        const __m256 r7 = _mm256_broadcast_ss(in + 7);
+        const __m256 r8 = _mm256_broadcast_ss(in + 8);
+
+        const __m256 k0 = _mm256_loadu_ps(kptr);
+        const __m256 k1 = _mm256_loadu_ps(kptr + 8);
+        const __m256 k2 = _mm256_loadu_ps(kptr + 16);
+        const __m256 k3 = _mm256_loadu_ps(kptr + 24);
+        const __m256 k4 = _mm256_loadu_ps(kptr + 32);
+        const __m256 k5 = _mm256_loadu_ps(kptr + 40);
+        const __m256 k6 = _mm256_loadu_ps(kptr + 48);
+        const __m256 k7 = _mm256_loadu_ps(kptr + 56);
+        const __m256 k8 = _mm256_loadu_ps(kptr + 64);
+
+        out0 = _mm256_fmadd_ps(r0, k0, out0);
+        out1 = _mm256_fmadd_ps(r1, k1, out1);
+        out2 = _mm256_fmadd_ps(r2, k2, out2);
+        out0 = _mm256_fmadd_ps(r3, k3, out0);
+        out1 = _mm256_fmadd_ps(r4, k4, out1);
+        out2 = _mm256_fmadd_ps(r5, k5, out2);
+        out0 = _mm256_fmadd_ps(r6, k6, out0);
+        out1 = _mm256_fmadd_ps(r7, k7, out1);
+        out2 = _mm256_fmadd_ps(r8, k8, out2);
 
-void Anime4KCPP::CPU::CNNProcessor::conv1To8(const cv::Mat& img, const float* kernels, const float* biases, cv::Mat& tmpMat)
-{
-    switch (img.depth())
-    {
-    case CV_8U:
-        detail::conv1To8Impl<std::uint8_t>(img, kernels, biases, tmpMat);
-        break;
-    case CV_16U:
-        detail::conv1To8Impl<std::uint16_t>(img, kernels, biases, tmpMat);
-        break;
-    case CV_32F:
-        detail::conv1To8Impl<float>(img, kernels, biases, tmpMat);
-        break;
-    default:
-        throw ACException<ExceptionType::RunTimeError>("Unsupported image data type");
-    }
-}
+        out0 = _mm256_max_ps(_mm256_add_ps(out2, _mm256_add_ps(out0, out1)), _mm256_setzero_ps());
 
-void Anime4KCPP::CPU::CNNProcessor::conv8To8(const float* kernels, const float* biases, cv::Mat& tmpMat)
-{
-    const int channels = 8;
-    const std::size_t lineStep = tmpMat.step1();
-    detail::changEachPixelNToN([&](const int i, const int j, detail::StorageType* outMat, detail::StorageType* curLine) {
-        const int jp = j < (tmpMat.cols - 1)* channels ? channels : 0;
-        const int jn = j > 0 ? -channels : 0;
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(outMat), _mm256_cvtps_ph(out0, 0));
+#elif defined(USE_NEON)
+        const float* const kptr = kernels;
+        const float* const bptr = biases;
 
-        const detail::StorageType* const pLineData = i < tmpMat.rows - 1 ? curLine + lineStep : curLine;
-        const detail::StorageType* const cLineData = curLine;
-        const detail::StorageType* const nLineData = i > 0 ? curLine - lineStep : curLine;
+        float32x4_t out0 = vld1q_f32(bptr);
+        float32x4_t out1 = vld1q_f32(bptr + 4);
 
-        const detail::StorageType* const tl = nLineData + j + jn, * const tc = nLineData + j, * const tr = nLineData + j + jp;
-        const detail::StorageType* const ml = cLineData + j + jn, * const mc = cLineData + j, * const mr = cLineData + j + jp;
-        const detail::StorageType* const bl = pLineData + j + jn, * const bc = pLineData + j, * const br = pLineData + j + jp;
+        for (std::size_t n = 0; n < 9; n++)
+        {
+            out0 = vfmaq_n_f32(out0, vld1q_f32(kptr + n * 8), in[n]);
+            out1 = vfmaq_n_f32(out1, vld1q_f32(kptr + n * 8 + 4), in[n]);
+        }
 
-#ifdef USE_RYZEN
+        storeHalf8(outMat, out0, out1);
+#elif defined(USE_EIGEN3)
+        float* const kptr = const_cast<float*>(kernels);
+        float* const bptr = const_cast<float*>(biases);
+
+        Eigen::Array<float, 8, 1> out = Eigen::Map<Eigen::Array<float, 8, 1>>(bptr, 8);
+
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k0(kptr, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k1(kptr + 8, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k2(kptr + 16, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k3(kptr + 24, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k4(kptr + 32, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k5(kptr + 40, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k6(kptr + 48, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k7(kptr + 56, 8);
+        const Eigen::Map<Eigen::Array<float, 8, 1>> k8(kptr + 64, 8);
+
+        auto t0 = in[0] * k0;
+        auto t1 = in[1] * k1;
+        auto t2 = in[2] * k2;
+        auto t3 = in[3] * k3;
+        auto t4 = in[4] * k4;
+        auto t5 = in[5] * k5;
+        auto t6 = in[6] * k6;
+        auto t7 = in[7] * k7;
+        auto t8 = in[8] * k8;
+
+        out += (t0 + t1 + t2 + t3 + t4 + t5 + t6 + t7 + t8);
+
+        Eigen::Map<Eigen::Array<StorageType, 8, 1>>(outMat, 8) = out.max(0.0f);
+#else
         const float* const kptr = kernels;
         const float* const bptr = biases;
 
+        alignas(32) float out[8];
+        std::copy_n(bptr, 8, out);
+
+        for (std::size_t n = 0; n < 9; n++)
+            for (std::size_t i = 0; i < 8; i++)
+                out[i] += in[n] * kptr[n * 8 + i];
+
+        for (std::size_t i = 0; i < 8; i++)
+            outMat[i] = std::max(out[i], 0.0f);
+#endif // USE_RYZEN
+    }
+
+    static inline void conv8To8Pixel(
+        const StorageType* const tl, const StorageType* const tc, const StorageType* const tr,
+        const StorageType* const ml, const StorageType* const mc, const StorageType* const mr,
+        const StorageType* const bl, const StorageType* const bc, const StorageType* const br,
+        const Conv8To8Weights& weights, StorageType* outMat)
+    {
+#ifdef USE_RYZEN
+        const float* const kptr = weights.kernels;
+        const float* const bptr = weights.biases;
+
         alignas(32) float d0[8];
         alignas(32) float d1[8];
         alignas(32) float d2[8];
@@ -415,9 +315,73 @@ void Anime4KCPP::CPU::CNNProcessor::conv8To8(const float* kernels, const float*
         out0 = _mm256_max_ps(_mm256_add_ps(out2, _mm256_add_ps(out0, out1)), _mm256_setzero_ps());
 
         _mm_storeu_si128(reinterpret_cast<__m128i*>(outMat), _mm256_cvtps_ph(out0, 0));
+#elif defined(USE_NEON)
+        const StorageType* const taps[9] = { tl, tc, tr, ml, mc, mr, bl, bc, br };
+
+#ifdef __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
+        const float16x8_t* const kptr = weights.kernels;
+
+        float16x8_t out0 = weights.biases;
+        float16x8_t out1 = vdupq_n_f16(0.0f);
+        float16x8_t out2 = vdupq_n_f16(0.0f);
+        float16x8_t out3 = vdupq_n_f16(0.0f);
+
+        for (std::size_t n = 0; n < 9; n++)
+        {
+            const float16x8_t d = vreinterpretq_f16_u16(vld1q_u16(taps[n]));
+
+            out0 = vfmaq_laneq_f16(out0, kptr[n], d, 0);
+            out1 = vfmaq_laneq_f16(out1, kptr[9 + n], d, 1);
+            out2 = vfmaq_laneq_f16(out2, kptr[18 + n], d, 2);
+            out3 = vfmaq_laneq_f16(out3, kptr[27 + n], d, 3);
+            out0 = vfmaq_laneq_f16(out0, kptr[36 + n], d, 4);
+            out1 = vfmaq_laneq_f16(out1, kptr[45 + n], d, 5);
+            out2 = vfmaq_laneq_f16(out2, kptr[54 + n], d, 6);
+            out3 = vfmaq_laneq_f16(out3, kptr[63 + n], d, 7);
+        }
+
+        out0 = vmaxq_f16(vaddq_f16(vaddq_f16(out0, out1), vaddq_f16(out2, out3)), vdupq_n_f16(0.0f));
+
+        vst1q_u16(outMat, vreinterpretq_u16_f16(out0));
+#else
+        const float* const kptr = weights.kernels;
+        const float* const bptr = weights.biases;
+
+        float32x4_t out00 = vld1q_f32(bptr);
+        float32x4_t out01 = vld1q_f32(bptr + 4);
+        float32x4_t out10 = vdupq_n_f32(0.0f);
+        float32x4_t out11 = vdupq_n_f32(0.0f);
+
+        for (std::size_t n = 0; n < 9; n++)
+        {
+            float32x4_t d0, d1;
+            loadHalf8(taps[n], d0, d1);
+
+            const float* const k = kptr + n * 8;
+
+            out00 = vfmaq_laneq_f32(out00, vld1q_f32(k), d0, 0);
+            out01 = vfmaq_laneq_f32(out01, vld1q_f32(k + 4), d0, 0);
+            out10 = vfmaq_laneq_f32(out10, vld1q_f32(k + 72), d0, 1);
+            out11 = vfmaq_laneq_f32(out11, vld1q_f32(k + 72 + 4), d0, 1);
+            out00 = vfmaq_laneq_f32(out00, vld1q_f32(k + 144), d0, 2);
+            out01 = vfmaq_laneq_f32(out01, vld1q_f32(k + 144 + 4), d0, 2);
+            out10 = vfmaq_laneq_f32(out10, vld1q_f32(k + 216), d0, 3);
+            out11 = vfmaq_laneq_f32(out11, vld1q_f32(k + 216 + 4), d0, 3);
+            out00 = vfmaq_laneq_f32(out00, vld1q_f32(k + 288), d1, 0);
+            out01 = vfmaq_laneq_f32(out01, vld1q_f32(k + 288 + 4), d1, 0);
+            out10 = vfmaq_laneq_f32(out10, vld1q_f32(k + 360), d1, 1);
+            out11 = vfmaq_laneq_f32(out11, vld1q_f32(k + 360 + 4), d1, 1);
+            out00 = vfmaq_laneq_f32(out00, vld1q_f32(k + 432), d1, 2);
+            out01 = vfmaq_laneq_f32(out01, vld1q_f32(k + 432 + 4), d1, 2);
+            out10 = vfmaq_laneq_f32(out10, vld1q_f32(k + 504), d1, 3);
+            out11 = vfmaq_laneq_f32(out11, vld1q_f32(k + 504 + 4), d1, 3);
+        }
+
+        storeHalf8(outMat, vaddq_f32(out00, out10), vaddq_f32(out01, out11));
+#endif // __ARM_FEATURE_FP16_VECTOR_ARITHMETIC
 #elif defined(USE_EIGEN3)
-        float* const kptr = const_cast<float*>(kernels);
-        float* const bptr = const_cast<float*>(biases);
+        float* const kptr = const_cast<float*>(weights.kernels);
+        float* const bptr = const_cast<float*>(weights.biases);
 
         Eigen::Array<float, 8, 1> out = Eigen::Map<Eigen::Array<float, 8, 1>>(bptr, 8);
 
@@ -446,10 +410,10 @@ void Anime4KCPP::CPU::CNNProcessor::conv8To8(const float* kernels, const float*
             out += (t0 + t1 + t2 + t3 + t4 + t5 + t6 + t7 + t8);
         }
 
-        Eigen::Map<Eigen::Array<detail::StorageType, 8, 1>>(outMat, 8) = out.max(0.0f);
+        Eigen::Map<Eigen::Array<StorageType, 8, 1>>(outMat, 8) = out.max(0.0f);
 #else
-        const float* const kptr = kernels;
-        const float* const bptr = biases;
+        const float* const kptr = weights.kernels;
+        const float* const bptr = weights.biases;
 
         alignas(32) float out[8];
         std::copy_n(bptr, 8, out);
@@ -488,24 +452,192 @@ void Anime4KCPP::CPU::CNNProcessor::conv8To8(const float* kernels, const float*
 
         for (std::size_t i = 0; i < 8; i++)
             outMat[i] = std::max(out[i], 0.0f);
-
 #endif // USE_RYZEN
+    }
+
+    static inline float convTranspose8To1Pixel(const StorageType* const inMat, const float* const kptr)
+    {
+#ifdef USE_RYZEN
+        const __m256 in = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(inMat)));
+        const __m256 k0 = _mm256_loadu_ps(kptr);
+        const __m256 r0 = _mm256_dp_ps(in, k0, 0xf1);
+        const __m128 r1 = _mm256_extractf128_ps(r0, 0x01);
+        const __m128 r2 = _mm256_castps256_ps128(r0);
+        const __m128 r3 = _mm_add_ps(r1, r2);
+
+        return _mm_cvtss_f32(r3);
+#elif defined(USE_NEON)
+        float32x4_t in0, in1;
+        loadHalf8(inMat, in0, in1);
+
+        return vaddvq_f32(vfmaq_f32(vmulq_f32(in0, vld1q_f32(kptr)), in1, vld1q_f32(kptr + 4)));
+#elif defined(USE_EIGEN3)
+        return
+            Eigen::Map<Eigen::Matrix<StorageType, 8, 1>>(const_cast<StorageType*>(inMat))
+            .dot(Eigen::Map<Eigen::Matrix<float, 8, 1>>(const_cast<float*>(kptr)));
+#else
+        float luma = 0;
+        for (std::size_t i = 0; i < 8; i++)
+            luma += kptr[i] * inMat[i];
+        return luma;
+#endif
+    }
+
+    //lines above, at and below, pixels past either end repeat the end pixel
+    template<typename T>
+    static void conv1To8Line(const T* const tLine, const T* const cLine, const T* const bLine, const int cols, const int srcChannels,
+        const float* kernels, const float* biases, StorageType* outLine)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            const int l = (x > 0 ? x - 1 : 0) * srcChannels;
+            const int c = x * srcChannels;
+            const int r = (x < cols - 1 ? x + 1 : x) * srcChannels;
+
+            const float in[9] = {
+                norm<T>(tLine[l + Y]), norm<T>(tLine[c + Y]), norm<T>(tLine[r + Y]),
+                norm<T>(cLine[l + Y]), norm<T>(cLine[c + Y]), norm<T>(cLine[r + Y]),
+                norm<T>(bLine[l + Y]), norm<T>(bLine[c + Y]), norm<T>(bLine[r + Y])
+            };
+
+            conv1To8Pixel(in, kernels, biases, outLine + static_cast<std::size_t>(x) * 8);
+        }
+    }
+
+    static void conv8To8Line(const StorageType* const tLine, const StorageType* const cLine, const StorageType* const bLine, const int cols,
+        const Conv8To8Weights& weights, StorageType* outLine)
+    {
+        for (int x = 0; x < cols; x++)
+        {
+            const std::size_t l = static_cast<std::size_t>(x > 0 ? x - 1 : 0) * 8;
+            const std::size_t c = static_cast<std::size_t>(x) * 8;
+            const std::size_t r = static_cast<std::size_t>(x < cols - 1 ? x + 1 : x) * 8;
+
+            conv8To8Pixel(
+                tLine + l, tLine + c, tLine + r,
+                cLine + l, cLine + c, cLine + r,
+                bLine + l, bLine + c, bLine + r,
+                weights, outLine + c);
+        }
+    }
 
-        }, tmpMat);
+    //one of the two output lines of every input line, 2 * cols pixels
+    template<typename T>
+    static void convTranspose8To1Line(const StorageType* const inLine, const int cols, const int odd, const float* kernels, T* outLine)
+    {
+        //180 degree rotation for kernel
+        //0 1  to  3 2
+        //2 3      1 0
+        const float* const k0 = kernels + (odd << 1) * 8;
+        const float* const k1 = k0 + 8;
+
+        for (int x = 0; x < cols; x++)
+        {
+            const StorageType* const inMat = inLine + static_cast<std::size_t>(x) * 8;
+            outLine[2 * x] = unnorm<T>(convTranspose8To1Pixel(inMat, k0));
+            outLine[2 * x + 1] = unnorm<T>(convTranspose8To1Pixel(inMat, k1));
+        }
+    }
+
+    //the tile x0..x1, y0..y1 of dst / 2, computed over the tile and its padding as if that was the
+    //whole image, the padding absorbs the differences at the tile edges inside the image
+    template<typename T>
+    static void processTile(const cv::Mat& src, cv::Mat& dst,
+        const float* kernelsL1, const float* biasL1, const Conv8To8Weights* weights, const float* kernelsL10,
+        const int x0, const int y0, const int x1, const int y1)
+    {
+        const int srcChannels = src.channels();
+        const int px0 = std::max(x0 - tilePadding, 0), px1 = std::min(x1 + tilePadding, src.cols);
+        const int py0 = std::max(y0 - tilePadding, 0), py1 = std::min(y1 + tilePadding, src.rows);
+        const int cols = px1 - px0, rows = py1 - py0;
+
+        //three lines for each 3x3 layer, line r of layer l lives at slot r % 3
+        const std::size_t lineSize = static_cast<std::size_t>(cols) * 8;
+        std::vector<StorageType> buffer(lineLayers * 3 * lineSize);
+        auto line = [&](const int l, const int r) {
+            return buffer.data() + (static_cast<std::size_t>(l) * 3 + r % 3) * lineSize;
+        };
+        auto srcLine = [&](const int r) {
+            return reinterpret_cast<const T*>(src.ptr(py0 + r)) + static_cast<std::size_t>(px0) * srcChannels;
+        };
+
+        //at step s layer l makes its line s - l, the layer before has just made the line below it
+        for (int s = 0; s < rows + lineLayers - 1; s++)
+        {
+            const int r0 = s;
+            if (r0 < rows)
+                conv1To8Line<T>(srcLine(r0 > 0 ? r0 - 1 : 0), srcLine(r0), srcLine(r0 < rows - 1 ? r0 + 1 : r0), cols, srcChannels,
+                    kernelsL1, biasL1, line(0, r0));
+
+            for (int l = 1; l < lineLayers; l++)
+            {
+                const int r = s - l;
+                if (r < 0 || r >= rows)
+                    continue;
+
+                conv8To8Line(line(l - 1, r > 0 ? r - 1 : 0), line(l - 1, r), line(l - 1, r < rows - 1 ? r + 1 : r), cols,
+                    weights[l - 1], line(l, r));
+            }
+
+            const int r = s - (lineLayers - 1);
+            if (r < 0 || py0 + r < y0 || py0 + r >= y1)
+                continue;
+
+            const StorageType* const inLine = line(lineLayers - 1, r) + static_cast<std::size_t>(x0 - px0) * 8;
+            for (int odd = 0; odd < 2; odd++)
+                convTranspose8To1Line<T>(inLine, x1 - x0, odd, kernelsL10, dst.ptr<T>(2 * (py0 + r) + odd) + 2 * x0);
+        }
+    }
+
+    template<typename T>
+    static void processLayersImpl(const cv::Mat& src, cv::Mat& dst,
+        const float* kernelsL1, const float* biasL1, const float (*kernels)[9 * 8 * 8], const float (*biases)[8], const float* kernelsL10)
+    {
+        const int h = src.rows, w = src.cols;
+        dst.create(h * 2, w * 2, cv::DataType<T>::type);
+
+        float kernelsL1Flushed[9 * 8], biasL1Flushed[8], kernelsL10Flushed[4 * 8];
+        std::transform(kernelsL1, kernelsL1 + 9 * 8, kernelsL1Flushed, flushSubnormal);
+        std::transform(biasL1, biasL1 + 8, biasL1Flushed, flushSubnormal);
+        std::transform(kernelsL10, kernelsL10 + 4 * 8, kernelsL10Flushed, flushSubnormal);
+
+        const std::vector<Conv8To8Weights> weights = {
+            { kernels[0], biases[0] }, { kernels[1], biases[1] }, { kernels[2], biases[2] }, { kernels[3], biases[3] },
+            { kernels[4], biases[4] }, { kernels[5], biases[5] }, { kernels[6], biases[6] }, { kernels[7], biases[7] }
+        };
+
+        //columns as wide as the buffer allows, then rows until every thread has some tiles
+        const int maxCols = static_cast<int>(tileBufferSize / (lineLayers * 3 * 8 * sizeof(StorageType))) - 2 * tilePadding;
+        const int tilesX = (w + maxCols - 1) / maxCols;
+        const int tileCols = (w + tilesX - 1) / tilesX;
+        const int tilesY = std::max(std::min(static_cast<int>(Utils::supportedThreads()) * 2 / tilesX, h / minTileRows), 1);
+        const int tileRows = (h + tilesY - 1) / tilesY;
+
+        Anime4KCPP::Utils::parallelFor(0, tilesX * tilesY,
+            [&](const int i) {
+                const int x0 = i % tilesX * tileCols, y0 = i / tilesX * tileRows;
+                const int x1 = std::min(x0 + tileCols, w), y1 = std::min(y0 + tileRows, h);
+                if (x0 >= x1 || y0 >= y1)
+                    return;
+
+                processTile<T>(src, dst, kernelsL1Flushed, biasL1Flushed, weights.data(), kernelsL10Flushed, x0, y0, x1, y1);
+            });
+    }
 }
 
-void Anime4KCPP::CPU::CNNProcessor::convTranspose8To1(cv::Mat& img, const float* kernels, cv::Mat& tmpMat)
+void Anime4KCPP::CPU::CNNProcessor::processLayers(const cv::Mat& src, cv::Mat& dst,
+    const float* kernelsL1, const float* biasL1, const float (*kernels)[9 * 8 * 8], const float (*biases)[8], const float* kernelsL10)
 {
-    switch (img.depth())
+    switch (src.depth())
     {
     case CV_8U:
-        detail::convTranspose8To1Impl<std::uint8_t>(img, kernels, tmpMat);
+        detail::processLayersImpl<std::uint8_t>(src, dst, kernelsL1, biasL1, kernels, biases, kernelsL10);
         break;
     case CV_16U:
-        detail::convTranspose8To1Impl<std::uint16_t>(img, kernels, tmpMat);
+        detail::processLayersImpl<std::uint16_t>(src, dst, kernelsL1, biasL1, kernels, biases, kernelsL10);
         break;
     case CV_32F:
-        detail::convTranspose8To1Impl<float>(img, kernels, tmpMat);
+        detail::processLayersImpl<float>(src, dst, kernelsL1, biasL1, kernels, biases, kernelsL10);
         break;
     default:
         throw ACException<ExceptionType::RunTimeError>("Unsupported image data type");
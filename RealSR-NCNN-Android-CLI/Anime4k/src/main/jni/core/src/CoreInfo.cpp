@@ -19,6 +19,10 @@ const char* Anime4KCPP::CoreInfo::CPUOptimizationMode()
         "OpenCV DNN"
 #elif defined(USE_RYZEN)
         "SIMD (AVX2)"
+#elif defined(USE_NEON) && defined(__ARM_FEATURE_FP16_VECTOR_ARITHMETIC)
+        "SIMD (NEON FP16)"
+#elif defined(USE_NEON)
+        "SIMD (NEON)"
 #elif defined(USE_EIGEN3)
         "Eigen3"
 #else
@@ -1,11 +1,15 @@
 #ifdef ENABLE_NCNN
 
+#include <algorithm>
+#include <atomic>
+
 #include <net.h>
 
 #include "ACNetType.hpp"
 #include "NCNNACNet.hpp"
 #include "NCNNACNetID.hpp"
 #include "NCNNACNetModel.hpp"
+#include "Parallel.hpp"
 
 namespace Anime4KCPP::NCNN::detail
 {
@@ -13,9 +17,54 @@ namespace Anime4KCPP::NCNN::detail
     static ncnn::VulkanDevice* vkdev = nullptr;
     static ncnn::Net net[Anime4KCPP::ACNetType::TotalTypeCount];
 
-    static void processCPU(const cv::Mat& orgImg, cv::Mat& dstImg, const int scaleTimes, int index, ncnn::Mat& holder)
+    // ACNet is nine 3x3 convolutions and a 2x2 stride 2 deconvolution, an output pixel sees the input
+    // up to 9 pixels away. Every tile takes that much of its neighbours as halo, like the prepadding
+    // of the ncnn upscalers, so the feature maps are bounded by the tile and the result is the same
+    // as one pass over the whole plane
+    static constexpr int tilePrepadding = 9;
+    static constexpr int tileSize = 256;
+
+    struct TileRect
+    {
+        // the tile, then the tile with its halo clipped to the plane
+        int x0, y0, x1, y1;
+        int px0, py0, px1, py1;
+    };
+
+    static TileRect getTileRect(const ncnn::Mat& plane, const int xi, const int yi)
+    {
+        TileRect r;
+        r.x0 = xi * tileSize;
+        r.y0 = yi * tileSize;
+        r.x1 = std::min(r.x0 + tileSize, plane.w);
+        r.y1 = std::min(r.y0 + tileSize, plane.h);
+        r.px0 = std::max(r.x0 - tilePrepadding, 0);
+        r.py0 = std::max(r.y0 - tilePrepadding, 0);
+        r.px1 = std::min(r.x1 + tilePrepadding, plane.w);
+        r.py1 = std::min(r.y1 + tilePrepadding, plane.h);
+        return r;
+    }
+
+    static void copyTileIn(const ncnn::Mat& plane, const TileRect& r, ncnn::Mat& tile)
+    {
+        tile.create(r.px1 - r.px0, r.py1 - r.py0, 1);
+        for (int y = r.py0; y < r.py1; y++)
+            std::memcpy(tile.row(y - r.py0), plane.row(y) + r.px0, (r.px1 - r.px0) * sizeof(float));
+    }
+
+    // the tile output is twice its padded input, the halo is dropped
+    static void copyTileOut(const ncnn::Mat& tile, const TileRect& r, ncnn::Mat& plane)
+    {
+        const int ox = (r.x0 - r.px0) * 2;
+        const int oy = (r.y0 - r.py0) * 2;
+        const int ow = (r.x1 - r.x0) * 2;
+        const int oh = (r.y1 - r.y0) * 2;
+        for (int y = 0; y < oh; y++)
+            std::memcpy(plane.row(r.y0 * 2 + y) + r.x0 * 2, tile.row(oy + y) + ox, ow * sizeof(float));
+    }
+
+    static void getPlane(const cv::Mat& orgImg, ncnn::Mat& in)
     {
-        ncnn::Mat in;
         if (orgImg.step == orgImg.cols * sizeof(float))
             in = ncnn::Mat{ orgImg.cols, orgImg.rows, 1, orgImg.data };
         else
@@ -30,15 +79,58 @@ namespace Anime4KCPP::NCNN::detail
                 src += orgImg.step;
             }
         }
+    }
+
+    static void processCPU(const cv::Mat& orgImg, cv::Mat& dstImg, const int scaleTimes, int index, ncnn::Mat& holder)
+    {
+        ncnn::Mat in;
+        getPlane(orgImg, in);
+
+        const int threads = std::max(net[index].opt.num_threads, 1);
 
         for (int i = 0; i < scaleTimes; i++)
         {
-            ncnn::Extractor ex = net[index].create_extractor();
-            ex.input(ACNetParamID::BLOB_data, in);
-            ex.extract(ACNetParamID::BLOB_output, holder);
-            in = holder;
+            const int xtiles = (in.w + tileSize - 1) / tileSize;
+            const int ytiles = (in.h + tileSize - 1) / tileSize;
+            const int tiles = xtiles * ytiles;
+
+            // tiles run side by side, each worker with its own extractor and allocators
+            const int workers = std::min(threads, tiles);
+            const int workerThreads = std::max(threads / workers, 1);
+
+            ncnn::Mat out(in.w * 2, in.h * 2, 1);
+            std::atomic<int> nextTile(0);
+
+            Utils::parallelFor(0, workers,
+                [&](const int)
+                {
+                    ncnn::UnlockedPoolAllocator blobAllocator;
+                    ncnn::PoolAllocator workspaceAllocator;
+
+                    for (int t = nextTile++; t < tiles; t = nextTile++)
+                    {
+                        const TileRect r = getTileRect(in, t % xtiles, t / xtiles);
+
+                        ncnn::Mat tileIn, tileOut;
+                        copyTileIn(in, r, tileIn);
+
+                        ncnn::Extractor ex = net[index].create_extractor();
+                        ex.set_light_mode(true);
+                        ex.set_num_threads(workerThreads);
+                        ex.set_blob_allocator(&blobAllocator);
+                        ex.set_workspace_allocator(&workspaceAllocator);
+
+                        ex.input(ACNetParamID::BLOB_data, tileIn);
+                        ex.extract(ACNetParamID::BLOB_output, tileOut);
+
+                        copyTileOut(tileOut, r, out);
+                    }
+                });
+
+            in = out;
         }
 
+        holder = in;
         dstImg = cv::Mat{ holder.h, holder.w,CV_32FC1, holder.data };
     }
 
@@ -53,43 +145,52 @@ namespace Anime4KCPP::NCNN::detail
         opt.staging_vkallocator = staging_vkallocator;
 
         ncnn::Mat in;
-        if (orgImg.step == orgImg.cols * sizeof(float))
-            in = ncnn::Mat{ orgImg.cols, orgImg.rows, 1, orgImg.data };
-        else
+        getPlane(orgImg, in);
+
+        for (int i = 0; i < scaleTimes; i++)
         {
-            in.create(orgImg.cols, orgImg.rows, 1);
-            float* dst = reinterpret_cast<float*>(in.data);
-            std::uint8_t* src = orgImg.data;
-            for (int i = 0; i < orgImg.rows; i++)
+            const int xtiles = (in.w + tileSize - 1) / tileSize;
+            const int ytiles = (in.h + tileSize - 1) / tileSize;
+
+            ncnn::Mat out(in.w * 2, in.h * 2, 1);
+
+            for (int yi = 0; yi < ytiles; yi++)
             {
-                std::memcpy(dst, src, orgImg.cols * sizeof(float));
-                dst += orgImg.cols;
-                src += orgImg.step;
-            }
-        }
+                for (int xi = 0; xi < xtiles; xi++)
+                {
+                    const TileRect r = getTileRect(in, xi, yi);
 
-        ncnn::VkCompute cmd(vkdev);
+                    ncnn::Mat tileIn, tileOut;
+                    copyTileIn(in, r, tileIn);
 
-        ncnn::VkMat vkIn;
-        ncnn::VkMat vkOut;
+                    ncnn::VkCompute cmd(vkdev);
 
-        cmd.record_upload(in, vkIn, opt);
-        for (int i = 0; i < scaleTimes; i++)
-        {
-            ncnn::Extractor ex = net[index].create_extractor();
+                    ncnn::VkMat vkIn;
+                    ncnn::VkMat vkOut;
 
-            ex.set_blob_vkallocator(blob_vkallocator);
-            ex.set_workspace_vkallocator(blob_vkallocator);
-            ex.set_staging_vkallocator(staging_vkallocator);
+                    cmd.record_upload(tileIn, vkIn, opt);
+                    {
+                        ncnn::Extractor ex = net[index].create_extractor();
 
-            ex.input(ACNetParamID::BLOB_data, vkIn);
-            ex.extract(ACNetParamID::BLOB_output, vkOut, cmd);
-            vkIn = vkOut;
-        }
-        cmd.record_download(vkOut, holder, opt);
+                        ex.set_blob_vkallocator(blob_vkallocator);
+                        ex.set_workspace_vkallocator(blob_vkallocator);
+                        ex.set_staging_vkallocator(staging_vkallocator);
+
+                        ex.input(ACNetParamID::BLOB_data, vkIn);
+                        ex.extract(ACNetParamID::BLOB_output, vkOut, cmd);
+                    }
+                    cmd.record_download(vkOut, tileOut, opt);
+
+                    cmd.submit_and_wait();
 
-        cmd.submit_and_wait();
+                    copyTileOut(tileOut, r, out);
+                }
+            }
+
+            in = out;
+        }
 
+        holder = in;
         dstImg = cv::Mat{ holder.h, holder.w,CV_32FC1, holder.data };
 
         vkdev->reclaim_blob_allocator(blob_vkallocator);
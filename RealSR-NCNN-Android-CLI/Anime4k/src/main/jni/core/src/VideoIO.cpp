@@ -306,21 +306,20 @@ void Anime4KCPP::Video::VideoIO::setTotalFrameCount(std::size_t count) noexcept
 
 void Anime4KCPP::Video::VideoIO::read(Frame& frame)
 {
-    {
-        const std::lock_guard<std::mutex> lock(mtxRead);
-        frame = std::move(rawFrames.front());
-        rawFrames.pop();
-    }
-    cndRead.notify_one();
+    const std::lock_guard<std::mutex> lock(mtxRead);
+    frame.second = taken++;
+    frame.first = slots[frame.second % slots.size()].raw;
 }
 
 void Anime4KCPP::Video::VideoIO::write(const Frame& frame)
 {
     {
         const std::lock_guard<std::mutex> lock(mtxWrite);
-        frameMap.emplace(frame.second, frame.first);
+        Slot& slot = slots[frame.second % slots.size()];
+        slot.dst = frame.first;
+        slot.ready = true;
     }
-    cndWrite.notify_one();
+    cndWrite.notify_all();
 }
 
 void Anime4KCPP::Video::VideoIO::release()
@@ -328,10 +327,118 @@ void Anime4KCPP::Video::VideoIO::release()
     reader.release();
     writer.release();
 
-    if (!rawFrames.empty())
-        std::queue<Frame>().swap(rawFrames);
-    if (!frameMap.empty())
-        frameMap.clear();
+    std::vector<Slot>().swap(slots);
+}
+
+void Anime4KCPP::Video::VideoIO::initSlots(const std::size_t count)
+{
+    slots.clear();
+    slots.resize(count);
+
+    decoded = claimed = taken = 0;
+    readDone = false;
+    written = frameTotal = 0;
+    totalKnown = false;
+}
+
+void Anime4KCPP::Video::VideoIO::readFrames()
+{
+    std::size_t frameCount = 0;
+    for (;; frameCount++)
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtxWrite);
+
+            while (!stop && frameCount >= written + slots.size())
+                cndSlot.wait(lock);
+
+            if (stop)
+                break;
+        }
+
+        // the frame that used this slot is written, so no processor holds its buffer any more
+        if (!reader.read(slots[frameCount % slots.size()].raw))
+            break;
+
+        {
+            const std::lock_guard<std::mutex> lock(mtxRead);
+            decoded = frameCount + 1;
+        }
+        cndRead.notify_one();
+    }
+
+    {
+        const std::lock_guard<std::mutex> lock(mtxRead);
+        readDone = true;
+    }
+    cndRead.notify_all();
+
+    {
+        const std::lock_guard<std::mutex> lock(mtxWrite);
+        frameTotal = frameCount;
+        totalKnown = true;
+    }
+    cndWrite.notify_all();
+}
+
+void Anime4KCPP::Video::VideoIO::writeFrames()
+{
+    double totalFrame = 0;
+    if (totalFrameCountOverride > 0)
+        totalFrame = static_cast<double>(totalFrameCountOverride);
+    else
+        totalFrame = reader.get(cv::CAP_PROP_FRAME_COUNT);
+    bool hasTotalFrames = (totalFrame > 0);
+
+    for (std::size_t frameCount = 0;; frameCount++)
+    {
+        Slot& slot = slots[frameCount % slots.size()];
+        {
+            std::unique_lock<std::mutex> lock(mtxWrite);
+
+            while (!stop && !slot.ready && !(totalKnown && frameCount >= frameTotal))
+                cndWrite.wait(lock);
+
+            if (stop || !slot.ready)
+                return;
+        }
+
+        // no one else touches the slot until it is handed back below
+        writer.write(slot.dst);
+
+        {
+            const std::lock_guard<std::mutex> lock(mtxWrite);
+            slot.dst.release();
+            slot.ready = false;
+            written = frameCount + 1;
+        }
+        cndSlot.notify_one();
+
+        if (hasTotalFrames && totalFrame > 0)
+            setProgress(static_cast<double>(frameCount) / totalFrame);
+        else
+            setProgress(0.0);
+    }
+}
+
+void Anime4KCPP::Video::VideoIO::work()
+{
+    while (acquire())
+        processor();
+}
+
+bool Anime4KCPP::Video::VideoIO::acquire()
+{
+    std::unique_lock<std::mutex> lock(mtxRead);
+
+    while (!stop && claimed == decoded && !readDone)
+        cndRead.wait(lock);
+
+    if (stop || claimed == decoded)
+        return false;
+
+    claimed++;
+    return true;
 }
 
 bool Anime4KCPP::Video::VideoIO::isPaused() noexcept
@@ -345,8 +452,9 @@ void Anime4KCPP::Video::VideoIO::stopProcess() noexcept
         std::scoped_lock lock(mtxRead, mtxWrite);
         stop = true;
     }
-    cndRead.notify_one();
-    cndWrite.notify_one();
+    cndRead.notify_all();
+    cndWrite.notify_all();
+    cndSlot.notify_all();
 }
 
 void Anime4KCPP::Video::VideoIO::pauseProcess()
@@ -1,70 +1,32 @@
 #if defined(ENABLE_VIDEO) && !defined(DISABLE_PARALLEL)
 
-#include <forward_list>
+#include <algorithm>
 #include <thread>
+#include <vector>
 
 #include "VideoIOAsync.hpp"
 
 void Anime4KCPP::Video::VideoIOAsync::process()
 {
-    std::forward_list<std::future<void>> futures;
+    std::vector<std::future<void>> futures;
 
     if ((limit = std::thread::hardware_concurrency()) < 4)
         limit = 4;
 
-    finished = 0;
+    initSlots(limit * 2);
 
-    futures.emplace_front(std::async(std::launch::async, [&]()
+    futures.emplace_back(std::async(std::launch::async, [this]()
         {
-            double totalFrame = 0;
-            if (totalFrameCountOverride > 0)
-                totalFrame = static_cast<double>(totalFrameCountOverride);
-            else
-                totalFrame = reader.get(cv::CAP_PROP_FRAME_COUNT);
-            bool hasTotalFrames = (totalFrame > 0);
-
-            for (std::size_t frameCount = 0; finished == 0 || frameCount < finished; frameCount++)
-            {
-                std::unique_lock<std::mutex> lock(mtxWrite);
-                std::unordered_map<std::size_t, cv::Mat>::iterator it;
-
-                while (!stop && ((it = frameMap.find(frameCount)) == frameMap.end()))
-                    cndWrite.wait(lock);
-
-                if (stop)
-                    return;
-
-                writer.write(it->second);
-                frameMap.erase(it);
-                
-                if (hasTotalFrames && totalFrame > 0)
-                    setProgress(static_cast<double>(frameCount) / totalFrame);
-                else
-                    setProgress(0.0);
-            }
+            writeFrames();
         }));
 
-    for (std::size_t frameCount = 0;; frameCount++)
-    {
-        cv::Mat frame;
-        if (!reader.read(frame))
-        {
-            finished = frameCount;
-            break;
-        }
-        {
-            std::unique_lock<std::mutex> lock(mtxRead);
-
-            while (!stop && rawFrames.size() >= limit)
-                cndRead.wait(lock);
-
-            if (stop)
-                break;
+    for (std::size_t i = 0; i < limit; i++)
+        futures.emplace_back(std::async(std::launch::async, [this]()
+            {
+                work();
+            }));
 
-            rawFrames.emplace(frame, frameCount);
-        }
-        futures.emplace_front(std::async(std::launch::async, processor));
-    }
+    readFrames();
 
     std::for_each(futures.begin(), futures.end(), std::mem_fn(&std::future<void>::wait));
 }
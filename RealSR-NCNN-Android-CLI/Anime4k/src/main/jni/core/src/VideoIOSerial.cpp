@@ -13,6 +13,10 @@ void Anime4KCPP::Video::VideoIOSerial::process()
 
     stop = false;
 
+    // one slot, its decoded buffer is refilled by every frame
+    initSlots(1);
+    Slot& slot = slots.front();
+
     for (std::size_t frameCount = 0;; frameCount++)
     {
         {
@@ -21,16 +25,19 @@ void Anime4KCPP::Video::VideoIOSerial::process()
                 break;
         }
 
-        cv::Mat frame;
-        if (!reader.read(frame))
+        if (!reader.read(slot.raw))
             break;
 
-        rawFrames.emplace(frame, frameCount);
         processor();
-        auto it = frameMap.find(frameCount);
-        writer.write(it->second);
-        frameMap.erase(it);
-        
+
+        // the processor stopped the process on an error
+        if (!slot.ready)
+            break;
+
+        writer.write(slot.dst);
+        slot.dst.release();
+        slot.ready = false;
+
         if (hasTotalFrames && totalFrame > 0)
             setProgress(static_cast<double>(frameCount) / totalFrame);
         else
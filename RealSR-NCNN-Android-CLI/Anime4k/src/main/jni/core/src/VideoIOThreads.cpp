@@ -5,61 +5,23 @@
 
 void Anime4KCPP::Video::VideoIOThreads::process()
 {
-    Utils::ThreadPool pool(threads);
+    initSlots(limit * 2);
 
-    finished = 0;
+    // the writer mostly waits, so it does not count as one of the processing threads
+    Utils::ThreadPool pool(threads + 1);
 
     pool.exec([this]()
         {
-            double totalFrame = 0;
-            if (totalFrameCountOverride > 0)
-                totalFrame = static_cast<double>(totalFrameCountOverride);
-            else
-                totalFrame = reader.get(cv::CAP_PROP_FRAME_COUNT);
-            bool hasTotalFrames = (totalFrame > 0);
-
-            for (std::size_t frameCount = 0; finished == 0 || frameCount < finished; frameCount++)
-            {
-                std::unique_lock<std::mutex> lock(mtxWrite);
-                std::unordered_map<std::size_t, cv::Mat>::iterator it;
-
-                while (!stop && ((it = frameMap.find(frameCount)) == frameMap.end()))
-                    cndWrite.wait(lock);
-
-                if (stop)
-                    return;
-
-                writer.write(it->second);
-                frameMap.erase(it);
-                
-                if (hasTotalFrames && totalFrame > 0)
-                    setProgress(static_cast<double>(frameCount) / totalFrame);
-                else
-                    setProgress(0.0);
-            }
+            writeFrames();
         });
 
-    for (std::size_t frameCount = 0;; frameCount++)
-    {
-        cv::Mat frame;
-        if (!reader.read(frame))
-        {
-            finished = frameCount;
-            break;
-        }
-        {
-            std::unique_lock<std::mutex> lock(mtxRead);
-
-            while (!stop && rawFrames.size() >= limit)
-                cndRead.wait(lock);
-
-            if (stop)
-                break;
+    for (std::size_t i = 0; i < threads; i++)
+        pool.exec([this]()
+            {
+                work();
+            });
 
-            rawFrames.emplace(frame, frameCount);
-        }
-        pool.exec(processor);
-    }
+    readFrames();
 }
 
 #endif
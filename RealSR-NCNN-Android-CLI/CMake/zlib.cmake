@@ -0,0 +1,10 @@
+# zlib backs the streaming png encoder in common/stream_writer.h, the NDK and desktop toolchains ship it
+find_package(ZLIB)
+if (ZLIB_FOUND)
+    add_definitions(-DSTREAM_WRITER_PNG=1)
+    include_directories(${ZLIB_INCLUDE_DIRS})
+    set(ZLIB_LIB ${ZLIB_LIBRARIES})
+else ()
+    message(STATUS "zlib not found, png output is not streamed")
+    set(ZLIB_LIB "")
+endif ()
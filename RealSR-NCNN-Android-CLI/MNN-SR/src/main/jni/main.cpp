@@ -1,7 +1,6 @@
 
 #include <stdio.h>
 
-#include <queue>
 #include <vector>
 #include <clocale>
 #include <thread>
@@ -116,6 +115,8 @@ static std::vector<int> parse_optarg_int_array(const char *optarg) {
 #include "mnnsr.h"
 #include "filesystem_utils.h"
 #include "image_processor.h"
+#include "task_queue.h"
+#include "bench_mode.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/hal/interface.h>
 
@@ -151,6 +152,7 @@ static void print_usage() {
             "  -c color-type        model & output color space type (RGB=1, BGR=2, YCbCr=5, YUV=6, GRAY=10, GRAY model & YCbCr output=11, GRAY model & YUV output=12, default=1)\n");
     fprintf(stderr,
             "  -d decensor-mode     remove censor mode (Not=-1, Mosaic=0, default=-1)\n");
+    fprintf(stderr, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
 }
 
 class Task {
@@ -167,51 +169,14 @@ public:
     cv::Mat inimage;
     cv::Mat outimage;
     cv::Mat inalpha;
-};
 
-class TaskQueue {
-public:
-    TaskQueue() {
+    size_t bytes() const {
+        return inimage.total() * inimage.elemSize() + outimage.total() * outimage.elemSize() + inalpha.total() * inalpha.elemSize();
     }
-
-    void put(const Task &v) {
-        std::unique_lock<std::mutex> lk(lock);
-
-        while (tasks.size() >= 8) // FIXME hardcode queue length
-        {
-            condition.wait(lk);
-        }
-
-        tasks.push(v);
-
-        lk.unlock();
-
-        condition.notify_one();
-    }
-
-    void get(Task &v) {
-        std::unique_lock<std::mutex> lk(lock);
-
-        while (tasks.size() == 0) {
-            condition.wait(lk);
-        }
-
-        v = tasks.front();
-        tasks.pop();
-
-        lk.unlock();
-
-        condition.notify_one();
-    }
-
-private:
-    std::mutex lock;
-    std::condition_variable condition;
-    std::queue<Task> tasks;
 };
 
-TaskQueue toproc;
-TaskQueue tosave;
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
 high_resolution_clock::time_point batch_start = high_resolution_clock::now();
 
 class LoadThreadParams {
@@ -329,7 +294,7 @@ void *load(void *args) {
 #endif // _WIN32
         }
 
-        toproc.put(v);
+        toproc.put(std::move(v), v.bytes());
 
     }
 
@@ -351,9 +316,7 @@ void *proc(void *args) {
     for (;;) {
         Task v;
 
-        toproc.get(v);
-
-        if (v.id == -233)
+        if (!toproc.get(v))
             break;
 
         if (ptp->decensor_mode == -1)
@@ -361,7 +324,7 @@ void *proc(void *args) {
         else
             mnnsr->decensor(v.inimage, v.outimage);
 
-        tosave.put(v);
+        tosave.put(std::move(v), v.bytes());
     }
 
     return 0;
@@ -382,9 +345,7 @@ void *save(void *args) {
     for (int saved_count = 1;;saved_count++) {
         Task v;
 
-        tosave.get(v);
-
-        if (v.id == -233)
+        if (!tosave.get(v))
             break;
 
         if (v.outimage.empty()) {
@@ -498,11 +459,13 @@ int main(int argc, char **argv)
     path_t suggested_format;
     long long skip_size = 0;
     path_t name_pattern = PATHSTR("{name}");
+    BenchOptions bench;
+    bool benchmark = false;
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"b:i:o:s:c:d:t:m:g:j:f:vxhk:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"b:i:o:s:c:d:t:m:g:j:f:vxhk:e:p:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -558,6 +521,13 @@ int main(int argc, char **argv)
             if(backend_type != MNN_FORWARD_CPU)
                 backend_type =_wtoi(optarg);
             break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0) {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L'h':
         default:
             print_usage();
@@ -566,7 +536,7 @@ int main(int argc, char **argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "b:i:o:s:c:d:t:m:g:j:f:vxhk:e:p:")) != -1) {
+    while ((opt = getopt(argc, argv, "b:i:o:s:c:d:t:m:g:j:f:vxhk:e:p:B:")) != -1) {
         switch (opt) {
             case 'i':
                 inputpath = optarg;
@@ -620,6 +590,13 @@ int main(int argc, char **argv)
                 if (backend_type != MNN_FORWARD_CPU)
                     backend_type = atoi(optarg);
                 break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0) {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
             case 'h':
             default:
                 print_usage();
@@ -629,7 +606,7 @@ int main(int argc, char **argv)
 #endif // _WIN32
 
 
-    if (inputpath.empty()) {
+    if (inputpath.empty() && !benchmark) {
         print_usage();
 #if _DEMO_PATH
         fprintf(stderr, "demo input argument\n");
@@ -640,7 +617,7 @@ int main(int argc, char **argv)
     }
 
 
-    if (outputpath.empty()) {
+    if (outputpath.empty() && !benchmark) {
         print_usage();
 #if _DEMO_PATH
         fprintf(stderr, "demo output argument\n");
@@ -658,7 +635,7 @@ int main(int argc, char **argv)
 
 
 
-    if (!path_is_directory(outputpath))
+    if (!benchmark && !path_is_directory(outputpath))
     {
         path_t ext = get_file_extension(outputpath);
         if (!ext.empty() && output_format.empty())
@@ -683,6 +660,7 @@ int main(int argc, char **argv)
 
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+    if (!benchmark)
     {
         path_t effective_format = output_format.empty() ? suggested_format : output_format;
 
@@ -876,6 +854,26 @@ int main(int argc, char **argv)
         mnnsr.scale = scale;
         mnnsr.load(modelfullpath, modelsize > 10);
 
+        if (benchmark)
+        {
+            // the proc thread is bypassed, images go straight through process()
+            const int bench_scale = decensor_mode == -1 ? scale : 1;
+            auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+                out = cv::Mat(in.rows * bench_scale, in.cols * bench_scale, CV_8UC3);
+                if (decensor_mode == -1)
+                    return mnnsr.process(in, out);
+                return mnnsr.decensor(in, out);
+            };
+
+            bench.format = bench_path_string(output_format);
+
+            BenchJson info;
+            info.add("engine", std::string("mnnsr")).add("model", bench_path_string(modelfullpath));
+            info.add("backend", backend_type).add("tilesize", tilesize).add("color", color_type);
+
+            return run_benchmark(bench, bench_scale, info, outputpath, upscale);
+        }
+
         // main routine
         {
             // load image
@@ -912,15 +910,12 @@ int main(int argc, char **argv)
             load_thread.join();
             batch_start = high_resolution_clock::now();
 
-            Task end;
-            end.id = -233;
-
-            toproc.put(end);
+            toproc.close();
 
             proc_thread->join();
             delete proc_thread;
 
-            tosave.put(end);
+            tosave.close();
 
             save_thread->join();
             delete save_thread;
@@ -2,6 +2,7 @@
 // Created by Yazii on 2025/3/16.
 //
 #include "mnnsr.h"
+#include "bench_stats.h"
 #include <thread>
 
 #include "MNN/ErrorCode.hpp"
@@ -216,7 +217,11 @@ int MNNSR::load(const std::string &modelpath, bool cachemodel,const bool nchw)
 
 
 cv::Mat MNNSR::TensorToCvMat(void) {
-    interpreter_output->copyToHostTensor(output_tensor);
+    {
+        BenchScope bench_download(BENCH_DOWNLOAD);
+        interpreter_output->copyToHostTensor(output_tensor);
+    }
+    BenchScope bench_postproc(BENCH_POSTPROC);
     int C = output_tensor->channel();
     int H = output_tensor->height();
     int W = output_tensor->width();
@@ -395,30 +400,42 @@ int MNNSR::process(const cv::Mat& inimage, cv::Mat& outimage, const cv::Mat& mas
                 in_tile_y1 - in_tile_y0));
 
             cv::Mat paddedTile;
-            if (inputTile.cols < tilesize || inputTile.rows < tilesize) {
-                int t = (yi == 0) ? yPrepadding : 0;
-                int b = tilesize + in_tile_y0 - in_tile_y1 - t;
-                int l = (xi == 0) ? xPrepadding : 0;
-                int r = tilesize + in_tile_x0 - in_tile_x1 - l;
-                cv::copyMakeBorder(inputTile, paddedTile, t, b, l, r, cv::BORDER_CONSTANT);
-
-                pretreat_->convert(paddedTile.data, paddedTile.cols, paddedTile.rows,
-                    paddedTile.cols * paddedTile.channels(),
-                    input_tensor);
+            {
+                BenchScope bench_preproc(BENCH_PREPROC);
+                if (inputTile.cols < tilesize || inputTile.rows < tilesize) {
+                    int t = (yi == 0) ? yPrepadding : 0;
+                    int b = tilesize + in_tile_y0 - in_tile_y1 - t;
+                    int l = (xi == 0) ? xPrepadding : 0;
+                    int r = tilesize + in_tile_x0 - in_tile_x1 - l;
+                    cv::copyMakeBorder(inputTile, paddedTile, t, b, l, r, cv::BORDER_CONSTANT);
+
+                    pretreat_->convert(paddedTile.data, paddedTile.cols, paddedTile.rows,
+                        paddedTile.cols * paddedTile.channels(),
+                        input_tensor);
 
-            }
-            else {
-                cv::copyMakeBorder(inputTile, paddedTile, 0, 0, 0, 0, cv::BORDER_CONSTANT);
-                pretreat_->convert(paddedTile.data, paddedTile.cols, paddedTile.rows,
-                    paddedTile.cols * paddedTile.channels(),
-                    input_tensor);
+                }
+                else {
+                    cv::copyMakeBorder(inputTile, paddedTile, 0, 0, 0, 0, cv::BORDER_CONSTANT);
+                    pretreat_->convert(paddedTile.data, paddedTile.cols, paddedTile.rows,
+                        paddedTile.cols * paddedTile.channels(),
+                        input_tensor);
+                }
             }
 
-            bool r = interpreter_input->copyFromHostTensor(input_tensor);
+            bool r;
+            {
+                BenchScope bench_upload(BENCH_UPLOAD);
+                r = interpreter_input->copyFromHostTensor(input_tensor);
+            }
 
-            interpreter->runSession(session);
+            {
+                BenchScope bench_inference(BENCH_INFERENCE);
+                interpreter->runSession(session);
+            }
             cv::Mat outputTile = TensorToCvMat();
 
+            BenchScope bench_postproc(BENCH_POSTPROC);
+
 
             if (!scale_checked) {
                 if(scale< 1e-5){
@@ -485,6 +502,7 @@ int MNNSR::process(const cv::Mat& inimage, cv::Mat& outimage, const cv::Mat& mas
                 time_print_progress = end;
             }
 
+            bench_tile_done();
         }
     }
 
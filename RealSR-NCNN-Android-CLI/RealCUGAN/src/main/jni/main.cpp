@@ -2,7 +2,8 @@
 
 #include <stdio.h>
 #include <algorithm>
-#include <queue>
+#include <atomic>
+#include <chrono>
 #include <vector>
 #include <clocale>
 
@@ -97,7 +98,16 @@ static std::vector<int> parse_optarg_int_array(const char* optarg)
 #include "realcugan.h"
 
 #include "filesystem_utils.h"
+#include "anim_image.h"
 #include "image_processor.h"
+#include "task_queue.h"
+#include "memory_budget.h"
+#include "result_cache.h"
+#include "stream_writer.h"
+#include "serve_mode.h"
+#include "bench_mode.h"
+#include "tile_autotune.h"
+#include "spirv_cache.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/hal/interface.h>
 #include "utils.hpp"
@@ -113,15 +123,24 @@ static void print_usage()
     fprintf(stdout, "  -n noise-level       denoise level (-1/0/1/2/3, default=-1)\n");
     fprintf(stdout, "  -s scale             upscale ratio (1/2/3/4, default=2)\n");
     fprintf(stdout, "  -t tile-size         tile size (>=32/0=auto, default=0) can be 0,0,0 for multi-gpu\n");
+    fprintf(stdout, "  -t auto-bench        time tile sizes up to the auto size once per device/model/scale, cached in the model dir\n");
     fprintf(stdout, "  -c syncgap-mode      sync gap mode (0/1/2/3, default=3)\n");
     fprintf(stdout, "  -m model-path        realcugan model path (default=models-se)\n");
     fprintf(stdout, "  -g gpu-id            gpu device to use (-1=cpu, default=auto) can be 0,1,2 for multi-gpu\n");
     fprintf(stdout, "  -j load:proc:save    thread count for load/proc/save (default=1:2:2) can be 1:2,2,2:2 for multi-gpu\n");
     fprintf(stdout, "  -x                   enable tta mode\n");
+    fprintf(stdout, "  -F range             skip the model on tiles within range levels per channel (0=one colour) or fully transparent, bilinear fill (default=-1=off)\n");
+    fprintf(stdout, "  -D cache-size        reuse the output of tiles identical to earlier ones, LRU cache size e.g. 256M (default=0=off)\n");
+    fprintf(stdout, "  -T tolerance         frame sequences only re-run tiles changed by more than tolerance levels since the previous frame (0=exact, default=-1=off)\n");
+    fprintf(stdout, "  -R cache-dir         reuse the results of identical inputs with the same model and settings from cache-dir\n");
     fprintf(stdout, "  -f format            force output format (ignore alpha channel detection)\n");
     fprintf(stdout, "  -e format            suggested output format (auto-convert to png if alpha detected)\n");
     fprintf(stdout, "  -k skip-size         skip if output file exists and size >= threshold bytes (0=disable)\n");
     fprintf(stdout, "  -p pattern           output name pattern for batch mode, placeholders: {name} {prog} {index} {timestamp} {datetime} {date} {time}\n");
+    fprintf(stdout, "  -S                   stream png/tiff/bmp output to disk by tile rows, the full result is never held in memory (images without alpha, syncgap modes only for images within one tile)\n");
+    fprintf(stdout, "  -G                   share the tiles of each image across all -g devices, one image at a time with the smallest tile-size\n");
+    fprintf(stdout, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
+    fprintf(stdout, "  --serve[=socket]     keep models loaded and take json jobs per line from stdin or a unix socket, see serve_mode.h\n");
 }
 
 class Task
@@ -137,56 +156,24 @@ public:
     ncnn::Mat inimage;
     ncnn::Mat outimage;
     ncnn::Mat inalpha;
-};
-
-class TaskQueue
-{
-public:
-    TaskQueue()
-    {
-    }
-
-    void put(const Task& v)
-    {
-        lock.lock();
 
-        while (tasks.size() >= 8) // FIXME hardcode queue length
-        {
-            condition.wait(lock);
-        }
+    // frame of a gif or animated webp, the writer collects all frames of the file
+    std::shared_ptr<AnimWriter> anim;
+    int frame;
 
-        tasks.push(v);
+    // encode the result by tile rows in the proc stage instead of saving outimage
+    bool stream;
+    std::shared_ptr<StreamImageWriter> writer;
+    int stream_success;
 
-        lock.unlock();
-
-        condition.signal();
-    }
-
-    void get(Task& v)
+    size_t bytes() const
     {
-        lock.lock();
-
-        while (tasks.size() == 0)
-        {
-            condition.wait(lock);
-        }
-
-        v = tasks.front();
-        tasks.pop();
-
-        lock.unlock();
-
-        condition.signal();
+        return inimage.total() * inimage.elemsize + outimage.total() * outimage.elemsize + inalpha.total() * inalpha.elemsize;
     }
-
-private:
-    ncnn::Mutex lock;
-    ncnn::ConditionVariable condition;
-    std::queue<Task> tasks;
 };
 
-TaskQueue toproc;
-TaskQueue tosave;
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
 
 class LoadThreadParams
 {
@@ -194,15 +181,21 @@ public:
     int scale;
     path_t output_format;
     int jobs_load;
+    int stream_output;
+
+    // the syncgap modes need the whole image, only images up to this size are streamed, 0 = any
+    int stream_max_side;
 
     // session data
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+
+    std::atomic<int> decode_failed;
 };
 
 void* load(void* args)
 {
-    const LoadThreadParams* ltp = (const LoadThreadParams*)args;
+    LoadThreadParams* ltp = (LoadThreadParams*)args;
     const int count = ltp->input_files.size();
     const int scale = ltp->scale;
 
@@ -211,67 +204,99 @@ void* load(void* args)
     {
         const path_t& imagepath = ltp->input_files[i];
 
-        cv::Mat inBGR, inAlpha;
-        imread(imagepath, inBGR, inAlpha);
+        // gif and animated webp give one task per frame
+        FrameSource source(imagepath, ltp->output_files[i]);
 
-        if (!inBGR.empty())
+        cv::Mat inBGR, inAlpha;
+        while (source.next(inBGR, inAlpha))
         {
-            Task v;
-            v.id = i;
-            v.scale = scale;
-            v.inpath = imagepath;
-            v.outpath = ltp->output_files[i];
-            v.has_alpha = !inAlpha.empty();
-
-            path_t ext = get_file_extension(v.outpath);
-            if (v.has_alpha && ltp->output_format.empty())
+            if (!inBGR.empty())
             {
-                if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+                // an animation its format can not hold is given up before any frame runs
+                if (source.writer && !source.writer->check_size(inBGR.cols * scale, inBGR.rows * scale))
                 {
-                    path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
-                    v.outpath = output_filename2;
+                    ltp->decode_failed++;
+                    break;
+                }
+
+                Task v;
+                v.id = i;
+                v.scale = scale;
+                v.inpath = imagepath;
+                v.outpath = ltp->output_files[i];
+                v.anim = source.writer;
+                v.frame = source.frame;
+                v.has_alpha = !inAlpha.empty();
+                v.stream = false;
+                v.stream_success = 0;
+
+                path_t ext = get_file_extension(v.outpath);
+                if (v.has_alpha && ltp->output_format.empty())
+                {
+                    if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+                    {
+                        path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
+                        v.outpath = output_filename2;
 #if _WIN32
-                    fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #else // _WIN32
-                    fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #endif // _WIN32
+                    }
+
+                    int w = inBGR.cols;
+                    int h = inBGR.rows;
+
+                    v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
+                    if (inAlpha.data)
+                    {
+                        memcpy(v.inalpha.data, inAlpha.data, w * h);
+                    }
                 }
 
                 int w = inBGR.cols;
                 int h = inBGR.rows;
+                int c = inBGR.channels();
 
-                v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
-                if (inAlpha.data)
+                unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
+                memcpy(pixeldata, inBGR.data, w * h * c);
+
+#ifndef _WIN32
+                for (int j = 0; j < w * h * c; j += c)
                 {
-                    memcpy(v.inalpha.data, inAlpha.data, w * h);
+                    std::swap(pixeldata[j], pixeldata[j + 2]);
                 }
-            }
-
-            int w = inBGR.cols;
-            int h = inBGR.rows;
-            int c = inBGR.channels();
+#endif
 
-            unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
-            memcpy(pixeldata, inBGR.data, w * h * c);
+                v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
 
-#ifndef _WIN32
-            for (int j = 0; j < w * h * c; j += c)
-            {
-                std::swap(pixeldata[j], pixeldata[j + 2]);
-            }
+                // alpha is merged in the save stage and needs outimage
+                v.stream = ltp->stream_output && !v.anim && !v.has_alpha && is_stream_encode_format(get_file_extension(v.outpath))
+                           && (ltp->stream_max_side == 0 || std::max(w, h) <= ltp->stream_max_side);
+                if (v.stream)
+                {
+#if _WIN32
+                    const bool bgr = true;
+#else
+                    const bool bgr = false;
 #endif
+                    v.writer.reset(new StreamImageWriter);
+                    v.stream = v.writer->open(v.outpath, w * scale, h * scale, c, bgr);
+                    if (!v.stream)
+                        v.writer.reset();
+                }
 
-            v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
-
-            toproc.put(v);
-        }
-        else
-        {
+                toproc.put(std::move(v), v.bytes());
+            }
+            else
+            {
+                ltp->decode_failed++;
 #if _WIN32
-            fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
+                fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
 #else // _WIN32
-            fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
+                fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
 #endif // _WIN32
+            }
         }
     }
 
@@ -282,6 +307,9 @@ class ProcThreadParams
 {
 public:
     const RealCUGAN* realcugan;
+
+    // -G, every image is split across these engines
+    std::vector<const RealCUGAN*> shared;
 };
 
 void* proc(void* args)
@@ -293,25 +321,39 @@ void* proc(void* args)
     {
         Task v;
 
-        toproc.get(v);
-
-        if (v.id == -233)
+        if (!toproc.get(v))
             break;
 
+        if (v.stream)
+        {
+            // a failed close removes the unfinished file
+            v.stream_success = realcugan->process(v.inimage, v.outimage, v.writer.get()) == 0 && v.writer->close();
+            v.writer.reset();
+
+            tosave.put(std::move(v), v.bytes());
+            continue;
+        }
+
         const int scale = v.scale;
         if (scale == 1)
         {
             v.outimage = ncnn::Mat(v.inimage.w, v.inimage.h, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
-            realcugan->process(v.inimage, v.outimage);
+            if (ptp->shared.empty())
+                realcugan->process(v.inimage, v.outimage);
+            else
+                RealCUGAN::process_shared(ptp->shared, v.inimage, v.outimage);
 
-            tosave.put(v);
+            tosave.put(std::move(v), v.bytes());
             continue;
         }
 
         v.outimage = ncnn::Mat(v.inimage.w * scale, v.inimage.h * scale, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
-        realcugan->process(v.inimage, v.outimage);
+        if (ptp->shared.empty())
+            realcugan->process(v.inimage, v.outimage);
+        else
+            RealCUGAN::process_shared(ptp->shared, v.inimage, v.outimage);
 
-        tosave.put(v);
+        tosave.put(std::move(v), v.bytes());
     }
 
     return 0;
@@ -321,20 +363,21 @@ class SaveThreadParams
 {
 public:
     int verbose;
+
+    std::atomic<int> saved;
+    std::atomic<int> failed;
 };
 
 void* save(void* args)
 {
-    const SaveThreadParams* stp = (const SaveThreadParams*)args;
+    SaveThreadParams* stp = (SaveThreadParams*)args;
     const int verbose = stp->verbose;
 
     for (;;)
     {
         Task v;
 
-        tosave.get(v);
-
-        if (v.id == -233)
+        if (!tosave.get(v))
             break;
 
         fprintf(stderr, "save result...\n");
@@ -349,9 +392,13 @@ void* save(void* args)
 
         int success = 0;
 
-        path_t ext = get_file_extension(v.outpath);
-
-        if (ext != PATHSTR("gif")) {
+        if (v.stream)
+        {
+            // already encoded by the proc stage
+            success = v.stream_success;
+        }
+        else
+        {
             cv::Mat image;
             if (v.has_alpha)
             {
@@ -397,43 +444,517 @@ void* save(void* args)
             if (image.empty()) {
                 std::cerr << "Error: Image data not loaded." << std::endl;
                 success = false;
+                if (v.anim)
+                    v.anim->fail_frame(v.frame);
             } else {
-                #if _WIN32
+                if (v.anim)
+                {
+                    success = v.anim->add(v.frame, image);
+                }
+                else
+                {
+#if _WIN32
                     success = imwrite_unicode(v.outpath, image);
-                #else
+#else
                     success = imwrite(v.outpath.c_str(), image);
-                #endif
+#endif
+                }
+            }
+
+        }
+
+        if (success)
+        {
+            stp->saved++;
+
+            float end = clock();
+            fprintf(stderr, "save result use time: %.3lf\n", (end - begin) / CLOCKS_PER_SEC);
+
+            if (verbose)
+            {
+#if _WIN32
+                fwprintf(stdout, L"%ls -> %ls done\n", v.inpath.c_str(), v.outpath.c_str());
+#else
+                fprintf(stdout, "%s -> %s done\n", v.inpath.c_str(), v.outpath.c_str());
+#endif
             }
+        }
+        else
+        {
+            stp->failed++;
+#if _WIN32
+            fwprintf(stderr, L"encode image %ls failed\n", v.outpath.c_str());
+#else
+            fprintf(stderr, "encode image %s failed\n", v.outpath.c_str());
+#endif
+        }
+    }
+
+    return 0;
+}
+
+
+// prepadding of the model family at the given scale, -1 for an unknown model dir
+static int model_prepadding(const path_t& model, int scale)
+{
+    if (model.find(PATHSTR("models-se")) != path_t::npos
+        || model.find(PATHSTR("models-nose")) != path_t::npos
+        || model.find(PATHSTR("models-pro")) != path_t::npos)
+    {
+        if (scale == 2)
+            return 18;
+        if (scale == 3)
+            return 14;
+        if (scale == 4)
+            return 19;
+        return 0;
+    }
+
+    return -1;
+}
+
+// up<scale>x-<noise>.param/bin of the model dir
+static void model_file_paths(const path_t& model, int noise, int scale, path_t& paramfullpath, path_t& modelfullpath)
+{
+#if _WIN32
+    wchar_t parampath[256];
+    wchar_t modelpath[256];
+    if (noise == -1)
+    {
+        swprintf(parampath, 256, L"%s/up%dx-conservative.param", model.c_str(), scale);
+        swprintf(modelpath, 256, L"%s/up%dx-conservative.bin", model.c_str(), scale);
+    }
+    else if (noise == 0)
+    {
+        swprintf(parampath, 256, L"%s/up%dx-no-denoise.param", model.c_str(), scale);
+        swprintf(modelpath, 256, L"%s/up%dx-no-denoise.bin", model.c_str(), scale);
+    }
+    else
+    {
+        swprintf(parampath, 256, L"%s/up%dx-denoise%dx.param", model.c_str(), scale, noise);
+        swprintf(modelpath, 256, L"%s/up%dx-denoise%dx.bin", model.c_str(), scale, noise);
+    }
+#else
+    char parampath[256];
+    char modelpath[256];
+    if (noise == -1)
+    {
+        sprintf(parampath, "%s/up%dx-conservative.param", model.c_str(), scale);
+        sprintf(modelpath, "%s/up%dx-conservative.bin", model.c_str(), scale);
+    }
+    else if (noise == 0)
+    {
+        sprintf(parampath, "%s/up%dx-no-denoise.param", model.c_str(), scale);
+        sprintf(modelpath, "%s/up%dx-no-denoise.bin", model.c_str(), scale);
+    }
+    else
+    {
+        sprintf(parampath, "%s/up%dx-denoise%dx.param", model.c_str(), scale, noise);
+        sprintf(modelpath, "%s/up%dx-denoise%dx.bin", model.c_str(), scale, noise);
+    }
+#endif
+
+    paramfullpath = sanitize_filepath(parampath);
+    modelfullpath = sanitize_filepath(modelpath);
+}
+
+// take the output format from the extension of a single output file, -1 if it can not be encoded
+static int resolve_output_format(const path_t& outputpath, path_t& output_format)
+{
+    if (path_is_directory(outputpath))
+        return 0;
+
+    path_t ext = get_file_extension(outputpath);
+    if (!ext.empty() && output_format.empty())
+    {
+        if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
+            output_format = PATHSTR("png");
+        else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
+            output_format = PATHSTR("webp");
+        else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+            output_format = PATHSTR("jpg");
+        else if (ext == PATHSTR("bmp") || ext == PATHSTR("BMP"))
+            output_format = PATHSTR("bmp");
+        else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
+            output_format = PATHSTR("tiff");
+        else if (ext == PATHSTR("gif") || ext == PATHSTR("GIF"))
+            output_format = PATHSTR("gif");
+    }
+    if (!output_format.empty() && !is_supported_encode_format(output_format))
+    {
+        fprintf(stderr, "invalid output format\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// {prog} of the name pattern, the executable name without extension and -ncnn suffix
+static path_t get_program_name(const path_t& argv0)
+{
+    path_t prog_name = argv0;
+
+    size_t last_sep = prog_name.find_last_of(PATHSTR("/\\"));
+    if (last_sep != path_t::npos)
+        prog_name = prog_name.substr(last_sep + 1);
+    size_t dot = prog_name.rfind(PATHSTR('.'));
+    if (dot != path_t::npos)
+        prog_name = prog_name.substr(0, dot);
+    const path_t ncnn_suffix = PATHSTR("-ncnn");
+    if (prog_name.size() > ncnn_suffix.size() &&
+        prog_name.compare(prog_name.size() - ncnn_suffix.size(), ncnn_suffix.size(), ncnn_suffix) == 0)
+        prog_name = prog_name.substr(0, prog_name.size() - ncnn_suffix.size());
+
+    return prog_name;
+}
+
+// tilesize for -t 0 from the heap budget of the device, shared_jobs proc threads split the heap
+static int auto_tilesize(const path_t& model, int scale, int gpuid, int shared_jobs)
+{
+    if (gpuid == -1)
+    {
+        // cpu only
+        return 400;
+    }
+
+    uint32_t heap_budget = ncnn::get_gpu_device(gpuid)->get_heap_budget();
+
+    if (shared_jobs > 1)
+    {
+        // multiple gpu jobs share the same heap
+        heap_budget /= shared_jobs;
+    }
+
+    int tilesize = 0;
+
+    // more fine-grained tilesize policy here
+    if (model.find(PATHSTR("models-nose")) != path_t::npos || model.find(PATHSTR("models-se")) != path_t::npos || model.find(PATHSTR("models-pro")) != path_t::npos)
+    {
+        if (scale == 2)
+        {
+            if (heap_budget > 1300)
+                tilesize = 400;
+            else if (heap_budget > 800)
+                tilesize = 300;
+            else if (heap_budget > 400)
+                tilesize = 200;
+            else if (heap_budget > 200)
+                tilesize = 100;
+            else
+                tilesize = 32;
+        }
+        if (scale == 3)
+        {
+            if (heap_budget > 3300)
+                tilesize = 400;
+            else if (heap_budget > 1900)
+                tilesize = 300;
+            else if (heap_budget > 950)
+                tilesize = 200;
+            else if (heap_budget > 320)
+                tilesize = 100;
+            else
+                tilesize = 32;
+        }
+        if (scale == 4)
+        {
+            if (heap_budget > 1690)
+                tilesize = 400;
+            else if (heap_budget > 980)
+                tilesize = 300;
+            else if (heap_budget > 530)
+                tilesize = 200;
+            else if (heap_budget > 240)
+                tilesize = 100;
+            else
+                tilesize = 32;
+        }
+    }
+
+    return tilesize;
+}
+
+// one load -> proc -> save pass over ltp.input_files, the queues are reopened so the
+// server mode can run it once per job. With tile_share one proc thread hands every image to all
+// engines at once
+static void run_pipeline(const std::vector<RealCUGAN*>& realcugan, const std::vector<int>& gpuid,
+                         const std::vector<int>& jobs_proc, int jobs_save,
+                         LoadThreadParams& ltp, SaveThreadParams& stp, bool tile_share = false)
+{
+    const int use_gpu_count = (int)gpuid.size();
+
+    toproc.configure(8, 0);
+    tosave.configure(8, 0);
+
+    // an image larger than the tile of any engine would take the syncgap path
+    ltp.stream_max_side = 0;
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        if (realcugan[i]->syncgap)
+            ltp.stream_max_side = ltp.stream_max_side ? std::min(ltp.stream_max_side, realcugan[i]->tilesize) : realcugan[i]->tilesize;
+    }
+
+    ltp.decode_failed = 0;
+    stp.saved = 0;
+    stp.failed = 0;
+
+    // load image
+    ncnn::Thread load_thread(load, (void*)&ltp);
+
+    // realcugan proc
+    std::vector<ProcThreadParams> ptp(use_gpu_count);
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        ptp[i].realcugan = realcugan[i];
+    }
+
+    std::vector<ncnn::Thread*> proc_threads;
+    if (tile_share)
+    {
+        ptp[0].shared.assign(realcugan.begin(), realcugan.end());
+        proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[0]));
+    }
+    for (int i=0; i<use_gpu_count && !tile_share; i++)
+    {
+        if (gpuid[i] == -1)
+        {
+            proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[i]));
+        }
+        else
+        {
+            for (int j=0; j<jobs_proc[i]; j++)
+            {
+                proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[i]));
+            }
+        }
+    }
+
+    // save image
+    std::vector<ncnn::Thread*> save_threads(jobs_save);
+    for (int i=0; i<jobs_save; i++)
+    {
+        save_threads[i] = new ncnn::Thread(save, (void*)&stp);
+    }
+
+    // end
+    load_thread.join();
+
+    toproc.close();
+
+    for (size_t i=0; i<proc_threads.size(); i++)
+    {
+        proc_threads[i]->join();
+        delete proc_threads[i];
+    }
+
+    tosave.close();
+
+    for (int i=0; i<jobs_save; i++)
+    {
+        save_threads[i]->join();
+        delete save_threads[i];
+    }
+}
+
+// realcugan instances of one model, one per gpu
+class RealCUGANSet
+{
+public:
+    ~RealCUGANSet()
+    {
+        for (size_t i=0; i<realcugan.size(); i++)
+            delete realcugan[i];
+    }
+
+    std::vector<RealCUGAN*> realcugan;
+};
+
+// --serve job handler, the command line options are the defaults of every job
+class RealCUGANServer
+{
+public:
+    RealCUGANServer() : cache(2)
+    {
+    }
+
+    int operator()(const ServeFields& job, ServeReply& reply, std::string& error)
+    {
+        std::chrono::high_resolution_clock::time_point begin = std::chrono::high_resolution_clock::now();
+
+        const path_t inputpath = utf8_to_path(field_or(job, "input", std::string()));
+        const path_t outputpath = utf8_to_path(field_or(job, "output", std::string()));
+        if (inputpath.empty() || outputpath.empty())
+        {
+            error = "input and output are required";
+            return -1;
+        }
+
+        const path_t job_model = utf8_to_path(field_or(job, "model", path_to_utf8(model)));
+        const int job_noise = field_or(job, "noise", noise);
+        const int job_scale = field_or(job, "scale", scale);
+        const int job_tta = field_or(job, "tta", tta_mode);
+        const int job_tile = field_or(job, "tile", -1);
+        path_t job_output_format = utf8_to_path(field_or(job, "format", path_to_utf8(output_format)));
+        const path_t job_name_pattern = utf8_to_path(field_or(job, "pattern", path_to_utf8(name_pattern)));
+
+        if (job_noise < -1 || job_noise > 3)
+        {
+            error = "invalid noise";
+            return -1;
+        }
+
+        if (!(job_scale == 1 || job_scale == 2 || job_scale == 3 || job_scale == 4))
+        {
+            error = "invalid scale";
+            return -1;
+        }
+
+        if (job_tile > 0 && job_tile < 32)
+        {
+            error = "invalid tile";
+            return -1;
+        }
+
+        if (resolve_output_format(outputpath, job_output_format) != 0)
+        {
+            error = "invalid output format";
+            return -1;
+        }
+
+        LoadThreadParams ltp;
+        {
+            path_t effective_format = job_output_format.empty() ? suggested_format : job_output_format;
+
+            if (collect_input_output_files(inputpath, outputpath, effective_format, job_name_pattern, prog_name, ltp.input_files, ltp.output_files) != 0)
+            {
+                error = "no input files";
+                return -1;
+            }
+        }
+
+        const int total = (int)ltp.input_files.size();
+        if (filter_files_by_size_threshold(ltp.input_files, ltp.output_files, skip_size, verbose) != 0)
+        {
+            error = "filter input files failed";
+            return -1;
+        }
+        const int skipped = total - (int)ltp.input_files.size();
+
+        const int prepadding = model_prepadding(job_model, job_scale);
+        if (prepadding < 0)
+        {
+            error = "unknown model dir type";
+            return -1;
+        }
+
+        path_t paramfullpath;
+        path_t modelfullpath;
+        model_file_paths(job_model, job_noise, job_scale, paramfullpath, modelfullpath);
+
+        // noise and scale pick the model file, so the path and tta mode identify the loaded nets
+        char key_suffix[32];
+        sprintf(key_suffix, "|%d", job_tta);
+        const std::string key = path_to_utf8(modelfullpath) + key_suffix;
+
+        RealCUGANSet* set = cache.get(key);
+        reply.add("cached", set ? 1 : 0);
+        if (!set)
+        {
+            cache.make_room();
+
+            set = new RealCUGANSet;
+            for (size_t i=0; i<gpuid.size(); i++)
+            {
+                int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
 
+                RealCUGAN* realcugan = new RealCUGAN(gpuid[i], job_tta, num_threads);
+                if (realcugan->load(paramfullpath, modelfullpath) != 0)
+                {
+                    delete realcugan;
+                    delete set;
+                    error = "load model failed";
+                    return -1;
+                }
+                set->realcugan.push_back(realcugan);
+            }
+            cache.put(key, set);
         }
 
-        if (success)
-        {
-            float end = clock();
-            fprintf(stderr, "save result use time: %.3lf\n", (end - begin) / CLOCKS_PER_SEC);
+        // force syncgap off for nose models
+        const int job_syncgap = job_model.find(PATHSTR("models-nose")) != path_t::npos ? 0 : syncgap;
 
-            if (verbose)
+        for (size_t i=0; i<gpuid.size(); i++)
+        {
+            set->realcugan[i]->noise = job_noise;
+            set->realcugan[i]->scale = job_scale;
+            set->realcugan[i]->prepadding = prepadding;
+            set->realcugan[i]->flat_tile_range = flat_tile_range;
+            set->realcugan[i]->syncgap = job_syncgap;
+
+            int t = job_tile >= 0 ? job_tile : tilesize[i];
+            if (t == 0)
             {
-#if _WIN32
-                fwprintf(stdout, L"%ls -> %ls done\n", v.inpath.c_str(), v.outpath.c_str());
-#else
-                fprintf(stdout, "%s -> %s done\n", v.inpath.c_str(), v.outpath.c_str());
-#endif
+                int shared_jobs = gpuid[i] != -1 && ltp.input_files.size() > 1 ? jobs_proc_per_gpu[gpuid[i]] : 1;
+                t = auto_tilesize(job_model, job_scale, gpuid[i], shared_jobs);
+                if (tile_autobench)
+                    t = autotune_tilesize(set->realcugan[i], gpuid[i], gpuid[i] == -1 ? jobs_proc[i] : 1, paramfullpath, modelfullpath, job_scale, t, verbose);
             }
+            set->realcugan[i]->tilesize = t;
         }
-        else
+
+        ltp.scale = job_scale;
+        ltp.output_format = job_output_format;
+        ltp.jobs_load = jobs_load;
+        ltp.stream_output = stream_output;
+
+        SaveThreadParams stp;
+        stp.verbose = verbose;
+
+        run_pipeline(set->realcugan, gpuid, jobs_proc, jobs_save, ltp, stp);
+
+        const int failed = stp.failed + ltp.decode_failed;
+
+        std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+        std::chrono::duration<double> time_span = std::chrono::duration_cast<std::chrono::duration<double>>(end - begin);
+
+        reply.add("done", (int)stp.saved).add("failed", failed).add("skipped", skipped).add("time", time_span.count());
+
+        if (failed)
         {
-#if _WIN32
-            fwprintf(stderr, L"encode image %ls failed\n", v.outpath.c_str());
-#else
-            fprintf(stderr, "encode image %s failed\n", v.outpath.c_str());
-#endif
+            char buf[64];
+            sprintf(buf, "%d of %d images failed", failed, (int)ltp.input_files.size());
+            error = buf;
+            return -1;
         }
+
+        return 0;
     }
 
-    return 0;
-}
+    path_t model;
+    int noise;
+    int scale;
+    int tta_mode;
+    int syncgap;
+    std::vector<int> tilesize;
+    int tile_autobench;
+    int flat_tile_range;
+    std::vector<int> gpuid;
+    std::vector<int> jobs_proc;
+    // proc threads sharing the heap of gpuid[i]
+    std::vector<int> jobs_proc_per_gpu;
+    int jobs_load;
+    int jobs_save;
+    int verbose;
+    path_t output_format;
+    path_t suggested_format;
+    path_t name_pattern;
+    path_t prog_name;
+    long long skip_size;
+    int stream_output;
 
+private:
+    ModelCache<RealCUGANSet> cache;
+};
 
 #if _WIN32
 int wmain(int argc, wchar_t** argv)
@@ -446,6 +967,9 @@ int main(int argc, char** argv)
     int noise = -1;
     int scale = 2;
     std::vector<int> tilesize;
+    int tile_autobench = 0;
+    int tile_share = 0;
+    int stream_output = 0;
     path_t model = PATHSTR("models-se");
     std::vector<int> gpuid;
     int jobs_load = 1;
@@ -454,15 +978,24 @@ int main(int argc, char** argv)
     int verbose = 0;
     int syncgap = 3;
     int tta_mode = 0;
+    int flat_tile_range = -1;
+    long long tile_cache_size = 0;
+    int temporal_tolerance = -1;
+    path_t result_cache_dir;
     path_t output_format;
     path_t suggested_format;
     long long skip_size = 0;
     path_t name_pattern = PATHSTR("{name}");
+    BenchOptions bench;
+    bool benchmark = false;
+
+    std::string serve_endpoint;
+    const bool serve = take_serve_option(argc, argv, serve_endpoint);
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"i:o:n:s:t:c:m:g:j:f:vxhk:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"i:o:n:s:t:c:m:g:j:f:vxhk:e:p:SGF:D:T:R:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -479,7 +1012,15 @@ int main(int argc, char** argv)
             scale = _wtoi(optarg);
             break;
         case L't':
-            tilesize = parse_optarg_int_array(optarg);
+            if (is_auto_bench_option(optarg))
+            {
+                tile_autobench = 1;
+                tilesize.clear();
+            }
+            else
+            {
+                tilesize = parse_optarg_int_array(optarg);
+            }
             break;
         case L'c':
             syncgap = _wtoi(optarg);
@@ -506,12 +1047,38 @@ int main(int argc, char** argv)
         case L'x':
             tta_mode = 1;
             break;
+        case L'F':
+            flat_tile_range = _wtoi(optarg);
+            break;
+        case L'D':
+            tile_cache_size = parse_size_string(optarg);
+            break;
+        case L'T':
+            temporal_tolerance = _wtoi(optarg);
+            break;
+        case L'R':
+            result_cache_dir = optarg;
+            break;
+        case L'S':
+            stream_output = 1;
+            break;
+        case L'G':
+            tile_share = 1;
+            break;
         case L'k':
             skip_size = _wtoi64(optarg);
             break;
         case L'p':
             name_pattern = optarg;
             break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0)
+            {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L'h':
         default:
             print_usage();
@@ -520,7 +1087,7 @@ int main(int argc, char** argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:n:s:t:c:m:g:j:f:vxhk:e:p:")) != -1)
+    while ((opt = getopt(argc, argv, "i:o:n:s:t:c:m:g:j:f:vxhk:e:p:SGF:D:T:R:B:")) != -1)
     {
         switch (opt)
         {
@@ -537,7 +1104,15 @@ int main(int argc, char** argv)
                 scale = atoi(optarg);
                 break;
             case 't':
-                tilesize = parse_optarg_int_array(optarg);
+                if (is_auto_bench_option(optarg))
+                {
+                    tile_autobench = 1;
+                    tilesize.clear();
+                }
+                else
+                {
+                    tilesize = parse_optarg_int_array(optarg);
+                }
                 break;
             case 'c':
                 syncgap = atoi(optarg);
@@ -564,12 +1139,38 @@ int main(int argc, char** argv)
             case 'x':
                 tta_mode = 1;
                 break;
+            case 'F':
+                flat_tile_range = atoi(optarg);
+                break;
+            case 'D':
+                tile_cache_size = parse_size_string(optarg);
+                break;
+            case 'T':
+                temporal_tolerance = atoi(optarg);
+                break;
+            case 'R':
+                result_cache_dir = optarg;
+                break;
+            case 'S':
+                stream_output = 1;
+                break;
+            case 'G':
+                tile_share = 1;
+                break;
             case 'k':
                 skip_size = atoll(optarg);
                 break;
             case 'p':
                 name_pattern = optarg;
                 break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0)
+                {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
         case 'h':
         default:
             print_usage();
@@ -578,7 +1179,7 @@ int main(int argc, char** argv)
     }
 #endif // _WIN32
 
-    if (inputpath.empty() || outputpath.empty())
+    if ((inputpath.empty() || outputpath.empty()) && !serve && !benchmark)
     {
         print_usage();
         return -1;
@@ -617,6 +1218,12 @@ int main(int argc, char** argv)
         }
     }
 
+    if (tile_cache_size < 0)
+    {
+        fprintf(stderr, "invalid tile cache size argument\n");
+        return -1;
+    }
+
     if (jobs_load < 1 || jobs_save < 1)
     {
         fprintf(stderr, "invalid thread count argument\n");
@@ -638,47 +1245,21 @@ int main(int argc, char** argv)
         }
     }
 
-    if (!path_is_directory(outputpath))
-    {
-        path_t ext = get_file_extension(outputpath);
-        if (!ext.empty() && output_format.empty())
-        {
-            if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
-                output_format = PATHSTR("png");
-            else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
-                output_format = PATHSTR("webp");
-            else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
-                output_format = PATHSTR("jpg");
-            else if (ext == PATHSTR("bmp") || ext == PATHSTR("BMP"))
-                output_format = PATHSTR("bmp");
-            else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
-                output_format = PATHSTR("tiff");
-        }
-        if (!output_format.empty() && !is_supported_encode_format(output_format))
-        {
-            fprintf(stderr, "invalid output format\n");
-            return -1;
-        }
-    }
+    const path_t prog_name = get_program_name(path_t(argv[0]));
 
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+    int prepadding = 0;
+    path_t paramfullpath;
+    path_t modelfullpath;
+
+    // in server mode every job brings its own paths and model, the benchmark makes up its images
+    if (!serve && !benchmark)
     {
-        path_t effective_format = output_format.empty() ? suggested_format : output_format;
+        if (resolve_output_format(outputpath, output_format) != 0)
+            return -1;
 
-        path_t prog_name = path_t(argv[0]);
-        {
-            size_t last_sep = prog_name.find_last_of(PATHSTR("/\\"));
-            if (last_sep != path_t::npos)
-                prog_name = prog_name.substr(last_sep + 1);
-            size_t dot = prog_name.rfind(PATHSTR('.'));
-            if (dot != path_t::npos)
-                prog_name = prog_name.substr(0, dot);
-            const path_t ncnn_suffix = PATHSTR("-ncnn");
-            if (prog_name.size() > ncnn_suffix.size() &&
-                prog_name.compare(prog_name.size() - ncnn_suffix.size(), ncnn_suffix.size(), ncnn_suffix) == 0)
-                prog_name = prog_name.substr(0, prog_name.size() - ncnn_suffix.size());
-        }
+        path_t effective_format = output_format.empty() ? suggested_format : output_format;
 
         int ret = collect_input_output_files(inputpath, outputpath, effective_format, name_pattern, prog_name, input_files, output_files);
         if (ret != 0)
@@ -689,29 +1270,16 @@ int main(int argc, char** argv)
             return -1;
     }
 
-    int prepadding = 0;
-
-    if (model.find(PATHSTR("models-se")) != path_t::npos
-        || model.find(PATHSTR("models-nose")) != path_t::npos
-        || model.find(PATHSTR("models-pro")) != path_t::npos)
+    if (!serve)
     {
-        if (scale == 2)
-        {
-            prepadding = 18;
-        }
-        if (scale == 3)
-        {
-            prepadding = 14;
-        }
-        if (scale == 4)
+        prepadding = model_prepadding(model, scale);
+        if (prepadding < 0)
         {
-            prepadding = 19;
+            fprintf(stderr, "unknown model dir type\n");
+            return -1;
         }
-    }
-    else
-    {
-        fprintf(stderr, "unknown model dir type\n");
-        return -1;
+
+        model_file_paths(model, noise, scale, paramfullpath, modelfullpath);
     }
 
     if (model.find(PATHSTR("models-nose")) != path_t::npos)
@@ -720,47 +1288,6 @@ int main(int argc, char** argv)
         syncgap = 0;
     }
 
-#if _WIN32
-    wchar_t parampath[256];
-    wchar_t modelpath[256];
-    if (noise == -1)
-    {
-        swprintf(parampath, 256, L"%s/up%dx-conservative.param", model.c_str(), scale);
-        swprintf(modelpath, 256, L"%s/up%dx-conservative.bin", model.c_str(), scale);
-    }
-    else if (noise == 0)
-    {
-        swprintf(parampath, 256, L"%s/up%dx-no-denoise.param", model.c_str(), scale);
-        swprintf(modelpath, 256, L"%s/up%dx-no-denoise.bin", model.c_str(), scale);
-    }
-    else
-    {
-        swprintf(parampath, 256, L"%s/up%dx-denoise%dx.param", model.c_str(), scale, noise);
-        swprintf(modelpath, 256, L"%s/up%dx-denoise%dx.bin", model.c_str(), scale, noise);
-    }
-#else
-    char parampath[256];
-    char modelpath[256];
-    if (noise == -1)
-    {
-        sprintf(parampath, "%s/up%dx-conservative.param", model.c_str(), scale);
-        sprintf(modelpath, "%s/up%dx-conservative.bin", model.c_str(), scale);
-    }
-    else if (noise == 0)
-    {
-        sprintf(parampath, "%s/up%dx-no-denoise.param", model.c_str(), scale);
-        sprintf(modelpath, "%s/up%dx-no-denoise.bin", model.c_str(), scale);
-    }
-    else
-    {
-        sprintf(parampath, "%s/up%dx-denoise%dx.param", model.c_str(), scale, noise);
-        sprintf(modelpath, "%s/up%dx-denoise%dx.bin", model.c_str(), scale, noise);
-    }
-#endif
-
-    path_t paramfullpath = sanitize_filepath(parampath);
-    path_t modelfullpath = sanitize_filepath(modelpath);
-
 #if _WIN32
     CoInitializeEx(NULL, COINIT_MULTITHREADED);
 #endif
@@ -834,180 +1361,222 @@ int main(int argc, char** argv)
         }
     }
 
-    int total_jobs_proc = 0;
     int jobs_proc_per_gpu[16] = {0};
     for (int i=0; i<use_gpu_count; i++)
     {
         if (gpuid[i] == -1)
         {
             jobs_proc[i] = std::min(jobs_proc[i], cpu_count);
-            total_jobs_proc += 1;
         }
         else
         {
-            total_jobs_proc += jobs_proc[i];
             jobs_proc_per_gpu[gpuid[i]] += jobs_proc[i];
         }
     }
 
-    for (int i=0; i<use_gpu_count; i++)
+    if (serve)
     {
-        if (tilesize[i] != 0)
-            continue;
+        RealCUGANServer server;
+        server.model = model;
+        server.noise = noise;
+        server.scale = scale;
+        server.tta_mode = tta_mode;
+        server.syncgap = syncgap;
+        server.tilesize = tilesize;
+        server.tile_autobench = tile_autobench;
+        server.flat_tile_range = flat_tile_range;
+        server.gpuid = gpuid;
+        server.jobs_proc = jobs_proc;
+        for (int i=0; i<use_gpu_count; i++)
+        {
+            server.jobs_proc_per_gpu.push_back(gpuid[i] == -1 ? 1 : jobs_proc_per_gpu[gpuid[i]]);
+        }
+        server.jobs_load = jobs_load;
+        server.jobs_save = jobs_save;
+        server.verbose = verbose;
+        server.output_format = output_format;
+        server.suggested_format = suggested_format;
+        server.name_pattern = name_pattern;
+        server.prog_name = prog_name;
+        server.skip_size = skip_size;
+        server.stream_output = stream_output;
+
+        int ret = serve_loop(serve_endpoint, server);
 
-        if (gpuid[i] == -1)
+        if (use_gpu)
         {
-            // cpu only
-            tilesize[i] = 400;
-            continue;
+            ncnn::destroy_gpu_instance();
         }
 
-        uint32_t heap_budget = ncnn::get_gpu_device(gpuid[i])->get_heap_budget();
+        return ret;
+    }
+
+    if (benchmark)
+    {
+        // one engine on the first device, images go straight through process() without the pipeline threads
+        if (tilesize[0] == 0)
+            tilesize[0] = auto_tilesize(model, scale, gpuid[0], 1);
 
-        if (input_files.size() > 1)
+        int ret;
         {
-            // multiple gpu jobs share the same heap
-            heap_budget /= jobs_proc_per_gpu[gpuid[i]];
+            RealCUGAN realcugan(gpuid[0], tta_mode, gpuid[0] == -1 ? jobs_proc[0] : 1);
+            realcugan.load(paramfullpath, modelfullpath);
+            realcugan.noise = noise;
+            realcugan.scale = scale;
+            realcugan.tilesize = tilesize[0];
+            realcugan.prepadding = prepadding;
+            realcugan.flat_tile_range = flat_tile_range;
+            realcugan.syncgap = syncgap;
+            if (tile_autobench)
+                tilesize[0] = autotune_tilesize(&realcugan, gpuid[0], gpuid[0] == -1 ? jobs_proc[0] : 1, paramfullpath, modelfullpath, scale, tilesize[0], verbose);
+
+            auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+                cv::Mat rgb;
+                ncnn::Mat inimage;
+                {
+                    BenchScope bench_preproc(BENCH_PREPROC);
+#if _WIN32
+                    rgb = in;
+#else
+                    cv::cvtColor(in, rgb, cv::COLOR_BGR2RGB);
+#endif
+                    inimage = ncnn::Mat(rgb.cols, rgb.rows, (void*)rgb.data, (size_t)3, 3);
+                }
+
+                ncnn::Mat outimage(rgb.cols * scale, rgb.rows * scale, (size_t)3, 3);
+                int r = realcugan.process(inimage, outimage);
+
+                BenchScope bench_postproc(BENCH_POSTPROC);
+                cv::Mat result(outimage.h, outimage.w, CV_8UC3, outimage.data);
+#if _WIN32
+                out = result.clone();
+#else
+                cv::cvtColor(result, out, cv::COLOR_RGB2BGR);
+#endif
+                return r;
+            };
+
+            bench.format = bench_path_string(output_format);
+
+            BenchJson info;
+            info.add("engine", std::string("realcugan")).add("model", bench_path_string(modelfullpath));
+            info.add("gpu", gpuid[0]).add("tilesize", tilesize[0]).add("tta", tta_mode);
+            info.add("noise", noise).add("syncgap", syncgap);
+            if (gpuid[0] != -1)
+                info.add("device", std::string(ncnn::get_gpu_info(gpuid[0]).device_name()));
+            else
+                info.add("threads", jobs_proc[0]);
+
+            ret = run_benchmark(bench, scale, info, outputpath, upscale);
         }
 
-        // more fine-grained tilesize policy here
-        if (model.find(PATHSTR("models-nose")) != path_t::npos || model.find(PATHSTR("models-se")) != path_t::npos || model.find(PATHSTR("models-pro")) != path_t::npos)
+        if (use_gpu)
         {
-            if (scale == 2)
-            {
-                if (heap_budget > 1300)
-                    tilesize[i] = 400;
-                else if (heap_budget > 800)
-                    tilesize[i] = 300;
-                else if (heap_budget > 400)
-                    tilesize[i] = 200;
-                else if (heap_budget > 200)
-                    tilesize[i] = 100;
-                else
-                    tilesize[i] = 32;
-            }
-            if (scale == 3)
-            {
-                if (heap_budget > 3300)
-                    tilesize[i] = 400;
-                else if (heap_budget > 1900)
-                    tilesize[i] = 300;
-                else if (heap_budget > 950)
-                    tilesize[i] = 200;
-                else if (heap_budget > 320)
-                    tilesize[i] = 100;
-                else
-                    tilesize[i] = 32;
-            }
-            if (scale == 4)
-            {
-                if (heap_budget > 1690)
-                    tilesize[i] = 400;
-                else if (heap_budget > 980)
-                    tilesize[i] = 300;
-                else if (heap_budget > 530)
-                    tilesize[i] = 200;
-                else if (heap_budget > 240)
-                    tilesize[i] = 100;
-                else
-                    tilesize[i] = 32;
-            }
+            ncnn::destroy_gpu_instance();
         }
+
+        return ret;
+    }
+
+    for (int i=0; i<use_gpu_count; i++)
+    {
+        if (tilesize[i] != 0)
+            continue;
+
+        int shared_jobs = gpuid[i] != -1 && input_files.size() > 1 ? jobs_proc_per_gpu[gpuid[i]] : 1;
+        tilesize[i] = auto_tilesize(model, scale, gpuid[i], shared_jobs);
     }
 
     {
+        ResultCache* result_cache = 0;
+        if (!result_cache_dir.empty())
+        {
+            char settings[128];
+            sprintf(settings, "realcugan noise=%d scale=%d tta=%d syncgap=%d flat=%d temporal=%d", noise, scale, tta_mode, syncgap, flat_tile_range, temporal_tolerance);
+            result_cache = new ResultCache(result_cache_dir, paramfullpath, modelfullpath, settings);
+            result_cache->take_hits(input_files, output_files, verbose);
+        }
+
+        // one cache for the whole run, tiles repeat across the images of a batch
+        TileDedupCache* tile_cache = tile_cache_size > 0 ? new TileDedupCache((size_t)tile_cache_size) : 0;
+
+        // frames of all animations and the images of the batch run through one temporal cache
+        TemporalTileCache* temporal_cache = temporal_tolerance >= 0 ? new TemporalTileCache(temporal_tolerance) : 0;
+
         std::vector<RealCUGAN*> realcugan(use_gpu_count);
 
+        // the first run of a model on a device compiles the shaders, later runs load them from the shader cache
+        double load_seconds = 0;
+
         for (int i=0; i<use_gpu_count; i++)
         {
             int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
 
             realcugan[i] = new RealCUGAN(gpuid[i], tta_mode, num_threads);
 
-            realcugan[i]->load(paramfullpath, modelfullpath);
+            const double load_begin = bench_now();
+            const int load_ret = realcugan[i]->load(paramfullpath, modelfullpath);
+            load_seconds += bench_now() - load_begin;
+
+            if (load_ret != 0)
+            {
+                fprintf(stderr, "load model failed\n");
+
+                for (int j=0; j<=i; j++)
+                    delete realcugan[j];
+                delete tile_cache;
+                delete temporal_cache;
+                delete result_cache;
+
+                ncnn::destroy_gpu_instance();
+                return -1;
+            }
 
             realcugan[i]->noise = noise;
             realcugan[i]->scale = scale;
             realcugan[i]->tilesize = tilesize[i];
             realcugan[i]->prepadding = prepadding;
+            realcugan[i]->flat_tile_range = flat_tile_range;
             realcugan[i]->syncgap = syncgap;
+
+            if (tile_autobench)
+                tilesize[i] = autotune_tilesize(realcugan[i], gpuid[i], num_threads, paramfullpath, modelfullpath, scale, tilesize[i], verbose);
+
+            // after autotuning, so the timed runs do not hit the cache
+            realcugan[i]->tile_cache = tile_cache;
+            realcugan[i]->temporal_cache = temporal_cache;
+        }
+
+        fprintf(stderr, "load model use time: %.3lf, %s\n", load_seconds, spirv_cache_summary().c_str());
+
+        // the devices walk one tile grid, so they all take the smallest tilesize
+        const bool share_tiles = tile_share && use_gpu_count > 1;
+        if (share_tiles)
+        {
+            const int shared_tilesize = *std::min_element(tilesize.begin(), tilesize.end());
+            for (int i=0; i<use_gpu_count; i++)
+            {
+                tilesize[i] = shared_tilesize;
+                realcugan[i]->tilesize = shared_tilesize;
+            }
+            if (stream_output)
+                fprintf(stderr, "-S is ignored with -G, the devices write bands out of order\n");
         }
 
         // main routine
         {
-            // load image
             LoadThreadParams ltp;
             ltp.scale = scale;
             ltp.output_format = output_format;
             ltp.jobs_load = jobs_load;
+            ltp.stream_output = share_tiles ? 0 : stream_output;
             ltp.input_files = input_files;
             ltp.output_files = output_files;
 
-            ncnn::Thread load_thread(load, (void*)&ltp);
-
-            // realcugan proc
-            std::vector<ProcThreadParams> ptp(use_gpu_count);
-            for (int i=0; i<use_gpu_count; i++)
-            {
-                ptp[i].realcugan = realcugan[i];
-            }
-
-            std::vector<ncnn::Thread*> proc_threads(total_jobs_proc);
-            {
-                int total_jobs_proc_id = 0;
-                for (int i=0; i<use_gpu_count; i++)
-                {
-                    if (gpuid[i] == -1)
-                    {
-                        proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                    }
-                    else
-                    {
-                        for (int j=0; j<jobs_proc[i]; j++)
-                        {
-                            proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                        }
-                    }
-                }
-            }
-
-            // save image
             SaveThreadParams stp;
             stp.verbose = verbose;
 
-            std::vector<ncnn::Thread*> save_threads(jobs_save);
-            for (int i=0; i<jobs_save; i++)
-            {
-                save_threads[i] = new ncnn::Thread(save, (void*)&stp);
-            }
-
-            // end
-            load_thread.join();
-
-            Task end;
-            end.id = -233;
-
-            for (int i=0; i<total_jobs_proc; i++)
-            {
-                toproc.put(end);
-            }
-
-            for (int i=0; i<total_jobs_proc; i++)
-            {
-                proc_threads[i]->join();
-                delete proc_threads[i];
-            }
-
-            for (int i=0; i<jobs_save; i++)
-            {
-                tosave.put(end);
-            }
-
-            for (int i=0; i<jobs_save; i++)
-            {
-                save_threads[i]->join();
-                delete save_threads[i];
-            }
+            run_pipeline(realcugan, gpuid, jobs_proc, jobs_save, ltp, stp, share_tiles);
         }
 
         for (int i=0; i<use_gpu_count; i++)
@@ -1015,6 +1584,25 @@ int main(int argc, char** argv)
             delete realcugan[i];
         }
         realcugan.clear();
+
+        if (tile_cache)
+        {
+            tile_cache->print_stats();
+            delete tile_cache;
+        }
+
+        if (temporal_cache)
+        {
+            temporal_cache->print_stats();
+            delete temporal_cache;
+        }
+
+        if (result_cache)
+        {
+            result_cache->store_results(verbose);
+            result_cache->print_stats();
+            delete result_cache;
+        }
     }
 
     if (use_gpu)
@@ -4,7 +4,8 @@
 
 #include <algorithm>
 #include <vector>
-#include <map>
+
+#include "spirv_cache.h"
 
 // ncnn
 #include "cpu.h"
@@ -16,43 +17,174 @@
 #include "realcugan_postproc_tta.comp.hex.h"
 #include "realcugan_4x_postproc_tta.comp.hex.h"
 
+static const char* feature_slot_name(int slot)
+{
+    static const char* names[FEATURE_SLOT_COUNT] = {"gap0", "gap1", "gap2", "gap3"};
+    return names[slot];
+}
+
+// Pooled se features in one flat table indexed by tile, tta pass and slot.
+// The per tile features of a slot only live from the stage that extracts them to the sync gap
+// that takes them, the global average replaces them for every later stage. Gpu features that
+// would push the cache over its budget are downloaded and parked on the host instead, the sync
+// gap reads those without another download.
 class FeatureCache
 {
 public:
+    explicit FeatureCache(size_t _budget = 0) : xtiles(0), ytiles(0), ttas(1), bytes(0), peak(0), spilled(0), budget(_budget)
+    {
+    }
+
+    // size the table for the tile grid of the stage that extracts per tile features, the previous
+    // sync gap has taken every per tile entry when the grid changes
+    void reserve(int _xtiles, int _ytiles, int _ttas)
+    {
+        if (xtiles == _xtiles && ytiles == _ytiles && ttas == _ttas)
+            return;
+
+        xtiles = _xtiles;
+        ytiles = _ytiles;
+        ttas = _ttas;
+        entries.assign((size_t)_xtiles * _ytiles * _ttas * FEATURE_SLOT_COUNT, Entry());
+    }
+
     void clear()
     {
-        gpu_cache.clear();
-        cpu_cache.clear();
+        entries.clear();
+        xtiles = 0;
+        ytiles = 0;
+        for (int i = 0; i < FEATURE_SLOT_COUNT; i++)
+        {
+            synced_gpu[i].release();
+            synced_cpu[i].release();
+        }
+        bytes = 0;
     }
 
-    std::string make_key(int yi, int xi, int ti, const std::string& name) const
+    void load(int yi, int xi, int ti, int slot, ncnn::VkMat& feat) const
     {
-        return std::to_string(yi) + "-" + std::to_string(xi) + "-" + std::to_string(ti) + "-" + name;
+        feat = synced_gpu[slot].empty() ? entry(yi, xi, ti, slot).gpu : synced_gpu[slot];
     }
 
-    void load(int yi, int xi, int ti, const std::string& name, ncnn::VkMat& feat)
+    void load(int yi, int xi, int ti, int slot, ncnn::Mat& feat) const
     {
-        feat = gpu_cache[make_key(yi, xi, ti, name)];
+        feat = synced_cpu[slot].empty() ? entry(yi, xi, ti, slot).cpu : synced_cpu[slot];
     }
 
-    void save(int yi, int xi, int ti, const std::string& name, ncnn::VkMat& feat)
+    // false when feat does not fit the budget, the caller spills it to the host
+    bool save(int yi, int xi, int ti, int slot, const ncnn::VkMat& feat)
     {
-        gpu_cache[make_key(yi, xi, ti, name)] = feat;
+        const size_t size = feat.total() * feat.elemsize;
+        if (budget && bytes + size > budget)
+            return false;
+
+        Entry& e = entry(yi, xi, ti, slot);
+        release(e);
+        e.gpu = feat;
+        e.bytes = size;
+        add_bytes(size);
+        return true;
     }
 
-    void load(int yi, int xi, int ti, const std::string& name, ncnn::Mat& feat)
+    void save(int yi, int xi, int ti, int slot, const ncnn::Mat& feat)
     {
-        feat = cpu_cache[make_key(yi, xi, ti, name)];
+        Entry& e = entry(yi, xi, ti, slot);
+        release(e);
+        e.cpu = feat;
+        e.bytes = feat.total() * feat.elemsize;
+        add_bytes(e.bytes);
     }
 
-    void save(int yi, int xi, int ti, const std::string& name, ncnn::Mat& feat)
+    // gpu feature saved on the host because the budget was exceeded
+    void spill(int yi, int xi, int ti, int slot, const ncnn::Mat& feat)
     {
-        cpu_cache[make_key(yi, xi, ti, name)] = feat;
+        save(yi, xi, ti, slot, feat);
+        spilled++;
     }
 
-public:
-    std::map<std::string, ncnn::VkMat> gpu_cache;
-    std::map<std::string, ncnn::Mat> cpu_cache;
+    // hand the per tile feature over to the sync gap, the slot entry is released
+    void take(int yi, int xi, int ti, int slot, ncnn::VkMat& feat, ncnn::Mat& feat_host)
+    {
+        Entry& e = entry(yi, xi, ti, slot);
+        feat = e.gpu;
+        feat_host = e.cpu;
+        release(e);
+    }
+
+    void take(int yi, int xi, int ti, int slot, ncnn::Mat& feat)
+    {
+        Entry& e = entry(yi, xi, ti, slot);
+        feat = e.cpu;
+        release(e);
+    }
+
+    // the global average of slot, read by every later stage
+    void save_synced(int slot, const ncnn::VkMat& feat)
+    {
+        synced_gpu[slot] = feat;
+        add_bytes(feat.total() * feat.elemsize);
+    }
+
+    void save_synced(int slot, const ncnn::Mat& feat)
+    {
+        synced_cpu[slot] = feat;
+        add_bytes(feat.total() * feat.elemsize);
+    }
+
+    void print_stats() const
+    {
+        if (spilled)
+            fprintf(stderr, "syncgap feature cache peak %.1f KB, %d features spilled to host\n", peak / 1024.0, spilled);
+        else
+            fprintf(stderr, "syncgap feature cache peak %.1f KB\n", peak / 1024.0);
+    }
+
+private:
+    struct Entry
+    {
+        Entry() : bytes(0)
+        {
+        }
+
+        ncnn::VkMat gpu;
+        ncnn::Mat cpu;
+        size_t bytes;
+    };
+
+    Entry& entry(int yi, int xi, int ti, int slot)
+    {
+        return entries[(((size_t)yi * xtiles + xi) * ttas + ti) * FEATURE_SLOT_COUNT + slot];
+    }
+
+    const Entry& entry(int yi, int xi, int ti, int slot) const
+    {
+        return entries[(((size_t)yi * xtiles + xi) * ttas + ti) * FEATURE_SLOT_COUNT + slot];
+    }
+
+    void release(Entry& e)
+    {
+        e.gpu.release();
+        e.cpu.release();
+        bytes -= e.bytes;
+        e.bytes = 0;
+    }
+
+    void add_bytes(size_t size)
+    {
+        bytes += size;
+        peak = std::max(peak, bytes);
+    }
+
+    std::vector<Entry> entries;
+    int xtiles;
+    int ytiles;
+    int ttas;
+    ncnn::VkMat synced_gpu[FEATURE_SLOT_COUNT];
+    ncnn::Mat synced_cpu[FEATURE_SLOT_COUNT];
+    size_t bytes;
+    size_t peak;
+    int spilled;
+    size_t budget;
 };
 
 RealCUGAN::RealCUGAN(int gpuid, bool _tta_mode, int num_threads)
@@ -79,14 +211,18 @@ RealCUGAN::~RealCUGAN()
         delete realcugan_postproc;
     }
 
-    bicubic_2x->destroy_pipeline(net.opt);
-    delete bicubic_2x;
+    // a load that failed early created no layers
+    if (bicubic_2x)
+    {
+        bicubic_2x->destroy_pipeline(net.opt);
+        delete bicubic_2x;
 
-    bicubic_3x->destroy_pipeline(net.opt);
-    delete bicubic_3x;
+        bicubic_3x->destroy_pipeline(net.opt);
+        delete bicubic_3x;
 
-    bicubic_4x->destroy_pipeline(net.opt);
-    delete bicubic_4x;
+        bicubic_4x->destroy_pipeline(net.opt);
+        delete bicubic_4x;
+    }
 }
 
 #if _WIN32
@@ -144,17 +280,17 @@ int RealCUGAN::load(const std::string& parampath, const std::string& modelpath)
 #endif
 
         {
-            static std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            std::vector<uint32_t> spirv;
+            int ret;
+            if (tta_mode)
+                ret = cached_spirv_module(realcugan_preproc_tta_comp_data, sizeof(realcugan_preproc_tta_comp_data), net.opt, vkdev, parampath, spirv);
+            else
+                ret = cached_spirv_module(realcugan_preproc_comp_data, sizeof(realcugan_preproc_comp_data), net.opt, vkdev, parampath, spirv);
+
+            if (ret != 0)
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(realcugan_preproc_tta_comp_data, sizeof(realcugan_preproc_tta_comp_data), net.opt, spirv);
-                    else
-                        compile_spirv_module(realcugan_preproc_comp_data, sizeof(realcugan_preproc_comp_data), net.opt, spirv);
-                }
+                fprintf(stderr, "compile realcugan_preproc failed\n");
+                return -1;
             }
 
             realcugan_preproc = new ncnn::Pipeline(vkdev);
@@ -163,17 +299,17 @@ int RealCUGAN::load(const std::string& parampath, const std::string& modelpath)
         }
 
         {
-            static std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            std::vector<uint32_t> spirv;
+            int ret;
+            if (tta_mode)
+                ret = cached_spirv_module(realcugan_postproc_tta_comp_data, sizeof(realcugan_postproc_tta_comp_data), net.opt, vkdev, parampath, spirv);
+            else
+                ret = cached_spirv_module(realcugan_postproc_comp_data, sizeof(realcugan_postproc_comp_data), net.opt, vkdev, parampath, spirv);
+
+            if (ret != 0)
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(realcugan_postproc_tta_comp_data, sizeof(realcugan_postproc_tta_comp_data), net.opt, spirv);
-                    else
-                        compile_spirv_module(realcugan_postproc_comp_data, sizeof(realcugan_postproc_comp_data), net.opt, spirv);
-                }
+                fprintf(stderr, "compile realcugan_postproc failed\n");
+                return -1;
             }
 
             realcugan_postproc = new ncnn::Pipeline(vkdev);
@@ -182,17 +318,17 @@ int RealCUGAN::load(const std::string& parampath, const std::string& modelpath)
         }
 
         {
-            static std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            std::vector<uint32_t> spirv;
+            int ret;
+            if (tta_mode)
+                ret = cached_spirv_module(realcugan_4x_postproc_tta_comp_data, sizeof(realcugan_4x_postproc_tta_comp_data), net.opt, vkdev, parampath, spirv);
+            else
+                ret = cached_spirv_module(realcugan_4x_postproc_comp_data, sizeof(realcugan_4x_postproc_comp_data), net.opt, vkdev, parampath, spirv);
+
+            if (ret != 0)
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(realcugan_4x_postproc_tta_comp_data, sizeof(realcugan_4x_postproc_tta_comp_data), net.opt, spirv);
-                    else
-                        compile_spirv_module(realcugan_4x_postproc_comp_data, sizeof(realcugan_4x_postproc_comp_data), net.opt, spirv);
-                }
+                fprintf(stderr, "compile realcugan_4x_postproc failed\n");
+                return -1;
             }
 
             realcugan_4x_postproc = new ncnn::Pipeline(vkdev);
@@ -242,10 +378,14 @@ int RealCUGAN::load(const std::string& parampath, const std::string& modelpath)
     return 0;
 }
 
-int RealCUGAN::process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
+int RealCUGAN::process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer) const
 {
     bool syncgap_needed = tilesize < std::max(inimage.w, inimage.h);
 
+    // the caller only streams images the syncgap modes leave alone
+    if (writer && syncgap_needed && syncgap)
+        return -1;
+
     if (!vkdev)
     {
         // cpu only
@@ -259,14 +399,11 @@ int RealCUGAN::process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
                 return process_cpu_se_very_rough(inimage, outimage);
         }
         else
-            return process_cpu(inimage, outimage);
+            return process_cpu(inimage, outimage, writer);
     }
 
     if (noise == -1 && scale == 1)
-    {
-        outimage = inimage;
-        return 0;
-    }
+        return process_unscaled(inimage, outimage, writer);
 
     if (syncgap_needed && syncgap)
     {
@@ -278,913 +415,671 @@ int RealCUGAN::process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
             return process_se_very_rough(inimage, outimage);
     }
 
-    const unsigned char* pixeldata = (const unsigned char*)inimage.data;
-    const int w = inimage.w;
-    const int h = inimage.h;
-    const int channels = inimage.elempack;
+    return process_tiled_gpu(inimage, outimage, writer);
+}
 
-    const int TILE_SIZE_X = tilesize;
-    const int TILE_SIZE_Y = tilesize;
+int RealCUGAN::process_shared(const std::vector<const RealCUGAN*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage)
+{
+    const RealCUGAN* e = engines[0];
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    // the syncgap modes average features over every tile of the image, they stay on one device
+    bool syncgap_needed = e->tilesize < std::max(inimage.w, inimage.h);
 
-    ncnn::Option opt = net.opt;
-    opt.blob_vkallocator = blob_vkallocator;
-    opt.workspace_vkallocator = blob_vkallocator;
-    opt.staging_vkallocator = staging_vkallocator;
+    if (engines.size() == 1 || (e->noise == -1 && e->scale == 1) || (syncgap_needed && e->syncgap))
+        return e->process(inimage, outimage);
 
-    // each tile 400x400
-    const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
-    const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
+    return process_tiled_shared(engines, inimage, outimage);
+}
 
-    const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
+// grow the bottom/right prepadding so the padded tile fits the model stride
+static int stride_aligned_prepadding(int prepadding, int tile_nopad, int scale)
+{
+    if (scale == 1 || scale == 3)
+        return prepadding + (tile_nopad + 3) / 4 * 4 - tile_nopad;
+    if (scale == 2 || scale == 4)
+        return prepadding + (tile_nopad + 1) / 2 * 2 - tile_nopad;
+    return prepadding;
+}
 
-    //#pragma omp parallel for num_threads(2)
-    for (int yi = 0; yi < ytiles; yi++)
+// the 4x model predicts a residual on top of the nearest upscaled input, out += in * 255
+static void merge_residual_4x(const ncnn::Mat& in_tile, ncnn::Mat& out, int prepadding)
+{
+    for (int q = 0; q < 3; q++)
     {
-        const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+        float* outptr = out.channel(q);
 
-        int prepadding_bottom = prepadding;
-        if (scale == 1 || scale == 3)
-        {
-            prepadding_bottom += (tile_h_nopad + 3) / 4 * 4 - tile_h_nopad;
-        }
-        if (scale == 2 || scale == 4)
+        for (int i = 0; i < out.h; i++)
         {
-            prepadding_bottom += (tile_h_nopad + 1) / 2 * 2 - tile_h_nopad;
+            const float* inptr = in_tile.channel(q).row(prepadding + i / 4) + prepadding;
+
+            for (int j = 0; j < out.w; j++)
+            {
+                *outptr++ += inptr[j / 4] * 255.f;
+            }
         }
+    }
+}
 
-        int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
-        int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom, h);
+void RealCUGAN::band_input_rows(const TileGrid& grid, int yi, int& y0, int& y1, int& standard_h) const
+{
+    const int tile_h_nopad = std::min((yi + 1) * tilesize, grid.h) - yi * tilesize;
+    const int prepadding_bottom = stride_aligned_prepadding(prepadding, tile_h_nopad, scale);
 
-        ncnn::Mat in;
-        if (opt.use_fp16_storage && opt.use_int8_storage)
+    y0 = std::max(yi * tilesize - prepadding, 0);
+    y1 = std::min((yi + 1) * tilesize + prepadding_bottom, grid.h);
+    standard_h = tilesize + prepadding + prepadding_bottom;
+}
+
+void RealCUGAN::process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const
+{
+    const int w = grid.w;
+    const int h = grid.h;
+    const int channels = grid.channels;
+
+    const int TILE_SIZE_X = tilesize;
+    const int TILE_SIZE_Y = tilesize;
+
+    ncnn::VkAllocator* blob_vkallocator = opt.blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator = opt.staging_vkallocator;
+
+    const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
+
+    const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const int prepadding_bottom = stride_aligned_prepadding(prepadding, tile_h_nopad, scale);
+
+    const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
+
+    const int prepadding_right = stride_aligned_prepadding(prepadding, tile_w_nopad, scale);
+
+    if (tta_mode)
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu[8];
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            const int safe_tile_h = in_tile_y1 - in_tile_y0;
-            const bool is_standard_size = (safe_tile_h == TILE_SIZE_Y + prepadding + prepadding_bottom);
-            if (is_standard_size) {
-                in = ncnn::Mat(w, safe_tile_h, (unsigned char*)pixeldata + in_tile_y0 * w * channels, (size_t)channels, 1);
-            } else {
-                in.create(w, safe_tile_h, (size_t)channels, 1);
-                const unsigned char* src = (unsigned char*)pixeldata + in_tile_y0 * w * channels;
-                memcpy(in.data, src, (size_t)w * safe_tile_h * channels);
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding_right;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding_bottom;
+
+            in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
+            if (channels == 4)
+            {
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
             }
+
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu[0];
+            bindings[2] = in_tile_gpu[1];
+            bindings[3] = in_tile_gpu[2];
+            bindings[4] = in_tile_gpu[3];
+            bindings[5] = in_tile_gpu[4];
+            bindings[6] = in_tile_gpu[5];
+            bindings[7] = in_tile_gpu[6];
+            bindings[8] = in_tile_gpu[7];
+            bindings[9] = in_alpha_tile_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu[0].w;
+            constants[4].i = in_tile_gpu[0].h;
+            constants[5].i = in_tile_gpu[0].cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = channels;
+            constants[11].i = in_alpha_tile_gpu.w;
+            constants[12].i = in_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu[0].w;
+            dispatcher.h = in_tile_gpu[0].h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realcugan_preproc, bindings, constants, dispatcher);
         }
-        else
+
+        // realcugan
+        ncnn::VkMat out_tile_gpu[8];
+        for (int ti = 0; ti < 8; ti++)
         {
-            if (channels == 3)
+            ncnn::Extractor ex = net.create_extractor();
+
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
+
+            ex.input("in0", in_tile_gpu[ti]);
+
+            ex.extract("out0", out_tile_gpu[ti], cmd);
+        }
+
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
+        {
+            if (scale == 1)
             {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGR2RGB, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGB, w, (in_tile_y1 - in_tile_y0));
-#endif
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
             }
-            if (channels == 4)
+            if (scale == 2)
             {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGRA2RGBA, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGBA, w, (in_tile_y1 - in_tile_y0));
-#endif
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
         }
 
-        ncnn::VkCompute cmd(vkdev);
-
-        // upload
-        ncnn::VkMat in_gpu;
+        // postproc
+        if (scale == 4)
         {
-            cmd.record_clone(in, in_gpu, opt);
+            std::vector<ncnn::VkMat> bindings(11);
+            bindings[0] = in_gpu;
+            bindings[1] = out_tile_gpu[0];
+            bindings[2] = out_tile_gpu[1];
+            bindings[3] = out_tile_gpu[2];
+            bindings[4] = out_tile_gpu[3];
+            bindings[5] = out_tile_gpu[4];
+            bindings[6] = out_tile_gpu[5];
+            bindings[7] = out_tile_gpu[6];
+            bindings[8] = out_tile_gpu[7];
+            bindings[9] = out_alpha_tile_gpu;
+            bindings[10] = out_gpu;
 
-            if (xtiles > 1)
-            {
-                cmd.submit_and_wait();
-                cmd.reset();
-            }
-        }
+            std::vector<ncnn::vk_constant_type> constants(16);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = out_tile_gpu[0].w;
+            constants[4].i = out_tile_gpu[0].h;
+            constants[5].i = out_tile_gpu[0].cstep;
+            constants[6].i = out_gpu.w;
+            constants[7].i = out_gpu.h;
+            constants[8].i = out_gpu.cstep;
+            constants[9].i = xi * TILE_SIZE_X;
+            constants[10].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[11].i = xi * TILE_SIZE_X * scale;
+            constants[12].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[13].i = channels;
+            constants[14].i = out_alpha_tile_gpu.w;
+            constants[15].i = out_alpha_tile_gpu.h;
 
-        int out_tile_y0 = std::max(yi * TILE_SIZE_Y, 0);
-        int out_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h);
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
 
-        ncnn::VkMat out_gpu;
-        if (opt.use_fp16_storage && opt.use_int8_storage)
-        {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, (size_t)channels, 1, blob_vkallocator);
+            cmd.record_pipeline(realcugan_4x_postproc, bindings, constants, dispatcher);
         }
         else
         {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, channels, (size_t)4u, 1, blob_vkallocator);
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = out_tile_gpu[0];
+            bindings[1] = out_tile_gpu[1];
+            bindings[2] = out_tile_gpu[2];
+            bindings[3] = out_tile_gpu[3];
+            bindings[4] = out_tile_gpu[4];
+            bindings[5] = out_tile_gpu[5];
+            bindings[6] = out_tile_gpu[6];
+            bindings[7] = out_tile_gpu[7];
+            bindings[8] = out_alpha_tile_gpu;
+            bindings[9] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(11);
+            constants[0].i = out_tile_gpu[0].w;
+            constants[1].i = out_tile_gpu[0].h;
+            constants[2].i = out_tile_gpu[0].cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = channels;
+            constants[9].i = out_alpha_tile_gpu.w;
+            constants[10].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realcugan_postproc, bindings, constants, dispatcher);
         }
-
-        for (int xi = 0; xi < xtiles; xi++)
+    }
+    else
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu;
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding_right;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding_bottom;
 
-            int prepadding_right = prepadding;
-            if (scale == 1 || scale == 3)
-            {
-                prepadding_right += (tile_w_nopad + 3) / 4 * 4 - tile_w_nopad;
-            }
-            if (scale == 2 || scale == 4)
-            {
-                prepadding_right += (tile_w_nopad + 1) / 2 * 2 - tile_w_nopad;
-            }
+            in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
 
-            if (tta_mode)
+            if (channels == 4)
             {
-                // preproc
-                ncnn::VkMat in_tile_gpu[8];
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding_right;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding_bottom;
-
-                    in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+            }
 
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu;
+            bindings[2] = in_alpha_tile_gpu;
 
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu[0];
-                    bindings[2] = in_tile_gpu[1];
-                    bindings[3] = in_tile_gpu[2];
-                    bindings[4] = in_tile_gpu[3];
-                    bindings[5] = in_tile_gpu[4];
-                    bindings[6] = in_tile_gpu[5];
-                    bindings[7] = in_tile_gpu[6];
-                    bindings[8] = in_tile_gpu[7];
-                    bindings[9] = in_alpha_tile_gpu;
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu.w;
+            constants[4].i = in_tile_gpu.h;
+            constants[5].i = in_tile_gpu.cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = channels;
+            constants[11].i = in_alpha_tile_gpu.w;
+            constants[12].i = in_alpha_tile_gpu.h;
 
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu[0].w;
-                    constants[4].i = in_tile_gpu[0].h;
-                    constants[5].i = in_tile_gpu[0].cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = channels;
-                    constants[11].i = in_alpha_tile_gpu.w;
-                    constants[12].i = in_alpha_tile_gpu.h;
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu.w;
+            dispatcher.h = in_tile_gpu.h;
+            dispatcher.c = channels;
 
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu[0].w;
-                    dispatcher.h = in_tile_gpu[0].h;
-                    dispatcher.c = channels;
+            cmd.record_pipeline(realcugan_preproc, bindings, constants, dispatcher);
+        }
 
-                    cmd.record_pipeline(realcugan_preproc, bindings, constants, dispatcher);
-                }
+        // realcugan
+        ncnn::VkMat out_tile_gpu;
+        {
+            ncnn::Extractor ex = net.create_extractor();
 
-                // realcugan
-                ncnn::VkMat out_tile_gpu[8];
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
 
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
+            ex.input("in0", in_tile_gpu);
 
-                    ex.input("in0", in_tile_gpu[ti]);
+            ex.extract("out0", out_tile_gpu, cmd);
+        }
 
-                    ex.extract("out0", out_tile_gpu[ti], cmd);
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
-
-                // postproc
-                if (scale == 4)
-                {
-                    std::vector<ncnn::VkMat> bindings(11);
-                    bindings[0] = in_gpu;
-                    bindings[1] = out_tile_gpu[0];
-                    bindings[2] = out_tile_gpu[1];
-                    bindings[3] = out_tile_gpu[2];
-                    bindings[4] = out_tile_gpu[3];
-                    bindings[5] = out_tile_gpu[4];
-                    bindings[6] = out_tile_gpu[5];
-                    bindings[7] = out_tile_gpu[6];
-                    bindings[8] = out_tile_gpu[7];
-                    bindings[9] = out_alpha_tile_gpu;
-                    bindings[10] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(16);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = out_tile_gpu[0].w;
-                    constants[4].i = out_tile_gpu[0].h;
-                    constants[5].i = out_tile_gpu[0].cstep;
-                    constants[6].i = out_gpu.w;
-                    constants[7].i = out_gpu.h;
-                    constants[8].i = out_gpu.cstep;
-                    constants[9].i = xi * TILE_SIZE_X;
-                    constants[10].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[11].i = xi * TILE_SIZE_X * scale;
-                    constants[12].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[13].i = channels;
-                    constants[14].i = out_alpha_tile_gpu.w;
-                    constants[15].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realcugan_4x_postproc, bindings, constants, dispatcher);
-                }
-                else
-                {
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = out_tile_gpu[0];
-                    bindings[1] = out_tile_gpu[1];
-                    bindings[2] = out_tile_gpu[2];
-                    bindings[3] = out_tile_gpu[3];
-                    bindings[4] = out_tile_gpu[4];
-                    bindings[5] = out_tile_gpu[5];
-                    bindings[6] = out_tile_gpu[6];
-                    bindings[7] = out_tile_gpu[7];
-                    bindings[8] = out_alpha_tile_gpu;
-                    bindings[9] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(11);
-                    constants[0].i = out_tile_gpu[0].w;
-                    constants[1].i = out_tile_gpu[0].h;
-                    constants[2].i = out_tile_gpu[0].cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = channels;
-                    constants[9].i = out_alpha_tile_gpu.w;
-                    constants[10].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realcugan_postproc, bindings, constants, dispatcher);
-                }
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
             }
-            else
+            if (scale == 2)
             {
-                // preproc
-                ncnn::VkMat in_tile_gpu;
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding_right;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding_bottom;
-
-                    in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
-
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu;
-                    bindings[2] = in_alpha_tile_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu.w;
-                    constants[4].i = in_tile_gpu.h;
-                    constants[5].i = in_tile_gpu.cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = channels;
-                    constants[11].i = in_alpha_tile_gpu.w;
-                    constants[12].i = in_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu.w;
-                    dispatcher.h = in_tile_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realcugan_preproc, bindings, constants, dispatcher);
-                }
-
-                // realcugan
-                ncnn::VkMat out_tile_gpu;
-                {
-                    ncnn::Extractor ex = net.create_extractor();
-
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input("in0", in_tile_gpu);
-
-                    ex.extract("out0", out_tile_gpu, cmd);
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
-
-                // postproc
-                if (scale == 4)
-                {
-                    std::vector<ncnn::VkMat> bindings(4);
-                    bindings[0] = in_gpu;
-                    bindings[1] = out_tile_gpu;
-                    bindings[2] = out_alpha_tile_gpu;
-                    bindings[3] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(16);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = out_tile_gpu.w;
-                    constants[4].i = out_tile_gpu.h;
-                    constants[5].i = out_tile_gpu.cstep;
-                    constants[6].i = out_gpu.w;
-                    constants[7].i = out_gpu.h;
-                    constants[8].i = out_gpu.cstep;
-                    constants[9].i = xi * TILE_SIZE_X;
-                    constants[10].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[11].i = xi * TILE_SIZE_X * scale;
-                    constants[12].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[13].i = channels;
-                    constants[14].i = out_alpha_tile_gpu.w;
-                    constants[15].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realcugan_4x_postproc, bindings, constants, dispatcher);
-                }
-                else
-                {
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = out_tile_gpu;
-                    bindings[1] = out_alpha_tile_gpu;
-                    bindings[2] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(11);
-                    constants[0].i = out_tile_gpu.w;
-                    constants[1].i = out_tile_gpu.h;
-                    constants[2].i = out_tile_gpu.cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = channels;
-                    constants[9].i = out_alpha_tile_gpu.w;
-                    constants[10].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realcugan_postproc, bindings, constants, dispatcher);
-                }
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
-
-            if (xtiles > 1)
+            if (scale == 3)
             {
-                cmd.submit_and_wait();
-                cmd.reset();
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
-
-            fprintf(stderr, "%.2f%%\n", (float)(yi * xtiles + xi) / (ytiles * xtiles) * 100);
         }
 
-        // download
+        // postproc
+        if (scale == 4)
         {
-            ncnn::Mat out;
-
-            if (opt.use_fp16_storage && opt.use_int8_storage)
-            {
-                out = ncnn::Mat(out_gpu.w, out_gpu.h, (unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, (size_t)channels, 1);
-            }
+            std::vector<ncnn::VkMat> bindings(4);
+            bindings[0] = in_gpu;
+            bindings[1] = out_tile_gpu;
+            bindings[2] = out_alpha_tile_gpu;
+            bindings[3] = out_gpu;
 
-            cmd.record_clone(out_gpu, out, opt);
+            std::vector<ncnn::vk_constant_type> constants(16);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = out_tile_gpu.w;
+            constants[4].i = out_tile_gpu.h;
+            constants[5].i = out_tile_gpu.cstep;
+            constants[6].i = out_gpu.w;
+            constants[7].i = out_gpu.h;
+            constants[8].i = out_gpu.cstep;
+            constants[9].i = xi * TILE_SIZE_X;
+            constants[10].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[11].i = xi * TILE_SIZE_X * scale;
+            constants[12].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[13].i = channels;
+            constants[14].i = out_alpha_tile_gpu.w;
+            constants[15].i = out_alpha_tile_gpu.h;
 
-            cmd.submit_and_wait();
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
 
-            if (!(opt.use_fp16_storage && opt.use_int8_storage))
-            {
-                if (channels == 3)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB2BGR);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB);
-#endif
-                }
-                if (channels == 4)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA2BGRA);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA);
-#endif
-                }
-            }
+            cmd.record_pipeline(realcugan_4x_postproc, bindings, constants, dispatcher);
+        }
+        else
+        {
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = out_tile_gpu;
+            bindings[1] = out_alpha_tile_gpu;
+            bindings[2] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(11);
+            constants[0].i = out_tile_gpu.w;
+            constants[1].i = out_tile_gpu.h;
+            constants[2].i = out_tile_gpu.cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = channels;
+            constants[9].i = out_alpha_tile_gpu.w;
+            constants[10].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realcugan_postproc, bindings, constants, dispatcher);
         }
     }
-
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
-
-    return 0;
 }
 
-int RealCUGAN::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
+int RealCUGAN::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer) const
 {
     if (noise == -1 && scale == 1)
-    {
-        outimage = inimage;
-        return 0;
-    }
+        return process_unscaled(inimage, outimage, writer);
+
+    return process_tiled_cpu(inimage, outimage, writer);
+}
 
+int RealCUGAN::process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const
+{
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
-    const int w = inimage.w;
-    const int h = inimage.h;
-    const int channels = inimage.elempack;
+    const int w = grid.w;
+    const int h = grid.h;
+    const int channels = grid.channels;
 
     const int TILE_SIZE_X = tilesize;
     const int TILE_SIZE_Y = tilesize;
 
-    ncnn::Option opt = net.opt;
+    const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const int prepadding_bottom = stride_aligned_prepadding(prepadding, tile_h_nopad, scale);
 
-    // each tile 400x400
-    const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
-    const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
+    int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
+    int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom, h);
 
-    for (int yi = 0; yi < ytiles; yi++)
-    {
-        const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
 
-        int prepadding_bottom = prepadding;
-        if (scale == 1 || scale == 3)
-        {
-            prepadding_bottom += (tile_h_nopad + 3) / 4 * 4 - tile_h_nopad;
-        }
-        if (scale == 2 || scale == 4)
-        {
-            prepadding_bottom += (tile_h_nopad + 1) / 2 * 2 - tile_h_nopad;
-        }
+    const int prepadding_right = stride_aligned_prepadding(prepadding, tile_w_nopad, scale);
 
-        int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
-        int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom, h);
+    int in_tile_x0 = std::max(xi * TILE_SIZE_X - prepadding, 0);
+    int in_tile_x1 = std::min((xi + 1) * TILE_SIZE_X + prepadding_right, w);
 
-        for (int xi = 0; xi < xtiles; xi++)
+    // crop tile
+    ncnn::Mat in;
+    {
+        if (channels == 3)
         {
-            const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
-
-            int prepadding_right = prepadding;
-            if (scale == 1 || scale == 3)
-            {
-                prepadding_right += (tile_w_nopad + 3) / 4 * 4 - tile_w_nopad;
-            }
-            if (scale == 2 || scale == 4)
-            {
-                prepadding_right += (tile_w_nopad + 1) / 2 * 2 - tile_w_nopad;
-            }
-
-            int in_tile_x0 = std::max(xi * TILE_SIZE_X - prepadding, 0);
-            int in_tile_x1 = std::min((xi + 1) * TILE_SIZE_X + prepadding_right, w);
-
-            // crop tile
-            ncnn::Mat in;
-            {
-                if (channels == 3)
-                {
 #if _WIN32
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGR2RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGR2RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #else
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #endif
-                }
-                if (channels == 4)
-                {
+        }
+        if (channels == 4)
+        {
 #if _WIN32
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGRA2RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGRA2RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #else
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #endif
-                }
-            }
+        }
+    }
 
-            ncnn::Mat out;
+    ncnn::Mat out;
 
-            if (tta_mode)
+    if (tta_mode)
+    {
+        // split alpha and preproc
+        ncnn::Mat in_tile[8];
+        ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
+        {
+            in_tile[0].create(in.w, in.h, 3);
+            for (int q = 0; q < 3; q++)
             {
-                // split alpha and preproc
-                ncnn::Mat in_tile[8];
-                ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
-                {
-                    in_tile[0].create(in.w, in.h, 3);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const float* ptr = in.channel(q);
-                        float* outptr0 = in_tile[0].channel(q);
+                const float* ptr = in.channel(q);
+                float* outptr0 = in_tile[0].channel(q);
 
-                        for (int i = 0; i < in.h; i++)
-                        {
-                            for (int j = 0; j < in.w; j++)
-                            {
-                                *outptr0++ = *ptr++ * (1 / 255.f);
-                            }
-                        }
-                    }
+                tile_scale(ptr, outptr0, in.w * in.h, 1 / 255.f);
+            }
 
-                    if (channels == 4)
-                    {
-                        in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
-                        int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
-                        int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
-                        int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
-                        int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
-                        ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
+            if (channels == 4)
+            {
+                in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
+                int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
+                int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
+                int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
+                int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
+                ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
 
-                    }
-                }
+            }
+        }
 
-                // border padding
-                {
-                    int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
-                    int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom - h, prepadding_bottom), 0);
-                    int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
-                    int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding_right - w, prepadding_right), 0);
+        // border padding
+        {
+            int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
+            int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom - h, prepadding_bottom), 0);
+            int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
+            int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding_right - w, prepadding_right), 0);
 
-                    ncnn::Mat in_tile_padded;
-                    ncnn::copy_make_border(in_tile[0], in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, net.opt);
-                    in_tile[0] = in_tile_padded;
-                }
+            ncnn::Mat in_tile_padded;
+            ncnn::copy_make_border(in_tile[0], in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, opt);
+            in_tile[0] = in_tile_padded;
+        }
 
-                // the other 7 directions
-                {
-                    in_tile[1].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[2].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[3].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[4].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[5].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[6].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[7].create(in_tile[0].h, in_tile[0].w, 3);
+        // the other 7 directions
+        tta_expand_8(in_tile);
 
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
-                        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
-                        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
-                        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
-                        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
-                        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
-                        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
-                        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
+        // realcugan
+        ncnn::Mat out_tile[8];
+        for (int ti = 0; ti < 8; ti++)
+        {
+            BenchInference bench_inference;
 
-                        for (int i = 0; i < in_tile[0].h; i++)
-                        {
-                            const float* outptr0 = in_tile_0.row(i);
-                            float* outptr1 = in_tile_1.row(in_tile[0].h - 1 - i);
-                            float* outptr2 = in_tile_2.row(i) + in_tile[0].w - 1;
-                            float* outptr3 = in_tile_3.row(in_tile[0].h - 1 - i) + in_tile[0].w - 1;
-
-                            for (int j = 0; j < in_tile[0].w; j++)
-                            {
-                                float* outptr4 = in_tile_4.row(j) + i;
-                                float* outptr5 = in_tile_5.row(in_tile[0].w - 1 - j) + i;
-                                float* outptr6 = in_tile_6.row(j) + in_tile[0].h - 1 - i;
-                                float* outptr7 = in_tile_7.row(in_tile[0].w - 1 - j) + in_tile[0].h - 1 - i;
-
-                                float v = *outptr0++;
-
-                                *outptr1++ = v;
-                                *outptr2-- = v;
-                                *outptr3-- = v;
-                                *outptr4 = v;
-                                *outptr5 = v;
-                                *outptr6 = v;
-                                *outptr7 = v;
-                            }
-                        }
-                    }
-                }
+            ncnn::Extractor ex = net.create_extractor();
 
-                // realcugan
-                ncnn::Mat out_tile[8];
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+            ex.set_light_mode(opt.lightmode);
+            ex.set_num_threads(opt.num_threads);
+            ex.set_blob_allocator(opt.blob_allocator);
+            ex.set_workspace_allocator(opt.workspace_allocator);
 
-                    ex.input("in0", in_tile[ti]);
+            ex.input("in0", in_tile[ti]);
 
-                    ex.extract("out0", out_tile[ti]);
-                }
+            ex.extract("out0", out_tile[ti]);
+        }
 
-                ncnn::Mat out_alpha_tile;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile = in_alpha_tile;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                }
+        ncnn::Mat out_alpha_tile;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile = in_alpha_tile;
+            }
+            if (scale == 2)
+            {
+                bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+        }
 
-                // postproc and merge alpha
-                {
-                    out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
-                    if (scale == 4)
-                    {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
-                            const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
-                            const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
-                            const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
-                            const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
-                            const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
-                            const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
-                            const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* inptr = in_tile[0].channel(q).row(prepadding + i / 4) + prepadding;
-                                const float* ptr0 = out_tile_0.row(i);
-                                const float* ptr1 = out_tile_1.row(out_tile[0].h - 1 - i);
-                                const float* ptr2 = out_tile_2.row(i) + out_tile[0].w - 1;
-                                const float* ptr3 = out_tile_3.row(out_tile[0].h - 1 - i) + out_tile[0].w - 1;
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    const float* ptr4 = out_tile_4.row(j) + i;
-                                    const float* ptr5 = out_tile_5.row(out_tile[0].w - 1 - j) + i;
-                                    const float* ptr6 = out_tile_6.row(j) + out_tile[0].h - 1 - i;
-                                    const float* ptr7 = out_tile_7.row(out_tile[0].w - 1 - j) + out_tile[0].h - 1 - i;
-
-                                    float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-
-                                    *outptr++ = v * 255.f + 0.5f + inptr[j / 4] * 255.f;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
-                            const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
-                            const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
-                            const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
-                            const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
-                            const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
-                            const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
-                            const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* ptr0 = out_tile_0.row(i);
-                                const float* ptr1 = out_tile_1.row(out_tile[0].h - 1 - i);
-                                const float* ptr2 = out_tile_2.row(i) + out_tile[0].w - 1;
-                                const float* ptr3 = out_tile_3.row(out_tile[0].h - 1 - i) + out_tile[0].w - 1;
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    const float* ptr4 = out_tile_4.row(j) + i;
-                                    const float* ptr5 = out_tile_5.row(out_tile[0].w - 1 - j) + i;
-                                    const float* ptr6 = out_tile_6.row(j) + out_tile[0].h - 1 - i;
-                                    const float* ptr7 = out_tile_7.row(out_tile[0].w - 1 - j) + out_tile[0].h - 1 - i;
-
-                                    float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-
-                                    *outptr++ = v * 255.f + 0.5f;
-                                }
-                            }
-                        }
-                    }
+        // postproc and merge alpha
+        {
+            out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
+            tta_merge_8(out_tile, out, 0, 255.f, 0.5f);
+            if (scale == 4)
+            {
+                merge_residual_4x(in_tile[0], out, prepadding);
+            }
 
-                    if (channels == 4)
-                    {
-                        memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
-                    }
-                }
+            if (channels == 4)
+            {
+                memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
             }
-            else
+        }
+    }
+    else
+    {
+        // split alpha and preproc
+        ncnn::Mat in_tile;
+        ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
+        {
+            in_tile.create(in.w, in.h, 3);
+            for (int q = 0; q < 3; q++)
             {
-                // split alpha and preproc
-                ncnn::Mat in_tile;
-                ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
-                {
-                    in_tile.create(in.w, in.h, 3);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const float* ptr = in.channel(q);
-                        float* outptr = in_tile.channel(q);
+                const float* ptr = in.channel(q);
+                float* outptr = in_tile.channel(q);
 
-                        for (int i = 0; i < in.w * in.h; i++)
-                        {
-                            *outptr++ = *ptr++ * (1 / 255.f);
-                        }
-                    }
+                tile_scale(ptr, outptr, in.w * in.h, 1 / 255.f);
+            }
 
-                    if (channels == 4)
-                    {
-                        in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
-                        int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
-                        int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
-                        int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
-                        int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
-                        ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
+            if (channels == 4)
+            {
+                in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
+                int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
+                int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
+                int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
+                int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
+                ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
 
-                    }
-                }
+            }
+        }
 
-                // border padding
-                {
-                    int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
-                    int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom - h, prepadding_bottom), 0);
-                    int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
-                    int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding_right - w, prepadding_right), 0);
+        // border padding
+        {
+            int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
+            int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding_bottom - h, prepadding_bottom), 0);
+            int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
+            int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding_right - w, prepadding_right), 0);
 
-                    ncnn::Mat in_tile_padded;
-                    ncnn::copy_make_border(in_tile, in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, net.opt);
-                    in_tile = in_tile_padded;
-                }
+            ncnn::Mat in_tile_padded;
+            ncnn::copy_make_border(in_tile, in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, opt);
+            in_tile = in_tile_padded;
+        }
 
-                // realcugan
-                ncnn::Mat out_tile;
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+        // realcugan
+        ncnn::Mat out_tile;
+        {
+            BenchInference bench_inference;
 
-                    ex.input("in0", in_tile);
+            ncnn::Extractor ex = net.create_extractor();
 
-                    ex.extract("out0", out_tile);
-                }
+            ex.set_light_mode(opt.lightmode);
+            ex.set_num_threads(opt.num_threads);
+            ex.set_blob_allocator(opt.blob_allocator);
+            ex.set_workspace_allocator(opt.workspace_allocator);
 
-                ncnn::Mat out_alpha_tile;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile = in_alpha_tile;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                }
+            ex.input("in0", in_tile);
 
-                // postproc and merge alpha
-                {
-                    out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
-                    if (scale == 4)
-                    {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* inptr = in_tile.channel(q).row(prepadding + i / 4) + prepadding;
-                                const float* ptr = out_tile.channel(q).row(i);
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    *outptr++ = *ptr++ * 255.f + 0.5f + inptr[j / 4] * 255.f;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            float* outptr = out.channel(q);
+            ex.extract("out0", out_tile);
+        }
 
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* ptr = out_tile.channel(q).row(i);
+        ncnn::Mat out_alpha_tile;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile = in_alpha_tile;
+            }
+            if (scale == 2)
+            {
+                bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+        }
 
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    *outptr++ = *ptr++ * 255.f + 0.5f;
-                                }
-                            }
-                        }
-                    }
+        // postproc and merge alpha
+        {
+            out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
+            for (int q = 0; q < 3; q++)
+            {
+                float* outptr = out.channel(q);
 
-                    if (channels == 4)
-                    {
-                        memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
-                    }
+                for (int i = 0; i < out.h; i++)
+                {
+                    const float* ptr = out_tile.channel(q).row(i);
+
+                    tile_scale_bias(ptr, outptr, out.w, 255.f, 0.5f);
+                    outptr += out.w;
                 }
             }
+            if (scale == 4)
+            {
+                merge_residual_4x(in_tile, out, prepadding);
+            }
 
+            if (channels == 4)
             {
-                if (channels == 3)
-                {
+                memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
+            }
+        }
+    }
+
+    {
+        if (channels == 3)
+        {
 #if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB2BGR, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB2BGR, w * scale * channels);
 #else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB, w * scale * channels);
 #endif
-                }
-                if (channels == 4)
-                {
+        }
+        if (channels == 4)
+        {
 #if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA2BGRA, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA2BGRA, w * scale * channels);
 #else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA, w * scale * channels);
 #endif
-                }
-            }
-
-            fprintf(stderr, "%.2f%%\n", (float)(yi * xtiles + xi) / (ytiles * xtiles) * 100);
         }
     }
 
@@ -1201,39 +1096,41 @@ int RealCUGAN::process_se(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
     opt.workspace_vkallocator = blob_vkallocator;
     opt.staging_vkallocator = staging_vkallocator;
 
-    FeatureCache cache;
+    // a quarter of the heap budget for the per tile features, the rest goes to the host
+    FeatureCache cache((size_t)vkdev->get_heap_budget() * 1024 * 1024 / 4);
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0};
     process_se_stage0(inimage, in0, out0, opt, cache);
 
-    std::vector<std::string> gap0 = {"gap0"};
+    std::vector<int> gap0 = {FEATURE_GAP0};
     process_se_sync_gap(inimage, gap0, opt, cache);
 
-    std::vector<std::string> in1 = {"gap0"};
-    std::vector<std::string> out1 = {"gap1"};
+    std::vector<int> in1 = {FEATURE_GAP0};
+    std::vector<int> out1 = {FEATURE_GAP1};
     process_se_stage0(inimage, in1, out1, opt, cache);
 
-    std::vector<std::string> gap1 = {"gap1"};
+    std::vector<int> gap1 = {FEATURE_GAP1};
     process_se_sync_gap(inimage, gap1, opt, cache);
 
-    std::vector<std::string> in2 = {"gap0", "gap1"};
-    std::vector<std::string> out2 = {"gap2"};
+    std::vector<int> in2 = {FEATURE_GAP0, FEATURE_GAP1};
+    std::vector<int> out2 = {FEATURE_GAP2};
     process_se_stage0(inimage, in2, out2, opt, cache);
 
-    std::vector<std::string> gap2 = {"gap2"};
+    std::vector<int> gap2 = {FEATURE_GAP2};
     process_se_sync_gap(inimage, gap2, opt, cache);
 
-    std::vector<std::string> in3 = {"gap0", "gap1", "gap2"};
-    std::vector<std::string> out3 = {"gap3"};
+    std::vector<int> in3 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2};
+    std::vector<int> out3 = {FEATURE_GAP3};
     process_se_stage0(inimage, in3, out3, opt, cache);
 
-    std::vector<std::string> gap3 = {"gap3"};
+    std::vector<int> gap3 = {FEATURE_GAP3};
     process_se_sync_gap(inimage, gap3, opt, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_stage2(inimage, in4, outimage, opt, cache);
 
+    cache.print_stats();
     cache.clear();
 
     vkdev->reclaim_blob_allocator(blob_vkallocator);
@@ -1252,18 +1149,20 @@ int RealCUGAN::process_se_rough(const ncnn::Mat& inimage, ncnn::Mat& outimage) c
     opt.workspace_vkallocator = blob_vkallocator;
     opt.staging_vkallocator = staging_vkallocator;
 
-    FeatureCache cache;
+    // a quarter of the heap budget for the per tile features, the rest goes to the host
+    FeatureCache cache((size_t)vkdev->get_heap_budget() * 1024 * 1024 / 4);
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_stage0(inimage, in0, out0, opt, cache);
 
-    std::vector<std::string> gap0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> gap0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_sync_gap(inimage, gap0, opt, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_stage2(inimage, in4, outimage, opt, cache);
 
+    cache.print_stats();
     cache.clear();
 
     vkdev->reclaim_blob_allocator(blob_vkallocator);
@@ -1282,18 +1181,20 @@ int RealCUGAN::process_se_very_rough(const ncnn::Mat& inimage, ncnn::Mat& outima
     opt.workspace_vkallocator = blob_vkallocator;
     opt.staging_vkallocator = staging_vkallocator;
 
-    FeatureCache cache;
+    // a quarter of the heap budget for the per tile features, the rest goes to the host
+    FeatureCache cache((size_t)vkdev->get_heap_budget() * 1024 * 1024 / 4);
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_very_rough_stage0(inimage, in0, out0, opt, cache);
 
-    std::vector<std::string> gap0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> gap0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_very_rough_sync_gap(inimage, gap0, opt, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_se_stage2(inimage, in4, outimage, opt, cache);
 
+    cache.print_stats();
     cache.clear();
 
     vkdev->reclaim_blob_allocator(blob_vkallocator);
@@ -1306,37 +1207,38 @@ int RealCUGAN::process_cpu_se(const ncnn::Mat& inimage, ncnn::Mat& outimage) con
 {
     FeatureCache cache;
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0};
     process_cpu_se_stage0(inimage, in0, out0, cache);
 
-    std::vector<std::string> gap0 = {"gap0"};
+    std::vector<int> gap0 = {FEATURE_GAP0};
     process_cpu_se_sync_gap(inimage, gap0, cache);
 
-    std::vector<std::string> in1 = {"gap0"};
-    std::vector<std::string> out1 = {"gap1"};
+    std::vector<int> in1 = {FEATURE_GAP0};
+    std::vector<int> out1 = {FEATURE_GAP1};
     process_cpu_se_stage0(inimage, in1, out1, cache);
 
-    std::vector<std::string> gap1 = {"gap1"};
+    std::vector<int> gap1 = {FEATURE_GAP1};
     process_cpu_se_sync_gap(inimage, gap1, cache);
 
-    std::vector<std::string> in2 = {"gap0", "gap1"};
-    std::vector<std::string> out2 = {"gap2"};
+    std::vector<int> in2 = {FEATURE_GAP0, FEATURE_GAP1};
+    std::vector<int> out2 = {FEATURE_GAP2};
     process_cpu_se_stage0(inimage, in2, out2, cache);
 
-    std::vector<std::string> gap2 = {"gap2"};
+    std::vector<int> gap2 = {FEATURE_GAP2};
     process_cpu_se_sync_gap(inimage, gap2, cache);
 
-    std::vector<std::string> in3 = {"gap0", "gap1", "gap2"};
-    std::vector<std::string> out3 = {"gap3"};
+    std::vector<int> in3 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2};
+    std::vector<int> out3 = {FEATURE_GAP3};
     process_cpu_se_stage0(inimage, in3, out3, cache);
 
-    std::vector<std::string> gap3 = {"gap3"};
+    std::vector<int> gap3 = {FEATURE_GAP3};
     process_cpu_se_sync_gap(inimage, gap3, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_stage2(inimage, in4, outimage, cache);
 
+    cache.print_stats();
     cache.clear();
 
     return 0;
@@ -1346,16 +1248,17 @@ int RealCUGAN::process_cpu_se_rough(const ncnn::Mat& inimage, ncnn::Mat& outimag
 {
     FeatureCache cache;
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_stage0(inimage, in0, out0, cache);
 
-    std::vector<std::string> gap0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> gap0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_sync_gap(inimage, gap0, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_stage2(inimage, in4, outimage, cache);
 
+    cache.print_stats();
     cache.clear();
 
     return 0;
@@ -1365,22 +1268,23 @@ int RealCUGAN::process_cpu_se_very_rough(const ncnn::Mat& inimage, ncnn::Mat& ou
 {
     FeatureCache cache;
 
-    std::vector<std::string> in0 = {};
-    std::vector<std::string> out0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in0 = {};
+    std::vector<int> out0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_very_rough_stage0(inimage, in0, out0, cache);
 
-    std::vector<std::string> gap0 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> gap0 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_very_rough_sync_gap(inimage, gap0, cache);
 
-    std::vector<std::string> in4 = {"gap0", "gap1", "gap2", "gap3"};
+    std::vector<int> in4 = {FEATURE_GAP0, FEATURE_GAP1, FEATURE_GAP2, FEATURE_GAP3};
     process_cpu_se_stage2(inimage, in4, outimage, cache);
 
+    cache.print_stats();
     cache.clear();
 
     return 0;
 }
 
-int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, const ncnn::Option& opt, FeatureCache& cache) const
+int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, const ncnn::Option& opt, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -1394,6 +1298,8 @@ int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<std
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
+    cache.reserve(xtiles, ytiles, tta_mode ? 8 : 1);
+
     const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
 
     //#pragma omp parallel for num_threads(2)
@@ -1561,20 +1467,26 @@ int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<std
 
                     ex.input("in0", in_tile_gpu[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        ex.extract(outnames[i].c_str(), feat, cmd);
+                        ex.extract(feature_slot_name(outslots[i]), feat, cmd);
 
-                        cache.save(yi, xi, ti, outnames[i], feat);
+                        if (!cache.save(yi, xi, ti, outslots[i], feat))
+                        {
+                            // over the cache budget, park it on the host until the sync gap
+                            ncnn::Mat feat_cpu;
+                            cmd.record_download(feat, feat_cpu, opt);
+                            cache.spill(yi, xi, ti, outslots[i], feat_cpu);
+                        }
                     }
                 }
             }
@@ -1635,20 +1547,26 @@ int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<std
 
                     ex.input("in0", in_tile_gpu);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        ex.extract(outnames[i].c_str(), feat, cmd);
+                        ex.extract(feature_slot_name(outslots[i]), feat, cmd);
 
-                        cache.save(yi, xi, 0, outnames[i], feat);
+                        if (!cache.save(yi, xi, 0, outslots[i], feat))
+                        {
+                            // over the cache budget, park it on the host until the sync gap
+                            ncnn::Mat feat_cpu;
+                            cmd.record_download(feat, feat_cpu, opt);
+                            cache.spill(yi, xi, 0, outslots[i], feat_cpu);
+                        }
                     }
                 }
             }
@@ -1667,7 +1585,7 @@ int RealCUGAN::process_se_stage0(const ncnn::Mat& inimage, const std::vector<std
     return 0;
 }
 
-int RealCUGAN::process_se_stage2(const ncnn::Mat& inimage, const std::vector<std::string>& names, ncnn::Mat& outimage, const ncnn::Option& opt, FeatureCache& cache) const
+int RealCUGAN::process_se_stage2(const ncnn::Mat& inimage, const std::vector<int>& slots, ncnn::Mat& outimage, const ncnn::Option& opt, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -1848,12 +1766,12 @@ int RealCUGAN::process_se_stage2(const ncnn::Mat& inimage, const std::vector<std
 
                     ex.input("in0", in_tile_gpu[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
                     ex.extract("out0", out_tile_gpu[ti], cmd);
@@ -2014,12 +1932,12 @@ int RealCUGAN::process_se_stage2(const ncnn::Mat& inimage, const std::vector<std
 
                     ex.input("in0", in_tile_gpu);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
                     ex.extract("out0", out_tile_gpu, cmd);
@@ -2157,7 +2075,7 @@ int RealCUGAN::process_se_stage2(const ncnn::Mat& inimage, const std::vector<std
     return 0;
 }
 
-int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, const ncnn::Option& opt, FeatureCache& cache) const
+int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, const ncnn::Option& opt, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -2171,30 +2089,35 @@ int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<s
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
-    std::vector< std::vector<ncnn::VkMat> > feats(names.size());
+    std::vector< std::vector<ncnn::VkMat> > feats(slots.size());
+    std::vector< std::vector<ncnn::Mat> > feats_host(slots.size());
     for (int yi = 0; yi < ytiles; yi++)
     {
         for (int xi = 0; xi < xtiles; xi++)
         {
             {
-                for (size_t i = 0; i < names.size(); i++)
+                for (size_t i = 0; i < slots.size(); i++)
                 {
                     if (tta_mode)
                     {
                         for (int ti = 0; ti < 8; ti++)
                         {
                             ncnn::VkMat feat;
-                            cache.load(yi, xi, ti, names[i], feat);
+                            ncnn::Mat feat_host;
+                            cache.take(yi, xi, ti, slots[i], feat, feat_host);
 
                             feats[i].push_back(feat);
+                            feats_host[i].push_back(feat_host);
                         }
                     }
                     else
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        ncnn::Mat feat_host;
+                        cache.take(yi, xi, 0, slots[i], feat, feat_host);
 
                         feats[i].push_back(feat);
+                        feats_host[i].push_back(feat_host);
                     }
                 }
             }
@@ -2206,14 +2129,17 @@ int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<s
     ncnn::VkCompute cmd(vkdev);
 
     // download
-    std::vector< std::vector<ncnn::Mat> > feats_cpu(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector< std::vector<ncnn::Mat> > feats_cpu(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         feats_cpu[i].resize(tiles);
 
         for (int j = 0; j < tiles; j++)
         {
-            cmd.record_download(feats[i][j], feats_cpu[i][j], opt);
+            if (feats[i][j].empty())
+                feats_cpu[i][j] = feats_host[i][j];
+            else
+                cmd.record_download(feats[i][j], feats_cpu[i][j], opt);
         }
     }
 
@@ -2222,8 +2148,8 @@ int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<s
 
     // global average
     // upload
-    std::vector<ncnn::VkMat> avgfeats(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector<ncnn::VkMat> avgfeats(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         for (int j = 0; j < tiles; j++)
         {
@@ -2272,34 +2198,15 @@ int RealCUGAN::process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<s
     cmd.submit_and_wait();
     cmd.reset();
 
-
-    for (int yi = 0; yi < ytiles; yi++)
+    for (size_t i = 0; i < slots.size(); i++)
     {
-        for (int xi = 0; xi < xtiles; xi++)
-        {
-            {
-                for (size_t i = 0; i < names.size(); i++)
-                {
-                    if (tta_mode)
-                    {
-                        for (int ti = 0; ti < 8; ti++)
-                        {
-                            cache.save(yi, xi, ti, names[i], avgfeats[i]);
-                        }
-                    }
-                    else
-                    {
-                        cache.save(yi, xi, 0, names[i], avgfeats[i]);
-                    }
-                }
-            }
-        }
+        cache.save_synced(slots[i], avgfeats[i]);
     }
 
     return 0;
 }
 
-int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, const ncnn::Option& opt, FeatureCache& cache) const
+int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, const ncnn::Option& opt, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -2313,6 +2220,8 @@ int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std:
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
+    cache.reserve(xtiles, ytiles, tta_mode ? 8 : 1);
+
     const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
 
     //#pragma omp parallel for num_threads(2)
@@ -2480,20 +2389,26 @@ int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std:
 
                     ex.input("in0", in_tile_gpu[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        ex.extract(outnames[i].c_str(), feat, cmd);
+                        ex.extract(feature_slot_name(outslots[i]), feat, cmd);
 
-                        cache.save(yi, xi, ti, outnames[i], feat);
+                        if (!cache.save(yi, xi, ti, outslots[i], feat))
+                        {
+                            // over the cache budget, park it on the host until the sync gap
+                            ncnn::Mat feat_cpu;
+                            cmd.record_download(feat, feat_cpu, opt);
+                            cache.spill(yi, xi, ti, outslots[i], feat_cpu);
+                        }
                     }
                 }
             }
@@ -2554,20 +2469,26 @@ int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std:
 
                     ex.input("in0", in_tile_gpu);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::VkMat feat;
-                        ex.extract(outnames[i].c_str(), feat, cmd);
+                        ex.extract(feature_slot_name(outslots[i]), feat, cmd);
 
-                        cache.save(yi, xi, 0, outnames[i], feat);
+                        if (!cache.save(yi, xi, 0, outslots[i], feat))
+                        {
+                            // over the cache budget, park it on the host until the sync gap
+                            ncnn::Mat feat_cpu;
+                            cmd.record_download(feat, feat_cpu, opt);
+                            cache.spill(yi, xi, 0, outslots[i], feat_cpu);
+                        }
                     }
                 }
             }
@@ -2586,7 +2507,7 @@ int RealCUGAN::process_se_very_rough_stage0(const ncnn::Mat& inimage, const std:
     return 0;
 }
 
-int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, const ncnn::Option& opt, FeatureCache& cache) const
+int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, const ncnn::Option& opt, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -2600,30 +2521,35 @@ int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const st
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
-    std::vector< std::vector<ncnn::VkMat> > feats(names.size());
+    std::vector< std::vector<ncnn::VkMat> > feats(slots.size());
+    std::vector< std::vector<ncnn::Mat> > feats_host(slots.size());
     for (int yi = 0; yi + 2 < ytiles; yi += 3)
     {
         for (int xi = 0; xi + 2 < xtiles; xi += 3)
         {
             {
-                for (size_t i = 0; i < names.size(); i++)
+                for (size_t i = 0; i < slots.size(); i++)
                 {
                     if (tta_mode)
                     {
                         for (int ti = 0; ti < 8; ti++)
                         {
                             ncnn::VkMat feat;
-                            cache.load(yi, xi, ti, names[i], feat);
+                            ncnn::Mat feat_host;
+                            cache.take(yi, xi, ti, slots[i], feat, feat_host);
 
                             feats[i].push_back(feat);
+                            feats_host[i].push_back(feat_host);
                         }
                     }
                     else
                     {
                         ncnn::VkMat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        ncnn::Mat feat_host;
+                        cache.take(yi, xi, 0, slots[i], feat, feat_host);
 
                         feats[i].push_back(feat);
+                        feats_host[i].push_back(feat_host);
                     }
                 }
             }
@@ -2635,14 +2561,17 @@ int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const st
     ncnn::VkCompute cmd(vkdev);
 
     // download
-    std::vector< std::vector<ncnn::Mat> > feats_cpu(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector< std::vector<ncnn::Mat> > feats_cpu(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         feats_cpu[i].resize(tiles);
 
         for (int j = 0; j < tiles; j++)
         {
-            cmd.record_download(feats[i][j], feats_cpu[i][j], opt);
+            if (feats[i][j].empty())
+                feats_cpu[i][j] = feats_host[i][j];
+            else
+                cmd.record_download(feats[i][j], feats_cpu[i][j], opt);
         }
     }
 
@@ -2651,8 +2580,8 @@ int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const st
 
     // global average
     // upload
-    std::vector<ncnn::VkMat> avgfeats(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector<ncnn::VkMat> avgfeats(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         for (int j = 0; j < tiles; j++)
         {
@@ -2701,50 +2630,15 @@ int RealCUGAN::process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const st
     cmd.submit_and_wait();
     cmd.reset();
 
-
-    for (int yi = 0; yi + 2 < ytiles; yi += 3)
+    for (size_t i = 0; i < slots.size(); i++)
     {
-        for (int xi = 0; xi + 2 < xtiles; xi += 3)
-        {
-            {
-                for (size_t i = 0; i < names.size(); i++)
-                {
-                    if (tta_mode)
-                    {
-                        for (int ti = 0; ti < 8; ti++)
-                        {
-                            cache.save(yi, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi, xi + 2, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi + 2, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi + 2, ti, names[i], avgfeats[i]);
-                        }
-                    }
-                    else
-                    {
-                        cache.save(yi, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi, xi + 2, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi + 2, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi + 2, 0, names[i], avgfeats[i]);
-                    }
-                }
-            }
-        }
+        cache.save_synced(slots[i], avgfeats[i]);
     }
 
     return 0;
 }
 
-int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, FeatureCache& cache) const
+int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -2760,6 +2654,8 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
+    cache.reserve(xtiles, ytiles, tta_mode ? 8 : 1);
+
     for (int yi = 0; yi < ytiles; yi++)
     {
         const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
@@ -2829,13 +2725,7 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
                         const float* ptr = in.channel(q);
                         float* outptr0 = in_tile[0].channel(q);
 
-                        for (int i = 0; i < in.h; i++)
-                        {
-                            for (int j = 0; j < in.w; j++)
-                            {
-                                *outptr0++ = *ptr++ * (1 / 255.f);
-                            }
-                        }
+                        tile_scale(ptr, outptr0, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -2863,53 +2753,7 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
                 }
 
                 // the other 7 directions
-                {
-                    in_tile[1].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[2].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[3].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[4].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[5].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[6].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[7].create(in_tile[0].h, in_tile[0].w, 3);
-
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
-                        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
-                        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
-                        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
-                        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
-                        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
-                        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
-                        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
-
-                        for (int i = 0; i < in_tile[0].h; i++)
-                        {
-                            const float* outptr0 = in_tile_0.row(i);
-                            float* outptr1 = in_tile_1.row(in_tile[0].h - 1 - i);
-                            float* outptr2 = in_tile_2.row(i) + in_tile[0].w - 1;
-                            float* outptr3 = in_tile_3.row(in_tile[0].h - 1 - i) + in_tile[0].w - 1;
-
-                            for (int j = 0; j < in_tile[0].w; j++)
-                            {
-                                float* outptr4 = in_tile_4.row(j) + i;
-                                float* outptr5 = in_tile_5.row(in_tile[0].w - 1 - j) + i;
-                                float* outptr6 = in_tile_6.row(j) + in_tile[0].h - 1 - i;
-                                float* outptr7 = in_tile_7.row(in_tile[0].w - 1 - j) + in_tile[0].h - 1 - i;
-
-                                float v = *outptr0++;
-
-                                *outptr1++ = v;
-                                *outptr2-- = v;
-                                *outptr3-- = v;
-                                *outptr4 = v;
-                                *outptr5 = v;
-                                *outptr6 = v;
-                                *outptr7 = v;
-                            }
-                        }
-                    }
-                }
+                tta_expand_8(in_tile);
 
                 // realcugan
                 ncnn::Mat out_tile[8];
@@ -2919,20 +2763,20 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
 
                     ex.input("in0", in_tile[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        ex.extract(outnames[i].c_str(), feat);
+                        ex.extract(feature_slot_name(outslots[i]), feat);
 
-                        cache.save(yi, xi, ti, outnames[i], feat);
+                        cache.save(yi, xi, ti, outslots[i], feat);
                     }
                 }
             }
@@ -2948,10 +2792,7 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
                         const float* ptr = in.channel(q);
                         float* outptr = in_tile.channel(q);
 
-                        for (int i = 0; i < in.w * in.h; i++)
-                        {
-                            *outptr++ = *ptr++ * (1 / 255.f);
-                        }
+                        tile_scale(ptr, outptr, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -2983,20 +2824,20 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
 
                     ex.input("in0", in_tile);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        ex.extract(outnames[i].c_str(), feat);
+                        ex.extract(feature_slot_name(outslots[i]), feat);
 
-                        cache.save(yi, xi, 0, outnames[i], feat);
+                        cache.save(yi, xi, 0, outslots[i], feat);
                     }
                 }
             }
@@ -3006,7 +2847,7 @@ int RealCUGAN::process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector
     return 0;
 }
 
-int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector<std::string>& names, ncnn::Mat& outimage, FeatureCache& cache) const
+int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector<int>& slots, ncnn::Mat& outimage, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -3091,13 +2932,7 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
                         const float* ptr = in.channel(q);
                         float* outptr0 = in_tile[0].channel(q);
 
-                        for (int i = 0; i < in.h; i++)
-                        {
-                            for (int j = 0; j < in.w; j++)
-                            {
-                                *outptr0++ = *ptr++ * (1 / 255.f);
-                            }
-                        }
+                        tile_scale(ptr, outptr0, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -3125,53 +2960,7 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
                 }
 
                 // the other 7 directions
-                {
-                    in_tile[1].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[2].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[3].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[4].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[5].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[6].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[7].create(in_tile[0].h, in_tile[0].w, 3);
-
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
-                        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
-                        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
-                        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
-                        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
-                        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
-                        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
-                        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
-
-                        for (int i = 0; i < in_tile[0].h; i++)
-                        {
-                            const float* outptr0 = in_tile_0.row(i);
-                            float* outptr1 = in_tile_1.row(in_tile[0].h - 1 - i);
-                            float* outptr2 = in_tile_2.row(i) + in_tile[0].w - 1;
-                            float* outptr3 = in_tile_3.row(in_tile[0].h - 1 - i) + in_tile[0].w - 1;
-
-                            for (int j = 0; j < in_tile[0].w; j++)
-                            {
-                                float* outptr4 = in_tile_4.row(j) + i;
-                                float* outptr5 = in_tile_5.row(in_tile[0].w - 1 - j) + i;
-                                float* outptr6 = in_tile_6.row(j) + in_tile[0].h - 1 - i;
-                                float* outptr7 = in_tile_7.row(in_tile[0].w - 1 - j) + in_tile[0].h - 1 - i;
-
-                                float v = *outptr0++;
-
-                                *outptr1++ = v;
-                                *outptr2-- = v;
-                                *outptr3-- = v;
-                                *outptr4 = v;
-                                *outptr5 = v;
-                                *outptr6 = v;
-                                *outptr7 = v;
-                            }
-                        }
-                    }
-                }
+                tta_expand_8(in_tile);
 
                 // realcugan
                 ncnn::Mat out_tile[8];
@@ -3181,12 +2970,12 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
 
                     ex.input("in0", in_tile[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
                     ex.extract("out0", out_tile[ti]);
@@ -3216,76 +3005,10 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
                 // postproc and merge alpha
                 {
                     out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
+                    tta_merge_8(out_tile, out, 0, 255.f, 0.5f);
                     if (scale == 4)
                     {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
-                            const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
-                            const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
-                            const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
-                            const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
-                            const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
-                            const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
-                            const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* inptr = in_tile[0].channel(q).row(prepadding + i / 4) + prepadding;
-                                const float* ptr0 = out_tile_0.row(i);
-                                const float* ptr1 = out_tile_1.row(out_tile[0].h - 1 - i);
-                                const float* ptr2 = out_tile_2.row(i) + out_tile[0].w - 1;
-                                const float* ptr3 = out_tile_3.row(out_tile[0].h - 1 - i) + out_tile[0].w - 1;
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    const float* ptr4 = out_tile_4.row(j) + i;
-                                    const float* ptr5 = out_tile_5.row(out_tile[0].w - 1 - j) + i;
-                                    const float* ptr6 = out_tile_6.row(j) + out_tile[0].h - 1 - i;
-                                    const float* ptr7 = out_tile_7.row(out_tile[0].w - 1 - j) + out_tile[0].h - 1 - i;
-
-                                    float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-
-                                    *outptr++ = v * 255.f + 0.5f + inptr[j / 4] * 255.f;
-                                }
-                            }
-                        }
-                    }
-                    else
-                    {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
-                            const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
-                            const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
-                            const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
-                            const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
-                            const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
-                            const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
-                            const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* ptr0 = out_tile_0.row(i);
-                                const float* ptr1 = out_tile_1.row(out_tile[0].h - 1 - i);
-                                const float* ptr2 = out_tile_2.row(i) + out_tile[0].w - 1;
-                                const float* ptr3 = out_tile_3.row(out_tile[0].h - 1 - i) + out_tile[0].w - 1;
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    const float* ptr4 = out_tile_4.row(j) + i;
-                                    const float* ptr5 = out_tile_5.row(out_tile[0].w - 1 - j) + i;
-                                    const float* ptr6 = out_tile_6.row(j) + out_tile[0].h - 1 - i;
-                                    const float* ptr7 = out_tile_7.row(out_tile[0].w - 1 - j) + out_tile[0].h - 1 - i;
-
-                                    float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-
-                                    *outptr++ = v * 255.f + 0.5f;
-                                }
-                            }
-                        }
+                        merge_residual_4x(in_tile[0], out, prepadding);
                     }
 
                     if (channels == 4)
@@ -3306,10 +3029,7 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
                         const float* ptr = in.channel(q);
                         float* outptr = in_tile.channel(q);
 
-                        for (int i = 0; i < in.w * in.h; i++)
-                        {
-                            *outptr++ = *ptr++ * (1 / 255.f);
-                        }
+                        tile_scale(ptr, outptr, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -3343,12 +3063,12 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
 
                     ex.input("in0", in_tile);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
                     ex.extract("out0", out_tile);
@@ -3378,40 +3098,21 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
                 // postproc and merge alpha
                 {
                     out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
-                    if (scale == 4)
+                    for (int q = 0; q < 3; q++)
                     {
-                        for (int q = 0; q < 3; q++)
+                        float* outptr = out.channel(q);
+
+                        for (int i = 0; i < out.h; i++)
                         {
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* inptr = in_tile.channel(q).row(prepadding + i / 4) + prepadding;
-                                const float* ptr = out_tile.channel(q).row(i);
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    *outptr++ = *ptr++ * 255.f + 0.5f + inptr[j / 4] * 255.f;
-                                }
-                            }
+                            const float* ptr = out_tile.channel(q).row(i);
+
+                            tile_scale_bias(ptr, outptr, out.w, 255.f, 0.5f);
+                            outptr += out.w;
                         }
                     }
-                    else
+                    if (scale == 4)
                     {
-                        for (int q = 0; q < 3; q++)
-                        {
-                            float* outptr = out.channel(q);
-
-                            for (int i = 0; i < out.h; i++)
-                            {
-                                const float* ptr = out_tile.channel(q).row(i);
-
-                                for (int j = 0; j < out.w; j++)
-                                {
-                                    *outptr++ = *ptr++ * 255.f + 0.5f;
-                                }
-                            }
-                        }
+                        merge_residual_4x(in_tile, out, prepadding);
                     }
 
                     if (channels == 4)
@@ -3448,7 +3149,7 @@ int RealCUGAN::process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector
     return 0;
 }
 
-int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, FeatureCache& cache) const
+int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -3464,20 +3165,20 @@ int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vect
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
-    std::vector< std::vector<ncnn::Mat> > feats(names.size());
+    std::vector< std::vector<ncnn::Mat> > feats(slots.size());
     for (int yi = 0; yi < ytiles; yi++)
     {
         for (int xi = 0; xi < xtiles; xi++)
         {
             {
-                for (size_t i = 0; i < names.size(); i++)
+                for (size_t i = 0; i < slots.size(); i++)
                 {
                     if (tta_mode)
                     {
                         for (int ti = 0; ti < 8; ti++)
                         {
                             ncnn::Mat feat;
-                            cache.load(yi, xi, ti, names[i], feat);
+                            cache.take(yi, xi, ti, slots[i], feat);
 
                             feats[i].push_back(feat);
                         }
@@ -3485,7 +3186,7 @@ int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vect
                     else
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.take(yi, xi, 0, slots[i], feat);
 
                         feats[i].push_back(feat);
                     }
@@ -3497,8 +3198,8 @@ int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vect
     const int tiles = ytiles * xtiles * (tta_mode ? 8 : 1);
 
     // global average
-    std::vector<ncnn::Mat> avgfeats(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector<ncnn::Mat> avgfeats(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         // handle feats[i] vector
         {
@@ -3526,34 +3227,15 @@ int RealCUGAN::process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vect
             avgfeats[i] = avgfeat;
         }
     }
-
-    for (int yi = 0; yi < ytiles; yi++)
+    for (size_t i = 0; i < slots.size(); i++)
     {
-        for (int xi = 0; xi < xtiles; xi++)
-        {
-            {
-                for (size_t i = 0; i < names.size(); i++)
-                {
-                    if (tta_mode)
-                    {
-                        for (int ti = 0; ti < 8; ti++)
-                        {
-                            cache.save(yi, xi, ti, names[i], avgfeats[i]);
-                        }
-                    }
-                    else
-                    {
-                        cache.save(yi, xi, 0, names[i], avgfeats[i]);
-                    }
-                }
-            }
-        }
+        cache.save_synced(slots[i], avgfeats[i]);
     }
 
     return 0;
 }
 
-int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, FeatureCache& cache) const
+int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -3569,6 +3251,8 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
+    cache.reserve(xtiles, ytiles, tta_mode ? 8 : 1);
+
     for (int yi = 0; yi + 2 < ytiles; yi += 3)
     {
         const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
@@ -3638,13 +3322,7 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
                         const float* ptr = in.channel(q);
                         float* outptr0 = in_tile[0].channel(q);
 
-                        for (int i = 0; i < in.h; i++)
-                        {
-                            for (int j = 0; j < in.w; j++)
-                            {
-                                *outptr0++ = *ptr++ * (1 / 255.f);
-                            }
-                        }
+                        tile_scale(ptr, outptr0, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -3672,53 +3350,7 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
                 }
 
                 // the other 7 directions
-                {
-                    in_tile[1].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[2].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[3].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[4].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[5].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[6].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[7].create(in_tile[0].h, in_tile[0].w, 3);
-
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
-                        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
-                        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
-                        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
-                        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
-                        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
-                        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
-                        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
-
-                        for (int i = 0; i < in_tile[0].h; i++)
-                        {
-                            const float* outptr0 = in_tile_0.row(i);
-                            float* outptr1 = in_tile_1.row(in_tile[0].h - 1 - i);
-                            float* outptr2 = in_tile_2.row(i) + in_tile[0].w - 1;
-                            float* outptr3 = in_tile_3.row(in_tile[0].h - 1 - i) + in_tile[0].w - 1;
-
-                            for (int j = 0; j < in_tile[0].w; j++)
-                            {
-                                float* outptr4 = in_tile_4.row(j) + i;
-                                float* outptr5 = in_tile_5.row(in_tile[0].w - 1 - j) + i;
-                                float* outptr6 = in_tile_6.row(j) + in_tile[0].h - 1 - i;
-                                float* outptr7 = in_tile_7.row(in_tile[0].w - 1 - j) + in_tile[0].h - 1 - i;
-
-                                float v = *outptr0++;
-
-                                *outptr1++ = v;
-                                *outptr2-- = v;
-                                *outptr3-- = v;
-                                *outptr4 = v;
-                                *outptr5 = v;
-                                *outptr6 = v;
-                                *outptr7 = v;
-                            }
-                        }
-                    }
-                }
+                tta_expand_8(in_tile);
 
                 // realcugan
                 ncnn::Mat out_tile[8];
@@ -3728,20 +3360,20 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
 
                     ex.input("in0", in_tile[ti]);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, ti, names[i], feat);
+                        cache.load(yi, xi, ti, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        ex.extract(outnames[i].c_str(), feat);
+                        ex.extract(feature_slot_name(outslots[i]), feat);
 
-                        cache.save(yi, xi, ti, outnames[i], feat);
+                        cache.save(yi, xi, ti, outslots[i], feat);
                     }
                 }
             }
@@ -3757,10 +3389,7 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
                         const float* ptr = in.channel(q);
                         float* outptr = in_tile.channel(q);
 
-                        for (int i = 0; i < in.w * in.h; i++)
-                        {
-                            *outptr++ = *ptr++ * (1 / 255.f);
-                        }
+                        tile_scale(ptr, outptr, in.w * in.h, 1 / 255.f);
                     }
 
                     if (channels == 4)
@@ -3792,20 +3421,20 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
 
                     ex.input("in0", in_tile);
 
-                    for (size_t i = 0; i < names.size(); i++)
+                    for (size_t i = 0; i < slots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.load(yi, xi, 0, slots[i], feat);
 
-                        ex.input(names[i].c_str(), feat);
+                        ex.input(feature_slot_name(slots[i]), feat);
                     }
 
-                    for (size_t i = 0; i < outnames.size(); i++)
+                    for (size_t i = 0; i < outslots.size(); i++)
                     {
                         ncnn::Mat feat;
-                        ex.extract(outnames[i].c_str(), feat);
+                        ex.extract(feature_slot_name(outslots[i]), feat);
 
-                        cache.save(yi, xi, 0, outnames[i], feat);
+                        cache.save(yi, xi, 0, outslots[i], feat);
                     }
                 }
             }
@@ -3815,7 +3444,7 @@ int RealCUGAN::process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const
     return 0;
 }
 
-int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, FeatureCache& cache) const
+int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, FeatureCache& cache) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -3831,20 +3460,20 @@ int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, cons
     const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
     const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
 
-    std::vector< std::vector<ncnn::Mat> > feats(names.size());
+    std::vector< std::vector<ncnn::Mat> > feats(slots.size());
     for (int yi = 0; yi + 2 < ytiles; yi += 3)
     {
         for (int xi = 0; xi + 2 < xtiles; xi += 3)
         {
             {
-                for (size_t i = 0; i < names.size(); i++)
+                for (size_t i = 0; i < slots.size(); i++)
                 {
                     if (tta_mode)
                     {
                         for (int ti = 0; ti < 8; ti++)
                         {
                             ncnn::Mat feat;
-                            cache.load(yi, xi, ti, names[i], feat);
+                            cache.take(yi, xi, ti, slots[i], feat);
 
                             feats[i].push_back(feat);
                         }
@@ -3852,7 +3481,7 @@ int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, cons
                     else
                     {
                         ncnn::Mat feat;
-                        cache.load(yi, xi, 0, names[i], feat);
+                        cache.take(yi, xi, 0, slots[i], feat);
 
                         feats[i].push_back(feat);
                     }
@@ -3864,8 +3493,8 @@ int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, cons
     const int tiles = (ytiles / 3) * (xtiles / 3) * (tta_mode ? 8 : 1);
 
     // global average
-    std::vector<ncnn::Mat> avgfeats(names.size());
-    for (size_t i = 0; i < names.size(); i++)
+    std::vector<ncnn::Mat> avgfeats(slots.size());
+    for (size_t i = 0; i < slots.size(); i++)
     {
         // handle feats[i] vector
         {
@@ -3893,44 +3522,9 @@ int RealCUGAN::process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, cons
             avgfeats[i] = avgfeat;
         }
     }
-
-    for (int yi = 0; yi + 2 < ytiles; yi += 3)
+    for (size_t i = 0; i < slots.size(); i++)
     {
-        for (int xi = 0; xi + 2 < xtiles; xi += 3)
-        {
-            {
-                for (size_t i = 0; i < names.size(); i++)
-                {
-                    if (tta_mode)
-                    {
-                        for (int ti = 0; ti < 8; ti++)
-                        {
-                            cache.save(yi, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi, xi + 2, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 1, xi + 2, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi + 1, ti, names[i], avgfeats[i]);
-                            cache.save(yi + 2, xi + 2, ti, names[i], avgfeats[i]);
-                        }
-                    }
-                    else
-                    {
-                        cache.save(yi, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi, xi + 2, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 1, xi + 2, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi + 1, 0, names[i], avgfeats[i]);
-                        cache.save(yi + 2, xi + 2, 0, names[i], avgfeats[i]);
-                    }
-                }
-            }
-        }
+        cache.save_synced(slots[i], avgfeats[i]);
     }
 
     return 0;
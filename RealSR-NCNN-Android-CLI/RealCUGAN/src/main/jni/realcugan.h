@@ -10,9 +10,24 @@
 #include "gpu.h"
 #include "layer.h"
 
+#include "tiled_upscaler.h"
+
 class FeatureCache;
-class RealCUGAN
+
+// se feature blobs handed between the syncgap stages
+enum FeatureSlot
+{
+    FEATURE_GAP0 = 0,
+    FEATURE_GAP1,
+    FEATURE_GAP2,
+    FEATURE_GAP3,
+    FEATURE_SLOT_COUNT
+};
+
+class RealCUGAN : public TiledUpscaler<RealCUGAN>
 {
+    friend class TiledUpscaler<RealCUGAN>;
+
 public:
     RealCUGAN(int gpuid, bool tta_mode = false, int num_threads = 1);
     ~RealCUGAN();
@@ -23,9 +38,14 @@ public:
     int load(const std::string& parampath, const std::string& modelpath);
 #endif
 
-    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    // with a writer the output rows are encoded as they finish and outimage stays empty,
+    // except in the syncgap modes, those need every tile before the first row is final
+    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
 
-    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+    // -G, the tile rows of one image split across the engines of several devices
+    static int process_shared(const std::vector<const RealCUGAN*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage);
 
     int process_se(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
 
@@ -40,19 +60,27 @@ public:
     int process_cpu_se_very_rough(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
 
 protected:
-    int process_se_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, const ncnn::Option& opt, FeatureCache& cache) const;
-    int process_se_stage2(const ncnn::Mat& inimage, const std::vector<std::string>& names, ncnn::Mat& outimage, const ncnn::Option& opt, FeatureCache& cache) const;
-    int process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, const ncnn::Option& opt, FeatureCache& cache) const;
+    int process_se_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, const ncnn::Option& opt, FeatureCache& cache) const;
+    int process_se_stage2(const ncnn::Mat& inimage, const std::vector<int>& slots, ncnn::Mat& outimage, const ncnn::Option& opt, FeatureCache& cache) const;
+    int process_se_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, const ncnn::Option& opt, FeatureCache& cache) const;
+
+    int process_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, const ncnn::Option& opt, FeatureCache& cache) const;
+    int process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, const ncnn::Option& opt, FeatureCache& cache) const;
+
+    int process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, FeatureCache& cache) const;
+    int process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector<int>& slots, ncnn::Mat& outimage, FeatureCache& cache) const;
+    int process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, FeatureCache& cache) const;
 
-    int process_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, const ncnn::Option& opt, FeatureCache& cache) const;
-    int process_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, const ncnn::Option& opt, FeatureCache& cache) const;
+    int process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<int>& slots, const std::vector<int>& outslots, FeatureCache& cache) const;
+    int process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<int>& slots, FeatureCache& cache) const;
+
+private:
+    // TiledUpscaler hooks
+    void band_input_rows(const TileGrid& grid, int yi, int& y0, int& y1, int& standard_h) const;
 
-    int process_cpu_se_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, FeatureCache& cache) const;
-    int process_cpu_se_stage2(const ncnn::Mat& inimage, const std::vector<std::string>& names, ncnn::Mat& outimage, FeatureCache& cache) const;
-    int process_cpu_se_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, FeatureCache& cache) const;
+    void process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
-    int process_cpu_se_very_rough_stage0(const ncnn::Mat& inimage, const std::vector<std::string>& names, const std::vector<std::string>& outnames, FeatureCache& cache) const;
-    int process_cpu_se_very_rough_sync_gap(const ncnn::Mat& inimage, const std::vector<std::string>& names, FeatureCache& cache) const;
+    int process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
 public:
     // realcugan parameters
@@ -2,7 +2,7 @@
 
 #include <stdio.h>
 #include <algorithm>
-#include <queue>
+#include <atomic>
 #include <vector>
 #include <clocale>
 
@@ -108,7 +108,16 @@ static std::vector<int> parse_optarg_int_array(const char *optarg) {
 #include "realsr.h"
 
 #include "filesystem_utils.h"
+#include "anim_image.h"
 #include "image_processor.h"
+#include "task_queue.h"
+#include "memory_budget.h"
+#include "result_cache.h"
+#include "stream_writer.h"
+#include "serve_mode.h"
+#include "bench_mode.h"
+#include "tile_autotune.h"
+#include "spirv_cache.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/hal/interface.h>
 #include "utils.hpp"
@@ -123,16 +132,27 @@ static void print_usage() {
     fprintf(stderr, "  -s scale             upscale ratio (2/4, default=4)\n");
     fprintf(stderr,
             "  -t tile-size         tile size (>=32/0=auto, default=0) can be 0,0,0 for multi-gpu\n");
+    fprintf(stderr,
+            "  -t auto-bench        time tile sizes up to the auto size once per device/model/scale, cached in the model dir\n");
     fprintf(stderr, "  -m model-path        realsr model path (default=models-DF2K_JPEG)\n");
     fprintf(stderr,
             "  -g gpu-id            gpu device to use (-1=cpu, default=auto) can be 0,1,2 for multi-gpu\n");
     fprintf(stderr,
             "  -j load:proc:save    thread count for load/proc/save (default=1:2:2) can be 1:2,2,2:2 for multi-gpu\n");
     fprintf(stderr, "  -x                   enable tta mode\n");
+    fprintf(stderr, "  -F range             skip the model on tiles within range levels per channel (0=one colour) or fully transparent, bilinear fill (default=-1=off)\n");
+    fprintf(stderr, "  -D cache-size        reuse the output of tiles identical to earlier ones, LRU cache size e.g. 256M (default=0=off)\n");
+    fprintf(stderr, "  -T tolerance         frame sequences only re-run tiles changed by more than tolerance levels since the previous frame (0=exact, default=-1=off)\n");
+    fprintf(stderr, "  -R cache-dir         reuse the results of identical inputs with the same model and settings from cache-dir\n");
     fprintf(stderr, "  -f format            force output format (ignore alpha channel detection)\n");
     fprintf(stderr, "  -e format            suggested output format (auto-convert to png if alpha detected)\n");
     fprintf(stderr, "  -k skip-size         skip if output file exists and size >= threshold bytes (0=disable)\n");
     fprintf(stderr, "  -p pattern           output name pattern for batch mode, placeholders: {name} {prog} {index} {timestamp} {datetime} {date} {time}\n");
+    fprintf(stderr, "  -M memory-budget     max memory for images in flight, e.g. 2G/512M (0=unlimited, default=0)\n");
+    fprintf(stderr, "  -S                   stream png/tiff/bmp output to disk by tile rows, the full result is never held in memory (images without alpha)\n");
+    fprintf(stderr, "  -G                   share the tiles of each image across all -g devices, one image at a time with the smallest tile-size\n");
+    fprintf(stderr, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
+    fprintf(stderr, "  --serve[=socket]     keep models loaded and take json jobs per line from stdin or a unix socket, see serve_mode.h\n");
 //    fprintf(stderr, "  -c check             check output image match input image\n");
 }
 
@@ -149,52 +169,45 @@ public:
     ncnn::Mat inimage;
     ncnn::Mat outimage;
     ncnn::Mat inalpha;
-    ncnn::Mat in;
-};
-
-class TaskQueue {
-public:
-    TaskQueue() {
-    }
 
-    void put(const Task &v) {
-        lock.lock();
-
-        while (tasks.size() >= 8) // FIXME hardcode queue length
-        {
-            condition.wait(lock);
-        }
+    // frame of a gif or animated webp, the writer collects all frames of the file
+    std::shared_ptr<AnimWriter> anim;
+    int frame;
+    ncnn::Mat in;
 
-        tasks.push(v);
+    // footprint reserved from the memory budget at load time
+    size_t budget_bytes;
 
-        lock.unlock();
+    // encode the result by tile rows in the proc stage instead of saving outimage,
+    // the file is opened at load time so the budget knows whether outimage is needed
+    bool stream;
+    std::shared_ptr<StreamImageWriter> writer;
+    int stream_success;
 
-        condition.signal();
+    size_t bytes() const {
+        return inimage.total() * inimage.elemsize + outimage.total() * outimage.elemsize + inalpha.total() * inalpha.elemsize + in.total() * in.elemsize;
     }
+};
 
-    void get(Task &v) {
-        lock.lock();
-
-        while (tasks.size() == 0) {
-            condition.wait(lock);
-        }
-
-        v = tasks.front();
-        tasks.pop();
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
+MemoryBudget budget;
 
-        lock.unlock();
+// estimate everything a task holds until it is saved: input pixels, upscaled output,
+// alpha plus its upscaled copy and the merged rgba image, and the float copy for -c.
+// a streamed task only holds one output tile row at a time, which is left out
+static size_t estimate_task_bytes(int w, int h, int c, int scale, bool has_alpha, bool check, bool stream) {
+    const size_t in_size = (size_t) w * h;
+    const size_t out_size = in_size * scale * scale;
 
-        condition.signal();
-    }
+    size_t bytes = in_size * c + (stream ? 0 : out_size * c);
+    if (has_alpha)
+        bytes += in_size + out_size * 5;
+    if (check)
+        bytes += in_size * 3 * sizeof(float);
 
-private:
-    ncnn::Mutex lock;
-    ncnn::ConditionVariable condition;
-    std::queue<Task> tasks;
-};
-
-TaskQueue toproc;
-TaskQueue tosave;
+    return bytes;
+}
 
 class LoadThreadParams {
 public:
@@ -202,14 +215,17 @@ public:
     path_t output_format;
     int jobs_load;
     int check_threshold;
+    int stream_output;
 
     // session data
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+
+    std::atomic<int> decode_failed;
 };
 
 void *load(void *args) {
-    const LoadThreadParams *ltp = (const LoadThreadParams *) args;
+    LoadThreadParams *ltp = (LoadThreadParams *) args;
     const int count = ltp->input_files.size();
     const int scale = ltp->scale;
     const bool check = ltp->check_threshold > 0;
@@ -218,75 +234,107 @@ void *load(void *args) {
     for (int i = 0; i < count; i++) {
         const path_t &imagepath = ltp->input_files[i];
 
+        // gif and animated webp give one task per frame
+        FrameSource source(imagepath, ltp->output_files[i], &budget);
+
         cv::Mat inBGR, inAlpha;
-        imread(imagepath, inBGR, inAlpha);
-
-        if (!inBGR.empty()) {
-            Task v;
-            v.id = i;
-            v.inpath = imagepath;
-            v.outpath = ltp->output_files[i];
-            v.has_alpha = !inAlpha.empty();
-            v.scale = scale;
-
-            path_t ext = get_file_extension(v.outpath);
-            if (v.has_alpha && ltp->output_format.empty())
-            {
-                if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") ||
-                    ext == PATHSTR("JPEG")) {
-                    path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
-                    v.outpath = output_filename2;
+        while (source.next(inBGR, inAlpha)) {
+            if (!inBGR.empty()) {
+                // an animation its format can not hold is given up before any frame runs
+                if (source.writer && !source.writer->check_size(inBGR.cols * scale, inBGR.rows * scale)) {
+                    ltp->decode_failed++;
+                    break;
+                }
+
+                Task v;
+                v.id = i;
+                v.inpath = imagepath;
+                v.outpath = ltp->output_files[i];
+                v.anim = source.writer;
+                v.frame = source.frame;
+                v.has_alpha = !inAlpha.empty();
+                v.scale = scale;
+                v.stream = false;
+                v.stream_success = 0;
+
+                path_t ext = get_file_extension(v.outpath);
+                if (v.has_alpha && ltp->output_format.empty())
+                {
+                    if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") ||
+                        ext == PATHSTR("JPEG")) {
+                        path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
+                        v.outpath = output_filename2;
 #if _WIN32
-                    fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #else // _WIN32
-                    fprintf(stderr, "image %s has alpha channel ! %s will output %s\n",
-                            imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fprintf(stderr, "image %s has alpha channel ! %s will output %s\n",
+                                imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #endif // _WIN32
+                    }
+
+                    int w = inBGR.cols;
+                    int h = inBGR.rows;
+
+                    v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
+                    if (inAlpha.data)
+                    {
+                        memcpy(v.inalpha.data, inAlpha.data, w * h);
+                    }
                 }
 
                 int w = inBGR.cols;
                 int h = inBGR.rows;
+                int c = inBGR.channels();
 
-                v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
-                if (inAlpha.data)
-                {
-                    memcpy(v.inalpha.data, inAlpha.data, w * h);
+                // alpha is merged and -c compares the whole result in the save stage, both need outimage
+                v.stream = ltp->stream_output && !v.anim && !v.has_alpha && !check && is_stream_encode_format(get_file_extension(v.outpath));
+                if (v.stream) {
+#if _WIN32
+                    const bool bgr = true;
+#else
+                    const bool bgr = false;
+#endif
+                    v.writer.reset(new StreamImageWriter);
+                    v.stream = v.writer->open(v.outpath, w * scale, h * scale, c, bgr);
+                    if (!v.stream)
+                        v.writer.reset();
                 }
-            }
 
-            int w = inBGR.cols;
-            int h = inBGR.rows;
-            int c = inBGR.channels();
+                // block until enough of the budget is freed by the save stage,
+                // the output buffer itself is only allocated by the proc stage
+                v.budget_bytes = estimate_task_bytes(w, h, c, scale, v.has_alpha, check, v.stream);
+                budget.acquire(v.budget_bytes);
 
-            unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
-            memcpy(pixeldata, inBGR.data, w * h * c);
+                unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
+                memcpy(pixeldata, inBGR.data, w * h * c);
 
 #ifndef _WIN32
-            for (int j = 0; j < w * h * c; j += c)
-            {
-                std::swap(pixeldata[j], pixeldata[j + 2]);
-            }
+                for (int j = 0; j < w * h * c; j += c)
+                {
+                    std::swap(pixeldata[j], pixeldata[j + 2]);
+                }
 #endif
 
-            v.inimage = ncnn::Mat(w, h, (void *) pixeldata, (size_t) c, c);
-            v.outimage = ncnn::Mat(w * scale, h * scale, (size_t) c, c);
+                v.inimage = ncnn::Mat(w, h, (void *) pixeldata, (size_t) c, c);
 
-            if (check) {
-                v.in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGB, w, h);
-            }
+                if (check) {
+                    v.in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGB, w, h);
+                }
 
-            fprintf(stderr, "scale=%d, w/h/c %d/%d/%d -> %d/%d/%d\n", scale,
-                    v.inimage.w, v.inimage.h, v.inimage.c,
-                    v.outimage.w, v.outimage.h, v.outimage.c
-            );
+                fprintf(stderr, "scale=%d, w/h/c %d/%d/%d -> %d/%d/%d\n", scale,
+                        v.inimage.w, v.inimage.h, v.inimage.c,
+                        v.inimage.w * scale, v.inimage.h * scale, v.inimage.c
+                );
 
-            toproc.put(v);
-        } else {
+                toproc.put(std::move(v), v.bytes());
+            } else {
+                ltp->decode_failed++;
 #if _WIN32
-            fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
+                fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
 #else // _WIN32
-            fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
+                fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
 #endif // _WIN32
+            }
         }
     }
 
@@ -296,6 +344,9 @@ void *load(void *args) {
 class ProcThreadParams {
 public:
     const RealSR *realsr;
+
+    // -G, every image is split across these engines
+    std::vector<const RealSR *> shared;
 };
 
 void *proc(void *args) {
@@ -305,14 +356,25 @@ void *proc(void *args) {
     for (;;) {
         Task v;
 
-        toproc.get(v);
-
-        if (v.id == -233)
+        if (!toproc.get(v))
             break;
 
-        realsr->process(v.inimage, v.outimage);
+        if (v.stream)
+        {
+            // a failed close removes the unfinished file
+            v.stream_success = realsr->process(v.inimage, v.outimage, v.writer.get()) == 0 && v.writer->close();
+            v.writer.reset();
+        }
+        else
+        {
+            v.outimage = ncnn::Mat(v.inimage.w * v.scale, v.inimage.h * v.scale, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
+            if (ptp->shared.empty())
+                realsr->process(v.inimage, v.outimage);
+            else
+                RealSR::process_shared(ptp->shared, v.inimage, v.outimage);
+        }
 
-        tosave.put(v);
+        tosave.put(std::move(v), v.bytes());
     }
 
     return 0;
@@ -324,6 +386,8 @@ public:
 //    bool check;
     int check_threshold;
 
+    std::atomic<int> saved;
+    std::atomic<int> failed;
 };
 
 float compareNcnnMats(const ncnn::Mat &mat1, const ncnn::Mat &mat2) {
@@ -409,16 +473,14 @@ float compareImageFiles(const std::string& file1, const std::string& file2)
 
 
 void *save(void *args) {
-    const SaveThreadParams *stp = (const SaveThreadParams *) args;
+    SaveThreadParams *stp = (SaveThreadParams *) args;
     const int verbose = stp->verbose;
     const int check_threshold = stp->check_threshold;
 
     for (;;) {
         Task v;
 
-        tosave.get(v);
-
-        if (v.id == -233)
+        if (!tosave.get(v))
             break;
 
 
@@ -433,9 +495,10 @@ void *save(void *args) {
 
         int success = 0;
 
-        path_t ext = get_file_extension(v.outpath);
-
-        if (ext != PATHSTR("gif")) {
+        if (v.stream) {
+            // already encoded by the proc stage
+            success = v.stream_success;
+        } else {
             cv::Mat image;
             if (v.has_alpha)
             {
@@ -481,15 +544,23 @@ void *save(void *args) {
             if (image.empty()) {
                 std::cerr << "Error: Image data not loaded." << std::endl;
                 success = false;
+                if (v.anim)
+                    v.anim->fail_frame(v.frame);
             } else {
-                #if _WIN32
+                if (v.anim) {
+                    success = v.anim->add(v.frame, image);
+                } else {
+#if _WIN32
                     success = imwrite_unicode(v.outpath, image);
-                #else
+#else
                     success = imwrite(v.outpath.c_str(), image);
-                #endif
+#endif
+                }
             }
         }
         if (success) {
+            stp->saved++;
+
             high_resolution_clock::time_point end = high_resolution_clock::now();
             duration<double> time_span = duration_cast<duration<double>>(end - begin);
             fprintf(stderr, "save result use time: %.3lf\n", time_span.count());
@@ -529,17 +600,472 @@ void *save(void *args) {
 
             }
         } else {
+            stp->failed++;
 #if _WIN32
             fwprintf(stderr, L"save result failed: %ls\n", v.outpath.c_str());
 #else
             fprintf(stderr, "save result failed: %s\n", v.outpath.c_str());
 #endif
         }
+
+        // drop the buffers before handing their budget back to the loader
+        v.outimage.release();
+        v.in.release();
+        budget.release(v.budget_bytes);
     }
 
     return 0;
 }
 
+// prepadding of the model family, -1 for an unknown model dir
+static int model_prepadding(const path_t& model) {
+    if (model.find(PATHSTR("models")) != path_t::npos)
+        return 10;
+
+    return -1;
+}
+
+// model is either a model file without extension or a dir of x<scale>.bin models,
+// scale is fixed up to the first model found when the requested one is missing
+static int find_model_files(const path_t& model, int& scale, path_t& paramfullpath, path_t& modelfullpath) {
+    int scales[] = {4, 2, 1, 8};
+    int sp = 0;
+
+    FILE* mp = nullptr;
+
+#if _WIN32
+    // First check: is model + ".bin" a direct bin file?
+    path_t direct_modelfullpath = model + PATHSTR(".bin");
+    mp = _wfopen(direct_modelfullpath.c_str(), L"rb");
+    
+    if (mp) {
+        // Found direct bin file
+        modelfullpath = direct_modelfullpath;
+        fprintf(stderr, "Direct model found: %ls\n", modelfullpath.c_str());
+    } else {
+        // Original directory search
+        wchar_t modelpath[256];
+        swprintf(modelpath, 256, L"%ls/x%d.bin", model.c_str(), scale);
+        fprintf(stderr, "search model: %ls\n", modelpath);
+        modelfullpath = sanitize_filepath(modelpath);
+        mp = _wfopen(modelfullpath.c_str(), L"rb");
+    }
+#else
+    // First check: is model + ".bin" a direct bin file?
+    path_t direct_modelfullpath = model + PATHSTR(".bin");
+    mp = fopen(direct_modelfullpath.c_str(), "rb");
+    
+    if (mp) {
+        // Found direct bin file
+        modelfullpath = direct_modelfullpath;
+        fprintf(stderr, "Direct model found: %s\n", modelfullpath.c_str());
+    } else {
+        // Original directory search
+        char modelpath[256];
+        sprintf(modelpath, "%s/x%d.bin", model.c_str(), scale);
+        fprintf(stderr, "search model: %s\n", modelpath);
+        modelfullpath = sanitize_filepath(modelpath);
+        mp = fopen(modelfullpath.c_str(), "rb");
+    }
+#endif
+
+    // If not found, try other scales (only for directory search)
+    while (!mp && sp < 4) {
+        int s = scales[sp];
+#if _WIN32
+        wchar_t modelpath[256];
+        swprintf(modelpath, 256, L"%ls/x%d.bin", model.c_str(), s);
+
+        modelfullpath = sanitize_filepath(modelpath);
+        mp = _wfopen(modelfullpath.c_str(), L"rb");
+#else
+        char modelpath[256];
+        sprintf(modelpath, "%s/x%d.bin", model.c_str(), s);
+
+        modelfullpath = sanitize_filepath(modelpath);
+        mp = fopen(modelfullpath.c_str(), "rb");
+#endif
+        if (mp) {
+            fprintf(stderr, "Fix scale: %d -> %d\n", scale, s);
+            scale = s;
+            break;
+        } else {
+            fprintf(stderr, "Fix scale fail -> %d\n", s);
+            sp++;
+        }
+    };
+
+    if (!mp) {
+#if _WIN32
+        fwprintf(stderr, L"Unknow scale for the model (%ls)\n", modelfullpath.c_str());
+#else
+        fprintf(stderr, "Unknow scale for the model (%s)\n", modelfullpath.c_str());
+#endif
+        return -1;
+    }
+
+    fclose(mp);
+
+    // Construct param file path from bin file path (replace extension)
+    paramfullpath = modelfullpath;
+    size_t dot_pos = paramfullpath.find_last_of(PATHSTR("."));
+    if (dot_pos != path_t::npos) {
+        // Replace extension with param
+        paramfullpath.replace(dot_pos + 1, paramfullpath.length() - dot_pos - 1, PATHSTR("param"));
+    } else {
+        // No extension, add .param (unlikely)
+        paramfullpath += PATHSTR(".param");
+    }
+
+#if _WIN32
+    fprintf(stderr, "Using model: %ls\n", modelfullpath.c_str());
+    fprintf(stderr, "Using param: %ls\n", paramfullpath.c_str());
+#else
+    fprintf(stderr, "Using model: %s\n", modelfullpath.c_str());
+    fprintf(stderr, "Using param: %s\n", paramfullpath.c_str());
+#endif
+
+    return 0;
+}
+
+// take the output format from the extension of a single output file, -1 if it can not be encoded
+static int resolve_output_format(const path_t& outputpath, path_t& output_format) {
+    if (path_is_directory(outputpath))
+        return 0;
+
+    path_t ext = get_file_extension(outputpath);
+    if (!ext.empty() && output_format.empty())
+    {
+        if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
+            output_format = PATHSTR("png");
+        else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
+            output_format = PATHSTR("webp");
+        else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+            output_format = PATHSTR("jpg");
+        else if (ext == PATHSTR("bmp") || ext == PATHSTR("BMP"))
+            output_format = PATHSTR("bmp");
+        else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
+            output_format = PATHSTR("tiff");
+        else if (ext == PATHSTR("gif") || ext == PATHSTR("GIF"))
+            output_format = PATHSTR("gif");
+    }
+    if (!output_format.empty() && !is_supported_encode_format(output_format))
+    {
+        fprintf(stderr, "invalid output format\n");
+        return -1;
+    }
+
+    return 0;
+}
+
+// {prog} of the name pattern, the executable name without extension and -ncnn suffix
+static path_t get_program_name(const path_t& argv0) {
+    path_t prog_name = argv0;
+
+    size_t last_sep = prog_name.find_last_of(PATHSTR("/\\"));
+    if (last_sep != path_t::npos)
+        prog_name = prog_name.substr(last_sep + 1);
+    size_t dot = prog_name.rfind(PATHSTR('.'));
+    if (dot != path_t::npos)
+        prog_name = prog_name.substr(0, dot);
+    const path_t ncnn_suffix = PATHSTR("-ncnn");
+    if (prog_name.size() > ncnn_suffix.size() &&
+        prog_name.compare(prog_name.size() - ncnn_suffix.size(), ncnn_suffix.size(), ncnn_suffix) == 0)
+        prog_name = prog_name.substr(0, prog_name.size() - ncnn_suffix.size());
+
+    return prog_name;
+}
+
+// tilesize for -t 0 from the heap budget of the device
+static int auto_tilesize(const path_t& model, int gpuid, int i, int verbose) {
+    int tilesize = 0;
+
+    if (gpuid == -1) {
+        // cpu only
+        tilesize = 200;
+        if (verbose)
+            fprintf(stderr, "init cpu tilesize %d = %d\n", i, tilesize);
+        return tilesize;
+    }
+
+    uint32_t heap_budget = ncnn::get_gpu_device(gpuid)->get_heap_budget();
+    const char* gpu_name = ncnn::get_gpu_info(gpuid).device_name();
+    const bool is_adreno = nullptr != strstr(gpu_name, "Adreno");
+
+    // more fine-grained tilesize policy here
+    if (model.find(PATHSTR("models-Real-ESRGANv")) != path_t::npos) {
+        if (heap_budget > 3300)
+            tilesize = 400;
+        else if (heap_budget > 1900)
+            tilesize = 200;
+        else if (heap_budget > 550)
+            tilesize = 100;
+        else if (heap_budget > 200)
+            tilesize = 64;
+        else
+            tilesize = 32;
+    } else {
+        if (heap_budget > 2800) {
+            if(is_adreno)
+                tilesize = 160;
+            else
+                tilesize = 200;
+        }
+        else if (heap_budget > 900)
+            tilesize = 100;
+        else if (heap_budget > 300)
+            tilesize = 64;
+        else
+            tilesize = 32;
+    }
+
+    fprintf(stderr, "config gpu[%d], tilesize=%d, heap_budget=%d\n", i, tilesize,
+            heap_budget);
+
+    if (verbose) {
+        const ncnn::GpuInfo &info = ncnn::get_gpu_info(gpuid);
+        fprintf(stderr,
+                "Gpu[%d]=%d, api_version= %d, driver_version=%d, vendor_id=%d ,device_id=%d, device_name=%s\n",
+                i, gpuid, info.api_version(), info.driver_version(), info.vendor_id(),
+                info.device_id(), info.device_name()
+        );
+    }
+
+    return tilesize;
+}
+
+// one load -> proc -> save pass over ltp.input_files, the queues are reopened so the
+// server mode can run it once per job. With tile_share one proc thread hands every image to all
+// engines at once
+static void run_pipeline(const std::vector<RealSR *>& realsr, const std::vector<int>& gpuid,
+                         const std::vector<int>& jobs_proc, int jobs_save,
+                         LoadThreadParams& ltp, SaveThreadParams& stp, bool tile_share = false) {
+    const int use_gpu_count = (int) gpuid.size();
+
+    toproc.configure(8, 0);
+    tosave.configure(8, 0);
+
+    ltp.decode_failed = 0;
+    stp.saved = 0;
+    stp.failed = 0;
+
+    // load image
+    ncnn::Thread load_thread(load, (void *) &ltp);
+
+    // realsr proc
+    std::vector<ProcThreadParams> ptp(use_gpu_count);
+    for (int i = 0; i < use_gpu_count; i++) {
+        ptp[i].realsr = realsr[i];
+    }
+
+    std::vector<ncnn::Thread *> proc_threads;
+    if (tile_share) {
+        ptp[0].shared.assign(realsr.begin(), realsr.end());
+        proc_threads.push_back(new ncnn::Thread(proc, (void *) &ptp[0]));
+    }
+    for (int i = 0; i < use_gpu_count && !tile_share; i++) {
+        if (gpuid[i] == -1) {
+            proc_threads.push_back(new ncnn::Thread(proc, (void *) &ptp[i]));
+        } else {
+            for (int j = 0; j < jobs_proc[i]; j++) {
+                proc_threads.push_back(new ncnn::Thread(proc, (void *) &ptp[i]));
+            }
+        }
+    }
+
+    // save image
+    std::vector<ncnn::Thread *> save_threads(jobs_save);
+    for (int i = 0; i < jobs_save; i++) {
+        if (stp.verbose)
+            fprintf(stderr, "init save_threads %d\n", i);
+        save_threads[i] = new ncnn::Thread(save, (void *) &stp);
+    }
+
+    // end
+    load_thread.join();
+
+    toproc.close();
+
+    for (size_t i = 0; i < proc_threads.size(); i++) {
+        proc_threads[i]->join();
+        delete proc_threads[i];
+    }
+
+    tosave.close();
+
+    for (int i = 0; i < jobs_save; i++) {
+        save_threads[i]->join();
+        delete save_threads[i];
+    }
+}
+
+// realsr instances of one model, one per gpu
+class RealSRSet {
+public:
+    ~RealSRSet() {
+        for (size_t i = 0; i < realsr.size(); i++)
+            delete realsr[i];
+    }
+
+    std::vector<RealSR *> realsr;
+};
+
+// --serve job handler, the command line options are the defaults of every job
+class RealSRServer {
+public:
+    RealSRServer() : cache(2) {
+    }
+
+    int operator()(const ServeFields& job, ServeReply& reply, std::string& error) {
+        high_resolution_clock::time_point begin = high_resolution_clock::now();
+
+        const path_t inputpath = utf8_to_path(field_or(job, "input", std::string()));
+        const path_t outputpath = utf8_to_path(field_or(job, "output", std::string()));
+        if (inputpath.empty() || outputpath.empty()) {
+            error = "input and output are required";
+            return -1;
+        }
+
+        const std::string model_utf8 = field_or(job, "model", path_to_utf8(model));
+        const path_t job_model = utf8_to_path(model_utf8);
+        int job_scale = field_or(job, "scale", scale);
+        const int job_tta = field_or(job, "tta", tta_mode);
+        const int job_tile = field_or(job, "tile", -1);
+        path_t job_output_format = utf8_to_path(field_or(job, "format", path_to_utf8(output_format)));
+        const path_t job_name_pattern = utf8_to_path(field_or(job, "pattern", path_to_utf8(name_pattern)));
+
+        if (job_tile > 0 && job_tile < 32) {
+            error = "invalid tile";
+            return -1;
+        }
+
+        if (resolve_output_format(outputpath, job_output_format) != 0) {
+            error = "invalid output format";
+            return -1;
+        }
+
+        LoadThreadParams ltp;
+        {
+            path_t effective_format = job_output_format.empty() ? suggested_format : job_output_format;
+
+            if (collect_input_output_files(inputpath, outputpath, effective_format, job_name_pattern, prog_name, ltp.input_files, ltp.output_files) != 0) {
+                error = "no input files";
+                return -1;
+            }
+        }
+
+        const int total = (int) ltp.input_files.size();
+        if (filter_files_by_size_threshold(ltp.input_files, ltp.output_files, skip_size, verbose) != 0) {
+            error = "filter input files failed";
+            return -1;
+        }
+        const int skipped = total - (int) ltp.input_files.size();
+
+        const int prepadding = model_prepadding(job_model);
+        if (prepadding < 0) {
+            error = "unknown model dir type";
+            return -1;
+        }
+
+        path_t paramfullpath;
+        path_t modelfullpath;
+        if (find_model_files(job_model, job_scale, paramfullpath, modelfullpath) != 0) {
+            error = "model not found: " + model_utf8;
+            return -1;
+        }
+
+        // the model file picks the scale, so the path and tta mode identify the loaded nets
+        char key_suffix[32];
+        sprintf(key_suffix, "|%d|%d", job_scale, job_tta);
+        const std::string key = path_to_utf8(modelfullpath) + key_suffix;
+
+        RealSRSet* set = cache.get(key);
+        reply.add("cached", set ? 1 : 0);
+        if (!set) {
+            cache.make_room();
+
+            set = new RealSRSet;
+            for (size_t i = 0; i < gpuid.size(); i++) {
+                int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
+
+                RealSR* realsr = new RealSR(gpuid[i], job_tta, num_threads);
+                if (realsr->load(paramfullpath, modelfullpath) != 0) {
+                    delete realsr;
+                    delete set;
+                    error = "load model failed";
+                    return -1;
+                }
+                set->realsr.push_back(realsr);
+            }
+            cache.put(key, set);
+        }
+
+        for (size_t i = 0; i < gpuid.size(); i++) {
+            set->realsr[i]->scale = job_scale;
+            set->realsr[i]->prepadding = prepadding;
+            set->realsr[i]->flat_tile_range = flat_tile_range;
+
+            int t = job_tile >= 0 ? job_tile : tilesize[i];
+            if (t == 0) {
+                t = auto_tilesize(job_model, gpuid[i], (int) i, verbose);
+                if (tile_autobench)
+                    t = autotune_tilesize(set->realsr[i], gpuid[i], gpuid[i] == -1 ? jobs_proc[i] : 1,
+                                          paramfullpath, modelfullpath, job_scale, t, verbose);
+            }
+            set->realsr[i]->tilesize = t;
+        }
+
+        ltp.scale = job_scale;
+        ltp.output_format = job_output_format;
+        ltp.check_threshold = 0;
+        ltp.stream_output = stream_output;
+        ltp.jobs_load = jobs_load;
+
+        SaveThreadParams stp;
+        stp.verbose = verbose;
+        stp.check_threshold = 0;
+
+        run_pipeline(set->realsr, gpuid, jobs_proc, jobs_save, ltp, stp);
+
+        const int failed = stp.failed + ltp.decode_failed;
+
+        high_resolution_clock::time_point end = high_resolution_clock::now();
+        duration<double> time_span = duration_cast<duration<double>>(end - begin);
+
+        reply.add("done", (int) stp.saved).add("failed", failed).add("skipped", skipped).add("time", time_span.count());
+
+        if (failed) {
+            char buf[64];
+            sprintf(buf, "%d of %d images failed", failed, (int) ltp.input_files.size());
+            error = buf;
+            return -1;
+        }
+
+        return 0;
+    }
+
+    path_t model;
+    int scale;
+    int tta_mode;
+    std::vector<int> tilesize;
+    int tile_autobench;
+    int flat_tile_range;
+    std::vector<int> gpuid;
+    std::vector<int> jobs_proc;
+    int jobs_load;
+    int jobs_save;
+    int verbose;
+    path_t output_format;
+    path_t suggested_format;
+    path_t name_pattern;
+    path_t prog_name;
+    long long skip_size;
+    int stream_output;
+
+private:
+    ModelCache<RealSRSet> cache;
+};
+
 #if _WIN32
 const std::wstring& optarg_in (L"A:\\Media\\realsr-ncnn-vulkan-20210210-windows\\input3.jpg");
 const std::wstring& optarg_out(L"A:\\Media\\realsr-ncnn-vulkan-20210210-windows\\output3.jpg");
@@ -564,6 +1090,7 @@ int main(int argc, char **argv)
     path_t outputpath;
     int scale = 4;
     std::vector<int> tilesize;
+    int tile_autobench = 0;
 #if _DEMO_PATH
     path_t model = optarg_mo;
 #else
@@ -575,16 +1102,28 @@ int main(int argc, char **argv)
     int jobs_save = 2;
     int verbose = 0;
     int tta_mode = 0;
+    int flat_tile_range = -1;
+    long long tile_cache_size = 0;
+    int temporal_tolerance = -1;
+    path_t result_cache_dir;
     path_t output_format;
     path_t suggested_format;
     long long skip_size = 0;
     int check_threshold = 0;
     path_t name_pattern = PATHSTR("{name}");
+    long long memory_budget = 0;
+    int stream_output = 0;
+    int tile_share = 0;
+    BenchOptions bench;
+    bool benchmark = false;
+
+    std::string serve_endpoint;
+    const bool serve = take_serve_option(argc, argv, serve_endpoint);
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"i:o:s:c:t:m:g:j:f:vxhk:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"i:o:s:c:t:m:g:j:f:vxhk:e:p:M:SGF:D:T:R:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -598,7 +1137,12 @@ int main(int argc, char **argv)
             scale = _wtoi(optarg);
             break;
         case L't':
-            tilesize = parse_optarg_int_array(optarg);
+            if (is_auto_bench_option(optarg)) {
+                tile_autobench = 1;
+                tilesize.clear();
+            } else {
+                tilesize = parse_optarg_int_array(optarg);
+            }
             break;
         case L'm':
             model = optarg;
@@ -622,6 +1166,18 @@ int main(int argc, char **argv)
         case L'x':
             tta_mode = 1;
             break;
+        case L'F':
+            flat_tile_range = _wtoi(optarg);
+            break;
+        case L'D':
+            tile_cache_size = parse_size_string(optarg);
+            break;
+        case L'T':
+            temporal_tolerance = _wtoi(optarg);
+            break;
+        case L'R':
+            result_cache_dir = optarg;
+            break;
         case L'k':
             skip_size = _wtoi64(optarg);
             break;
@@ -631,6 +1187,22 @@ int main(int argc, char **argv)
         case L'c':
             check_threshold = _wtoi(optarg);
             break;
+        case L'M':
+            memory_budget = parse_size_string(optarg);
+            break;
+        case L'S':
+            stream_output = 1;
+            break;
+        case L'G':
+            tile_share = 1;
+            break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0) {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L'h':
         default:
             print_usage();
@@ -639,7 +1211,7 @@ int main(int argc, char **argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:s:c:t:m:g:j:f:vxhk:e:p:")) != -1) {
+    while ((opt = getopt(argc, argv, "i:o:s:c:t:m:g:j:f:vxhk:e:p:M:SGF:D:T:R:B:")) != -1) {
         switch (opt) {
             case 'i':
                 inputpath = optarg;
@@ -651,7 +1223,12 @@ int main(int argc, char **argv)
                 scale = atoi(optarg);
                 break;
             case 't':
-                tilesize = parse_optarg_int_array(optarg);
+                if (is_auto_bench_option(optarg)) {
+                    tile_autobench = 1;
+                    tilesize.clear();
+                } else {
+                    tilesize = parse_optarg_int_array(optarg);
+                }
                 break;
             case 'm':
                 model = optarg;
@@ -675,6 +1252,18 @@ int main(int argc, char **argv)
             case 'x':
                 tta_mode = 1;
                 break;
+            case 'F':
+                flat_tile_range = atoi(optarg);
+                break;
+            case 'D':
+                tile_cache_size = parse_size_string(optarg);
+                break;
+            case 'T':
+                temporal_tolerance = atoi(optarg);
+                break;
+            case 'R':
+                result_cache_dir = optarg;
+                break;
             case 'k':
                 skip_size = atoll(optarg);
                 break;
@@ -684,6 +1273,22 @@ int main(int argc, char **argv)
             case 'c':
                 check_threshold = atoi(optarg);
                 break;
+            case 'M':
+                memory_budget = parse_size_string(optarg);
+                break;
+            case 'S':
+                stream_output = 1;
+                break;
+            case 'G':
+                tile_share = 1;
+                break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0) {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
             case 'h':
             default:
                 print_usage();
@@ -693,7 +1298,7 @@ int main(int argc, char **argv)
 #endif // _WIN32
 
 
-    if (inputpath.empty()) {
+    if (inputpath.empty() && !serve && !benchmark) {
         print_usage();
 #if _DEMO_PATH
         fprintf(stderr, "demo input argument\n");
@@ -704,7 +1309,7 @@ int main(int argc, char **argv)
     }
 
 
-    if (outputpath.empty()) {
+    if (outputpath.empty() && !serve && !benchmark) {
         print_usage();
 #if _DEMO_PATH
         fprintf(stderr, "demo output argument\n");
@@ -731,6 +1336,16 @@ int main(int argc, char **argv)
         }
     }
 
+    if (memory_budget < 0) {
+        fprintf(stderr, "invalid memory budget argument\n");
+        return -1;
+    }
+
+    if (tile_cache_size < 0) {
+        fprintf(stderr, "invalid tile cache size argument\n");
+        return -1;
+    }
+
     if (jobs_load < 1 || jobs_save < 1) {
         fprintf(stderr, "invalid thread count argument\n");
         return -1;
@@ -748,47 +1363,20 @@ int main(int argc, char **argv)
         }
     }
 
-    if (!path_is_directory(outputpath))
-    {
-        path_t ext = get_file_extension(outputpath);
-        if (!ext.empty() && output_format.empty())
-        {
-            if (ext == PATHSTR("png") || ext == PATHSTR("PNG"))
-                output_format = PATHSTR("png");
-            else if (ext == PATHSTR("webp") || ext == PATHSTR("WEBP"))
-                output_format = PATHSTR("webp");
-            else if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
-                output_format = PATHSTR("jpg");
-            else if (ext == PATHSTR("bmp") || ext == PATHSTR("BMP"))
-                output_format = PATHSTR("bmp");
-            else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
-                output_format = PATHSTR("tiff");
-        }
-        if (!output_format.empty() && !is_supported_encode_format(output_format))
-        {
-            fprintf(stderr, "invalid output format\n");
-            return -1;
-        }
-    }
+    const path_t prog_name = get_program_name(path_t(argv[0]));
 
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
-    {
-        path_t effective_format = output_format.empty() ? suggested_format : output_format;
+    int prepadding = 0;
+    path_t paramfullpath;
+    path_t modelfullpath;
 
-        path_t prog_name = path_t(argv[0]);
-        {
-            size_t last_sep = prog_name.find_last_of(PATHSTR("/\\"));
-            if (last_sep != path_t::npos)
-                prog_name = prog_name.substr(last_sep + 1);
-            size_t dot = prog_name.rfind(PATHSTR('.'));
-            if (dot != path_t::npos)
-                prog_name = prog_name.substr(0, dot);
-            const path_t ncnn_suffix = PATHSTR("-ncnn");
-            if (prog_name.size() > ncnn_suffix.size() &&
-                prog_name.compare(prog_name.size() - ncnn_suffix.size(), ncnn_suffix.size(), ncnn_suffix) == 0)
-                prog_name = prog_name.substr(0, prog_name.size() - ncnn_suffix.size());
-        }
+    // in server mode every job brings its own paths and model, the benchmark makes up its images
+    if (!serve && !benchmark) {
+        if (resolve_output_format(outputpath, output_format) != 0)
+            return -1;
+
+        path_t effective_format = output_format.empty() ? suggested_format : output_format;
 
         int ret = collect_input_output_files(inputpath, outputpath, effective_format, name_pattern, prog_name, input_files, output_files);
         if (ret != 0)
@@ -799,108 +1387,18 @@ int main(int argc, char **argv)
             return -1;
     }
 
-    int prepadding = 0;
-
-    if (model.find(PATHSTR("models")) != path_t::npos) {
-        prepadding = 10;
-    } else {
-        fprintf(stderr, "unknown model dir type\n");
-        return -1;
+    if (!serve) {
+        prepadding = model_prepadding(model);
+        if (prepadding < 0) {
+            fprintf(stderr, "unknown model dir type\n");
+            return -1;
+        }
     }
 
     std::cout << "build time: " << __DATE__ << " " << __TIME__ << std::endl;
 
-    int scales[] = {4, 2, 1, 8};
-    int sp = 0;
-
-    path_t modelfullpath;
-    FILE* mp = nullptr;
-
-#if _WIN32
-    // First check: is model + ".bin" a direct bin file?
-    path_t direct_modelfullpath = model + PATHSTR(".bin");
-    mp = _wfopen(direct_modelfullpath.c_str(), L"rb");
-    
-    if (mp) {
-        // Found direct bin file
-        modelfullpath = direct_modelfullpath;
-        fprintf(stderr, "Direct model found: %ls\n", modelfullpath.c_str());
-    } else {
-        // Original directory search
-        wchar_t modelpath[256];
-        swprintf(modelpath, 256, L"%ls/x%d.bin", model.c_str(), scale);
-        fprintf(stderr, "search model: %ls\n", modelpath);
-        modelfullpath = sanitize_filepath(modelpath);
-        mp = _wfopen(modelfullpath.c_str(), L"rb");
-    }
-#else
-    // First check: is model + ".bin" a direct bin file?
-    path_t direct_modelfullpath = model + PATHSTR(".bin");
-    mp = fopen(direct_modelfullpath.c_str(), "rb");
-    
-    if (mp) {
-        // Found direct bin file
-        modelfullpath = direct_modelfullpath;
-        fprintf(stderr, "Direct model found: %s\n", modelfullpath.c_str());
-    } else {
-        // Original directory search
-        char modelpath[256];
-        sprintf(modelpath, "%s/x%d.bin", model.c_str(), scale);
-        fprintf(stderr, "search model: %s\n", modelpath);
-        modelfullpath = sanitize_filepath(modelpath);
-        mp = fopen(modelfullpath.c_str(), "rb");
-    }
-#endif
-
-    // If not found, try other scales (only for directory search)
-    while (!mp && sp < 4) {
-        int s = scales[sp];
-#if _WIN32
-        wchar_t modelpath[256];
-        swprintf(modelpath, 256, L"%ls/x%d.bin", model.c_str(), s);
-
-        modelfullpath = sanitize_filepath(modelpath);
-        mp = _wfopen(modelfullpath.c_str(), L"rb");
-#else
-        char modelpath[256];
-        sprintf(modelpath, "%s/x%d.bin", model.c_str(), s);
-
-        modelfullpath = sanitize_filepath(modelpath);
-        mp = fopen(modelfullpath.c_str(), "rb");
-#endif
-        if (mp) {
-            fprintf(stderr, "Fix scale: %d -> %d\n", scale, s);
-            scale = s;
-            break;
-        } else {
-            fprintf(stderr, "Fix scale fail -> %d\n", s);
-            sp++;
-        }
-    };
-
-    if (!mp) {
-        fprintf(stderr, "Unknow scale for the model (%s)\n", modelfullpath.c_str());
+    if (!serve && find_model_files(model, scale, paramfullpath, modelfullpath) != 0)
         return -1;
-    }
-
-    // Construct param file path from bin file path (replace extension)
-    path_t paramfullpath = modelfullpath;
-    size_t dot_pos = paramfullpath.find_last_of(PATHSTR("."));
-    if (dot_pos != path_t::npos) {
-        // Replace extension with param
-        paramfullpath.replace(dot_pos + 1, paramfullpath.length() - dot_pos - 1, PATHSTR("param"));
-    } else {
-        // No extension, add .param (unlikely)
-        paramfullpath += PATHSTR(".param");
-    }
-
-#if _WIN32
-    fprintf(stderr, "Using model: %ls\n", modelfullpath.c_str());
-    fprintf(stderr, "Using param: %ls\n", paramfullpath.c_str());
-#else
-    fprintf(stderr, "Using model: %s\n", modelfullpath.c_str());
-    fprintf(stderr, "Using param: %s\n", paramfullpath.c_str());
-#endif
 
 
 #if _WIN32
@@ -938,172 +1436,227 @@ int main(int argc, char **argv)
         }
     }
 
-    int total_jobs_proc = 0;
     for (int i = 0; i < use_gpu_count; i++) {
         if (gpuid[i] == -1) {
             jobs_proc[i] = std::min(jobs_proc[i], cpu_count);
-            total_jobs_proc += 1;
 
             fprintf(stderr, "use CPU\n");
-        } else {
-            total_jobs_proc += jobs_proc[i];
         }
     }
 
-    if (verbose)
-        fprintf(stderr, "init heap_budget, use_gpu_count=%d\n", use_gpu_count);
-    for (int i = 0; i < use_gpu_count; i++) {
+    budget.set_limit((size_t) memory_budget);
 
+    if (serve) {
+        int ret;
+        {
+            RealSRServer server;
+            server.model = model;
+            server.scale = scale;
+            server.tta_mode = tta_mode;
+            server.tilesize = tilesize;
+            server.tile_autobench = tile_autobench;
+            server.flat_tile_range = flat_tile_range;
+            server.gpuid = gpuid;
+            server.jobs_proc = jobs_proc;
+            server.jobs_load = jobs_load;
+            server.jobs_save = jobs_save;
+            server.verbose = verbose;
+            server.output_format = output_format;
+            server.suggested_format = suggested_format;
+            server.name_pattern = name_pattern;
+            server.prog_name = prog_name;
+            server.skip_size = skip_size;
+            server.stream_output = stream_output;
+
+            ret = serve_loop(serve_endpoint, server);
+        }
 
-        if (tilesize[i] != 0)
-            continue;
+        ncnn::destroy_gpu_instance();
+        return ret;
+    }
 
-        if (gpuid[i] == -1) {
-            // cpu only
-            tilesize[i] = 200;
-            if (verbose)
-                fprintf(stderr, "init cpu tilesize %d/%lu = %lu\n", i, tilesize.size(), tilesize[i]);
-            continue;
-        }
+    if (benchmark) {
+        // one engine on the first device, images go straight through process() without the pipeline threads
+        if (tilesize[0] == 0)
+            tilesize[0] = auto_tilesize(model, gpuid[0], 0, verbose);
 
-        uint32_t heap_budget = ncnn::get_gpu_device(gpuid[i])->get_heap_budget();
-        const char* gpu_name = ncnn::get_gpu_info(i).device_name();
-        const bool is_adreno = nullptr != strstr(gpu_name, "Adreno");
-
-        // more fine-grained tilesize policy here
-        if (model.find(PATHSTR("models-Real-ESRGANv")) != path_t::npos) {
-            if (heap_budget > 3300)
-                tilesize[i] = 400;
-            else if (heap_budget > 1900)
-                tilesize[i] = 200;
-            else if (heap_budget > 550)
-                tilesize[i] = 100;
-            else if (heap_budget > 200)
-                tilesize[i] = 64;
-            else
-                tilesize[i] = 32;
-        } else {
-            if (heap_budget > 2800) {
-                if(is_adreno)
-                    tilesize[i] = 160;
-                else
-                    tilesize[i] = 200;
-            }
-            else if (heap_budget > 900)
-                tilesize[i] = 100;
-            else if (heap_budget > 300)
-                tilesize[i] = 64;
+        int ret;
+        {
+            RealSR realsr(gpuid[0], tta_mode, gpuid[0] == -1 ? jobs_proc[0] : 1);
+            realsr.load(paramfullpath, modelfullpath);
+            realsr.scale = scale;
+            realsr.tilesize = tilesize[0];
+            realsr.prepadding = prepadding;
+            realsr.flat_tile_range = flat_tile_range;
+            if (tile_autobench)
+                tilesize[0] = autotune_tilesize(&realsr, gpuid[0], gpuid[0] == -1 ? jobs_proc[0] : 1,
+                                                paramfullpath, modelfullpath, scale, tilesize[0], verbose);
+
+            auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+                cv::Mat rgb;
+                ncnn::Mat inimage;
+                {
+                    BenchScope bench_preproc(BENCH_PREPROC);
+#if _WIN32
+                    rgb = in;
+#else
+                    cv::cvtColor(in, rgb, cv::COLOR_BGR2RGB);
+#endif
+                    inimage = ncnn::Mat(rgb.cols, rgb.rows, (void *) rgb.data, (size_t) 3, 3);
+                }
+
+                ncnn::Mat outimage(rgb.cols * scale, rgb.rows * scale, (size_t) 3, 3);
+                int r = realsr.process(inimage, outimage);
+
+                BenchScope bench_postproc(BENCH_POSTPROC);
+                cv::Mat result(outimage.h, outimage.w, CV_8UC3, outimage.data);
+#if _WIN32
+                out = result.clone();
+#else
+                cv::cvtColor(result, out, cv::COLOR_RGB2BGR);
+#endif
+                return r;
+            };
+
+            bench.format = bench_path_string(output_format);
+
+            BenchJson info;
+            info.add("engine", std::string("realsr")).add("model", bench_path_string(modelfullpath));
+            info.add("gpu", gpuid[0]).add("tilesize", tilesize[0]).add("tta", tta_mode);
+            if (gpuid[0] != -1)
+                info.add("device", std::string(ncnn::get_gpu_info(gpuid[0]).device_name()));
             else
-                tilesize[i] = 32;
+                info.add("threads", jobs_proc[0]);
+
+            ret = run_benchmark(bench, scale, info, outputpath, upscale);
         }
 
-        fprintf(stderr, "config gpu[%d], tilesize=%d, heap_budget=%d\n", i, tilesize[i],
-                heap_budget);
+        ncnn::destroy_gpu_instance();
+        return ret;
+    }
 
-        if (verbose) {
-            const ncnn::GpuInfo &info = ncnn::get_gpu_info(gpuid[i]);
-            fprintf(stderr,
-                    "Gpu[%d]=%d, api_version= %d, driver_version=%d, vendor_id=%d ,device_id=%d, device_name=%s\n",
-                    i, gpuid[i], info.api_version(), info.driver_version(), info.vendor_id(),
-                    info.device_id(), info.device_name()
-            );
-        }
+    if (verbose)
+        fprintf(stderr, "init heap_budget, use_gpu_count=%d\n", use_gpu_count);
+    for (int i = 0; i < use_gpu_count; i++) {
+        if (tilesize[i] == 0)
+            tilesize[i] = auto_tilesize(model, gpuid[i], i, verbose);
     }
     if (verbose)
         fprintf(stderr, "init realsr\n");
     else
         fprintf(stderr, "busy...\n");
     {
+        ResultCache *result_cache = 0;
+        if (!result_cache_dir.empty()) {
+            char settings[128];
+            sprintf(settings, "realsr scale=%d tta=%d flat=%d temporal=%d", scale, tta_mode, flat_tile_range, temporal_tolerance);
+            result_cache = new ResultCache(result_cache_dir, paramfullpath, modelfullpath, settings);
+            result_cache->take_hits(input_files, output_files, verbose);
+        }
+
+        // one cache for the whole run, tiles repeat across the images of a batch
+        TileDedupCache* tile_cache = tile_cache_size > 0 ? new TileDedupCache((size_t)tile_cache_size) : 0;
+
+        // frames of all animations and the images of the batch run through one temporal cache
+        TemporalTileCache* temporal_cache = temporal_tolerance >= 0 ? new TemporalTileCache(temporal_tolerance) : 0;
+
         std::vector<RealSR *> realsr(use_gpu_count);
 
+        // the first run of a model on a device compiles the shaders, later runs load them from the shader cache
+        double load_seconds = 0;
+
         for (int i = 0; i < use_gpu_count; i++) {
             int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
 
             realsr[i] = new RealSR(gpuid[i], tta_mode, num_threads);
 
-            realsr[i]->load(paramfullpath, modelfullpath);
+            const double load_begin = bench_now();
+            const int load_ret = realsr[i]->load(paramfullpath, modelfullpath);
+            load_seconds += bench_now() - load_begin;
+
+            if (load_ret != 0) {
+                fprintf(stderr, "load model failed\n");
+
+                for (int j = 0; j <= i; j++)
+                    delete realsr[j];
+                delete tile_cache;
+                delete temporal_cache;
+                delete result_cache;
+
+                ncnn::destroy_gpu_instance();
+                return -1;
+            }
 
             realsr[i]->scale = scale;
             realsr[i]->tilesize = tilesize[i];
             realsr[i]->prepadding = prepadding;
+            realsr[i]->flat_tile_range = flat_tile_range;
+
+            if (tile_autobench)
+                tilesize[i] = autotune_tilesize(realsr[i], gpuid[i], num_threads, paramfullpath, modelfullpath,
+                                                scale, tilesize[i], verbose);
+
+            // after autotuning, so the timed runs do not hit the cache
+            realsr[i]->tile_cache = tile_cache;
+            realsr[i]->temporal_cache = temporal_cache;
+        }
+
+        fprintf(stderr, "load model use time: %.3lf, %s\n", load_seconds, spirv_cache_summary().c_str());
+
+        // the devices walk one tile grid, so they all take the smallest tilesize
+        const bool share_tiles = tile_share && use_gpu_count > 1;
+        if (share_tiles) {
+            const int shared_tilesize = *std::min_element(tilesize.begin(), tilesize.end());
+            for (int i = 0; i < use_gpu_count; i++) {
+                tilesize[i] = shared_tilesize;
+                realsr[i]->tilesize = shared_tilesize;
+            }
+            if (stream_output)
+                fprintf(stderr, "-S is ignored with -G, the devices write bands out of order\n");
         }
 
         // main routine
         {
-            // load image
             LoadThreadParams ltp;
             ltp.scale = scale;
             ltp.output_format = output_format;
             ltp.check_threshold = check_threshold;
+            ltp.stream_output = share_tiles ? 0 : stream_output;
             ltp.jobs_load = jobs_load;
             ltp.input_files = input_files;
             ltp.output_files = output_files;
 
-            ncnn::Thread load_thread(load, (void *) &ltp);
-
-            // realsr proc
-            std::vector<ProcThreadParams> ptp(use_gpu_count);
-            for (int i = 0; i < use_gpu_count; i++) {
-                ptp[i].realsr = realsr[i];
-            }
-
-            std::vector<ncnn::Thread *> proc_threads(total_jobs_proc);
-            {
-                int total_jobs_proc_id = 0;
-                for (int i = 0; i < use_gpu_count; i++) {
-                    if (gpuid[i] == -1) {
-                        proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc,
-                                                                              (void *) &ptp[i]);
-                    } else {
-                        for (int j = 0; j < jobs_proc[i]; j++) {
-                            proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc,
-                                                                                  (void *) &ptp[i]);
-                        }
-                    }
-                }
-            }
-
-            // save image
             SaveThreadParams stp;
             stp.verbose = verbose;
             stp.check_threshold = check_threshold;
 
-            std::vector<ncnn::Thread *> save_threads(jobs_save);
-            for (int i = 0; i < jobs_save; i++) {
-                if (verbose)
-                    fprintf(stderr, "init save_threads %d\n", i);
-                save_threads[i] = new ncnn::Thread(save, (void *) &stp);
-            }
-
-            // end
-            load_thread.join();
-
-            Task end;
-            end.id = -233;
-
-            for (int i = 0; i < total_jobs_proc; i++) {
-                toproc.put(end);
-            }
-
-            for (int i = 0; i < total_jobs_proc; i++) {
-                proc_threads[i]->join();
-                delete proc_threads[i];
-            }
-
-            for (int i = 0; i < jobs_save; i++) {
-                tosave.put(end);
-            }
+            run_pipeline(realsr, gpuid, jobs_proc, jobs_save, ltp, stp, share_tiles);
 
-            for (int i = 0; i < jobs_save; i++) {
-                save_threads[i]->join();
-                delete save_threads[i];
-            }
+            if (budget.get_limit())
+                fprintf(stderr, "memory budget %sB, peak %sB\n", float2str((float) budget.get_limit()).c_str(),
+                        float2str((float) budget.peak_bytes()).c_str());
         }
 
         for (int i = 0; i < use_gpu_count; i++) {
             delete realsr[i];
         }
         realsr.clear();
+
+        if (tile_cache) {
+            tile_cache->print_stats();
+            delete tile_cache;
+        }
+
+        if (temporal_cache) {
+            temporal_cache->print_stats();
+            delete temporal_cache;
+        }
+
+        if (result_cache) {
+            result_cache->store_results(verbose);
+            result_cache->print_stats();
+            delete result_cache;
+        }
     }
 
     ncnn::destroy_gpu_instance();
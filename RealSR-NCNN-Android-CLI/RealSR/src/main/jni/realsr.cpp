@@ -4,7 +4,8 @@
 
 #include <algorithm>
 #include <vector>
-//#include <omp.h>
+
+#include "spirv_cache.h"
 
 #include "realsr_preproc.comp.hex.h"
 #include "realsr_postproc.comp.hex.h"
@@ -33,14 +34,18 @@ RealSR::~RealSR()
         delete realsr_postproc;
     }
 
-    bicubic_2x->destroy_pipeline(net.opt);
-    delete bicubic_2x;
+    // a load that failed early created no layers
+    if (bicubic_2x)
+    {
+        bicubic_2x->destroy_pipeline(net.opt);
+        delete bicubic_2x;
 
-    bicubic_3x->destroy_pipeline(net.opt);
-    delete bicubic_3x;
+        bicubic_3x->destroy_pipeline(net.opt);
+        delete bicubic_3x;
 
-    bicubic_4x->destroy_pipeline(net.opt);
-    delete bicubic_4x;
+        bicubic_4x->destroy_pipeline(net.opt);
+        delete bicubic_4x;
+    }
 }
 
 #if _WIN32
@@ -123,17 +128,17 @@ int RealSR::load(const std::string& parampath, const std::string& modelpath)
 #endif
 
         {
-            static std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            std::vector<uint32_t> spirv;
+            int ret;
+            if (tta_mode)
+                ret = cached_spirv_module(realsr_preproc_tta_comp_data, sizeof(realsr_preproc_tta_comp_data), net.opt, vkdev, parampath, spirv);
+            else
+                ret = cached_spirv_module(realsr_preproc_comp_data, sizeof(realsr_preproc_comp_data), net.opt, vkdev, parampath, spirv);
+
+            if (ret != 0)
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(realsr_preproc_tta_comp_data, sizeof(realsr_preproc_tta_comp_data), net.opt, spirv);
-                    else
-                        compile_spirv_module(realsr_preproc_comp_data, sizeof(realsr_preproc_comp_data), net.opt, spirv);
-                }
+                fprintf(stderr, "compile realsr_preproc failed\n");
+                return -1;
             }
 
             realsr_preproc = new ncnn::Pipeline(vkdev);
@@ -142,17 +147,17 @@ int RealSR::load(const std::string& parampath, const std::string& modelpath)
         }
 
         {
-            static std::vector<uint32_t> spirv;
-            static ncnn::Mutex lock;
+            std::vector<uint32_t> spirv;
+            int ret;
+            if (tta_mode)
+                ret = cached_spirv_module(realsr_postproc_tta_comp_data, sizeof(realsr_postproc_tta_comp_data), net.opt, vkdev, parampath, spirv);
+            else
+                ret = cached_spirv_module(realsr_postproc_comp_data, sizeof(realsr_postproc_comp_data), net.opt, vkdev, parampath, spirv);
+
+            if (ret != 0)
             {
-                ncnn::MutexLockGuard guard(lock);
-                if (spirv.empty())
-                {
-                    if (tta_mode)
-                        compile_spirv_module(realsr_postproc_tta_comp_data, sizeof(realsr_postproc_tta_comp_data), net.opt, spirv);
-                    else
-                        compile_spirv_module(realsr_postproc_comp_data, sizeof(realsr_postproc_comp_data), net.opt, spirv);
-                }
+                fprintf(stderr, "compile realsr_postproc failed\n");
+                return -1;
             }
 
             realsr_postproc = new ncnn::Pipeline(vkdev);
@@ -203,427 +208,310 @@ int RealSR::load(const std::string& parampath, const std::string& modelpath)
     return 0;
 }
 
-int RealSR::process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
+int RealSR::process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer) const
 {
     if (!vkdev)
     {
         // cpu only
-        return process_cpu(inimage, outimage);
+        return process_cpu(inimage, outimage, writer);
     }
 
-    const unsigned char* pixeldata = (const unsigned char*)inimage.data;
-    const int w = inimage.w;
-    const int h = inimage.h;
-    const int channels = inimage.elempack;
+    return process_tiled_gpu(inimage, outimage, writer);
+}
 
-    const int TILE_SIZE_X = tilesize;
-    const int TILE_SIZE_Y = tilesize;
+int RealSR::process_shared(const std::vector<const RealSR*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage)
+{
+    if (engines.size() == 1)
+        return engines[0]->process(inimage, outimage);
 
-    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    return process_tiled_shared(engines, inimage, outimage);
+}
 
-    ncnn::Option opt = net.opt;
-    opt.blob_vkallocator = blob_vkallocator;
-    opt.workspace_vkallocator = blob_vkallocator;
-    opt.staging_vkallocator = staging_vkallocator;
+bool RealSR::band_int8(const ncnn::Option& opt) const
+{
+    return (opt.use_fp16_storage || opt.use_fp16_packed) && opt.use_int8_storage;
+}
 
-    // each tile 100x100
-    const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
-    const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
+void RealSR::process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const
+{
+    const int w = grid.w;
+    const int h = grid.h;
+    const int channels = grid.channels;
 
-    const size_t in_out_tile_elemsize =  (opt.use_fp16_storage || opt.use_fp16_packed)  ? 2u : 4u;
-    high_resolution_clock::time_point begin = high_resolution_clock::now();
-    high_resolution_clock::time_point time_print_progress;
+    const int TILE_SIZE_X = tilesize;
+    const int TILE_SIZE_Y = tilesize;
 
+    ncnn::VkAllocator* blob_vkallocator = opt.blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator = opt.staging_vkallocator;
 
-    //#pragma omp parallel for num_threads(2)
-    for (int yi = 0; yi < ytiles; yi++)
-    {
-        const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const size_t in_out_tile_elemsize = (opt.use_fp16_storage || opt.use_fp16_packed) ? 2u : 4u;
 
-        int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
-        int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding, h);
+    const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
 
-        ncnn::Mat in;
-        if ((opt.use_fp16_storage || opt.use_fp16_packed) && opt.use_int8_storage)
-        {
-            const int safe_tile_h = in_tile_y1 - in_tile_y0;
-            const bool is_standard_size = (safe_tile_h == TILE_SIZE_Y + 2 * prepadding);
-            if (is_standard_size) {
-                in = ncnn::Mat(w, safe_tile_h, (unsigned char*)pixeldata + in_tile_y0 * w * channels, (size_t)channels, 1);
-            } else {
-                in.create(w, safe_tile_h, (size_t)channels, 1);
-                const unsigned char* src = (unsigned char*)pixeldata + in_tile_y0 * w * channels;
-                memcpy(in.data, src, (size_t)w * safe_tile_h * channels);
-            }
-        }
-        else
+    const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
+
+    if (tta_mode)
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu[8];
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            if (channels == 3)
-            {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGR2RGB, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGB, w, (in_tile_y1 - in_tile_y0));
-#endif
-            }
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
+
+            in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
+
             if (channels == 4)
             {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGRA2RGBA, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGBA, w, (in_tile_y1 - in_tile_y0));
-#endif
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
             }
-        }
 
-        ncnn::VkCompute cmd(vkdev);
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu[0];
+            bindings[2] = in_tile_gpu[1];
+            bindings[3] = in_tile_gpu[2];
+            bindings[4] = in_tile_gpu[3];
+            bindings[5] = in_tile_gpu[4];
+            bindings[6] = in_tile_gpu[5];
+            bindings[7] = in_tile_gpu[6];
+            bindings[8] = in_tile_gpu[7];
+            bindings[9] = in_alpha_tile_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu[0].w;
+            constants[4].i = in_tile_gpu[0].h;
+            constants[5].i = in_tile_gpu[0].cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = channels;
+            constants[11].i = in_alpha_tile_gpu.w;
+            constants[12].i = in_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu[0].w;
+            dispatcher.h = in_tile_gpu[0].h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realsr_preproc, bindings, constants, dispatcher);
+        }
 
-        // upload
-        ncnn::VkMat in_gpu;
+        // realsr
+        ncnn::VkMat out_tile_gpu[8];
+        for (int ti = 0; ti < 8; ti++)
         {
-            cmd.record_clone(in, in_gpu, opt);
+            ncnn::Extractor ex = net.create_extractor();
+
+
+
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
+
+
+            ex.input(net_input_name.c_str(), in_tile_gpu[ti]);
+
+            ex.extract("output", out_tile_gpu[ti], cmd);
 
-            if (xtiles > 1)
             {
                 cmd.submit_and_wait();
                 cmd.reset();
             }
         }
 
-        int out_tile_y0 = std::max(yi * TILE_SIZE_Y, 0);
-        int out_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h);
-
-        ncnn::VkMat out_gpu;
-        if ((opt.use_fp16_storage || opt.use_fp16_packed) && opt.use_int8_storage)
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
         {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, (size_t)channels, 1, blob_vkallocator);
+            if (scale == 1)
+            {
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
+            }
+            if (scale == 2)
+            {
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
         }
-        else
+
+        // postproc
         {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, channels, (size_t)4u, 1, blob_vkallocator);
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = out_tile_gpu[0];
+            bindings[1] = out_tile_gpu[1];
+            bindings[2] = out_tile_gpu[2];
+            bindings[3] = out_tile_gpu[3];
+            bindings[4] = out_tile_gpu[4];
+            bindings[5] = out_tile_gpu[5];
+            bindings[6] = out_tile_gpu[6];
+            bindings[7] = out_tile_gpu[7];
+            bindings[8] = out_alpha_tile_gpu;
+            bindings[9] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = out_tile_gpu[0].w;
+            constants[1].i = out_tile_gpu[0].h;
+            constants[2].i = out_tile_gpu[0].cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = prepadding * scale;
+            constants[9].i = prepadding * scale;
+            constants[10].i = channels;
+            constants[11].i = out_alpha_tile_gpu.w;
+            constants[12].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realsr_postproc, bindings, constants, dispatcher);
         }
-
-        for (int xi = 0; xi < xtiles; xi++)
+    }
+    else
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu;
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
-
-            if (tta_mode)
-            {
-                // preproc
-                ncnn::VkMat in_tile_gpu[8];
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
-
-                    in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
-
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu[0];
-                    bindings[2] = in_tile_gpu[1];
-                    bindings[3] = in_tile_gpu[2];
-                    bindings[4] = in_tile_gpu[3];
-                    bindings[5] = in_tile_gpu[4];
-                    bindings[6] = in_tile_gpu[5];
-                    bindings[7] = in_tile_gpu[6];
-                    bindings[8] = in_tile_gpu[7];
-                    bindings[9] = in_alpha_tile_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu[0].w;
-                    constants[4].i = in_tile_gpu[0].h;
-                    constants[5].i = in_tile_gpu[0].cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = channels;
-                    constants[11].i = in_alpha_tile_gpu.w;
-                    constants[12].i = in_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu[0].w;
-                    dispatcher.h = in_tile_gpu[0].h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realsr_preproc, bindings, constants, dispatcher);
-                }
-
-                // realsr
-                ncnn::VkMat out_tile_gpu[8];
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
 
+            in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
 
+            if (channels == 4)
+            {
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
+            }
 
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu;
+            bindings[2] = in_alpha_tile_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu.w;
+            constants[4].i = in_tile_gpu.h;
+            constants[5].i = in_tile_gpu.cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = channels;
+            constants[11].i = in_alpha_tile_gpu.w;
+            constants[12].i = in_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu.w;
+            dispatcher.h = in_tile_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realsr_preproc, bindings, constants, dispatcher);
+        }
 
+        // realsr
+        ncnn::VkMat out_tile_gpu;
+        {
+            ncnn::Extractor ex = net.create_extractor();
 
-                    ex.input(net_input_name.c_str(), in_tile_gpu[ti]);
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
 
-                    ex.extract("output", out_tile_gpu[ti], cmd);
+            ex.input(net_input_name.c_str(), in_tile_gpu);
 
-                    {
-                        cmd.submit_and_wait();
-                        cmd.reset();
-                    }
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
+            ex.extract(net_output_name.c_str(), out_tile_gpu, cmd);
+        }
 
-                // postproc
-                {
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = out_tile_gpu[0];
-                    bindings[1] = out_tile_gpu[1];
-                    bindings[2] = out_tile_gpu[2];
-                    bindings[3] = out_tile_gpu[3];
-                    bindings[4] = out_tile_gpu[4];
-                    bindings[5] = out_tile_gpu[5];
-                    bindings[6] = out_tile_gpu[6];
-                    bindings[7] = out_tile_gpu[7];
-                    bindings[8] = out_alpha_tile_gpu;
-                    bindings[9] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = out_tile_gpu[0].w;
-                    constants[1].i = out_tile_gpu[0].h;
-                    constants[2].i = out_tile_gpu[0].cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = prepadding * scale;
-                    constants[9].i = prepadding * scale;
-                    constants[10].i = channels;
-                    constants[11].i = out_alpha_tile_gpu.w;
-                    constants[12].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realsr_postproc, bindings, constants, dispatcher);
-                }
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
             }
-            else
+            if (scale == 2)
             {
-                // preproc
-                ncnn::VkMat in_tile_gpu;
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
-
-                    in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, 3, in_out_tile_elemsize, 1, blob_vkallocator);
-
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
-
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu;
-                    bindings[2] = in_alpha_tile_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu.w;
-                    constants[4].i = in_tile_gpu.h;
-                    constants[5].i = in_tile_gpu.cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = channels;
-                    constants[11].i = in_alpha_tile_gpu.w;
-                    constants[12].i = in_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu.w;
-                    dispatcher.h = in_tile_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realsr_preproc, bindings, constants, dispatcher);
-                }
-
-                // realsr
-                ncnn::VkMat out_tile_gpu;
-                {
-                    ncnn::Extractor ex = net.create_extractor();
-
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input(net_input_name.c_str(), in_tile_gpu);
-
-                    ex.extract(net_output_name.c_str(), out_tile_gpu, cmd);
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
-
-                // postproc
-                {
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = out_tile_gpu;
-                    bindings[1] = out_alpha_tile_gpu;
-                    bindings[2] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = out_tile_gpu.w;
-                    constants[1].i = out_tile_gpu.h;
-                    constants[2].i = out_tile_gpu.cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = prepadding * scale;
-                    constants[9].i = prepadding * scale;
-                    constants[10].i = channels;
-                    constants[11].i = out_alpha_tile_gpu.w;
-                    constants[12].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(realsr_postproc, bindings, constants, dispatcher);
-                }
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
-
-            if (xtiles > 1) {
-                cmd.submit_and_wait();
-                cmd.reset();
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
-            high_resolution_clock::time_point end = high_resolution_clock::now();
-            float time_span_print_progress = duration_cast<duration<double>>(
-                    end - time_print_progress).count();
-            float progress_tile = (float) (yi * xtiles + xi + 1);
-            if (time_span_print_progress > 0.5 || (yi + 1 == ytiles && xi + 3 > xtiles)) {
-                double progress = progress_tile / (ytiles * xtiles);
-                double time_span = duration_cast<duration<double>>(end - begin).count();
-                fprintf(stderr, "%5.2f%%\t[%5.2fs /%5.2f ETA]\n", progress * 100, time_span,
-                        time_span / progress - time_span);
-                time_print_progress = end;
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
         }
 
-        // download
+        // postproc
         {
-            ncnn::Mat out;
-
-            if ((opt.use_fp16_storage || opt.use_fp16_packed) && opt.use_int8_storage)
-            {
-                int out_tile_y0 = std::max(yi * TILE_SIZE_Y, 0);
-                size_t offset = out_tile_y0 * scale * w * scale * channels;
-                out = ncnn::Mat(out_gpu.w, out_gpu.h, (unsigned char*)outimage.data + offset, (size_t)channels, 1, opt.blob_allocator);
-            }
-
-            cmd.record_clone(out_gpu, out, opt);
-
-            cmd.submit_and_wait();
-
-            if (!((opt.use_fp16_storage || opt.use_fp16_packed) && opt.use_int8_storage))
-            {
-                if (channels == 3)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB2BGR);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB);
-#endif
-                }
-                if (channels == 4)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA2BGRA);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA);
-#endif
-                }
-            }
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = out_tile_gpu;
+            bindings[1] = out_alpha_tile_gpu;
+            bindings[2] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = out_tile_gpu.w;
+            constants[1].i = out_tile_gpu.h;
+            constants[2].i = out_tile_gpu.cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = prepadding * scale;
+            constants[9].i = prepadding * scale;
+            constants[10].i = channels;
+            constants[11].i = out_alpha_tile_gpu.w;
+            constants[12].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(realsr_postproc, bindings, constants, dispatcher);
         }
     }
+}
 
-    vkdev->reclaim_blob_allocator(blob_vkallocator);
-    vkdev->reclaim_staging_allocator(staging_vkallocator);
-
-    return 0;
+int RealSR::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer) const
+{
+    return process_tiled_cpu(inimage, outimage, writer);
 }
 
-int RealSR::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
+int RealSR::process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const
 {
     const unsigned char* pixeldata = (const unsigned char*)inimage.data;
     const int w = inimage.w;
@@ -633,248 +521,154 @@ int RealSR::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
     const int TILE_SIZE_X = tilesize;
     const int TILE_SIZE_Y = tilesize;
 
-    ncnn::Option opt = net.opt;
-
-    // each tile 100x100
-    const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
-    const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
-
-    high_resolution_clock::time_point begin = high_resolution_clock::now();
-    high_resolution_clock::time_point time_print_progress;
-
-    for (int yi = 0; yi < ytiles; yi++)
-    {
-        const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
 
-        int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
-        int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding, h);
+    int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
+    int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding, h);
 
+    const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
 
+    int in_tile_x0 = std::max(xi * TILE_SIZE_X - prepadding, 0);
+    int in_tile_x1 = std::min((xi + 1) * TILE_SIZE_X + prepadding, w);
 
-        for (int xi = 0; xi < xtiles; xi++)
+    // crop tile
+    ncnn::Mat in;
+    {
+        if (channels == 3)
         {
-            const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
-
-            int in_tile_x0 = std::max(xi * TILE_SIZE_X - prepadding, 0);
-            int in_tile_x1 = std::min((xi + 1) * TILE_SIZE_X + prepadding, w);
-
-            // crop tile
-            ncnn::Mat in;
-            {
-                if (channels == 3)
-                {
 #if _WIN32
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGR2RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGR2RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #else
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGB, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #endif
-                }
-                if (channels == 4)
-                {
+        }
+        if (channels == 4)
+        {
 #if _WIN32
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGRA2RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_BGRA2RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #else
-                    in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
+            in = ncnn::Mat::from_pixels_roi(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h, in_tile_x0, in_tile_y0, in_tile_x1 - in_tile_x0, in_tile_y1 - in_tile_y0);
 #endif
-                }
-            }
+        }
+    }
 
-            ncnn::Mat out;
+    ncnn::Mat out;
 
-            if (tta_mode)
+    if (tta_mode)
+    {
+        // split alpha and preproc
+        ncnn::Mat in_tile[8];
+        ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
+        {
+            in_tile[0].create(in.w, in.h, 3);
+            for (int q = 0; q < 3; q++)
             {
-                // split alpha and preproc
-                ncnn::Mat in_tile[8];
-                ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
-                {
-                    in_tile[0].create(in.w, in.h, 3);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const float* ptr = in.channel(q);
-                        float* outptr0 = in_tile[0].channel(q);
-
-                        for (int i = 0; i < in.h; i++)
-                        {
-                            for (int j = 0; j < in.w; j++)
-                            {
-                                *outptr0++ = *ptr++ * (1 / 255.f);
-                            }
-                        }
-                    }
-
-                    if (channels == 4)
-                    {
-                        in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
-                        int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
-                        int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
-                        int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
-                        int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
-                        ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
-
-                    }
-                }
+                const float* ptr = in.channel(q);
+                float* outptr0 = in_tile[0].channel(q);
 
-                // border padding
-                {
-                    int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
-                    int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding - h, prepadding), 0);
-                    int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
-                    int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding - w, prepadding), 0);
-
-                    ncnn::Mat in_tile_padded;
-                    ncnn::copy_make_border(in_tile[0], in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, net.opt);
-                    in_tile[0] = in_tile_padded;
-                }
+                tile_scale(ptr, outptr0, in.w * in.h, 1 / 255.f);
+            }
 
-                // the other 7 directions
-                {
-                    in_tile[1].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[2].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[3].create(in_tile[0].w, in_tile[0].h, 3);
-                    in_tile[4].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[5].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[6].create(in_tile[0].h, in_tile[0].w, 3);
-                    in_tile[7].create(in_tile[0].h, in_tile[0].w, 3);
-
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
-                        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
-                        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
-                        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
-                        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
-                        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
-                        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
-                        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
-
-                        for (int i = 0; i < in_tile[0].h; i++)
-                        {
-                            const float* outptr0 = in_tile_0.row(i);
-                            float* outptr1 = in_tile_1.row(in_tile[0].h - 1 - i);
-                            float* outptr2 = in_tile_2.row(i) + in_tile[0].w - 1;
-                            float* outptr3 = in_tile_3.row(in_tile[0].h - 1 - i) + in_tile[0].w - 1;
-
-                            for (int j = 0; j < in_tile[0].w; j++)
-                            {
-                                float* outptr4 = in_tile_4.row(j) + i;
-                                float* outptr5 = in_tile_5.row(in_tile[0].w - 1 - j) + i;
-                                float* outptr6 = in_tile_6.row(j) + in_tile[0].h - 1 - i;
-                                float* outptr7 = in_tile_7.row(in_tile[0].w - 1 - j) + in_tile[0].h - 1 - i;
-
-                                float v = *outptr0++;
-
-                                *outptr1++ = v;
-                                *outptr2-- = v;
-                                *outptr3-- = v;
-                                *outptr4 = v;
-                                *outptr5 = v;
-                                *outptr6 = v;
-                                *outptr7 = v;
-                            }
-                        }
-                    }
-                }
+            if (channels == 4)
+            {
+                in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
+                int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
+                int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
+                int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
+                int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
+                ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
 
-                // realsr
-                ncnn::Mat out_tile[8];
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+            }
+        }
+
+        // border padding
+        {
+            int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
+            int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding - h, prepadding), 0);
+            int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
+            int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding - w, prepadding), 0);
+
+            ncnn::Mat in_tile_padded;
+            ncnn::copy_make_border(in_tile[0], in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, opt);
+            in_tile[0] = in_tile_padded;
+        }
 
-                    ex.input(net_input_name.c_str(), in_tile[ti]);
+        // the other 7 directions
+        tta_expand_8(in_tile);
 
-                    ex.extract(net_output_name.c_str(), out_tile[ti]);
-                }
+        // realsr
+        ncnn::Mat out_tile[8];
+        for (int ti = 0; ti < 8; ti++)
+        {
+            BenchInference bench_inference;
 
-                ncnn::Mat out_alpha_tile;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile = in_alpha_tile;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                }
+            ncnn::Extractor ex = net.create_extractor();
 
-                // postproc and merge alpha
-                {
-                    out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
-                        const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
-                        const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
-                        const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
-                        const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
-                        const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
-                        const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
-                        const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
-                        float* outptr = out.channel(q);
-
-                        for (int i = 0; i < out.h; i++)
-                        {
-                            const float* ptr0 = out_tile_0.row(i + prepadding * scale) + prepadding * scale;
-                            const float* ptr1 = out_tile_1.row(out_tile[0].h - 1 - i - prepadding * scale) + prepadding * scale;
-                            const float* ptr2 = out_tile_2.row(i + prepadding * scale) + out_tile[0].w - 1 - prepadding * scale;
-                            const float* ptr3 = out_tile_3.row(out_tile[0].h - 1 - i - prepadding * scale) + out_tile[0].w - 1 - prepadding * scale;
-
-                            for (int j = 0; j < out.w; j++)
-                            {
-                                const float* ptr4 = out_tile_4.row(j + prepadding * scale) + i + prepadding * scale;
-                                const float* ptr5 = out_tile_5.row(out_tile[0].w - 1 - j - prepadding * scale) + i + prepadding * scale;
-                                const float* ptr6 = out_tile_6.row(j + prepadding * scale) + out_tile[0].h - 1 - i - prepadding * scale;
-                                const float* ptr7 = out_tile_7.row(out_tile[0].w - 1 - j - prepadding * scale) + out_tile[0].h - 1 - i - prepadding * scale;
-
-                                float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
-
-                                *outptr++ = v * 255.f + 0.5f;
-                            }
-                        }
-                    }
-
-                    if (channels == 4)
-                    {
-                        memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
-                    }
-                }
+            ex.set_light_mode(opt.lightmode);
+            ex.set_num_threads(opt.num_threads);
+            ex.set_blob_allocator(opt.blob_allocator);
+            ex.set_workspace_allocator(opt.workspace_allocator);
+
+            ex.input(net_input_name.c_str(), in_tile[ti]);
+
+            ex.extract(net_output_name.c_str(), out_tile[ti]);
+        }
+
+        ncnn::Mat out_alpha_tile;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile = in_alpha_tile;
             }
-            else
+            if (scale == 2)
             {
-                // split alpha and preproc
-                ncnn::Mat in_tile;
-                ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
-                {
-                    in_tile.create(in.w, in.h, 3);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        const float* ptr = in.channel(q);
-                        float* outptr = in_tile.channel(q);
-
-                        for (int i = 0; i < in.w * in.h; i++)
-                        {
-                            *outptr++ = *ptr++ * (1 / 255.f);
-                        }
-                    }
-
-                    if (channels == 4)
-                    {
-                        in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
-                        int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
-                        int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
-                        int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
-                        int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
-                        ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
+                bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+        }
+
+        // postproc and merge alpha
+        {
+            out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
+            tta_merge_8(out_tile, out, prepadding * scale, 255.f, 0.5f);
+
+            if (channels == 4)
+            {
+                memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
+            }
+        }
+    }
+    else
+    {
+        // split alpha and preproc
+        ncnn::Mat in_tile;
+        ncnn::Mat in_alpha_tile, in_alpah_tile_nocrop;
+        {
+            in_tile.create(in.w, in.h, 3);
+            for (int q = 0; q < 3; q++)
+            {
+                const float* ptr = in.channel(q);
+                float* outptr = in_tile.channel(q);
+
+                tile_scale(ptr, outptr, in.w * in.h, 1 / 255.f);
+            }
+
+            if (channels == 4)
+            {
+                in_alpah_tile_nocrop = in.channel_range(3, 1).clone();
+                int crop_top=(yi*TILE_SIZE_Y-in_tile_y0);
+                int crop_bottom=in_tile_y1-std::min(yi*TILE_SIZE_Y+TILE_SIZE_Y ,h);
+                int crop_left=(xi*TILE_SIZE_X-in_tile_x0);
+                int crop_right=in_tile_x1-std::min(xi*TILE_SIZE_X+TILE_SIZE_X ,w);
+                ncnn::copy_cut_border(in_alpah_tile_nocrop, in_alpha_tile, crop_top, crop_bottom, crop_left, crop_right);
 
 //                        fprintf(stderr,"in_alpah_tile_nocrop: %d/%d/%d, in_alpha_tile: %d/%d/%d, crop: %d/%d/%d/%d, TILE_SIZE_X %d, TILE_SIZE_Y %d\n"
 //                                ,in_alpah_tile_nocrop.w,in_alpah_tile_nocrop.h,in_alpah_tile_nocrop.c
@@ -882,72 +676,77 @@ int RealSR::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
 //                                ,crop_top,crop_bottom,crop_left,crop_right
 //                                ,TILE_SIZE_X,TILE_SIZE_Y
 //                                );
-                    }
-                }
+            }
+        }
 
-                // border padding
-                {
-                    int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
-                    int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding - h, prepadding), 0);
-                    int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
-                    int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding - w, prepadding), 0);
-
-                    ncnn::Mat in_tile_padded;
-                    ncnn::copy_make_border(in_tile, in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, net.opt);
-                    in_tile = in_tile_padded;
-                }
+        // border padding
+        {
+            int pad_top = std::max(prepadding - yi * TILE_SIZE_Y, 0);
+            int pad_bottom = std::max(std::min((yi + 1) * TILE_SIZE_Y + prepadding - h, prepadding), 0);
+            int pad_left = std::max(prepadding - xi * TILE_SIZE_X, 0);
+            int pad_right = std::max(std::min((xi + 1) * TILE_SIZE_X + prepadding - w, prepadding), 0);
+
+            ncnn::Mat in_tile_padded;
+            ncnn::copy_make_border(in_tile, in_tile_padded, pad_top, pad_bottom, pad_left, pad_right, 2, 0.f, opt);
+            in_tile = in_tile_padded;
+        }
 
-                // realsr
-                ncnn::Mat out_tile;
-                {
-                    ncnn::Extractor ex = net.create_extractor();
+        // realsr
+        ncnn::Mat out_tile;
+        {
+            BenchInference bench_inference;
 
-                    ex.input(net_input_name.c_str(), in_tile);
+            ncnn::Extractor ex = net.create_extractor();
 
-                    ex.extract(net_output_name.c_str(), out_tile);
-                }
+            ex.set_light_mode(opt.lightmode);
+            ex.set_num_threads(opt.num_threads);
+            ex.set_blob_allocator(opt.blob_allocator);
+            ex.set_workspace_allocator(opt.workspace_allocator);
 
-                ncnn::Mat out_alpha_tile;
-                if (channels == 4)
+            ex.input(net_input_name.c_str(), in_tile);
+
+            ex.extract(net_output_name.c_str(), out_tile);
+        }
+
+        ncnn::Mat out_alpha_tile;
+        if (channels == 4)
+        {
+            if (scale == 1)
+            {
+                out_alpha_tile = in_alpha_tile;
+            }
+            if (scale == 2)
+            {
+                bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
+            }
+        }
+
+        // postproc and merge alpha
+        {
+            out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
+            for (int q = 0; q < 3; q++)
+            {
+                float* outptr = out.channel(q);
+
+                for (int i = 0; i < out.h; i++)
                 {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile = in_alpha_tile;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile, out_alpha_tile, opt);
-                    }
+                    const float* ptr = out_tile.channel(q).row(i + prepadding * scale) + prepadding * scale;
+
+                    tile_scale_bias(ptr, outptr, out.w, 255.f, 0.5f);
+                    outptr += out.w;
                 }
+            }
 
-                // postproc and merge alpha
-                {
-                    out.create(tile_w_nopad * scale, tile_h_nopad * scale, channels);
-                    for (int q = 0; q < 3; q++)
-                    {
-                        float* outptr = out.channel(q);
-
-                        for (int i = 0; i < out.h; i++)
-                        {
-                            const float* ptr = out_tile.channel(q).row(i + prepadding * scale) + prepadding * scale;
-
-                            for (int j = 0; j < out.w; j++)
-                            {
-                                *outptr++ = *ptr++ * 255.f + 0.5f;
-                            }
-                        }
-                    }
-
-                    if (channels == 4)
-                    {
+            if (channels == 4)
+            {
 //                        fprintf(stderr, "process_cpu 4c memcpy\n");
 //                        fprintf(stderr,"outimage: %d/%d/%d, outtile: %d/%d/%d, offset: %d, outimage size: %d, outtile size: %d, left: %d, outtilealpha: %d/%d/%d, %d * %d\n"
 //                                ,outimage.w,outimage.h,outimage.c,out.w,out.h,out.c
@@ -959,46 +758,30 @@ int RealSR::process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
 //                        );
 
 
-                        memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
+                memcpy(out.channel_range(3, 1), out_alpha_tile, out_alpha_tile.total() * sizeof(float));
 
 //                        fprintf(stderr, "process_cpu 4c memcpy done\n");
 
-                    }
-                }
             }
+        }
+    }
 
-            {
-                if (channels == 3)
-                {
+    {
+        if (channels == 3)
+        {
 #if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB2BGR, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB2BGR, w * scale * channels);
 #else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGB, w * scale * channels);
 #endif
-                }
-                if (channels == 4)
-                {
+        }
+        if (channels == 4)
+        {
 #if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA2BGRA, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA2BGRA, w * scale * channels);
 #else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA, w * scale * channels);
+            out.to_pixels(outrows + xi * scale * TILE_SIZE_X * channels, ncnn::Mat::PIXEL_RGBA, w * scale * channels);
 #endif
-                }
-            }
-
-            high_resolution_clock::time_point end = high_resolution_clock::now();
-            float time_span_print_progress = duration_cast<duration<double>>(
-                    end - time_print_progress).count();
-            float progress_tile = (float) (yi * xtiles + xi + 1);
-            if (time_span_print_progress > 0.5 || (yi + 1 == ytiles && xi + 3 > xtiles)) {
-                double progress = progress_tile / (ytiles * xtiles);
-                double time_span = duration_cast<duration<double>>(end - begin).count();
-//                fprintf(stderr, "%5.2f%%\t[%5.2fs /%5.2f] y %d x %d\n", progress * 100,time_span,
-//                        time_span / progress - time_span ,yi,xi, omp_get_thread_num());
-                fprintf(stderr, "%5.2f%%\t[%5.2fs /%5.2f ETA]\n", progress * 100, time_span,
-                        time_span / progress - time_span);
-                time_print_progress = end;
-            }
         }
     }
 
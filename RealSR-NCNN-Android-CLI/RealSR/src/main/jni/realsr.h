@@ -11,9 +11,14 @@
 #include "layer.h"
 #include <chrono>
 
+#include "tiled_upscaler.h"
+
 using namespace std::chrono;
-class RealSR
+
+class RealSR : public TiledUpscaler<RealSR>
 {
+    friend class TiledUpscaler<RealSR>;
+
 public:
     RealSR(int gpuid, bool tta_mode = false, int num_threads = 1);
     ~RealSR();
@@ -24,9 +29,21 @@ public:
     int load(const std::string& parampath, const std::string& modelpath);
 #endif
 
-    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    // with a writer the output is encoded band by band and outimage is left untouched
+    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+    // -G, the tile rows of one image split across the engines of several devices
+    static int process_shared(const std::vector<const RealSR*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage);
+
+private:
+    // TiledUpscaler hooks
+    bool band_int8(const ncnn::Option& opt) const;
+
+    void process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
-    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    int process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
 public:
     // realsr parameters
@@ -51,6 +51,7 @@ using namespace cv;
 
 #include "perfect_pixel.h"
 #include "mosaic_detect.h"
+#include "resize_threads.h"
 
 using namespace std::chrono;
 
@@ -152,6 +153,8 @@ static std::vector<int> parse_optarg_int_array(const char *optarg) {
 
 #include "filesystem_utils.h"
 #include "image_processor.h"
+#include "bench_mode.h"
+#include "task_queue.h"
 
 static void print_usage() {
     fprintf(stderr, "Usage: resize-ncnn -i infile -o outfile [options]...\n\n");
@@ -162,10 +165,934 @@ static void print_usage() {
     fprintf(stderr, "  -s scale             upscale ratio (4, default=4)\n");
     fprintf(stderr, "  -m mode        resize mode (bicubic/bilinear/nearest/avir/avir-lancir/de-nearest/de-nearest2/de-nearest3/perfectpixel, default=nearest)\n");
     fprintf(stderr, "  -n not-use-ncnn        bicubic/bilinear not use ncnn\n");
+    fprintf(stderr, "  -j load:proc:save    thread count for load/proc/save (default=1:big cores:2), proc is the threads of avir/avir-lancir\n");
+    fprintf(stderr, "                       or the images resized at once in the other modes, with -B proc can be a list like 1,2,4\n");
     fprintf(stderr, "  -f format            force output format (ignore alpha channel detection)\n");
     fprintf(stderr, "  -e format            suggested output format (auto-convert to png if alpha detected)\n");
     fprintf(stderr, "  -k skip-size         skip if output file exists and size >= threshold bytes (0=disable)\n");
     fprintf(stderr, "  -p pattern           output name pattern for batch mode, placeholders: {name} {prog} {index} {timestamp} {datetime} {date} {time}\n");
+    fprintf(stderr, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
+}
+
+// the avir/lancir/ncnn interpolation modes, buf holds out_w x out_h x c pixels.
+// avir and lancir run on the threads of pool, lancir keeps its bands in lancir
+static void resize_pixels(const path_t& model, const unsigned char* pixeldata, int w, int h, int c,
+                          unsigned char* buf, int out_w, int out_h, ResizeThreadPool& pool, LancirBands& lancir) {
+    if (model.find(PATHSTR("lancir")) != path_t::npos) {
+        lancir.resize(pixeldata, w, h, c, buf, out_w, out_h);
+    } else if (model.find(PATHSTR("avir")) != path_t::npos) {
+        avir::CImageResizerVars vars;
+        vars.ThreadPool = &pool;
+        avir::CImageResizer<> ImageResizer(8);
+        ImageResizer.resizeImage(pixeldata, w, h, 0, buf, out_w, out_h, c, 0, &vars);
+    } else {
+        ncnn::Mat in, out;
+        if (c == 4) {
+            in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h);
+        } else {
+            in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGB, w, h);
+        }
+
+        if (model.find(PATHSTR("nearest")) != path_t::npos) {
+            ncnn::resize_nearest(in, out, out_w, out_h);
+        } else if (model.find(PATHSTR("bilinear")) != path_t::npos) {
+            ncnn::resize_bilinear(in, out, out_w, out_h);
+        } else {
+            ncnn::resize_bicubic(in, out, out_w, out_h);
+        }
+
+        if (c == 4) {
+            out.to_pixels(buf, ncnn::Mat::PIXEL_RGBA);
+        } else {
+            out.to_pixels(buf, ncnn::Mat::PIXEL_RGB);
+        }
+    }
+}
+
+class Task {
+public:
+    int id;
+
+    path_t inpath;
+    path_t outpath;
+
+    // decoded rgb/rgba pixels from malloc, freed by the proc stage
+    unsigned char *pixeldata;
+    int w;
+    int h;
+    int c;
+
+    // resized pixels from new[], freed by the save stage
+    unsigned char *buf;
+    int out_w;
+    int out_h;
+
+    size_t bytes() const {
+        return (pixeldata ? (size_t) w * h * c : 0) + (buf ? (size_t) out_w * out_h * c : 0);
+    }
+};
+
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
+
+#if !_WIN32
+// stb_image gives grey and grey + alpha images in 1 and 2 channels, they are widened to rgb and rgba
+// in the same buffer from the last pixel back, so no pixel is overwritten before it is read
+static unsigned char *expand_grey(unsigned char *pixeldata, int w, int h, int &c) {
+    const int out_c = c == 1 ? 3 : 4;
+    const size_t count = (size_t) w * h;
+
+    unsigned char *data = (unsigned char *) realloc(pixeldata, count * out_c);
+    if (!data) {
+        free(pixeldata);
+        return 0;
+    }
+
+    for (size_t i = count; i-- > 0;) {
+        const unsigned char grey = data[i * c];
+        const unsigned char alpha = c == 2 ? data[i * c + 1] : 255;
+        unsigned char *p = data + i * out_c;
+        p[0] = grey;
+        p[1] = grey;
+        p[2] = grey;
+        if (out_c == 4)
+            p[3] = alpha;
+    }
+
+    c = out_c;
+    return data;
+}
+#endif // _WIN32
+
+class LoadThreadParams {
+public:
+    int jobs_load;
+    path_t output_format;
+
+    // session data
+    std::vector<path_t> input_files;
+    std::vector<path_t> output_files;
+
+    std::atomic<int> next;
+    std::atomic<int> decode_failed;
+};
+
+// every load thread reads and decodes the next file not taken yet
+void *load(void *args) {
+    LoadThreadParams *ltp = (LoadThreadParams *) args;
+    const int count = ltp->input_files.size();
+
+    for (;;) {
+        const int i = ltp->next++;
+        if (i >= count)
+            break;
+
+        const path_t &imagepath = ltp->input_files[i];
+
+        unsigned char *pixeldata = 0;
+        int w;
+        int h;
+        int c;
+
+#if _WIN32
+        FILE* fp = _wfopen(imagepath.c_str(), L"rb");
+#else
+        FILE *fp = fopen(imagepath.c_str(), "rb");
+#endif
+        if (fp) {
+            // read whole file
+            unsigned char *filedata = 0;
+            int length = 0;
+            {
+                fseek(fp, 0, SEEK_END);
+                length = ftell(fp);
+                rewind(fp);
+                filedata = (unsigned char *) malloc(length);
+                if (filedata) {
+                    fread(filedata, 1, length, fp);
+                }
+                fclose(fp);
+            }
+
+            if (filedata) {
+                pixeldata = webp_load(filedata, length, &w, &h, &c);
+                if (!pixeldata) {
+                    // not webp, try jpg png etc.
+#if _WIN32
+                    pixeldata = wic_decode_image(imagepath.c_str(), &w, &h, &c);
+#else // _WIN32
+                    pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 0);
+
+                    fprintf(stderr, "pixeldata stbi_load w/h/c %d/%d/%d \n",
+                            w, h, c
+                    );
+
+                    // stb_image auto channel, grayscale -> rgb, grayscale + alpha -> rgba
+                    if (pixeldata && (c == 1 || c == 2)) {
+                        pixeldata = expand_grey(pixeldata, w, h, c);
+                    }
+#endif // _WIN32
+                }
+            } else if (_VERBOSE_LOG) {
+#if _WIN32
+                fwprintf(stderr, L"no filedata\n");
+#else // _WIN32
+                fprintf(stderr, "no filedata\n");
+#endif // _WIN32
+            }
+
+            free(filedata);
+        } else if (_VERBOSE_LOG) {
+#if _WIN32
+            fwprintf(stderr, L"fopen failed\n");
+#else // _WIN32
+            fprintf(stderr, "fopen failed\n");
+#endif // _WIN32
+        }
+
+        if (!pixeldata) {
+            ltp->decode_failed++;
+#if _WIN32
+            fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
+#else // _WIN32
+            fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
+#endif // _WIN32
+            continue;
+        }
+
+        Task v;
+        v.id = i;
+        v.inpath = imagepath;
+        v.outpath = ltp->output_files[i];
+        v.pixeldata = pixeldata;
+        v.w = w;
+        v.h = h;
+        v.c = c;
+        v.buf = 0;
+        v.out_w = 0;
+        v.out_h = 0;
+
+        path_t ext = get_file_extension(v.outpath);
+        if (c == 4 && ltp->output_format.empty() &&
+            (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") ||
+             ext == PATHSTR("JPEG"))) {
+            path_t output_filename2 = v.outpath + PATHSTR(".png");
+            v.outpath = output_filename2;
+#if _WIN32
+            fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+#else // _WIN32
+            fprintf(stderr, "image %s has alpha channel ! %s will output %s\n",
+                    imagepath.c_str(),
+                    imagepath.c_str(), output_filename2.c_str());
+#endif // _WIN32
+        }
+
+        toproc.put(std::move(v), v.bytes());
+    }
+
+    return 0;
+}
+
+class ProcThreadParams {
+public:
+    path_t model;
+    int scale;
+    double scale_d;
+    bool not_use_ncnn;
+    int verbose;
+
+    // avir and avir-lancir run a single proc thread, it resizes every image on all threads of the pool
+    ResizeThreadPool *pool;
+    LancirBands *lancir;
+
+    std::atomic<int> failed;
+};
+
+// resize v.pixeldata into v.buf, the de-nearest modes detect the scale of every image first
+static int process_image(const ProcThreadParams *ptp, Task &v) {
+    const path_t &model = ptp->model;
+    const int verbose = ptp->verbose;
+    int scale = ptp->scale;
+    double scale_d = ptp->scale_d;
+    bool not_use_ncnn = ptp->not_use_ncnn;
+
+    unsigned char *pixeldata = v.pixeldata;
+    const int w = v.w;
+    const int h = v.h;
+    const int c = v.c;
+
+    // 计算降采样的倍率
+    if (model.find(PATHSTR("de-nearest3")) != path_t::npos){
+        // 使用demosaic算法检查目标倍率
+        scale = detectMosaicResolution(pixeldata, w, h, c);
+        scale_d = 1.0 / scale;
+        fprintf(stderr, "image might be interpolated by nearest x%d\n", scale);
+    } else if (model.find(PATHSTR("de-nearest2")) != path_t::npos) {
+        fprintf(stderr, "Running de-nearest2 (identical row/col check):\n");
+
+        int identical_rows = 0;
+        int identical_cols = 0;
+        // Tolerance for comparison (e.g., handle minor JPEG artifacts)
+        // Set to 0 for strict nearest neighbor, maybe 1 or 2 otherwise.
+        const int tolerance = 32;
+        int line_size = w * c;
+
+        // --- Row Comparison ---
+        // Compare row i with row i-1
+        for (int i = 1; i < h; ++i) {
+            bool rows_are_identical = true;
+            // Pointer to the start of row i and row i-1
+            const unsigned char* p1 = pixeldata + i * line_size;
+            const unsigned char* p0 = pixeldata + (i - 1) * line_size;
+            // Compare the entire row byte by byte (or pixel by pixel)
+            for (int j = 0; j < line_size; ++j) {
+                if (abs(p1[j] - p0[j]) > tolerance) {
+                    rows_are_identical = false;
+                    break; // Rows differ, no need to check further
+                }
+            }
+            if (rows_are_identical) {
+                identical_rows++;
+            }
+        }
+
+        // --- Column Comparison ---
+        // Compare column j with column j-1
+        for (int j = 1; j < w; ++j) {
+            bool cols_are_identical = true;
+            // Iterate through each row for the current pair of columns
+            for (int i = 0; i < h; ++i) {
+                // Pointer to pixel (i, j) and pixel (i, j-1)
+                const unsigned char* p1 = pixeldata + i * line_size + j * c;
+                const unsigned char* p0 = pixeldata + i * line_size + (j - 1) * c;
+                // Compare all channels for this pixel
+                for(int k = 0; k < c; ++k) {
+                    if (abs(p1[k] - p0[k]) > tolerance) {
+                        cols_are_identical = false;
+                        break; // Pixels differ in this channel
+                    }
+                }
+                if (!cols_are_identical) {
+                    break; // Columns differ in this row, no need to check further rows
+                }
+            }
+            if (cols_are_identical) {
+                identical_cols++;
+            }
+        }
+
+        fprintf(stderr, "Identical adjacent rows found: %d (out of %d pairs)\n", identical_rows, h - 1);
+        fprintf(stderr, "Identical adjacent cols found: %d (out of %d pairs)\n", identical_cols, w - 1);
+
+        // --- Calculate Scale ---
+        double scale_y = 1.0;
+        double scale_x = 1.0;
+
+        // Number of unique rows = total rows - identical rows = h - identical_rows
+        // Scale = total rows / unique rows
+        int unique_rows = h - identical_rows;
+        if (unique_rows > 0) {
+            // We expect identical_rows ~= (scale_y - 1) * unique_rows
+            // So h = scale_y * unique_rows => scale_y = h / unique_rows
+            scale_y = static_cast<double>(h) / unique_rows;
+        } else if (h > 0) {
+            fprintf(stderr, "Warning: Zero unique rows estimated (image might be uniform vertically?). Assuming scale_y=1.\n");
+            // If the image is perfectly uniform vertically, scale is ambiguous.
+            // Or maybe identical_rows calculation is slightly off near 100%
+            // If identical_rows == h-1 (all rows same), scale_y is effectively h if h>1, or 1 if h=1.
+            // Let's refine: if identical_rows == h-1 and h > 1, maybe scale_y = h?
+            // But sticking to scale_y = h / unique_rows seems more general. A near-zero unique_rows will give large scale.
+            // If unique_rows is truly 0, maybe scale_y=1 is safest default.
+            scale_y = 1.0;
+        }
+
+        // Similarly for columns
+        int unique_cols = w - identical_cols;
+        if (unique_cols > 0) {
+            scale_x = static_cast<double>(w) / unique_cols;
+        } else if (w > 0) {
+            fprintf(stderr, "Warning: Zero unique cols estimated (image might be uniform horizontally?). Assuming scale_x=1.\n");
+            scale_x = 1.0;
+        }
+
+        fprintf(stderr, "Calculated scale_x: %.3f, scale_y: %.3f\n", scale_x, scale_y);
+
+        // --- Validation and Output ---
+        double scale_threshold = 1.9; // Require scale to be close to at least 2
+        double integer_proximity = 0.3; // How close scale needs to be to an integer
+        double scale_diff_threshold = 0.4; // How close scale_x and scale_y need to be
+
+        bool detected = false;
+        int final_scale = 1;
+
+        // Check if both scales are valid and close to each other
+        if (scale_x >= scale_threshold && scale_y >= scale_threshold &&
+            abs(scale_x - round(scale_x)) < integer_proximity &&
+            abs(scale_y - round(scale_y)) < integer_proximity &&
+            abs(scale_x - scale_y) <= scale_diff_threshold)
+        {
+            final_scale = static_cast<int>(round((scale_x + scale_y) / 2.0));
+            fprintf(stderr, "Consistent x/y scaling detected.\n");
+            detected = true;
+        }
+            // Check if only scale_x is valid (potential horizontal-only scaling)
+        else if (scale_x >= scale_threshold && scale_y < 1.5 && // Check y scale is low
+                 abs(scale_x - round(scale_x)) < integer_proximity)
+        {
+            final_scale = static_cast<int>(round(scale_x));
+            fprintf(stderr, "Horizontal-only scaling detected.\n");
+            detected = true;
+        }
+            // Check if only scale_y is valid (potential vertical-only scaling)
+        else if (scale_y >= scale_threshold && scale_x < 1.5 && // Check x scale is low
+                 abs(scale_y - round(scale_y)) < integer_proximity)
+        {
+            final_scale = static_cast<int>(round(scale_y));
+            fprintf(stderr, "Vertical-only scaling detected.\n");
+            detected = true;
+        }
+            // Maybe a fallback if they are different but both look like integers?
+        else if (scale_x >= scale_threshold && scale_y >= scale_threshold &&
+                 abs(scale_x - round(scale_x)) < integer_proximity &&
+                 abs(scale_y - round(scale_y)) < integer_proximity)
+        {
+            // Scales differ but both look valid - take the minimum? Or average?
+            // Taking minimum might be safer for downscaling.
+            final_scale = static_cast<int>(round(fmin(scale_x, scale_y)));
+            fprintf(stderr, "Warning: Different integer scales detected (x%.1f, y%.1f). Using minimum scale %d.\n", scale_x, scale_y, final_scale);
+            detected = true;
+        }
+
+
+        if (detected && final_scale >= 2) {
+            scale = final_scale; // Set the global scale variable
+            scale_d = 1.0 / scale;
+            not_use_ncnn = false; // Indicate we found a scale and NCNN is not needed for this task
+            fprintf(stderr, "de-nearest2: Image likely interpolated by nearest x%d\n", scale);
+        } else {
+            fprintf(stderr, "de-nearest2: Image does not appear to be clearly interpolated by nearest neighbor (scale_x=%.2f, scale_y=%.2f, final_scale=%.2f)\n", scale_x, scale_y, final_scale);
+            return -1; // Indicate failure or non-detection by this method
+        }
+    }
+
+    else if (model.find(PATHSTR("de-nearest")) != path_t::npos) {
+        // Use dynamic allocation instead of VLA (not supported by VS)
+        double *lost_y = new double[h - 1];
+        double *lost_x = new double[w - 1];
+        double avg_y = 0, avg_x = 0;
+        double scale_y = 1, scale_x = 1;
+        int line_size = w * c;
+
+        double **lost_x0 = new double *[h];
+        for (int i = 0; i < h; i++) {
+            lost_x0[i] = new double[w - 1];
+        }
+
+//                fprintf(stderr, "de-nearest:");
+
+        //row
+        int p = line_size;
+        int q = 0;
+        for (int i = 0; i < h - 1; i++) {
+            //line
+            double l = 0;
+            for (int j = 0; j < line_size; j++) {
+                l += pow(pixeldata[p] - pixeldata[q], 2);
+                p++;
+                q++;
+                //   fprintf(stderr," [%d,%d]",i ,j);
+            }
+
+            double m = l / line_size;
+            lost_y[i] = m;
+            avg_y += m;
+        }
+
+        avg_y = avg_y / (h - 1);
+
+        for (int i = 0; i < h - 1; i++) {
+            if (lost_y[i] > avg_y) {
+//                         fprintf(stderr," [%.2f]", lost_y[i]);
+                scale_y++;
+            } //else
+//                         fprintf(stderr," %.2f", lost_y[i]);
+        }
+        fprintf(stderr, "scale_y: %d/%f", h, scale_y);
+        scale_y = h / scale_y;
+        fprintf(stderr, " = %f; avg_lost_y=[%f]\n", scale_y, avg_y);
+
+        for (int i = 0; i < h; i++) {
+            p = i * line_size;
+            for (int j = 0; j < w - 1; j++) {
+                double l = 0;
+                for (int k = 0; k < c; k++) {
+//                            l += pow(pixeldata[p] - pixeldata[p + c], 2);
+                    l = fmax(l, pow(pixeldata[p] - pixeldata[p + c], 2));
+                    p++;
+                }
+                lost_x0[i][j] = l;
+
+                // fprintf(stderr," [%d,%d]",i ,j);
+            }
+//                    fprintf(stderr, " %d", i);
+        }
+
+        for (int j = 0; j < w - 1; j++) {
+            double l = 0;
+            for (int i = 0; i < h; i++) {
+                l += lost_x0[i][j];
+            }
+            double m = l / h;
+            lost_x[j] = m;
+            avg_x += m;
+        }
+
+        avg_x = avg_x / (w - 1);
+
+        for (int i = 0; i < w - 1; i++) {
+            if (lost_x[i] > avg_x) {
+//                    fprintf(stderr," [%.2f]", lost_x[i]);
+                scale_x++;
+            } // else
+//                    fprintf(stderr," %.2f", lost_x[i]);
+        }
+        fprintf(stderr, "scale_x: %d/%f", w, scale_x);
+        scale_x = w / scale_x;
+        fprintf(stderr, " = %f; avg_lost_x=[%f]\n", scale_x, avg_x);
+
+        for (int i = 0; i < h; i++) {
+            delete[] lost_x0[i];
+        }
+        delete[] lost_x0;
+
+        // Free dynamically allocated arrays
+        delete[] lost_y;
+        delete[] lost_x;
+
+        if (scale_x < 1.5 || scale_y < 1.5) {
+            fprintf(stderr, "image is not interpolated by nearest\n");
+            return -1;
+        } else {
+            not_use_ncnn = false;
+            if (abs(scale_y - scale_x) < 1)
+                scale = round((scale_x + scale_y) / 2);
+            else if (scale_x > scale_y)
+                scale = round(scale_y);
+            else
+                scale = round(scale_x);
+
+            scale_d = 1.0 / scale;
+            fprintf(stderr, "image might be interpolated by nearest x%d\n", scale);
+        }
+    }
+
+    int out_w, out_h;
+    if ( scale_d<1 ) {
+        out_w = (int) (w * scale_d);
+        out_h = (int) (h * scale_d);
+    } else if (model.find(PATHSTR("perfectpixel")) != path_t::npos && scale <= 0) {
+         // perfectpixel mode with scale <= 0 implies outputting original size
+         // We set a placeholder out_w/out_h to w/h for initial allocation (though it will be reallocated)
+         out_w = w;
+         out_h = h;
+    } else {
+        out_w = w * scale;
+        out_h = h * scale;
+    }
+    int out_line_size = out_w * c;
+    unsigned char *buf = new unsigned char[out_line_size * out_h];
+    fprintf(stderr, "output w/h/s/s = %d/%d/%d/%f, mode=%s\n", out_w, out_h, scale, scale_d,
+            model.c_str());
+
+    if (verbose) {
+        fprintf(stderr, "pixeldata: ");
+        for (int i = 0; i < 32; i++) {
+            fprintf(stderr, " %08X", pixeldata[i]);
+        }
+        fprintf(stderr, "\n");
+    }
+
+    high_resolution_clock::time_point process_begin = high_resolution_clock::now();
+
+
+    if (not_use_ncnn && model.find(PATHSTR("nearest")) != path_t::npos) {
+
+        if (_MODE == 1) {
+
+            //row
+            for (int i = 0; i < h; i++) {
+                //line
+                for (int j = 0; j < w; j++) {
+                    int p = (w * i + j) * c;
+                    int q = (out_w * i + j) * c * scale;
+
+                    //sub-pixel
+                    for (int k = 0; k < c; k++) {
+                        int m = pixeldata[p + k];
+
+                        // output x offset
+                        int x_offset = 0;
+                        for (int n = 0; n < scale; n++) {
+                            int o = q + k + x_offset;
+
+                            // output y offset
+                            int y_offset = 0;
+                            for (int g = 0; g < scale; g++) {
+                                buf[o + y_offset] = m;
+                                y_offset += out_line_size;
+                            }
+                            x_offset += c;
+                        }
+
+                        if (verbose) {
+                            fprintf(stderr, "i:%d j:%d :", i, j);
+                            for (int i = 0; i < 32; i++) {
+                                fprintf(stderr, " %02X", buf[i]
+                                );
+                            }
+                            fprintf(stderr, " ,m=%d %d\n", p + k, k + q);
+                        }
+                    }
+                }
+            }
+        } else {
+            if(scale_d>=1)
+            {
+                int p = 0;
+                int q = 0;
+                //row
+                for (int i = 0; i < h; i++) {
+                    //line
+                    void *l = buf + q;
+                    for (int j = 0; j < w; j++) {
+
+                        //pixel
+                        for (int k = 0; k < scale; k++) {
+                            memcpy(buf + q, pixeldata + p, sizeof(unsigned char) * c);
+                            q += c;
+                        }
+                        p += c;
+                    }
+                    // mult-line
+                    for (int k = 1; k < scale; k++) {
+                        memcpy(buf + q, l, sizeof(unsigned char) * out_line_size);
+                        q += out_line_size;
+                    }
+                }
+            }else{
+                // de-nearest
+                int p=(scale-1)/2, q=0;
+                // double step = 1/scale_d;
+                // row
+                for(int i=0;i<out_h;i++){
+                    for(int j=0;j<out_w;j++){
+                        memcpy(buf + q, pixeldata + p+j*scale, sizeof(unsigned char) * c);
+                        q+=c;
+                    }
+                    p+=w*c;
+                }
+            }
+        }
+
+    } else if (not_use_ncnn && model.find(PATHSTR("bilinear")) != path_t::npos) {
+        if (w < 2 && h < 2) {
+            fprintf(stderr, "[Err]image is too small\n");
+            delete[] buf;
+            return -1;
+        }
+        if (scale < 2) {
+            fprintf(stderr, "[Err]scale <2\n");
+            delete[] buf;
+            return -1;
+        }
+
+
+        out_w = out_w - scale + 1;
+        out_h = out_h - scale + 1;
+        out_line_size = out_w * c;
+        delete[] buf;
+        buf = new unsigned char[out_line_size * out_h];
+
+        // 子像素a点，b点
+        unsigned char a, b;
+        int p = 0;
+        int q = 0;
+
+        int block_size = scale * out_line_size;
+
+        // channel
+        for (int l = 0; l < c; l++) {
+            p = l;
+            q = l;
+            for (int i = 0; i < h; i++) {
+                for (int j = 1; j < w; j++) {
+
+                    a = pixeldata[p];
+                    b = pixeldata[p + c];
+                    if (a == b) {
+                        for (int k = 0; k < scale; k++) {
+                            buf[q] = a;
+                            q += c;
+                        }
+                    } else {
+                        float d = ((float) (b - a)) / scale;
+                        float e = 0;
+                        for (int k = 0; k < scale; k++) {
+                            buf[q] = a + (int) (e);
+                            e += d;
+                            q += c;
+                        }
+                    }
+
+                    p += c;
+                }
+                buf[q] = b;
+                p += c;
+                q = q + block_size - out_line_size + c;
+                //                        fprintf(stderr, " %d-%d",l,i);
+            }
+
+        }
+
+        //                fprintf(stderr, "\n 2nd\n");
+        //
+        //                fprintf(stderr, "out_line_size=%d block=%d\n", out_line_size, block_size);
+        p = 0;
+        for (int i = 0; i < h; i++) {
+
+            for (int j = 0; j < out_line_size; j++) {
+                a = buf[p];
+                q = out_line_size;
+                b = buf[p + block_size];
+                if (a == b) {
+                    for (int k = 1; k < scale; k++) {
+                        buf[p + q] = a;
+                        q += out_line_size;
+                    }
+                } else {
+                    float d = ((float) (b - a)) / scale;
+                    float e = d;
+                    for (int k = 1; k < scale; k++) {
+                        buf[p + q] = a + (int) (e);
+                        //                            fprintf(stderr, "i-j:%d-%d p-q-k:%d-%d-%d\n",i,j, p, q,k);
+                        e += d;
+                        q += out_line_size;
+                    }
+
+                }
+
+                p++;
+            }
+            p = p + block_size - out_line_size;
+
+        }
+
+    } else if (model.find(PATHSTR("perfectpixel")) != path_t::npos) {
+        // Perfect Pixel Mode
+        cv::Mat in_mat;
+        if (c == 3) in_mat = cv::Mat(h, w, CV_8UC3, pixeldata);
+        else if (c == 4) in_mat = cv::Mat(h, w, CV_8UC4, pixeldata);
+
+        if (!in_mat.empty()) {
+            cv::Mat out_mat;
+            if (process_perfect_pixel(in_mat, out_mat, scale) == 0) {
+                if (buf) delete[] buf;
+                out_w = out_mat.cols;
+                out_h = out_mat.rows;
+                out_line_size = out_w * c;
+                buf = new unsigned char[out_mat.total() * out_mat.elemSize()];
+                memcpy(buf, out_mat.data, out_mat.total() * out_mat.elemSize());
+            } else {
+                fprintf(stderr, "perfectpixel failed\n");
+            }
+        }
+    } else {
+        resize_pixels(model, pixeldata, w, h, c, buf, out_w, out_h, *ptp->pool, *ptp->lancir);
+    }
+
+    high_resolution_clock::time_point process_end = high_resolution_clock::now();
+    duration<double> process_time_span = duration_cast<duration<double>>(process_end - process_begin);
+    fprintf(stderr, "%s use time: %.3lf\n", model.c_str(),process_time_span.count());
+
+    if (verbose) {
+        fprintf(stderr, "buf data: ");
+        for (int i = 0; i < 32; i++) {
+            fprintf(stderr, " %02X", buf[i]
+            );
+        }
+        fprintf(stderr, "\n");
+    }
+
+    v.buf = buf;
+    v.out_w = out_w;
+    v.out_h = out_h;
+
+    return 0;
+}
+
+void *proc(void *args) {
+    ProcThreadParams *ptp = (ProcThreadParams *) args;
+
+    for (;;) {
+        Task v;
+
+        if (!toproc.get(v))
+            break;
+
+        const int ret = process_image(ptp, v);
+
+        free(v.pixeldata);
+        v.pixeldata = 0;
+
+        if (ret != 0) {
+            ptp->failed++;
+            continue;
+        }
+
+        tosave.put(std::move(v), v.bytes());
+    }
+
+    return 0;
+}
+
+class SaveThreadParams {
+public:
+    int verbose;
+
+    std::atomic<int> saved;
+    std::atomic<int> failed;
+};
+
+void *save(void *args) {
+    SaveThreadParams *stp = (SaveThreadParams *) args;
+    const int verbose = stp->verbose;
+
+    for (;;) {
+        Task v;
+
+        if (!tosave.get(v))
+            break;
+
+        high_resolution_clock::time_point save_begin = high_resolution_clock::now();
+
+        int success = 0;
+
+        path_t ext = get_file_extension(v.inpath);
+
+        if (ext != PATHSTR("gif")) {
+            // 不对gif格式进行支持
+            // 使用opencv保存图片，速度比默认的stb更快
+            cv::Mat image;
+            switch (v.c) {
+            case 1:
+                image = cv::Mat(v.out_h, v.out_w, CV_8UC1, v.buf); // 单通道图像
+                break;
+            case 3:
+                image = cv::Mat(v.out_h, v.out_w, CV_8UC3, v.buf); // 3通道图像
+#ifndef  _WIN32
+                cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
+#endif
+                break;
+            case 4:
+                image = cv::Mat(v.out_h, v.out_w, CV_8UC4, v.buf); // 4通道图像
+#ifndef  _WIN32
+                cv::cvtColor(image, image, cv::COLOR_RGBA2BGRA);
+#endif
+                break;
+            }
+            if (image.empty()) {
+                std::cerr << "Error: Image data not loaded." << std::endl;
+                success = false;
+            }
+            else {
+#if _WIN32
+                success = imwrite_unicode(v.outpath, image);
+#else
+                success = imwrite(v.outpath.c_str(), image);
+#endif
+                fprintf(stderr, "opencv save image success, c=%d, w=%d, h=%d\n", v.c, v.out_w, v.out_h);
+            }
+        }
+
+        delete[] v.buf;
+        v.buf = 0;
+
+        if (success) {
+            stp->saved++;
+            if (verbose) {
+#if _WIN32
+                fwprintf(stderr, L"%ls -> %ls done\n", v.inpath.c_str(), v.outpath.c_str());
+#else
+                fprintf(stderr, "%s -> %s done\n", v.inpath.c_str(), v.outpath.c_str());
+#endif
+            }
+        } else {
+            stp->failed++;
+#if _WIN32
+            fwprintf(stderr, L"encode image %ls failed\n", v.outpath.c_str());
+#else
+            fprintf(stderr, "encode image %s failed\n", v.outpath.c_str());
+#endif
+        }
+
+        high_resolution_clock::time_point save_end = high_resolution_clock::now();
+        duration<double> time_span = duration_cast<duration<double>>(save_end - save_begin);
+        fprintf(stderr, "save use time: %.3lf\n", time_span.count());
+    }
+
+    return 0;
+}
+
+// load -> proc -> save, decode and encode of other images run while one is resized
+static void run_pipeline(int jobs_proc, int jobs_save, LoadThreadParams& ltp, ProcThreadParams& ptp, SaveThreadParams& stp) {
+    toproc.configure(8, 0);
+    tosave.configure(8, 0);
+
+    ltp.next = 0;
+    ltp.decode_failed = 0;
+    ptp.failed = 0;
+    stp.saved = 0;
+    stp.failed = 0;
+
+    // load image
+    std::vector<ncnn::Thread *> load_threads(ltp.jobs_load);
+    for (int i = 0; i < ltp.jobs_load; i++) {
+        load_threads[i] = new ncnn::Thread(load, (void *) &ltp);
+    }
+
+    // resize
+    std::vector<ncnn::Thread *> proc_threads(jobs_proc);
+    for (int i = 0; i < jobs_proc; i++) {
+        proc_threads[i] = new ncnn::Thread(proc, (void *) &ptp);
+    }
+
+    // save image
+    std::vector<ncnn::Thread *> save_threads(jobs_save);
+    for (int i = 0; i < jobs_save; i++) {
+        if (stp.verbose)
+            fprintf(stderr, "init save_threads %d\n", i);
+        save_threads[i] = new ncnn::Thread(save, (void *) &stp);
+    }
+
+    // end
+    for (int i = 0; i < ltp.jobs_load; i++) {
+        load_threads[i]->join();
+        delete load_threads[i];
+    }
+
+    toproc.close();
+
+    for (int i = 0; i < jobs_proc; i++) {
+        proc_threads[i]->join();
+        delete proc_threads[i];
+    }
+
+    tosave.close();
+
+    for (int i = 0; i < jobs_save; i++) {
+        save_threads[i]->join();
+        delete save_threads[i];
+    }
 }
 
 #if _WIN32
@@ -207,11 +1134,16 @@ int main(int argc, char **argv)
     path_t suggested_format;
     long long skip_size = 0;
     path_t name_pattern = PATHSTR("{name}");
+    int jobs_load = 1;
+    std::vector<int> jobs_proc;
+    int jobs_save = 2;
+    BenchOptions bench;
+    bool benchmark = false;
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"i:o:s:t:m:g:j:f:vxhkn:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"i:o:s:t:m:g:j:f:vxhkn:e:p:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -247,6 +1179,23 @@ int main(int argc, char **argv)
         case L'p':
             name_pattern = optarg;
             break;
+        case L'j':
+            // a single number only sets proc
+            if (wcschr(optarg, L':')) {
+                swscanf(optarg, L"%d:%*[^:]:%d", &jobs_load, &jobs_save);
+                jobs_proc = parse_optarg_int_array(wcschr(optarg, L':') + 1);
+            } else {
+                jobs_proc = parse_optarg_int_array(optarg);
+            }
+            break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0)
+            {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L't':
         case L'g':
             break;
@@ -258,7 +1207,7 @@ int main(int argc, char **argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:s:t:m:g:j:f:vxhkn:e:p:")) != -1) {
+    while ((opt = getopt(argc, argv, "i:o:s:t:m:g:j:f:vxhkn:e:p:B:")) != -1) {
         switch (opt) {
             case 'i':
                 inputpath = optarg;
@@ -293,6 +1242,22 @@ int main(int argc, char **argv)
             case 'p':
                 name_pattern = optarg;
                 break;
+            case 'j':
+                // a single number only sets proc
+                if (strchr(optarg, ':')) {
+                    sscanf(optarg, "%d:%*[^:]:%d", &jobs_load, &jobs_save);
+                    jobs_proc = parse_optarg_int_array(strchr(optarg, ':') + 1);
+                } else {
+                    jobs_proc = parse_optarg_int_array(optarg);
+                }
+                break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0) {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
             case 'g':
             case 't':
                 break;
@@ -301,11 +1266,87 @@ int main(int argc, char **argv)
                 print_usage();
                 return -1;
         }
-    }
-#endif // _WIN32
+    }
+#endif // _WIN32
+
+
+    std::cout << "build time: " << __DATE__ << " " << __TIME__ << std::endl;
+
+    if (jobs_load < 1 || jobs_save < 1) {
+        fprintf(stderr, "invalid thread count argument\n");
+        return -1;
+    }
+
+    int cpu_count = std::max(1, ncnn::get_cpu_count());
+    jobs_load = std::min(jobs_load, cpu_count);
+    jobs_save = std::min(jobs_save, cpu_count);
+
+    // 0 or no proc count uses the big cores
+    if (jobs_proc.empty())
+        jobs_proc.push_back(0);
+    for (size_t i = 0; i < jobs_proc.size(); i++) {
+        if (jobs_proc[i] < 1)
+            jobs_proc[i] = std::max(ncnn::get_big_cpu_count(), 1);
+    }
+
+    if (benchmark) {
+        // only the interpolation modes, the de-nearest and perfectpixel modes depend on the image content
+        if (not_use_ncnn || scale < 1 || model.find(PATHSTR("de-nearest")) != path_t::npos ||
+            model.find(PATHSTR("perfectpixel")) != path_t::npos) {
+            fprintf(stderr, "benchmark supports bicubic/bilinear/nearest/avir/avir-lancir with an integer scale\n");
+            return -1;
+        }
 
+        // resize keeps the alpha channel in the pixels, so the image is not split
+        bench.split_alpha = false;
+        bench.format = bench_path_string(output_format);
 
-    std::cout << "build time: " << __DATE__ << " " << __TIME__ << std::endl;
+        ResizeThreadPool* pool = NULL;
+        LancirBands* lancir = NULL;
+
+        auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+            const int c = in.channels();
+            cv::Mat pixels;
+            {
+                BenchScope bench_preproc(BENCH_PREPROC);
+#if _WIN32
+                pixels = in;
+#else
+                cv::cvtColor(in, pixels, c == 4 ? cv::COLOR_BGRA2RGBA : cv::COLOR_BGR2RGB);
+#endif
+            }
+
+            cv::Mat result(in.rows * scale, in.cols * scale, CV_8UC(c));
+            {
+                BenchScope bench_inference(BENCH_INFERENCE);
+                resize_pixels(model, pixels.data, in.cols, in.rows, c, result.data, result.cols, result.rows, *pool, *lancir);
+            }
+
+            BenchScope bench_postproc(BENCH_POSTPROC);
+#if _WIN32
+            out = result;
+#else
+            cv::cvtColor(result, out, c == 4 ? cv::COLOR_RGBA2BGRA : cv::COLOR_RGB2BGR);
+#endif
+            return 0;
+        };
+
+        // one report per thread count, a line each
+        for (size_t i = 0; i < jobs_proc.size(); i++) {
+            ResizeThreadPool bench_pool(jobs_proc[i]);
+            LancirBands bench_lancir(bench_pool);
+            pool = &bench_pool;
+            lancir = &bench_lancir;
+
+            BenchJson info;
+            info.add("engine", std::string("resize")).add("model", bench_path_string(model)).add("threads", jobs_proc[i]);
+
+            int ret = run_benchmark(bench, scale, info, outputpath, upscale, i > 0);
+            if (ret != 0)
+                return ret;
+        }
+        return 0;
+    }
 
     if (inputpath.empty()) {
         print_usage();
@@ -403,721 +1444,47 @@ int main(int argc, char **argv)
     else
         fprintf(stderr, "busy...\n");
 
+    // avir and avir-lancir spread one image over the pool, the other modes resize one image per proc thread
+    const bool avir_mode = model.find(PATHSTR("avir")) != path_t::npos;
+    ResizeThreadPool pool(jobs_proc[0]);
+    LancirBands lancir(pool);
+
 #if _WIN32
     // 初始化 COM
     if (FAILED(CoInitializeEx(NULL, COINIT_MULTITHREADED)))
         return -1;
 #endif
-    for (int i = 0; i < input_files.size(); i++) {
-        const path_t &imagepath = input_files[i];
-        path_t &outputpath = output_files[i];
-
-//        int webp = 0;
-
-        unsigned char *pixeldata = 0;
-        int w;
-        int h;
-        int c;
-
-#if _WIN32
-        FILE* fp = _wfopen(imagepath.c_str(), L"rb");
-#else
-        FILE *fp = fopen(imagepath.c_str(), "rb");
-#endif
-        if (fp) {
-            // read whole file
-            unsigned char *filedata = 0;
-            int length = 0;
-            {
-                fseek(fp, 0, SEEK_END);
-                length = ftell(fp);
-                rewind(fp);
-                filedata = (unsigned char *) malloc(length);
-                if (filedata) {
-                    fread(filedata, 1, length, fp);
-                }
-                fclose(fp);
-            }
-
-            if (filedata) {
-                pixeldata = webp_load(filedata, length, &w, &h, &c);
-                if (!pixeldata) {
-//                    webp = 1;
-//                } else {
-                    // not webp, try jpg png etc.
-#if _WIN32
-                    pixeldata = wic_decode_image(imagepath.c_str(), &w, &h, &c);
-#else // _WIN32
-                    pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 0);
-
-
-                    fprintf(stderr, "pixeldata stbi_load w/h/c %d/%d/%d \n",
-                            w, h, c
-                    );
-
-                    if (pixeldata) {
-                        // stb_image auto channel
-                        if (c == 1) {
-                            // grayscale -> rgb
-                            stbi_image_free(pixeldata);
-                            pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 3);
-                            c = 3;
-                            fprintf(stderr, "pixeldata c==1 w/h/c %d/%d/%d \n",
-                                    w, h, c
-                            );
-                        } else if (c == 2) {
-                            // grayscale + alpha -> rgba
-                            stbi_image_free(pixeldata);
-                            pixeldata = stbi_load_from_memory(filedata, length, &w, &h, &c, 4);
-                            c = 4;
-                            fprintf(stderr, "pixeldata c==2 w/h/c %d/%d/%d \n",
-                                    w, h, c
-                            );
-                        }
-                    }
-#endif // _WIN32
-                }
-            } else if (_VERBOSE_LOG) {
-#if _WIN32
-                fwprintf(stderr, L"no filedata\n");
-#else // _WIN32
-                fprintf(stderr, "no filedata\n");
-#endif // _WIN32
-            }
-
-            free(filedata);
-        } else if (_VERBOSE_LOG) {
-#if _WIN32
-            fwprintf(stderr, L"fopen failed\n");
-#else // _WIN32
-            fprintf(stderr, "fopen failed\n");
-#endif // _WIN32
-        }
-
-
-        // 计算降采样的倍率
-        if (pixeldata) {
-            if (model.find(PATHSTR("de-nearest3")) != path_t::npos){
-                // 使用demosaic算法检查目标倍率
-                scale = detectMosaicResolution(pixeldata, w, h, c);
-                scale_d = 1.0 / scale;
-                fprintf(stderr, "image might be interpolated by nearest x%d\n", scale);
-            } else if (model.find(PATHSTR("de-nearest2")) != path_t::npos) {
-                fprintf(stderr, "Running de-nearest2 (identical row/col check):\n");
-
-                int identical_rows = 0;
-                int identical_cols = 0;
-                // Tolerance for comparison (e.g., handle minor JPEG artifacts)
-                // Set to 0 for strict nearest neighbor, maybe 1 or 2 otherwise.
-                const int tolerance = 32;
-                int line_size = w * c;
-
-                // --- Row Comparison ---
-                // Compare row i with row i-1
-                for (int i = 1; i < h; ++i) {
-                    bool rows_are_identical = true;
-                    // Pointer to the start of row i and row i-1
-                    const unsigned char* p1 = pixeldata + i * line_size;
-                    const unsigned char* p0 = pixeldata + (i - 1) * line_size;
-                    // Compare the entire row byte by byte (or pixel by pixel)
-                    for (int j = 0; j < line_size; ++j) {
-                        if (abs(p1[j] - p0[j]) > tolerance) {
-                            rows_are_identical = false;
-                            break; // Rows differ, no need to check further
-                        }
-                    }
-                    if (rows_are_identical) {
-                        identical_rows++;
-                    }
-                }
-
-                // --- Column Comparison ---
-                // Compare column j with column j-1
-                for (int j = 1; j < w; ++j) {
-                    bool cols_are_identical = true;
-                    // Iterate through each row for the current pair of columns
-                    for (int i = 0; i < h; ++i) {
-                        // Pointer to pixel (i, j) and pixel (i, j-1)
-                        const unsigned char* p1 = pixeldata + i * line_size + j * c;
-                        const unsigned char* p0 = pixeldata + i * line_size + (j - 1) * c;
-                        // Compare all channels for this pixel
-                        for(int k = 0; k < c; ++k) {
-                            if (abs(p1[k] - p0[k]) > tolerance) {
-                                cols_are_identical = false;
-                                break; // Pixels differ in this channel
-                            }
-                        }
-                        if (!cols_are_identical) {
-                            break; // Columns differ in this row, no need to check further rows
-                        }
-                    }
-                    if (cols_are_identical) {
-                        identical_cols++;
-                    }
-                }
-
-                fprintf(stderr, "Identical adjacent rows found: %d (out of %d pairs)\n", identical_rows, h - 1);
-                fprintf(stderr, "Identical adjacent cols found: %d (out of %d pairs)\n", identical_cols, w - 1);
-
-                // --- Calculate Scale ---
-                double scale_y = 1.0;
-                double scale_x = 1.0;
-
-                // Number of unique rows = total rows - identical rows = h - identical_rows
-                // Scale = total rows / unique rows
-                int unique_rows = h - identical_rows;
-                if (unique_rows > 0) {
-                    // We expect identical_rows ~= (scale_y - 1) * unique_rows
-                    // So h = scale_y * unique_rows => scale_y = h / unique_rows
-                    scale_y = static_cast<double>(h) / unique_rows;
-                } else if (h > 0) {
-                    fprintf(stderr, "Warning: Zero unique rows estimated (image might be uniform vertically?). Assuming scale_y=1.\n");
-                    // If the image is perfectly uniform vertically, scale is ambiguous.
-                    // Or maybe identical_rows calculation is slightly off near 100%
-                    // If identical_rows == h-1 (all rows same), scale_y is effectively h if h>1, or 1 if h=1.
-                    // Let's refine: if identical_rows == h-1 and h > 1, maybe scale_y = h?
-                    // But sticking to scale_y = h / unique_rows seems more general. A near-zero unique_rows will give large scale.
-                    // If unique_rows is truly 0, maybe scale_y=1 is safest default.
-                    scale_y = 1.0;
-                }
-
-                // Similarly for columns
-                int unique_cols = w - identical_cols;
-                if (unique_cols > 0) {
-                    scale_x = static_cast<double>(w) / unique_cols;
-                } else if (w > 0) {
-                    fprintf(stderr, "Warning: Zero unique cols estimated (image might be uniform horizontally?). Assuming scale_x=1.\n");
-                    scale_x = 1.0;
-                }
-
-                fprintf(stderr, "Calculated scale_x: %.3f, scale_y: %.3f\n", scale_x, scale_y);
-
-                // --- Validation and Output ---
-                double scale_threshold = 1.9; // Require scale to be close to at least 2
-                double integer_proximity = 0.3; // How close scale needs to be to an integer
-                double scale_diff_threshold = 0.4; // How close scale_x and scale_y need to be
-
-                bool detected = false;
-                int final_scale = 1;
-
-                // Check if both scales are valid and close to each other
-                if (scale_x >= scale_threshold && scale_y >= scale_threshold &&
-                    abs(scale_x - round(scale_x)) < integer_proximity &&
-                    abs(scale_y - round(scale_y)) < integer_proximity &&
-                    abs(scale_x - scale_y) <= scale_diff_threshold)
-                {
-                    final_scale = static_cast<int>(round((scale_x + scale_y) / 2.0));
-                    fprintf(stderr, "Consistent x/y scaling detected.\n");
-                    detected = true;
-                }
-                    // Check if only scale_x is valid (potential horizontal-only scaling)
-                else if (scale_x >= scale_threshold && scale_y < 1.5 && // Check y scale is low
-                         abs(scale_x - round(scale_x)) < integer_proximity)
-                {
-                    final_scale = static_cast<int>(round(scale_x));
-                    fprintf(stderr, "Horizontal-only scaling detected.\n");
-                    detected = true;
-                }
-                    // Check if only scale_y is valid (potential vertical-only scaling)
-                else if (scale_y >= scale_threshold && scale_x < 1.5 && // Check x scale is low
-                         abs(scale_y - round(scale_y)) < integer_proximity)
-                {
-                    final_scale = static_cast<int>(round(scale_y));
-                    fprintf(stderr, "Vertical-only scaling detected.\n");
-                    detected = true;
-                }
-                    // Maybe a fallback if they are different but both look like integers?
-                else if (scale_x >= scale_threshold && scale_y >= scale_threshold &&
-                         abs(scale_x - round(scale_x)) < integer_proximity &&
-                         abs(scale_y - round(scale_y)) < integer_proximity)
-                {
-                    // Scales differ but both look valid - take the minimum? Or average?
-                    // Taking minimum might be safer for downscaling.
-                    final_scale = static_cast<int>(round(fmin(scale_x, scale_y)));
-                    fprintf(stderr, "Warning: Different integer scales detected (x%.1f, y%.1f). Using minimum scale %d.\n", scale_x, scale_y, final_scale);
-                    detected = true;
-                }
-
-
-                if (detected && final_scale >= 2) {
-                    scale = final_scale; // Set the global scale variable
-                    scale_d = 1.0 / scale;
-                    not_use_ncnn = false; // Indicate we found a scale and NCNN is not needed for this task
-                    fprintf(stderr, "de-nearest2: Image likely interpolated by nearest x%d\n", scale);
-                } else {
-                    fprintf(stderr, "de-nearest2: Image does not appear to be clearly interpolated by nearest neighbor (scale_x=%.2f, scale_y=%.2f, final_scale=%.2f)\n", scale_x, scale_y, final_scale);
-                    return -1; // Indicate failure or non-detection by this method
-                }
-            }
-
-            else if (model.find(PATHSTR("de-nearest")) != path_t::npos) {
-                // Use dynamic allocation instead of VLA (not supported by VS)
-                double *lost_y = new double[h - 1];
-                double *lost_x = new double[w - 1];
-                double avg_y = 0, avg_x = 0;
-                double scale_y = 1, scale_x = 1;
-                int line_size = w * c;
-
-                double **lost_x0 = new double *[h];
-                for (int i = 0; i < h; i++) {
-                    lost_x0[i] = new double[w - 1];
-                }
-
-//                fprintf(stderr, "de-nearest:");
-
-                //row
-                int p = line_size;
-                int q = 0;
-                for (int i = 0; i < h - 1; i++) {
-                    //line
-                    double l = 0;
-                    for (int j = 0; j < line_size; j++) {
-                        l += pow(pixeldata[p] - pixeldata[q], 2);
-                        p++;
-                        q++;
-                        //   fprintf(stderr," [%d,%d]",i ,j);
-                    }
-
-                    double m = l / line_size;
-                    lost_y[i] = m;
-                    avg_y += m;
-                }
-
-                avg_y = avg_y / (h - 1);
-
-                for (int i = 0; i < h - 1; i++) {
-                    if (lost_y[i] > avg_y) {
-//                         fprintf(stderr," [%.2f]", lost_y[i]);
-                        scale_y++;
-                    } //else
-//                         fprintf(stderr," %.2f", lost_y[i]);
-                }
-                fprintf(stderr, "scale_y: %d/%f", h, scale_y);
-                scale_y = h / scale_y;
-                fprintf(stderr, " = %f; avg_lost_y=[%f]\n", scale_y, avg_y);
-
-                for (int i = 0; i < h; i++) {
-                    p = i * line_size;
-                    for (int j = 0; j < w - 1; j++) {
-                        double l = 0;
-                        for (int k = 0; k < c; k++) {
-//                            l += pow(pixeldata[p] - pixeldata[p + c], 2);
-                            l = fmax(l, pow(pixeldata[p] - pixeldata[p + c], 2));
-                            p++;
-                        }
-                        lost_x0[i][j] = l;
-
-                        // fprintf(stderr," [%d,%d]",i ,j);
-                    }
-//                    fprintf(stderr, " %d", i);
-                }
-
-                for (int j = 0; j < w - 1; j++) {
-                    double l = 0;
-                    for (int i = 0; i < h; i++) {
-                        l += lost_x0[i][j];
-                    }
-                    double m = l / h;
-                    lost_x[j] = m;
-                    avg_x += m;
-                }
-
-                avg_x = avg_x / (w - 1);
-
-                for (int i = 0; i < w - 1; i++) {
-                    if (lost_x[i] > avg_x) {
-//                    fprintf(stderr," [%.2f]", lost_x[i]);
-                        scale_x++;
-                    } // else
-//                    fprintf(stderr," %.2f", lost_x[i]);
-                }
-                fprintf(stderr, "scale_x: %d/%f", w, scale_x);
-                scale_x = w / scale_x;
-                fprintf(stderr, " = %f; avg_lost_x=[%f]\n", scale_x, avg_x);
-
-                for (int i = 0; i < h; i++) {
-                    delete[] lost_x0[i];
-                }
-                delete[] lost_x0;
-                
-                // Free dynamically allocated arrays
-                delete[] lost_y;
-                delete[] lost_x;
-
-                if (scale_x < 1.5 || scale_y < 1.5) {
-                    fprintf(stderr, "image is not interpolated by nearest\n");
-                    return -1;
-                } else {
-                    not_use_ncnn = false;
-                    if (abs(scale_y - scale_x) < 1)
-                        scale = round((scale_x + scale_y) / 2);
-                    else if (scale_x > scale_y)
-                        scale = round(scale_y);
-                    else
-                        scale = round(scale_x);
-
-                    scale_d = 1.0 / scale;
-                    fprintf(stderr, "image might be interpolated by nearest x%d\n", scale);
-                }
-            }
-
-        }
-
-
-        int out_w, out_h;
-        if ( scale_d<1 ) {
-            out_w = (int) (w * scale_d);
-            out_h = (int) (h * scale_d);
-        } else if (model.find(PATHSTR("perfectpixel")) != path_t::npos && scale <= 0) {
-             // perfectpixel mode with scale <= 0 implies outputting original size
-             // We set a placeholder out_w/out_h to w/h for initial allocation (though it will be reallocated)
-             out_w = w;
-             out_h = h;
-        } else {
-            out_w = w * scale;
-            out_h = h * scale;
-        }
-        int out_line_size = out_w * c;
-        unsigned char *buf = new unsigned char[out_line_size * out_h];
-        fprintf(stderr, "output w/h/s/s = %d/%d/%d/%f, mode=%s\n", out_w, out_h, scale, scale_d,
-                model.c_str());
-
-        if (pixeldata) {
-
-            if (verbose) {
-                fprintf(stderr, "pixeldata: ");
-                for (int i = 0; i < 32; i++) {
-                    fprintf(stderr, " %08X", pixeldata[i]);
-                }
-                fprintf(stderr, "\n");
-            }
-
-            high_resolution_clock::time_point process_begin = high_resolution_clock::now();
-
-
-            if (not_use_ncnn && model.find(PATHSTR("nearest")) != path_t::npos) {
-
-                if (_MODE == 1) {
-
-                    //row
-                    for (int i = 0; i < h; i++) {
-                        //line
-                        for (int j = 0; j < w; j++) {
-                            int p = (w * i + j) * c;
-                            int q = (out_w * i + j) * c * scale;
-
-                            //sub-pixel
-                            for (int k = 0; k < c; k++) {
-                                int m = pixeldata[p + k];
-
-                                // output x offset
-                                int x_offset = 0;
-                                for (int n = 0; n < scale; n++) {
-                                    int o = q + k + x_offset;
-
-                                    // output y offset
-                                    int y_offset = 0;
-                                    for (int g = 0; g < scale; g++) {
-                                        buf[o + y_offset] = m;
-                                        y_offset += out_line_size;
-                                    }
-                                    x_offset += c;
-                                }
-
-                                if (verbose) {
-                                    fprintf(stderr, "i:%d j:%d :", i, j);
-                                    for (int i = 0; i < 32; i++) {
-                                        fprintf(stderr, " %02X", buf[i]
-                                        );
-                                    }
-                                    fprintf(stderr, " ,m=%d %d\n", p + k, k + q);
-                                }
-                            }
-                        }
-                    }
-                } else {
-                    if(scale_d>=1)
-                    {
-                        int p = 0;
-                        int q = 0;
-                        //row
-                        for (int i = 0; i < h; i++) {
-                            //line
-                            void *l = buf + q;
-                            for (int j = 0; j < w; j++) {
-
-                                //pixel
-                                for (int k = 0; k < scale; k++) {
-                                    memcpy(buf + q, pixeldata + p, sizeof(unsigned char) * c);
-                                    q += c;
-                                }
-                                p += c;
-                            }
-                            // mult-line
-                            for (int k = 1; k < scale; k++) {
-                                memcpy(buf + q, l, sizeof(unsigned char) * out_line_size);
-                                q += out_line_size;
-                            }
-                        }
-                    }else{
-                        // de-nearest
-                        int p=(scale-1)/2, q=0;
-                        // double step = 1/scale_d;
-                        // row
-                        for(int i=0;i<out_h;i++){
-                            for(int j=0;j<out_w;j++){
-                                memcpy(buf + q, pixeldata + p+j*scale, sizeof(unsigned char) * c);
-                                q+=c;
-                            }
-                            p+=w*c;
-                        }
-                    }
-                }
-
-            } else if (not_use_ncnn && model.find(PATHSTR("bilinear")) != path_t::npos) {
-                if (w < 2 && h < 2) {
-                    fprintf(stderr, "[Err]image is too small\n");
-                    return -1;
-                }
-                if (scale < 2) {
-                    fprintf(stderr, "[Err]scale <2\n");
-                    return -1;
-                }
-
-
-                out_w = out_w - scale + 1;
-                out_h = out_h - scale + 1;
-                out_line_size = out_w * c;
-                free(buf);
-                buf = new unsigned char[out_line_size * out_h];
-
-                // 子像素a点，b点
-                unsigned char a, b;
-                int p = 0;
-                int q = 0;
-
-                int block_size = scale * out_line_size;
-
-                // channel
-                for (int l = 0; l < c; l++) {
-                    p = l;
-                    q = l;
-                    for (int i = 0; i < h; i++) {
-                        for (int j = 1; j < w; j++) {
-
-                            a = pixeldata[p];
-                            b = pixeldata[p + c];
-                            if (a == b) {
-                                for (int k = 0; k < scale; k++) {
-                                    buf[q] = a;
-                                    q += c;
-                                }
-                            } else {
-                                float d = ((float) (b - a)) / scale;
-                                float e = 0;
-                                for (int k = 0; k < scale; k++) {
-                                    buf[q] = a + (int) (e);
-                                    e += d;
-                                    q += c;
-                                }
-                            }
-
-                            p += c;
-                        }
-                        buf[q] = b;
-                        p += c;
-                        q = q + block_size - out_line_size + c;
-                        //                        fprintf(stderr, " %d-%d",l,i);
-                    }
-
-                }
-
-                //                fprintf(stderr, "\n 2nd\n");
-                //
-                //                fprintf(stderr, "out_line_size=%d block=%d\n", out_line_size, block_size);
-                p = 0;
-                for (int i = 0; i < h; i++) {
-
-                    for (int j = 0; j < out_line_size; j++) {
-                        a = buf[p];
-                        q = out_line_size;
-                        b = buf[p + block_size];
-                        if (a == b) {
-                            for (int k = 1; k < scale; k++) {
-                                buf[p + q] = a;
-                                q += out_line_size;
-                            }
-                        } else {
-                            float d = ((float) (b - a)) / scale;
-                            float e = d;
-                            for (int k = 1; k < scale; k++) {
-                                buf[p + q] = a + (int) (e);
-                                //                            fprintf(stderr, "i-j:%d-%d p-q-k:%d-%d-%d\n",i,j, p, q,k);
-                                e += d;
-                                q += out_line_size;
-                            }
-
-                        }
-
-                        p++;
-                    }
-                    p = p + block_size - out_line_size;
-
-                }
-
-            } else if (model.find(PATHSTR("perfectpixel")) != path_t::npos) {
-                // Perfect Pixel Mode
-                cv::Mat in_mat;
-                if (c == 3) in_mat = cv::Mat(h, w, CV_8UC3, pixeldata);
-                else if (c == 4) in_mat = cv::Mat(h, w, CV_8UC4, pixeldata);
-
-                if (!in_mat.empty()) {
-                    cv::Mat out_mat;
-                    if (process_perfect_pixel(in_mat, out_mat, scale) == 0) {
-                        if (buf) delete[] buf;
-                        out_w = out_mat.cols;
-                        out_h = out_mat.rows;
-                        out_line_size = out_w * c;
-                        buf = new unsigned char[out_mat.total() * out_mat.elemSize()];
-                        memcpy(buf, out_mat.data, out_mat.total() * out_mat.elemSize());
-                    } else {
-                        fprintf(stderr, "perfectpixel failed\n");
-                    }
-                }
-            } else if (model.find(PATHSTR("lancir")) != path_t::npos) {
-                avir::CLancIR ImageResizer;
-                ImageResizer.resizeImage(pixeldata, w, h, 0, buf, out_w, out_h, 0, c);
-            } else if (model.find(PATHSTR("avir")) != path_t::npos) {
-                avir::CImageResizer<> ImageResizer(8);
-                ImageResizer.resizeImage(pixeldata, w, h, 0, buf, out_w, out_h, c, 0);
-            } else {
-                ncnn::Mat in, out;
-                if (c == 4) {
-                    in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGBA, w, h);
-                } else {
-                    in = ncnn::Mat::from_pixels(pixeldata, ncnn::Mat::PIXEL_RGB, w, h);
-                }
-
-                if (model.find(PATHSTR("nearest")) != path_t::npos) {
-                    ncnn::resize_nearest(in, out, out_w, out_h);
-                } else if (model.find(PATHSTR("bilinear")) != path_t::npos) {
-                    ncnn::resize_bilinear(in, out, out_w, out_h);
-                } else {
-                    ncnn::resize_bicubic(in, out, out_w, out_h);
-                }
-
-                if (c == 4) {
-                    out.to_pixels(buf, ncnn::Mat::PIXEL_RGBA);
-                } else {
-                    out.to_pixels(buf, ncnn::Mat::PIXEL_RGB);
-                }
-            }
-
-            high_resolution_clock::time_point process_end = high_resolution_clock::now();
-            duration<double> process_time_span = duration_cast<duration<double>>(process_end - process_begin);
-            fprintf(stderr, "%s use time: %.3lf\n", model.c_str(),process_time_span.count());
-
-
-
-            if (verbose) {
-                fprintf(stderr, "buf data: ");
-                for (int i = 0; i < 32; i++) {
-                    fprintf(stderr, " %02X", buf[i]
-                    );
-                }
-                fprintf(stderr, "\n");
-            }
 
-            path_t ext = get_file_extension(outputpath);
-            if (c == 4 && output_format.empty() &&
-                (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") ||
-                 ext == PATHSTR("JPEG"))) {
-                path_t output_filename2 = output_files[i] + PATHSTR(".png");
-                outputpath = output_filename2;
-#if _WIN32
-                fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
-#else // _WIN32
-                fprintf(stderr, "image %s has alpha channel ! %s will output %s\n",
-                        imagepath.c_str(),
-                        imagepath.c_str(), output_filename2.c_str());
-#endif // _WIN32
-            }
+    // main routine
+    LoadThreadParams ltp;
+    ltp.jobs_load = jobs_load;
+    ltp.output_format = output_format;
+    ltp.input_files = input_files;
+    ltp.output_files = output_files;
 
-            // save
-            high_resolution_clock::time_point save_begin = high_resolution_clock::now();
-
-            {
-                int success = 0;
-
-                path_t ext = get_file_extension(imagepath);
-
-				if (ext != PATHSTR("gif")) {
-                    // 不对gif格式进行支持
-					// 使用opencv保存图片，速度比默认的stb更快
-					cv::Mat image;
-					switch (c) {
-					case 1:
-						image = cv::Mat(out_h, out_w, CV_8UC1, buf); // 单通道图像
-						break;
-					case 3:
-						image = cv::Mat(out_h, out_w, CV_8UC3, buf); // 3通道图像
-#ifndef  _WIN32
-						cv::cvtColor(image, image, cv::COLOR_RGB2BGR);
-#endif
-						break;
-					case 4:
-						image = cv::Mat(out_h, out_w, CV_8UC4, buf); // 4通道图像
-#ifndef  _WIN32
-						cv::cvtColor(image, image, cv::COLOR_RGBA2BGRA);
-#endif
-						break;
-					}
-					if (image.empty()) {
-						std::cerr << "Error: Image data not loaded." << std::endl;
-						success = false;
-					}
-					else {
-#if _WIN32
-						success = imwrite_unicode(outputpath, image);
-#else
-						success = imwrite(outputpath.c_str(), image);
-#endif
-						fprintf(stderr, "opencv save image success, c=%d, w=%d, h=%d\n", c, out_w, out_h);
-					}
-				}
-                if (success) {
-                    if (verbose) {
-#if _WIN32
-                        fwprintf(stderr, L"%ls -> %ls done\n", imagepath.c_str(), outputpath.c_str());
-#else
-                        fprintf(stderr, "%s -> %s done\n", imagepath.c_str(), outputpath.c_str());
-#endif
-                    }
-                } else {
-#if _WIN32
-                    fwprintf(stderr, L"encode image %ls failed\n", outputpath.c_str());
-#else
-                    fprintf(stderr, "encode image %s failed\n", outputpath.c_str());
-#endif
-                }
-            }
+    ProcThreadParams ptp;
+    ptp.model = model;
+    ptp.scale = scale;
+    ptp.scale_d = scale_d;
+    ptp.not_use_ncnn = not_use_ncnn;
+    ptp.verbose = verbose;
+    ptp.pool = &pool;
+    ptp.lancir = &lancir;
 
-            high_resolution_clock::time_point save_end = high_resolution_clock::now();
-            duration<double> time_span = duration_cast<duration<double>>(save_end - save_begin);
-            fprintf(stderr, "Total use time: %.3lf\n",time_span.count());
+    SaveThreadParams stp;
+    stp.verbose = verbose;
 
+    high_resolution_clock::time_point begin = high_resolution_clock::now();
 
+    run_pipeline(avir_mode ? 1 : jobs_proc[0], jobs_save, ltp, ptp, stp);
 
-        } else {
-#if _WIN32
-            fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
-#else // _WIN32
-            fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
-#endif // _WIN32
-        }
-    }
+    high_resolution_clock::time_point end = high_resolution_clock::now();
+    duration<double> time_span = duration_cast<duration<double>>(end - begin);
+    fprintf(stderr, "Total use time: %.3lf, %d done, %d failed\n", time_span.count(), (int) stp.saved,
+            ltp.decode_failed + ptp.failed + stp.failed);
 
-    return 0;
+    // the de-nearest modes fail the run when an image does not look nearest upscaled
+    return ptp.failed ? -1 : 0;
 }
 
 void pretty_print(ncnn::Mat m) {
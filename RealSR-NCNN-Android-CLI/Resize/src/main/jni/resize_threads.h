@@ -0,0 +1,194 @@
+#ifndef RESIZE_THREADS_H
+#define RESIZE_THREADS_H
+
+// -j, threads for the avir and avir-lancir modes.
+//
+// ResizeThreadPool is handed to avir through CImageResizerVars. Every workload avir adds gets a
+// thread of its own that stays alive between images, the calling thread runs workload 0 itself.
+// lancir has no threading of its own: LancirBands cuts the output into bands of rows and resizes
+// every band with its own CLancIR on the same pool. A band passes the step and offset of the
+// whole image to lancir, so the bands put together are the image resized in one piece.
+
+#include <algorithm>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "avir.h"
+#include "lancir.h"
+
+class ResizeThreadPool : public avir::CImageResizerThreadPool
+{
+public:
+    explicit ResizeThreadPool(int _threads) : threads(std::max(_threads, 1)), generation(0), running(0), stop(false)
+    {
+    }
+
+    virtual ~ResizeThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            stop = true;
+        }
+        start.notify_all();
+
+        for (size_t i = 0; i < workers.size(); i++)
+            workers[i].join();
+    }
+
+    int thread_count() const
+    {
+        return threads;
+    }
+
+    // the calling thread included
+    virtual int getSuggestedWorkloadCount() const
+    {
+        return threads;
+    }
+
+    // the workloads only change while none runs
+    virtual void addWorkload(CWorkload* const workload)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        workloads.push_back(workload);
+        if (workers.size() < workloads.size())
+            workers.push_back(std::thread(&ResizeThreadPool::work, this, (int)workers.size(), generation));
+    }
+
+    virtual void startAllWorkloads()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            running = (int)workloads.size();
+            generation++;
+        }
+        start.notify_all();
+    }
+
+    virtual void waitAllWorkloadsToFinish()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        finish.wait(guard, [this] { return running == 0; });
+    }
+
+    virtual void removeAllWorkloads()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        workloads.clear();
+    }
+
+private:
+    // worker index runs workloads[index] once per start, seen is the start it was created after
+    void work(int index, unsigned int seen)
+    {
+        for (;;)
+        {
+            CWorkload* workload;
+            {
+                std::unique_lock<std::mutex> guard(lock);
+                start.wait(guard, [&] { return stop || generation != seen; });
+                if (stop)
+                    return;
+
+                seen = generation;
+                if (index >= (int)workloads.size())
+                    continue;
+                workload = workloads[index];
+            }
+
+            workload->process();
+
+            std::lock_guard<std::mutex> guard(lock);
+            if (--running == 0)
+                finish.notify_all();
+        }
+    }
+
+    const int threads;
+    std::vector<std::thread> workers;
+    std::vector<CWorkload*> workloads;
+    std::mutex lock;
+    std::condition_variable start;
+    std::condition_variable finish;
+    unsigned int generation;
+    int running;
+    bool stop;
+};
+
+class LancirBands
+{
+public:
+    explicit LancirBands(ResizeThreadPool& _pool) : pool(_pool)
+    {
+    }
+
+    void resize(const unsigned char* src, int w, int h, int c, unsigned char* dst, int out_w, int out_h)
+    {
+        // a band reads the few source rows around its own, too short bands read them over and over
+        static const int min_band_rows = 32;
+
+        const int count = std::max(std::min(pool.thread_count(), out_h / min_band_rows), 1);
+        while ((int)bands.size() < count)
+            bands.push_back(std::unique_ptr<Band>(new Band));
+
+        const double kx = (double)w / out_w;
+        const double ky = (double)h / out_h;
+
+        for (int i = 0; i < count; i++)
+        {
+            Band& band = *bands[i];
+            band.src = src;
+            band.w = w;
+            band.h = h;
+            band.c = c;
+            band.out_w = out_w;
+            band.y0 = (int)((long long)out_h * i / count);
+            band.y1 = (int)((long long)out_h * (i + 1) / count);
+            band.dst = dst + (size_t)band.y0 * out_w * c;
+            band.kx = kx;
+            band.ky = ky;
+
+            if (i > 0)
+                pool.addWorkload(&band);
+        }
+
+        pool.startAllWorkloads();
+        bands[0]->process();
+        pool.waitAllWorkloadsToFinish();
+        pool.removeAllWorkloads();
+    }
+
+private:
+    // rows y0..y1 of the output
+    struct Band : public avir::CImageResizerThreadPool::CWorkload
+    {
+        virtual void process()
+        {
+            // a negative step skips lancir's centering, the offset is the one of the whole image
+            resizer.resizeImage(src, w, h, 0, dst, out_w, y1 - y0, 0, c, -kx, -ky,
+                                (kx - 1.0) * 0.5, (ky - 1.0) * 0.5 + y0 * ky);
+        }
+
+        // keeps its buffers from one image to the next
+        avir::CLancIR resizer;
+        const unsigned char* src;
+        int w;
+        int h;
+        int c;
+        unsigned char* dst;
+        int out_w;
+        int y0;
+        int y1;
+        double kx;
+        double ky;
+    };
+
+    ResizeThreadPool& pool;
+    std::vector<std::unique_ptr<Band> > bands;
+};
+
+#endif // RESIZE_THREADS_H
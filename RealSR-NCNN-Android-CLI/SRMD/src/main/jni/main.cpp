@@ -2,7 +2,6 @@
 
 #include <stdio.h>
 #include <algorithm>
-#include <queue>
 #include <vector>
 #include <clocale>
 
@@ -97,7 +96,13 @@ static std::vector<int> parse_optarg_int_array(const char* optarg)
 #include "srmd.h"
 
 #include "filesystem_utils.h"
+#include "anim_image.h"
 #include "image_processor.h"
+#include "task_queue.h"
+#include "memory_budget.h"
+#include "result_cache.h"
+#include "stream_writer.h"
+#include "bench_mode.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/hal/interface.h>
 #include "utils.hpp"
@@ -117,10 +122,16 @@ static void print_usage()
     fprintf(stderr, "  -g gpu-id            gpu device to use (default=auto) can be 0,1,2 for multi-gpu\n");
     fprintf(stderr, "  -j load:proc:save    thread count for load/proc/save (default=1:2:2) can be 1:2,2,2:2 for multi-gpu\n");
     fprintf(stderr, "  -x                   enable tta mode\n");
+    fprintf(stderr, "  -F range             skip the model on tiles within range levels per channel (0=one colour) or fully transparent, bilinear fill (default=-1=off)\n");
+    fprintf(stderr, "  -D cache-size        reuse the output of tiles identical to earlier ones, LRU cache size e.g. 256M (default=0=off)\n");
+    fprintf(stderr, "  -T tolerance         frame sequences only re-run tiles changed by more than tolerance levels since the previous frame (0=exact, default=-1=off)\n");
+    fprintf(stderr, "  -R cache-dir         reuse the results of identical inputs with the same model and settings from cache-dir\n");
     fprintf(stderr, "  -f format            force output format (ignore alpha channel detection)\n");
     fprintf(stderr, "  -e format            suggested output format (auto-convert to png if alpha detected)\n");
     fprintf(stderr, "  -k skip-size         skip if output file exists and size >= threshold bytes (0=disable)\n");
     fprintf(stderr, "  -p pattern           output name pattern for batch mode, placeholders: {name} {prog} {index} {timestamp} {datetime} {date} {time}\n");
+    fprintf(stderr, "  -S                   stream png/tiff/bmp output to disk by tile rows, the full result is never held in memory (images without alpha)\n");
+    fprintf(stderr, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
 }
 
 class Task
@@ -135,56 +146,24 @@ public:
     ncnn::Mat outimage;
     ncnn::Mat inalpha;  
     int has_alpha;
-};
-
-class TaskQueue
-{
-public:
-    TaskQueue()
-    {
-    }
-
-    void put(const Task& v)
-    {
-        lock.lock();
-
-        while (tasks.size() >= 8) // FIXME hardcode queue length
-        {
-            condition.wait(lock);
-        }
 
-        tasks.push(v);
+    // frame of a gif or animated webp, the writer collects all frames of the file
+    std::shared_ptr<AnimWriter> anim;
+    int frame;
 
-        lock.unlock();
+    // encode the result by tile rows in the proc stage instead of saving outimage
+    bool stream;
+    std::shared_ptr<StreamImageWriter> writer;
+    int stream_success;
 
-        condition.signal();
-    }
-
-    void get(Task& v)
+    size_t bytes() const
     {
-        lock.lock();
-
-        while (tasks.size() == 0)
-        {
-            condition.wait(lock);
-        }
-
-        v = tasks.front();
-        tasks.pop();
-
-        lock.unlock();
-
-        condition.signal();
+        return inimage.total() * inimage.elemsize + outimage.total() * outimage.elemsize + inalpha.total() * inalpha.elemsize;
     }
-
-private:
-    ncnn::Mutex lock;
-    ncnn::ConditionVariable condition;
-    std::queue<Task> tasks;
 };
 
-TaskQueue toproc;
-TaskQueue tosave;
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
 
 class LoadThreadParams
 {
@@ -192,6 +171,7 @@ public:
     int scale;
     path_t output_format;
     int jobs_load;
+    int stream_output;
 
     // session data
     std::vector<path_t> input_files;
@@ -209,52 +189,76 @@ void* load(void* args)
     {
         const path_t& imagepath = ltp->input_files[i];
 
+        // gif and animated webp give one task per frame
+        FrameSource source(imagepath, ltp->output_files[i]);
+
         cv::Mat inBGR, inAlpha;
-        imread(imagepath, inBGR, inAlpha);
-        
-        if (inBGR.empty())
+        while (source.next(inBGR, inAlpha))
         {
-            continue;
-        }
-        
-        Task v;
-        v.id = i;
-        v.inpath = imagepath;
-        v.outpath = ltp->output_files[i];
-        v.has_alpha = 0;
+            if (inBGR.empty())
+            {
+                continue;
+            }
 
-        int w = inBGR.cols;
-        int h = inBGR.rows;
-        int c = inBGR.channels();
+            // an animation its format can not hold is given up before any frame runs
+            if (source.writer && !source.writer->check_size(inBGR.cols * scale, inBGR.rows * scale))
+                break;
 
-        if (!inAlpha.empty())
-        {
-            v.has_alpha = 1;
+            Task v;
+            v.id = i;
+            v.inpath = imagepath;
+            v.outpath = ltp->output_files[i];
+            v.anim = source.writer;
+            v.frame = source.frame;
+            v.has_alpha = 0;
+            v.stream = false;
+            v.stream_success = 0;
+
+            int w = inBGR.cols;
+            int h = inBGR.rows;
+            int c = inBGR.channels();
+
+            if (!inAlpha.empty())
+            {
+                v.has_alpha = 1;
 
-            unsigned char* alphadata = (unsigned char*)malloc(w * h);
-            memcpy(alphadata, inAlpha.data, w * h);
-            v.inalpha = ncnn::Mat(w, h, (void*)alphadata, (size_t)1, 1);
+                unsigned char* alphadata = (unsigned char*)malloc(w * h);
+                memcpy(alphadata, inAlpha.data, w * h);
+                v.inalpha = ncnn::Mat(w, h, (void*)alphadata, (size_t)1, 1);
 
-            path_t ext = get_file_extension(v.outpath);
-            if (ltp->output_format.empty() && (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG")))
-            {
-                path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
-                v.outpath = output_filename2;
+                path_t ext = get_file_extension(v.outpath);
+                if (ltp->output_format.empty() && (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG")))
+                {
+                    path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
+                    v.outpath = output_filename2;
 #if _WIN32
-                fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                    fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #else // _WIN32
-                fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                    fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #endif // _WIN32
+                }
             }
-        }
 
-        unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
-        memcpy(pixeldata, inBGR.data, w * h * c);
-        
-        v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
-        v.outimage = ncnn::Mat(w * scale, h * scale, (size_t)c, c);
+            unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
+            memcpy(pixeldata, inBGR.data, w * h * c);
+
+            v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
+
+            // alpha is merged in the save stage and needs outimage, the pixels stay bgr throughout
+            v.stream = ltp->stream_output && !v.anim && !v.has_alpha && is_stream_encode_format(get_file_extension(v.outpath));
+            if (v.stream)
+            {
+                v.writer.reset(new StreamImageWriter);
+                v.stream = v.writer->open(v.outpath, w * scale, h * scale, c, true);
+                if (!v.stream)
+                    v.writer.reset();
+            }
+
+            if (!v.stream)
+                v.outimage = ncnn::Mat(w * scale, h * scale, (size_t)c, c);
 
-        toproc.put(v);
+            toproc.put(std::move(v), v.bytes());
+        }
     }
 
     return 0;
@@ -275,14 +279,21 @@ void* proc(void* args)
     {
         Task v;
 
-        toproc.get(v);
-
-        if (v.id == -233)
+        if (!toproc.get(v))
             break;
 
-        srmd->process(v.inimage, v.outimage);
+        if (v.stream)
+        {
+            // a failed close removes the unfinished file
+            v.stream_success = srmd->process(v.inimage, v.outimage, v.writer.get()) == 0 && v.writer->close();
+            v.writer.reset();
+        }
+        else
+        {
+            srmd->process(v.inimage, v.outimage);
+        }
 
-        tosave.put(v);
+        tosave.put(std::move(v), v.bytes());
     }
 
     return 0;
@@ -303,16 +314,19 @@ void* save(void* args)
     {
         Task v;
 
-        tosave.get(v);
-
-        if (v.id == -233)
+        if (!tosave.get(v))
             break;
 
         int success = 0;
 
         path_t ext = get_file_extension(v.outpath);
 
-        // if (ext != PATHSTR("gif")) 
+        if (v.stream)
+        {
+            // already encoded by the proc stage
+            success = v.stream_success;
+        }
+        else
         {
             cv::Mat image;
             
@@ -337,12 +351,21 @@ void* save(void* args)
             if (image.empty()) {
                 std::cerr << "Error: Image data not loaded." << std::endl;
                 success = false;
+                if (v.anim)
+                    v.anim->fail_frame(v.frame);
             } else {
-                #if _WIN32
+                if (v.anim)
+                {
+                    success = v.anim->add(v.frame, image);
+                }
+                else
+                {
+#if _WIN32
                     success = imwrite_unicode(v.outpath, image);
-                #else
+#else
                     success = imwrite(v.outpath.c_str(), image);
-                #endif
+#endif
+                }
             }
         }
         
@@ -401,16 +424,23 @@ int main(int argc, char** argv)
     std::vector<int> jobs_proc;
     int jobs_save = 2;
     int verbose = 0;
+    int stream_output = 0;
     int tta_mode = 0;
+    int flat_tile_range = -1;
+    long long tile_cache_size = 0;
+    int temporal_tolerance = -1;
+    path_t result_cache_dir;
     path_t output_format;
     path_t suggested_format;
     long long skip_size = 0;
     path_t name_pattern = PATHSTR("{name}");
+    BenchOptions bench;
+    bool benchmark = false;
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"i:o:n:s:t:m:g:j:f:vxhk:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"i:o:n:s:t:m:g:j:f:vxhk:e:p:SF:D:T:R:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -451,12 +481,35 @@ int main(int argc, char** argv)
         case L'x':
             tta_mode = 1;
             break;
+        case L'F':
+            flat_tile_range = _wtoi(optarg);
+            break;
+        case L'D':
+            tile_cache_size = parse_size_string(optarg);
+            break;
+        case L'T':
+            temporal_tolerance = _wtoi(optarg);
+            break;
+        case L'R':
+            result_cache_dir = optarg;
+            break;
+        case L'S':
+            stream_output = 1;
+            break;
         case L'k':
             skip_size = _wtoi64(optarg);
             break;
         case L'p':
             name_pattern = optarg;
             break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0)
+            {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L'h':
         default:
             print_usage();
@@ -465,7 +518,7 @@ int main(int argc, char** argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:n:s:t:m:g:j:f:vxhk:e:p:")) != -1)
+    while ((opt = getopt(argc, argv, "i:o:n:s:t:m:g:j:f:vxhk:e:p:SF:D:T:R:B:")) != -1)
     {
         switch (opt)
         {
@@ -506,12 +559,35 @@ int main(int argc, char** argv)
             case 'x':
                 tta_mode = 1;
                 break;
+            case 'F':
+                flat_tile_range = atoi(optarg);
+                break;
+            case 'D':
+                tile_cache_size = parse_size_string(optarg);
+                break;
+            case 'T':
+                temporal_tolerance = atoi(optarg);
+                break;
+            case 'R':
+                result_cache_dir = optarg;
+                break;
+            case 'S':
+                stream_output = 1;
+                break;
             case 'k':
                 skip_size = atoll(optarg);
                 break;
             case 'p':
                 name_pattern = optarg;
                 break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0)
+                {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
         case 'h':
         default:
             print_usage();
@@ -520,7 +596,7 @@ int main(int argc, char** argv)
     }
 #endif // _WIN32
 
-    if (inputpath.empty() || outputpath.empty())
+    if ((inputpath.empty() || outputpath.empty()) && !benchmark)
     {
         print_usage();
         return -1;
@@ -547,6 +623,12 @@ int main(int argc, char** argv)
         }
     }
 
+    if (tile_cache_size < 0)
+    {
+        fprintf(stderr, "invalid tile cache size argument\n");
+        return -1;
+    }
+
     if (jobs_load < 1 || jobs_save < 1)
     {
         fprintf(stderr, "invalid thread count argument\n");
@@ -583,6 +665,8 @@ int main(int argc, char** argv)
                 output_format = PATHSTR("bmp");
             else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
                 output_format = PATHSTR("tiff");
+            else if (ext == PATHSTR("gif") || ext == PATHSTR("GIF"))
+                output_format = PATHSTR("gif");
         }
         if (!output_format.empty() && !is_supported_encode_format(output_format))
         {
@@ -593,6 +677,7 @@ int main(int argc, char** argv)
 
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+    if (!benchmark)
     {
         path_t effective_format = output_format.empty() ? suggested_format : output_format;
 
@@ -730,7 +815,59 @@ int main(int argc, char** argv)
         }
     }
 
+    if (benchmark)
     {
+        // one engine on the first device, images go straight through process() without the pipeline threads
+        int ret;
+        {
+            SRMD srmd(gpuid[0], tta_mode);
+            srmd.load(paramfullpath, modelfullpath);
+            srmd.noise = noise;
+            srmd.scale = scale;
+            srmd.tilesize = tilesize[0];
+            srmd.prepadding = prepadding;
+            srmd.flat_tile_range = flat_tile_range;
+
+            // srmd takes the decoded bgr pixels as they are
+            auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+                ncnn::Mat inimage(in.cols, in.rows, (void*)in.data, (size_t)3, 3);
+                out.create(in.rows * scale, in.cols * scale, CV_8UC3);
+                ncnn::Mat outimage(out.cols, out.rows, (void*)out.data, (size_t)3, 3);
+                return srmd.process(inimage, outimage);
+            };
+
+            bench.format = bench_path_string(output_format);
+
+            BenchJson info;
+            info.add("engine", std::string("srmd")).add("model", bench_path_string(modelfullpath));
+            info.add("gpu", gpuid[0]).add("tilesize", tilesize[0]).add("tta", tta_mode);
+            info.add("noise", noise);
+            info.add("device", std::string(ncnn::get_gpu_info(gpuid[0]).device_name()));
+
+            ret = run_benchmark(bench, scale, info, outputpath, upscale);
+        }
+
+        ncnn::destroy_gpu_instance();
+
+        return ret;
+    }
+
+    {
+        ResultCache* result_cache = 0;
+        if (!result_cache_dir.empty())
+        {
+            char settings[128];
+            sprintf(settings, "srmd noise=%d scale=%d tta=%d flat=%d temporal=%d", noise, scale, tta_mode, flat_tile_range, temporal_tolerance);
+            result_cache = new ResultCache(result_cache_dir, paramfullpath, modelfullpath, settings);
+            result_cache->take_hits(input_files, output_files, verbose);
+        }
+
+        // one cache for the whole run, tiles repeat across the images of a batch
+        TileDedupCache* tile_cache = tile_cache_size > 0 ? new TileDedupCache((size_t)tile_cache_size) : 0;
+
+        // frames of all animations and the images of the batch run through one temporal cache
+        TemporalTileCache* temporal_cache = temporal_tolerance >= 0 ? new TemporalTileCache(temporal_tolerance) : 0;
+
         std::vector<SRMD*> srmd(use_gpu_count);
 
         for (int i=0; i<use_gpu_count; i++)
@@ -743,6 +880,9 @@ int main(int argc, char** argv)
             srmd[i]->scale = scale;
             srmd[i]->tilesize = tilesize[i];
             srmd[i]->prepadding = prepadding;
+            srmd[i]->flat_tile_range = flat_tile_range;
+            srmd[i]->tile_cache = tile_cache;
+            srmd[i]->temporal_cache = temporal_cache;
         }
 
         // main routine
@@ -752,6 +892,7 @@ int main(int argc, char** argv)
             ltp.scale = scale;
             ltp.output_format = output_format;
             ltp.jobs_load = jobs_load;
+            ltp.stream_output = stream_output;
             ltp.input_files = input_files;
             ltp.output_files = output_files;
 
@@ -789,13 +930,7 @@ int main(int argc, char** argv)
             // end
             load_thread.join();
 
-            Task end;
-            end.id = -233;
-
-            for (int i=0; i<total_jobs_proc; i++)
-            {
-                toproc.put(end);
-            }
+            toproc.close();
 
             for (int i=0; i<total_jobs_proc; i++)
             {
@@ -803,10 +938,7 @@ int main(int argc, char** argv)
                 delete proc_threads[i];
             }
 
-            for (int i=0; i<jobs_save; i++)
-            {
-                tosave.put(end);
-            }
+            tosave.close();
 
             for (int i=0; i<jobs_save; i++)
             {
@@ -820,6 +952,25 @@ int main(int argc, char** argv)
             delete srmd[i];
         }
         srmd.clear();
+
+        if (tile_cache)
+        {
+            tile_cache->print_stats();
+            delete tile_cache;
+        }
+
+        if (temporal_cache)
+        {
+            temporal_cache->print_stats();
+            delete temporal_cache;
+        }
+
+        if (result_cache)
+        {
+            result_cache->store_results(verbose);
+            result_cache->print_stats();
+            delete result_cache;
+        }
     }
 
     ncnn::destroy_gpu_instance();
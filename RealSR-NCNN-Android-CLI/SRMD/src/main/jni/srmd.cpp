@@ -200,395 +200,275 @@ int SRMD::load(const std::string& parampath, const std::string& modelpath)
     return 0;
 }
 
-int SRMD::process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const
+int SRMD::process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer) const
 {
-    const unsigned char* pixeldata = (const unsigned char*)inimage.data;
-    const int w = inimage.w;
-    const int h = inimage.h;
-    const int channels = inimage.elempack;
+    return process_tiled_gpu(inimage, outimage, writer);
+}
+
+void SRMD::process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const
+{
+    const int w = grid.w;
+    const int h = grid.h;
+    const int channels = grid.channels;
 
     const int TILE_SIZE_X = tilesize;
     const int TILE_SIZE_Y = tilesize;
 
-    ncnn::VkAllocator* blob_vkallocator = net.vulkan_device()->acquire_blob_allocator();
-    ncnn::VkAllocator* staging_vkallocator = net.vulkan_device()->acquire_staging_allocator();
-
-    ncnn::Option opt = net.opt;
-    opt.blob_vkallocator = blob_vkallocator;
-    opt.workspace_vkallocator = blob_vkallocator;
-    opt.staging_vkallocator = staging_vkallocator;
-
-    // each tile 400x400
-    const int xtiles = (w + TILE_SIZE_X - 1) / TILE_SIZE_X;
-    const int ytiles = (h + TILE_SIZE_Y - 1) / TILE_SIZE_Y;
+    ncnn::VkAllocator* blob_vkallocator = opt.blob_vkallocator;
+    ncnn::VkAllocator* staging_vkallocator = opt.staging_vkallocator;
 
     const size_t in_out_tile_elemsize = opt.use_fp16_storage ? 2u : 4u;
 
-    //#pragma omp parallel for num_threads(2)
-    for (int yi = 0; yi < ytiles; yi++)
-    {
-        const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
+    const int tile_h_nopad = std::min((yi + 1) * TILE_SIZE_Y, h) - yi * TILE_SIZE_Y;
 
-        int in_tile_y0 = std::max(yi * TILE_SIZE_Y - prepadding, 0);
-        int in_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y + prepadding, h);
+    const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
 
-        ncnn::Mat in;
-        if (opt.use_fp16_storage && opt.use_int8_storage)
-        {
-            const int safe_tile_h = in_tile_y1 - in_tile_y0;
-            const bool is_standard_size = (safe_tile_h == TILE_SIZE_Y + 2 * prepadding);
-            if (is_standard_size) {
-                in = ncnn::Mat(w, safe_tile_h, (unsigned char*)pixeldata + in_tile_y0 * w * channels, (size_t)channels, 1);
-            } else {
-                in.create(w, safe_tile_h, (size_t)channels, 1);
-                const unsigned char* src = (unsigned char*)pixeldata + in_tile_y0 * w * channels;
-                memcpy(in.data, src, (size_t)w * safe_tile_h * channels);
-            }
-        }
-        else
+    if (tta_mode)
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu[8];
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            if (channels == 3)
-            {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGR2RGB, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGB, w, (in_tile_y1 - in_tile_y0));
-#endif
-            }
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
+
+            in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+            in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
+
             if (channels == 4)
             {
-#if _WIN32
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGRA2RGBA, w, (in_tile_y1 - in_tile_y0));
-#else
-                in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGBA, w, (in_tile_y1 - in_tile_y0));
-#endif
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
             }
-        }
 
-        ncnn::VkCompute cmd(net.vulkan_device());
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu[0];
+            bindings[2] = in_tile_gpu[1];
+            bindings[3] = in_tile_gpu[2];
+            bindings[4] = in_tile_gpu[3];
+            bindings[5] = in_tile_gpu[4];
+            bindings[6] = in_tile_gpu[5];
+            bindings[7] = in_tile_gpu[6];
+            bindings[8] = in_tile_gpu[7];
+            bindings[9] = in_alpha_tile_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(14);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu[0].w;
+            constants[4].i = in_tile_gpu[0].h;
+            constants[5].i = in_tile_gpu[0].cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = noise;
+            constants[11].i = channels;//(noise == -1 ? 18 : 19) + channels - 3;
+            constants[12].i = in_alpha_tile_gpu.w;
+            constants[13].i = in_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu[0].w;
+            dispatcher.h = in_tile_gpu[0].h;
+            dispatcher.c = (noise == -1 ? 18 : 19) + channels - 3;
+
+            cmd.record_pipeline(srmd_preproc, bindings, constants, dispatcher);
+        }
 
-        // upload
-        ncnn::VkMat in_gpu;
+        // srmd
+        ncnn::VkMat out_tile_gpu[8];
+        for (int ti = 0; ti < 8; ti++)
         {
-            cmd.record_clone(in, in_gpu, opt);
+            ncnn::Extractor ex = net.create_extractor();
 
-            if (xtiles > 1)
-            {
-                cmd.submit_and_wait();
-                cmd.reset();
-            }
-        }
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
 
-        int out_tile_y0 = std::max(yi * TILE_SIZE_Y, 0);
-        int out_tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h);
+            ex.input("input", in_tile_gpu[ti]);
 
-        ncnn::VkMat out_gpu;
-        if (opt.use_fp16_storage && opt.use_int8_storage)
-        {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, (size_t)channels, 1, blob_vkallocator);
-        }
-        else
-        {
-            out_gpu.create(w * scale, (out_tile_y1 - out_tile_y0) * scale, channels, (size_t)4u, 1, blob_vkallocator);
+            ex.extract("output", out_tile_gpu[ti], cmd);
         }
 
-        for (int xi = 0; xi < xtiles; xi++)
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
         {
-            const int tile_w_nopad = std::min((xi + 1) * TILE_SIZE_X, w) - xi * TILE_SIZE_X;
-
-            if (tta_mode)
+            if (scale == 1)
             {
-                // preproc
-                ncnn::VkMat in_tile_gpu[8];
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
-
-                    in_tile_gpu[0].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[1].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[2].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[3].create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[4].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[5].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[6].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-                    in_tile_gpu[7].create(tile_y1 - tile_y0, tile_x1 - tile_x0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
-
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu[0];
-                    bindings[2] = in_tile_gpu[1];
-                    bindings[3] = in_tile_gpu[2];
-                    bindings[4] = in_tile_gpu[3];
-                    bindings[5] = in_tile_gpu[4];
-                    bindings[6] = in_tile_gpu[5];
-                    bindings[7] = in_tile_gpu[6];
-                    bindings[8] = in_tile_gpu[7];
-                    bindings[9] = in_alpha_tile_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(14);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu[0].w;
-                    constants[4].i = in_tile_gpu[0].h;
-                    constants[5].i = in_tile_gpu[0].cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = noise;
-                    constants[11].i = channels;//(noise == -1 ? 18 : 19) + channels - 3;
-                    constants[12].i = in_alpha_tile_gpu.w;
-                    constants[13].i = in_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu[0].w;
-                    dispatcher.h = in_tile_gpu[0].h;
-                    dispatcher.c = (noise == -1 ? 18 : 19) + channels - 3;
-
-                    cmd.record_pipeline(srmd_preproc, bindings, constants, dispatcher);
-                }
-
-                // srmd
-                ncnn::VkMat out_tile_gpu[8];
-                for (int ti = 0; ti < 8; ti++)
-                {
-                    ncnn::Extractor ex = net.create_extractor();
-
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input("input", in_tile_gpu[ti]);
-
-                    ex.extract("output", out_tile_gpu[ti], cmd);
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
-
-                // postproc
-                {
-                    std::vector<ncnn::VkMat> bindings(10);
-                    bindings[0] = out_tile_gpu[0];
-                    bindings[1] = out_tile_gpu[1];
-                    bindings[2] = out_tile_gpu[2];
-                    bindings[3] = out_tile_gpu[3];
-                    bindings[4] = out_tile_gpu[4];
-                    bindings[5] = out_tile_gpu[5];
-                    bindings[6] = out_tile_gpu[6];
-                    bindings[7] = out_tile_gpu[7];
-                    bindings[8] = out_alpha_tile_gpu;
-                    bindings[9] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = out_tile_gpu[0].w;
-                    constants[1].i = out_tile_gpu[0].h;
-                    constants[2].i = out_tile_gpu[0].cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = prepadding * scale;
-                    constants[9].i = prepadding * scale;
-                    constants[10].i = channels;
-                    constants[11].i = out_alpha_tile_gpu.w;
-                    constants[12].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(srmd_postproc, bindings, constants, dispatcher);
-                }
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
             }
-            else
+            if (scale == 2)
             {
-                // preproc
-                ncnn::VkMat in_tile_gpu;
-                ncnn::VkMat in_alpha_tile_gpu;
-                {
-                    // crop tile
-                    int tile_x0 = xi * TILE_SIZE_X - prepadding;
-                    int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
-                    int tile_y0 = yi * TILE_SIZE_Y - prepadding;
-                    int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
-
-                    in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
-
-                    if (channels == 4)
-                    {
-                        in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
-                    }
-
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = in_gpu;
-                    bindings[1] = in_tile_gpu;
-                    bindings[2] = in_alpha_tile_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(14);
-                    constants[0].i = in_gpu.w;
-                    constants[1].i = in_gpu.h;
-                    constants[2].i = in_gpu.cstep;
-                    constants[3].i = in_tile_gpu.w;
-                    constants[4].i = in_tile_gpu.h;
-                    constants[5].i = in_tile_gpu.cstep;
-                    constants[6].i = prepadding;
-                    constants[7].i = prepadding;
-                    constants[8].i = xi * TILE_SIZE_X;
-                    constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
-                    constants[10].i = noise;
-                    constants[11].i = channels;//(noise == -1 ? 18 : 19) + channels - 3;
-                    constants[12].i = in_alpha_tile_gpu.w;
-                    constants[13].i = in_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = in_tile_gpu.w;
-                    dispatcher.h = in_tile_gpu.h;
-                    dispatcher.c = (noise == -1 ? 18 : 19) + channels - 3;
-
-                    cmd.record_pipeline(srmd_preproc, bindings, constants, dispatcher);
-                }
-
-                // srmd
-                ncnn::VkMat out_tile_gpu;
-                {
-                    ncnn::Extractor ex = net.create_extractor();
-
-                    ex.set_blob_vkallocator(blob_vkallocator);
-                    ex.set_workspace_vkallocator(blob_vkallocator);
-                    ex.set_staging_vkallocator(staging_vkallocator);
-
-                    ex.input("input", in_tile_gpu);
-
-                    ex.extract("output", out_tile_gpu, cmd);
-                }
-
-                ncnn::VkMat out_alpha_tile_gpu;
-                if (channels == 4)
-                {
-                    if (scale == 1)
-                    {
-                        out_alpha_tile_gpu = in_alpha_tile_gpu;
-                    }
-                    if (scale == 2)
-                    {
-                        bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 3)
-                    {
-                        bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                    if (scale == 4)
-                    {
-                        bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
-                    }
-                }
-
-                // postproc
-                {
-                    std::vector<ncnn::VkMat> bindings(3);
-                    bindings[0] = out_tile_gpu;
-                    bindings[1] = out_alpha_tile_gpu;
-                    bindings[2] = out_gpu;
-
-                    std::vector<ncnn::vk_constant_type> constants(13);
-                    constants[0].i = out_tile_gpu.w;
-                    constants[1].i = out_tile_gpu.h;
-                    constants[2].i = out_tile_gpu.cstep;
-                    constants[3].i = out_gpu.w;
-                    constants[4].i = out_gpu.h;
-                    constants[5].i = out_gpu.cstep;
-                    constants[6].i = xi * TILE_SIZE_X * scale;
-                    constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    constants[8].i = prepadding * scale;
-                    constants[9].i = prepadding * scale;
-                    constants[10].i = channels;
-                    constants[11].i = out_alpha_tile_gpu.w;
-                    constants[12].i = out_alpha_tile_gpu.h;
-
-                    ncnn::VkMat dispatcher;
-                    dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
-                    dispatcher.h = out_gpu.h;
-                    dispatcher.c = channels;
-
-                    cmd.record_pipeline(srmd_postproc, bindings, constants, dispatcher);
-                }
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
-
-            if (xtiles > 1)
+            if (scale == 3)
             {
-                cmd.submit_and_wait();
-                cmd.reset();
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
         }
 
-        // download
+        // postproc
+        {
+            std::vector<ncnn::VkMat> bindings(10);
+            bindings[0] = out_tile_gpu[0];
+            bindings[1] = out_tile_gpu[1];
+            bindings[2] = out_tile_gpu[2];
+            bindings[3] = out_tile_gpu[3];
+            bindings[4] = out_tile_gpu[4];
+            bindings[5] = out_tile_gpu[5];
+            bindings[6] = out_tile_gpu[6];
+            bindings[7] = out_tile_gpu[7];
+            bindings[8] = out_alpha_tile_gpu;
+            bindings[9] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = out_tile_gpu[0].w;
+            constants[1].i = out_tile_gpu[0].h;
+            constants[2].i = out_tile_gpu[0].cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = prepadding * scale;
+            constants[9].i = prepadding * scale;
+            constants[10].i = channels;
+            constants[11].i = out_alpha_tile_gpu.w;
+            constants[12].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(srmd_postproc, bindings, constants, dispatcher);
+        }
+    }
+    else
+    {
+        // preproc
+        ncnn::VkMat in_tile_gpu;
+        ncnn::VkMat in_alpha_tile_gpu;
         {
-            ncnn::Mat out;
+            // crop tile
+            int tile_x0 = xi * TILE_SIZE_X - prepadding;
+            int tile_x1 = std::min((xi + 1) * TILE_SIZE_X, w) + prepadding;
+            int tile_y0 = yi * TILE_SIZE_Y - prepadding;
+            int tile_y1 = std::min((yi + 1) * TILE_SIZE_Y, h) + prepadding;
+
+            in_tile_gpu.create(tile_x1 - tile_x0, tile_y1 - tile_y0, noise == -1 ? 18 : 19, in_out_tile_elemsize, 1, blob_vkallocator);
 
-            if (opt.use_fp16_storage && opt.use_int8_storage)
+            if (channels == 4)
             {
-                out = ncnn::Mat(out_gpu.w, out_gpu.h, (unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, (size_t)channels, 1);
+                in_alpha_tile_gpu.create(tile_w_nopad, tile_h_nopad, 1, in_out_tile_elemsize, 1, blob_vkallocator);
             }
 
-            cmd.record_clone(out_gpu, out, opt);
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = in_gpu;
+            bindings[1] = in_tile_gpu;
+            bindings[2] = in_alpha_tile_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(14);
+            constants[0].i = in_gpu.w;
+            constants[1].i = in_gpu.h;
+            constants[2].i = in_gpu.cstep;
+            constants[3].i = in_tile_gpu.w;
+            constants[4].i = in_tile_gpu.h;
+            constants[5].i = in_tile_gpu.cstep;
+            constants[6].i = prepadding;
+            constants[7].i = prepadding;
+            constants[8].i = xi * TILE_SIZE_X;
+            constants[9].i = std::min(yi * TILE_SIZE_Y, prepadding);
+            constants[10].i = noise;
+            constants[11].i = channels;//(noise == -1 ? 18 : 19) + channels - 3;
+            constants[12].i = in_alpha_tile_gpu.w;
+            constants[13].i = in_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = in_tile_gpu.w;
+            dispatcher.h = in_tile_gpu.h;
+            dispatcher.c = (noise == -1 ? 18 : 19) + channels - 3;
+
+            cmd.record_pipeline(srmd_preproc, bindings, constants, dispatcher);
+        }
+
+        // srmd
+        ncnn::VkMat out_tile_gpu;
+        {
+            ncnn::Extractor ex = net.create_extractor();
+
+            ex.set_blob_vkallocator(blob_vkallocator);
+            ex.set_workspace_vkallocator(blob_vkallocator);
+            ex.set_staging_vkallocator(staging_vkallocator);
+
+            ex.input("input", in_tile_gpu);
 
-            cmd.submit_and_wait();
+            ex.extract("output", out_tile_gpu, cmd);
+        }
 
-            if (!(opt.use_fp16_storage && opt.use_int8_storage))
+        ncnn::VkMat out_alpha_tile_gpu;
+        if (channels == 4)
+        {
+            if (scale == 1)
             {
-                if (channels == 3)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB2BGR);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGB);
-#endif
-                }
-                if (channels == 4)
-                {
-#if _WIN32
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA2BGRA);
-#else
-                    out.to_pixels((unsigned char*)outimage.data + yi * scale * TILE_SIZE_Y * w * scale * channels, ncnn::Mat::PIXEL_RGBA);
-#endif
-                }
+                out_alpha_tile_gpu = in_alpha_tile_gpu;
+            }
+            if (scale == 2)
+            {
+                bicubic_2x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 3)
+            {
+                bicubic_3x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
+            }
+            if (scale == 4)
+            {
+                bicubic_4x->forward(in_alpha_tile_gpu, out_alpha_tile_gpu, cmd, opt);
             }
         }
-    }
-
-    net.vulkan_device()->reclaim_blob_allocator(blob_vkallocator);
-    net.vulkan_device()->reclaim_staging_allocator(staging_vkallocator);
 
-    return 0;
+        // postproc
+        {
+            std::vector<ncnn::VkMat> bindings(3);
+            bindings[0] = out_tile_gpu;
+            bindings[1] = out_alpha_tile_gpu;
+            bindings[2] = out_gpu;
+
+            std::vector<ncnn::vk_constant_type> constants(13);
+            constants[0].i = out_tile_gpu.w;
+            constants[1].i = out_tile_gpu.h;
+            constants[2].i = out_tile_gpu.cstep;
+            constants[3].i = out_gpu.w;
+            constants[4].i = out_gpu.h;
+            constants[5].i = out_gpu.cstep;
+            constants[6].i = xi * TILE_SIZE_X * scale;
+            constants[7].i = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            constants[8].i = prepadding * scale;
+            constants[9].i = prepadding * scale;
+            constants[10].i = channels;
+            constants[11].i = out_alpha_tile_gpu.w;
+            constants[12].i = out_alpha_tile_gpu.h;
+
+            ncnn::VkMat dispatcher;
+            dispatcher.w = std::min(TILE_SIZE_X * scale, out_gpu.w - xi * TILE_SIZE_X * scale);
+            dispatcher.h = out_gpu.h;
+            dispatcher.c = channels;
+
+            cmd.record_pipeline(srmd_postproc, bindings, constants, dispatcher);
+        }
+    }
 }
@@ -10,8 +10,12 @@
 #include "gpu.h"
 #include "layer.h"
 
-class SRMD
+#include "tiled_upscaler.h"
+
+class SRMD : public TiledUpscaler<SRMD>
 {
+    friend class TiledUpscaler<SRMD>;
+
 public:
     SRMD(int gpuid, bool tta_mode = false);
     ~SRMD();
@@ -22,7 +26,11 @@ public:
     int load(const std::string& parampath, const std::string& modelpath);
 #endif
 
-    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    // with a writer the output rows are encoded as they finish and outimage stays empty
+    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+private:
+    void process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
 public:
     // srmd parameters
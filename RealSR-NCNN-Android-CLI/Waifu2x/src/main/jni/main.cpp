@@ -2,7 +2,6 @@
 
 #include <stdio.h>
 #include <algorithm>
-#include <queue>
 #include <vector>
 #include <clocale>
 #include "utils.hpp"
@@ -98,7 +97,15 @@ static std::vector<int> parse_optarg_int_array(const char* optarg)
 #include "waifu2x.h"
 
 #include "filesystem_utils.h"
+#include "anim_image.h"
 #include "image_processor.h"
+#include "task_queue.h"
+#include "memory_budget.h"
+#include "result_cache.h"
+#include "stream_writer.h"
+#include "bench_mode.h"
+#include "tile_autotune.h"
+#include "spirv_cache.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/core/hal/interface.h>
 using namespace cv;
@@ -113,14 +120,22 @@ static void print_usage()
     fprintf(stdout, "  -n noise-level       denoise level (-1/0/1/2/3, default=0)\n");
     fprintf(stdout, "  -s scale             upscale ratio (1/2/4/8/16/32, default=2)\n");
     fprintf(stdout, "  -t tile-size         tile size (>=32/0=auto, default=0) can be 0,0,0 for multi-gpu\n");
+    fprintf(stdout, "  -t auto-bench        time tile sizes up to the auto size once per device/model, cached in the model dir\n");
     fprintf(stdout, "  -m model-path        waifu2x model path (default=models-cunet)\n");
     fprintf(stdout, "  -g gpu-id            gpu device to use (-1=cpu, default=auto) can be 0,1,2 for multi-gpu\n");
     fprintf(stdout, "  -j load:proc:save    thread count for load/proc/save (default=1:2:2) can be 1:2,2,2:2 for multi-gpu\n");
     fprintf(stdout, "  -x                   enable tta mode\n");
+    fprintf(stdout, "  -F range             skip the model on tiles within range levels per channel (0=one colour) or fully transparent, bilinear fill (default=-1=off)\n");
+    fprintf(stdout, "  -D cache-size        reuse the output of tiles identical to earlier ones, LRU cache size e.g. 256M (default=0=off)\n");
+    fprintf(stdout, "  -T tolerance         frame sequences only re-run tiles changed by more than tolerance levels since the previous frame (0=exact, default=-1=off)\n");
+    fprintf(stdout, "  -R cache-dir         reuse the results of identical inputs with the same model and settings from cache-dir\n");
     fprintf(stdout, "  -f format            force output format (ignore alpha channel detection)\n");
     fprintf(stdout, "  -e format            suggested output format (auto-convert to png if alpha detected)\n");
     fprintf(stdout, "  -k skip-size         skip if output file exists and size >= threshold bytes (0=disable)\n");
     fprintf(stdout, "  -p pattern           output name pattern for batch mode, placeholders: {name} {prog} {index} {timestamp} {datetime} {date} {time}\n");
+    fprintf(stdout, "  -S                   stream png/tiff/bmp output to disk by tile rows, the full result is never held in memory (images without alpha)\n");
+    fprintf(stdout, "  -G                   share the tiles of each image across all -g devices, one image at a time with the smallest tile-size\n");
+    fprintf(stdout, "  -B sizes[:n[:warmup]] benchmark on random images, e.g. 512x512,1920x1080a:10:2 (a=alpha), json to stdout or -o\n");
 }
 
 class Task
@@ -136,56 +151,24 @@ public:
     ncnn::Mat inimage;
     ncnn::Mat outimage;
     ncnn::Mat inalpha;
-};
-
-class TaskQueue
-{
-public:
-    TaskQueue()
-    {
-    }
-
-    void put(const Task& v)
-    {
-        lock.lock();
-
-        while (tasks.size() >= 8) // FIXME hardcode queue length
-        {
-            condition.wait(lock);
-        }
 
-        tasks.push(v);
+    // frame of a gif or animated webp, the writer collects all frames of the file
+    std::shared_ptr<AnimWriter> anim;
+    int frame;
 
-        lock.unlock();
+    // encode the result by tile rows in the proc stage instead of saving outimage
+    bool stream;
+    std::shared_ptr<StreamImageWriter> writer;
+    int stream_success;
 
-        condition.signal();
-    }
-
-    void get(Task& v)
+    size_t bytes() const
     {
-        lock.lock();
-
-        while (tasks.size() == 0)
-        {
-            condition.wait(lock);
-        }
-
-        v = tasks.front();
-        tasks.pop();
-
-        lock.unlock();
-
-        condition.signal();
+        return inimage.total() * inimage.elemsize + outimage.total() * outimage.elemsize + inalpha.total() * inalpha.elemsize;
     }
-
-private:
-    ncnn::Mutex lock;
-    ncnn::ConditionVariable condition;
-    std::queue<Task> tasks;
 };
 
-TaskQueue toproc;
-TaskQueue tosave;
+TaskQueue<Task> toproc;
+TaskQueue<Task> tosave;
 
 class LoadThreadParams
 {
@@ -193,6 +176,7 @@ public:
     int scale;
     path_t output_format;
     int jobs_load;
+    int stream_output;
 
     // session data
     std::vector<path_t> input_files;
@@ -210,67 +194,94 @@ void* load(void* args)
     {
         const path_t& imagepath = ltp->input_files[i];
 
-        cv::Mat inBGR, inAlpha;
-        imread(imagepath, inBGR, inAlpha);
+        // gif and animated webp give one task per frame
+        FrameSource source(imagepath, ltp->output_files[i]);
 
-        if (!inBGR.empty())
+        cv::Mat inBGR, inAlpha;
+        while (source.next(inBGR, inAlpha))
         {
-            Task v;
-            v.id = i;
-            v.scale = scale;
-            v.inpath = imagepath;
-            v.outpath = ltp->output_files[i];
-            v.has_alpha = !inAlpha.empty();
-
-            path_t ext = get_file_extension(v.outpath);
-            if (v.has_alpha && ltp->output_format.empty())
+            if (!inBGR.empty())
             {
-                if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+                // an animation its format can not hold is given up before any frame runs
+                if (source.writer && !source.writer->check_size(inBGR.cols * scale, inBGR.rows * scale))
+                    break;
+
+                Task v;
+                v.id = i;
+                v.scale = scale;
+                v.inpath = imagepath;
+                v.outpath = ltp->output_files[i];
+                v.anim = source.writer;
+                v.frame = source.frame;
+                v.has_alpha = !inAlpha.empty();
+                v.stream = false;
+                v.stream_success = 0;
+
+                path_t ext = get_file_extension(v.outpath);
+                if (v.has_alpha && ltp->output_format.empty())
                 {
-                    path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
-                    v.outpath = output_filename2;
+                    if (ext == PATHSTR("jpg") || ext == PATHSTR("JPG") || ext == PATHSTR("jpeg") || ext == PATHSTR("JPEG"))
+                    {
+                        path_t output_filename2 = ltp->output_files[i] + PATHSTR(".png");
+                        v.outpath = output_filename2;
 #if _WIN32
-                    fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fwprintf(stderr, L"image %ls has alpha channel ! %ls will output %ls\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #else // _WIN32
-                    fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
+                        fprintf(stderr, "image %s has alpha channel ! %s will output %s\n", imagepath.c_str(), imagepath.c_str(), output_filename2.c_str());
 #endif // _WIN32
+                    }
+
+                    int w = inBGR.cols;
+                    int h = inBGR.rows;
+
+                    v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
+                    if (inAlpha.data)
+                    {
+                        memcpy(v.inalpha.data, inAlpha.data, w * h);
+                    }
                 }
 
                 int w = inBGR.cols;
                 int h = inBGR.rows;
+                int c = inBGR.channels();
+
+                unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
+                memcpy(pixeldata, inBGR.data, w * h * c);
 
-                v.inalpha = ncnn::Mat(w, h, (size_t)1, 1);
-                if (inAlpha.data)
+#ifndef _WIN32
+                for (int j = 0; j < w * h * c; j += c)
                 {
-                    memcpy(v.inalpha.data, inAlpha.data, w * h);
+                    std::swap(pixeldata[j], pixeldata[j + 2]);
                 }
-            }
-
-            int w = inBGR.cols;
-            int h = inBGR.rows;
-            int c = inBGR.channels();
+#endif
 
-            unsigned char* pixeldata = (unsigned char*)malloc(w * h * c);
-            memcpy(pixeldata, inBGR.data, w * h * c);
+                v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
 
-#ifndef _WIN32
-            for (int j = 0; j < w * h * c; j += c)
-            {
-                std::swap(pixeldata[j], pixeldata[j + 2]);
-            }
+                // alpha is merged in the save stage and needs outimage
+                v.stream = ltp->stream_output && !v.anim && !v.has_alpha && is_stream_encode_format(get_file_extension(v.outpath));
+                if (v.stream)
+                {
+#if _WIN32
+                    const bool bgr = true;
+#else
+                    const bool bgr = false;
 #endif
+                    v.writer.reset(new StreamImageWriter);
+                    v.stream = v.writer->open(v.outpath, w * scale, h * scale, c, bgr);
+                    if (!v.stream)
+                        v.writer.reset();
+                }
 
-            v.inimage = ncnn::Mat(w, h, (void*)pixeldata, (size_t)c, c);
-
-            toproc.put(v);
-        }
-        else
-        {
+                toproc.put(std::move(v), v.bytes());
+            }
+            else
+            {
 #if _WIN32
-            fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
+                fwprintf(stderr, L"decode image %ls failed\n", imagepath.c_str());
 #else // _WIN32
-            fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
+                fprintf(stderr, "decode image %s failed\n", imagepath.c_str());
 #endif // _WIN32
+            }
         }
     }
 
@@ -281,29 +292,47 @@ class ProcThreadParams
 {
 public:
     const Waifu2x* waifu2x;
+
+    // -G, every image is split across these engines
+    std::vector<const Waifu2x*> shared;
 };
 
+// -G never streams, the writer is only passed to a single engine
+static int proc_upscale(const ProcThreadParams* ptp, const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0)
+{
+    if (ptp->shared.empty())
+        return ptp->waifu2x->process(inimage, outimage, writer);
+
+    return Waifu2x::process_shared(ptp->shared, inimage, outimage);
+}
+
 void* proc(void* args)
 {
     const ProcThreadParams* ptp = (const ProcThreadParams*)args;
-    const Waifu2x* waifu2x = ptp->waifu2x;
 
     for (;;)
     {
         Task v;
 
-        toproc.get(v);
-
-        if (v.id == -233)
+        if (!toproc.get(v))
             break;
 
         const int scale = v.scale;
         if (scale == 1)
         {
-            v.outimage = ncnn::Mat(v.inimage.w, v.inimage.h, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
-            waifu2x->process(v.inimage, v.outimage);
+            if (v.stream)
+            {
+                // a failed close removes the unfinished file
+                v.stream_success = proc_upscale(ptp, v.inimage, v.outimage, v.writer.get()) == 0 && v.writer->close();
+                v.writer.reset();
+            }
+            else
+            {
+                v.outimage = ncnn::Mat(v.inimage.w, v.inimage.h, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
+                proc_upscale(ptp, v.inimage, v.outimage);
+            }
 
-            tosave.put(v);
+            tosave.put(std::move(v), v.bytes());
             continue;
         }
 
@@ -329,17 +358,25 @@ void* proc(void* args)
             scale_run_count = 5;
         }
 
-        v.outimage = ncnn::Mat(v.inimage.w * 2, v.inimage.h * 2, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
-        waifu2x->process(v.inimage, v.outimage);
+        // with -S the last 2x pass is encoded by tile rows, the passes before it stay in memory
+        const int memory_run_count = v.stream ? scale_run_count - 1 : scale_run_count;
 
-        for (int i = 1; i < scale_run_count; i++)
+        ncnn::Mat tmp = v.inimage;
+        for (int i = 0; i < memory_run_count; i++)
         {
-            ncnn::Mat tmp = v.outimage;
             v.outimage = ncnn::Mat(tmp.w * 2, tmp.h * 2, (size_t)v.inimage.elemsize, (int)v.inimage.elemsize);
-            waifu2x->process(tmp, v.outimage);
+            proc_upscale(ptp, tmp, v.outimage);
+            tmp = v.outimage;
         }
 
-        tosave.put(v);
+        if (v.stream)
+        {
+            v.outimage.release();
+            v.stream_success = proc_upscale(ptp, tmp, v.outimage, v.writer.get()) == 0 && v.writer->close();
+            v.writer.reset();
+        }
+
+        tosave.put(std::move(v), v.bytes());
     }
 
     return 0;
@@ -360,9 +397,7 @@ void* save(void* args)
     {
         Task v;
 
-        tosave.get(v);
-
-        if (v.id == -233)
+        if (!tosave.get(v))
             break;
 
         // free input pixel data
@@ -374,9 +409,13 @@ void* save(void* args)
 
         int success = 0;
 
-        path_t ext = get_file_extension(v.outpath);
-
-        if (ext != PATHSTR("gif")) {
+        if (v.stream)
+        {
+            // already encoded by the proc stage
+            success = v.stream_success;
+        }
+        else
+        {
             // 使用opencv保存图片，速度比默认的stb更快
             cv::Mat image;
             if (v.has_alpha)
@@ -423,12 +462,21 @@ void* save(void* args)
             if (image.empty()) {
                 std::cerr << "Error: Image data not loaded." << std::endl;
                 success = false;
+                if (v.anim)
+                    v.anim->fail_frame(v.frame);
             } else {
+                if (v.anim)
+                {
+                    success = v.anim->add(v.frame, image);
+                }
+                else
+                {
 #if _WIN32
-                success = imwrite_unicode(v.outpath, image);
+                    success = imwrite_unicode(v.outpath, image);
 #else
-                success = imwrite(v.outpath.c_str(), image);
+                    success = imwrite(v.outpath.c_str(), image);
 #endif
+                }
             }
         }
 
@@ -468,6 +516,9 @@ int main(int argc, char** argv)
     int noise = 0;
     int scale = 2;
     std::vector<int> tilesize;
+    int tile_autobench = 0;
+    int tile_share = 0;
+    int stream_output = 0;
     path_t model = PATHSTR("models-cunet");
     std::vector<int> gpuid;
     int jobs_load = 1;
@@ -475,15 +526,21 @@ int main(int argc, char** argv)
     int jobs_save = 2;
     int verbose = 0;
     int tta_mode = 0;
+    int flat_tile_range = -1;
+    long long tile_cache_size = 0;
+    int temporal_tolerance = -1;
+    path_t result_cache_dir;
     path_t output_format;
     path_t suggested_format;
     long long skip_size = 0;
     path_t name_pattern = PATHSTR("{name}");
+    BenchOptions bench;
+    bool benchmark = false;
 
 #if _WIN32
     setlocale(LC_ALL, "");
     wchar_t opt;
-    while ((opt = getopt(argc, argv, L"i:o:n:s:t:m:g:j:f:vxhk:e:p:")) != (wchar_t)-1)
+    while ((opt = getopt(argc, argv, L"i:o:n:s:t:m:g:j:f:vxhk:e:p:SGF:D:T:R:B:")) != (wchar_t)-1)
     {
         switch (opt)
         {
@@ -500,7 +557,15 @@ int main(int argc, char** argv)
             scale = _wtoi(optarg);
             break;
         case L't':
-            tilesize = parse_optarg_int_array(optarg);
+            if (is_auto_bench_option(optarg))
+            {
+                tile_autobench = 1;
+                tilesize.clear();
+            }
+            else
+            {
+                tilesize = parse_optarg_int_array(optarg);
+            }
             break;
         case L'm':
             model = optarg;
@@ -524,12 +589,38 @@ int main(int argc, char** argv)
         case L'x':
             tta_mode = 1;
             break;
+        case L'F':
+            flat_tile_range = _wtoi(optarg);
+            break;
+        case L'D':
+            tile_cache_size = parse_size_string(optarg);
+            break;
+        case L'T':
+            temporal_tolerance = _wtoi(optarg);
+            break;
+        case L'R':
+            result_cache_dir = optarg;
+            break;
+        case L'S':
+            stream_output = 1;
+            break;
+        case L'G':
+            tile_share = 1;
+            break;
         case L'k':
             skip_size = _wtoi64(optarg);
             break;
         case L'p':
             name_pattern = optarg;
             break;
+        case L'B':
+            if (parse_bench_option(optarg, bench) != 0)
+            {
+                fprintf(stderr, "invalid benchmark argument\n");
+                return -1;
+            }
+            benchmark = true;
+            break;
         case L'h':
         default:
             print_usage();
@@ -538,7 +629,7 @@ int main(int argc, char** argv)
     }
 #else // _WIN32
     int opt;
-    while ((opt = getopt(argc, argv, "i:o:n:s:t:m:g:j:f:vxhk:e:p:")) != -1)
+    while ((opt = getopt(argc, argv, "i:o:n:s:t:m:g:j:f:vxhk:e:p:SGF:D:T:R:B:")) != -1)
     {
         switch (opt)
         {
@@ -555,7 +646,15 @@ int main(int argc, char** argv)
                 scale = atoi(optarg);
                 break;
             case 't':
-                tilesize = parse_optarg_int_array(optarg);
+                if (is_auto_bench_option(optarg))
+                {
+                    tile_autobench = 1;
+                    tilesize.clear();
+                }
+                else
+                {
+                    tilesize = parse_optarg_int_array(optarg);
+                }
                 break;
             case 'm':
                 model = optarg;
@@ -579,12 +678,38 @@ int main(int argc, char** argv)
             case 'x':
                 tta_mode = 1;
                 break;
+            case 'F':
+                flat_tile_range = atoi(optarg);
+                break;
+            case 'D':
+                tile_cache_size = parse_size_string(optarg);
+                break;
+            case 'T':
+                temporal_tolerance = atoi(optarg);
+                break;
+            case 'R':
+                result_cache_dir = optarg;
+                break;
+            case 'S':
+                stream_output = 1;
+                break;
+            case 'G':
+                tile_share = 1;
+                break;
             case 'k':
                 skip_size = atoll(optarg);
                 break;
             case 'p':
                 name_pattern = optarg;
                 break;
+            case 'B':
+                if (parse_bench_option(optarg, bench) != 0)
+                {
+                    fprintf(stderr, "invalid benchmark argument\n");
+                    return -1;
+                }
+                benchmark = true;
+                break;
         case 'h':
         default:
             print_usage();
@@ -593,7 +718,7 @@ int main(int argc, char** argv)
     }
 #endif // _WIN32
 
-    if (inputpath.empty() || outputpath.empty())
+    if ((inputpath.empty() || outputpath.empty()) && !benchmark)
     {
         print_usage();
         return -1;
@@ -626,6 +751,12 @@ int main(int argc, char** argv)
         }
     }
 
+    if (tile_cache_size < 0)
+    {
+        fprintf(stderr, "invalid tile cache size argument\n");
+        return -1;
+    }
+
     if (jobs_load < 1 || jobs_save < 1)
     {
         fprintf(stderr, "invalid thread count argument\n");
@@ -662,6 +793,8 @@ int main(int argc, char** argv)
                 output_format = PATHSTR("bmp");
             else if (ext == PATHSTR("tif") || ext == PATHSTR("TIF") || ext == PATHSTR("tiff") || ext == PATHSTR("TIFF"))
                 output_format = PATHSTR("tiff");
+            else if (ext == PATHSTR("gif") || ext == PATHSTR("GIF"))
+                output_format = PATHSTR("gif");
         }
         if (!output_format.empty() && !is_supported_encode_format(output_format))
         {
@@ -680,6 +813,7 @@ int main(int argc, char** argv)
 
     std::vector<path_t> input_files;
     std::vector<path_t> output_files;
+    if (!benchmark)
     {
         path_t effective_format = output_format.empty() ? suggested_format : output_format;
 
@@ -879,21 +1013,151 @@ int main(int argc, char** argv)
         }
     }
 
+    if (benchmark)
     {
+        // one engine on the first device, images go straight through process() without the pipeline threads
+        int ret;
+        {
+            Waifu2x waifu2x(gpuid[0], tta_mode, gpuid[0] == -1 ? jobs_proc[0] : 1);
+            waifu2x.load(paramfullpath, modelfullpath);
+            waifu2x.noise = noise;
+            waifu2x.scale = (scale >= 2) ? 2 : scale;
+            waifu2x.tilesize = tilesize[0];
+            waifu2x.prepadding = prepadding;
+            waifu2x.flat_tile_range = flat_tile_range;
+            if (tile_autobench)
+                tilesize[0] = autotune_tilesize(&waifu2x, gpuid[0], gpuid[0] == -1 ? jobs_proc[0] : 1, paramfullpath, modelfullpath, waifu2x.scale, tilesize[0], verbose);
+
+            auto upscale = [&](const cv::Mat& in, cv::Mat& out) -> int {
+                cv::Mat rgb;
+                ncnn::Mat inimage;
+                {
+                    BenchScope bench_preproc(BENCH_PREPROC);
+#if _WIN32
+                    rgb = in;
+#else
+                    cv::cvtColor(in, rgb, cv::COLOR_BGR2RGB);
+#endif
+                    inimage = ncnn::Mat(rgb.cols, rgb.rows, (void*)rgb.data, (size_t)3, 3);
+                }
+
+                // scales above 2 run the 2x model repeatedly, same as proc()
+                int scale_run_count = 1;
+                for (int s = 4; s <= scale; s *= 2)
+                    scale_run_count++;
+
+                ncnn::Mat outimage = inimage;
+                int r = 0;
+                for (int i = 0; i < scale_run_count && r == 0; i++)
+                {
+                    ncnn::Mat tmp = outimage;
+                    outimage = ncnn::Mat(tmp.w * waifu2x.scale, tmp.h * waifu2x.scale, (size_t)3, 3);
+                    r = waifu2x.process(tmp, outimage);
+                }
+
+                BenchScope bench_postproc(BENCH_POSTPROC);
+                cv::Mat result(outimage.h, outimage.w, CV_8UC3, outimage.data);
+#if _WIN32
+                out = result.clone();
+#else
+                cv::cvtColor(result, out, cv::COLOR_RGB2BGR);
+#endif
+                return r;
+            };
+
+            bench.format = bench_path_string(output_format);
+
+            BenchJson info;
+            info.add("engine", std::string("waifu2x")).add("model", bench_path_string(modelfullpath));
+            info.add("gpu", gpuid[0]).add("tilesize", tilesize[0]).add("tta", tta_mode);
+            info.add("noise", noise);
+            if (gpuid[0] != -1)
+                info.add("device", std::string(ncnn::get_gpu_info(gpuid[0]).device_name()));
+            else
+                info.add("threads", jobs_proc[0]);
+
+            ret = run_benchmark(bench, scale, info, outputpath, upscale);
+        }
+
+        ncnn::destroy_gpu_instance();
+
+        return ret;
+    }
+
+    {
+        ResultCache* result_cache = 0;
+        if (!result_cache_dir.empty())
+        {
+            char settings[128];
+            sprintf(settings, "waifu2x noise=%d scale=%d tta=%d flat=%d temporal=%d", noise, scale, tta_mode, flat_tile_range, temporal_tolerance);
+            result_cache = new ResultCache(result_cache_dir, paramfullpath, modelfullpath, settings);
+            result_cache->take_hits(input_files, output_files, verbose);
+        }
+
+        // one cache for the whole run, tiles repeat across the images of a batch
+        TileDedupCache* tile_cache = tile_cache_size > 0 ? new TileDedupCache((size_t)tile_cache_size) : 0;
+
+        // frames of all animations and the images of the batch run through one temporal cache
+        TemporalTileCache* temporal_cache = temporal_tolerance >= 0 ? new TemporalTileCache(temporal_tolerance) : 0;
+
         std::vector<Waifu2x*> waifu2x(use_gpu_count);
 
+        // the first run of a model on a device compiles the shaders, later runs load them from the shader cache
+        double load_seconds = 0;
+
         for (int i=0; i<use_gpu_count; i++)
         {
             int num_threads = gpuid[i] == -1 ? jobs_proc[i] : 1;
 
             waifu2x[i] = new Waifu2x(gpuid[i], tta_mode, num_threads);
 
-            waifu2x[i]->load(paramfullpath, modelfullpath);
+            const double load_begin = bench_now();
+            const int load_ret = waifu2x[i]->load(paramfullpath, modelfullpath);
+            load_seconds += bench_now() - load_begin;
+
+            if (load_ret != 0)
+            {
+                fprintf(stderr, "load model failed\n");
+
+                for (int j=0; j<=i; j++)
+                    delete waifu2x[j];
+                delete tile_cache;
+                delete temporal_cache;
+                delete result_cache;
+
+                ncnn::destroy_gpu_instance();
+                return -1;
+            }
 
             waifu2x[i]->noise = noise;
             waifu2x[i]->scale = (scale >= 2) ? 2 : scale;
             waifu2x[i]->tilesize = tilesize[i];
             waifu2x[i]->prepadding = prepadding;
+            waifu2x[i]->flat_tile_range = flat_tile_range;
+
+            // scales above 2 repeat the 2x model, so the model scale keys the cache
+            if (tile_autobench)
+                tilesize[i] = autotune_tilesize(waifu2x[i], gpuid[i], num_threads, paramfullpath, modelfullpath, waifu2x[i]->scale, tilesize[i], verbose);
+
+            // after autotuning, so the timed runs do not hit the cache
+            waifu2x[i]->tile_cache = tile_cache;
+            waifu2x[i]->temporal_cache = temporal_cache;
+        }
+
+        fprintf(stderr, "load model use time: %.3lf, %s\n", load_seconds, spirv_cache_summary().c_str());
+
+        // the devices walk one tile grid, so they all take the smallest tilesize
+        const bool share_tiles = tile_share && use_gpu_count > 1;
+        if (share_tiles)
+        {
+            const int shared_tilesize = *std::min_element(tilesize.begin(), tilesize.end());
+            for (int i=0; i<use_gpu_count; i++)
+            {
+                tilesize[i] = shared_tilesize;
+                waifu2x[i]->tilesize = shared_tilesize;
+            }
+            if (stream_output)
+                fprintf(stderr, "-S is ignored with -G, the devices write bands out of order\n");
         }
 
         // main routine
@@ -903,6 +1167,7 @@ int main(int argc, char** argv)
             ltp.scale = scale;
             ltp.output_format = output_format;
             ltp.jobs_load = jobs_load;
+            ltp.stream_output = share_tiles ? 0 : stream_output;
             ltp.input_files = input_files;
             ltp.output_files = output_files;
 
@@ -915,21 +1180,24 @@ int main(int argc, char** argv)
                 ptp[i].waifu2x = waifu2x[i];
             }
 
-            std::vector<ncnn::Thread*> proc_threads(total_jobs_proc);
+            // with -G one proc thread hands every image to all engines at once
+            std::vector<ncnn::Thread*> proc_threads;
+            if (share_tiles)
             {
-                int total_jobs_proc_id = 0;
-                for (int i=0; i<use_gpu_count; i++)
+                ptp[0].shared.assign(waifu2x.begin(), waifu2x.end());
+                proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[0]));
+            }
+            for (int i=0; i<use_gpu_count && !share_tiles; i++)
+            {
+                if (gpuid[i] == -1)
                 {
-                    if (gpuid[i] == -1)
-                    {
-                        proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                    }
-                    else
+                    proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[i]));
+                }
+                else
+                {
+                    for (int j=0; j<jobs_proc[i]; j++)
                     {
-                        for (int j=0; j<jobs_proc[i]; j++)
-                        {
-                            proc_threads[total_jobs_proc_id++] = new ncnn::Thread(proc, (void*)&ptp[i]);
-                        }
+                        proc_threads.push_back(new ncnn::Thread(proc, (void*)&ptp[i]));
                     }
                 }
             }
@@ -947,24 +1215,15 @@ int main(int argc, char** argv)
             // end
             load_thread.join();
 
-            Task end;
-            end.id = -233;
+            toproc.close();
 
-            for (int i=0; i<total_jobs_proc; i++)
-            {
-                toproc.put(end);
-            }
-
-            for (int i=0; i<total_jobs_proc; i++)
+            for (size_t i=0; i<proc_threads.size(); i++)
             {
                 proc_threads[i]->join();
                 delete proc_threads[i];
             }
 
-            for (int i=0; i<jobs_save; i++)
-            {
-                tosave.put(end);
-            }
+            tosave.close();
 
             for (int i=0; i<jobs_save; i++)
             {
@@ -978,6 +1237,25 @@ int main(int argc, char** argv)
             delete waifu2x[i];
         }
         waifu2x.clear();
+
+        if (tile_cache)
+        {
+            tile_cache->print_stats();
+            delete tile_cache;
+        }
+
+        if (temporal_cache)
+        {
+            temporal_cache->print_stats();
+            delete temporal_cache;
+        }
+
+        if (result_cache)
+        {
+            result_cache->store_results(verbose);
+            result_cache->print_stats();
+            delete result_cache;
+        }
     }
 
     ncnn::destroy_gpu_instance();
@@ -13,8 +13,12 @@ using namespace std::chrono;
 #include "gpu.h"
 #include "layer.h"
 
-class Waifu2x
+#include "tiled_upscaler.h"
+
+class Waifu2x : public TiledUpscaler<Waifu2x>
 {
+    friend class TiledUpscaler<Waifu2x>;
+
 public:
     Waifu2x(int gpuid, bool tta_mode = false, int num_threads = 1);
     ~Waifu2x();
@@ -25,9 +29,25 @@ public:
     int load(const std::string& parampath, const std::string& modelpath);
 #endif
 
-    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    // with a writer the output rows are encoded as they finish and outimage stays empty
+    int process(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0) const;
+
+    // -G, the tile rows of one image split across the engines of several devices
+    static int process_shared(const std::vector<const Waifu2x*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage);
+
+private:
+    // TiledUpscaler hooks
+    void tile_grid(TileGrid& grid) const;
+
+    void band_output_rows(const TileGrid& grid, int yi, int& y0, int& y1) const;
+
+    void tile_output_columns(const TileGrid& grid, int xi, int& x0, int& x1) const;
+
+    void process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
-    int process_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage) const;
+    int process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows, const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
 
 public:
     // waifu2x parameters
@@ -0,0 +1,1082 @@
+#ifndef ANIM_IMAGE_H
+#define ANIM_IMAGE_H
+
+// animated gif and webp through the load -> proc -> save pipeline.
+//
+// FrameSource hands the loader one frame after another, every frame becomes its own task and goes
+// through the same loaded model as a still image. The save threads pass their results to the shared
+// AnimWriter of the file, which keeps frames that arrive early in a reorder buffer and encodes them
+// in order with the original frame delays and loop count as soon as the gap before them closes.
+//
+// Frames are full canvas BGR(A) images, the gif decoder applies the disposal methods itself and
+// WebPAnimDecoder does the same for webp. Gif output is quantised per frame with median cut into a
+// local palette, webp output is lossless like webp_save(). A gif input saved as another format and
+// a still image saved as gif take the first frame or a single frame. A frame that is lost on the way
+// or fails to encode gives up the whole animation and removes what was written of it.
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+#include <opencv2/opencv.hpp>
+
+#include "webp/decode.h"
+#include "webp/demux.h"
+#include "webp/encode.h"
+#include "webp/mux.h"
+
+#include "filesystem_utils.h"
+#include "memory_budget.h"
+#include "utils.hpp"
+
+static FILE* anim_fopen(const path_t& path, const char* mode)
+{
+#if _WIN32
+    std::wstring wmode(mode, mode + strlen(mode));
+    return _wfopen(path.c_str(), wmode.c_str());
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+// bgra frame to the bgr + alpha pair imread() returns, alpha only when some pixel is not opaque
+static void anim_split_alpha(const cv::Mat& bgra, cv::Mat& inBGR, cv::Mat& inAlpha)
+{
+    std::vector<cv::Mat> channels;
+    cv::split(bgra, channels);
+    cv::merge(channels.data(), 3, inBGR);
+
+    inAlpha = cv::Mat();
+    if (cv::countNonZero(channels[3] == 255) != (int)channels[3].total())
+        inAlpha = channels[3];
+}
+
+class AnimReader
+{
+public:
+    AnimReader() : is_gif(false), webp_decoder(0), loop(1), prev_timestamp(0), broken(false)
+    {
+    }
+
+    ~AnimReader()
+    {
+        if (webp_decoder)
+            WebPAnimDecoderDelete(webp_decoder);
+    }
+
+    // true for gif and animated webp files
+    bool open(const path_t& path)
+    {
+        unsigned char magic[32];
+        FILE* fp = anim_fopen(path, "rb");
+        if (!fp)
+            return false;
+
+        const size_t n = fread(magic, 1, sizeof(magic), fp);
+        is_gif = n >= 6 && (memcmp(magic, "GIF87a", 6) == 0 || memcmp(magic, "GIF89a", 6) == 0);
+
+        WebPBitstreamFeatures features;
+        const bool is_webp = n >= 12 && memcmp(magic, "RIFF", 4) == 0 && memcmp(magic + 8, "WEBP", 4) == 0;
+        if (!is_gif && !(is_webp && WebPGetFeatures(magic, n, &features) == VP8_STATUS_OK && features.has_animation))
+        {
+            fclose(fp);
+            return false;
+        }
+
+        fseek(fp, 0, SEEK_END);
+        data.resize(ftell(fp));
+        rewind(fp);
+        const bool ok = fread(data.data(), 1, data.size(), fp) == data.size();
+        fclose(fp);
+        if (!ok)
+            return false;
+
+        return is_gif ? gif_open() : webp_open();
+    }
+
+    // number of times the animation plays, 0 = forever. gif inputs know it after the first frame
+    int loop_count() const
+    {
+        return loop;
+    }
+
+    bool next(cv::Mat& bgra, int& delay_ms)
+    {
+        return is_gif ? gif_next(bgra, delay_ms) : webp_next(bgra, delay_ms);
+    }
+
+    // next() stopped at broken data instead of the end of the animation
+    bool error() const
+    {
+        return broken;
+    }
+
+private:
+    bool webp_open()
+    {
+        WebPAnimDecoderOptions options;
+        if (!WebPAnimDecoderOptionsInit(&options))
+            return false;
+        options.color_mode = MODE_BGRA;
+        options.use_threads = 0;
+
+        WebPData webp_data;
+        webp_data.bytes = data.data();
+        webp_data.size = data.size();
+        webp_decoder = WebPAnimDecoderNew(&webp_data, &options);
+        if (!webp_decoder)
+            return false;
+
+        WebPAnimInfo info;
+        if (!WebPAnimDecoderGetInfo(webp_decoder, &info))
+            return false;
+
+        canvas_w = info.canvas_width;
+        canvas_h = info.canvas_height;
+        loop = info.loop_count;
+        return true;
+    }
+
+    bool webp_next(cv::Mat& bgra, int& delay_ms)
+    {
+        uint8_t* buf = 0;
+        int timestamp = 0;
+        if (!WebPAnimDecoderHasMoreFrames(webp_decoder))
+            return false;
+        if (!WebPAnimDecoderGetNext(webp_decoder, &buf, &timestamp))
+        {
+            broken = true;
+            return false;
+        }
+
+        bgra = cv::Mat(canvas_h, canvas_w, CV_8UC4, buf).clone();
+        delay_ms = timestamp - prev_timestamp;
+        prev_timestamp = timestamp;
+        return true;
+    }
+
+    bool gif_open()
+    {
+        if (data.size() < 13)
+            return false;
+
+        canvas_w = data[6] | (data[7] << 8);
+        canvas_h = data[8] | (data[9] << 8);
+        pos = 13;
+
+        const int flags = data[10];
+        if (flags & 0x80)
+        {
+            const int size = 3 << ((flags & 7) + 1);
+            if (pos + size > data.size())
+                return false;
+            global_palette.assign(data.begin() + pos, data.begin() + pos + size);
+            pos += size;
+        }
+
+        if (canvas_w <= 0 || canvas_h <= 0)
+            return false;
+
+        canvas = cv::Mat(canvas_h, canvas_w, CV_8UC4, cv::Scalar(0, 0, 0, 0));
+        dispose = 0;
+        return true;
+    }
+
+    // sub blocks from pos, appended to out unless out is null
+    bool gif_sub_blocks(std::vector<unsigned char>* out)
+    {
+        while (pos < data.size())
+        {
+            const size_t size = data[pos++];
+            if (size == 0)
+                return true;
+            if (pos + size > data.size())
+                return false;
+            if (out)
+                out->insert(out->end(), data.begin() + pos, data.begin() + pos + size);
+            pos += size;
+        }
+        return false;
+    }
+
+    bool gif_next(cv::Mat& bgra, int& delay_ms)
+    {
+        int delay_cs = 0;
+        int transparent = -1;
+        int frame_dispose = 0;
+
+        // every early return below is broken data, the trailer and the end of the file are not
+        broken = true;
+
+        while (pos < data.size())
+        {
+            const int block = data[pos++];
+
+            if (block == 0x3b)
+            {
+                broken = false;
+                return false;
+            }
+
+            if (block == 0x21)
+            {
+                if (pos >= data.size())
+                    return false;
+                const int label = data[pos++];
+
+                std::vector<unsigned char> ext;
+                if (!gif_sub_blocks(&ext))
+                    return false;
+
+                if (label == 0xf9 && ext.size() >= 4)
+                {
+                    frame_dispose = (ext[0] >> 2) & 7;
+                    delay_cs = ext[1] | (ext[2] << 8);
+                    transparent = (ext[0] & 1) ? ext[3] : -1;
+                }
+                if (label == 0xff && ext.size() >= 14 && memcmp(ext.data(), "NETSCAPE2.0", 11) == 0 && ext[11] == 1)
+                {
+                    // repeat count, the first play comes on top
+                    const int repeat = ext[12] | (ext[13] << 8);
+                    loop = repeat == 0 ? 0 : repeat + 1;
+                }
+                continue;
+            }
+
+            if (block != 0x2c || pos + 9 > data.size())
+                return false;
+
+            const int fx = data[pos] | (data[pos + 1] << 8);
+            const int fy = data[pos + 2] | (data[pos + 3] << 8);
+            const int fw = data[pos + 4] | (data[pos + 5] << 8);
+            const int fh = data[pos + 6] | (data[pos + 7] << 8);
+            const int flags = data[pos + 8];
+            pos += 9;
+
+            std::vector<unsigned char> palette = global_palette;
+            if (flags & 0x80)
+            {
+                const int size = 3 << ((flags & 7) + 1);
+                if (pos + size > data.size())
+                    return false;
+                palette.assign(data.begin() + pos, data.begin() + pos + size);
+                pos += size;
+            }
+
+            if (pos >= data.size())
+                return false;
+            const int min_code_size = data[pos++];
+
+            std::vector<unsigned char> lzw;
+            if (!gif_sub_blocks(&lzw))
+                return false;
+
+            std::vector<unsigned char> indices;
+            if (!gif_lzw_decode(lzw, min_code_size, (size_t)fw * fh, indices))
+                return false;
+
+            // the previous frame leaves its area as it asked for
+            if (dispose == 2)
+                canvas(prev_rect).setTo(cv::Scalar(0, 0, 0, 0));
+            if (dispose == 3 && !restore.empty())
+                restore.copyTo(canvas);
+
+            if (frame_dispose == 3)
+                restore = canvas.clone();
+
+            const bool interlaced = (flags & 0x40) != 0;
+            for (int row = 0; row < fh; row++)
+            {
+                const int y = fy + (interlaced ? gif_interlaced_row(row, fh) : row);
+                if (y >= canvas_h)
+                    continue;
+
+                const unsigned char* src = indices.data() + (size_t)row * fw;
+                unsigned char* dst = canvas.ptr<unsigned char>(y);
+                for (int x = 0; x < fw && fx + x < canvas_w; x++)
+                {
+                    const int index = src[x];
+                    if (index == transparent || index * 3 + 2 >= (int)palette.size())
+                        continue;
+
+                    unsigned char* p = dst + (fx + x) * 4;
+                    p[0] = palette[index * 3 + 2];
+                    p[1] = palette[index * 3 + 1];
+                    p[2] = palette[index * 3];
+                    p[3] = 255;
+                }
+            }
+
+            dispose = frame_dispose;
+            prev_rect = cv::Rect(fx, fy, fw, fh) & cv::Rect(0, 0, canvas_w, canvas_h);
+
+            bgra = canvas.clone();
+
+            // browsers play delays below 20ms as 100ms
+            delay_ms = delay_cs <= 1 ? 100 : delay_cs * 10;
+            broken = false;
+            return true;
+        }
+
+        // a missing trailer is common and taken as the end
+        broken = false;
+        return false;
+    }
+
+    static int gif_interlaced_row(int row, int h)
+    {
+        const int pass1 = (h + 7) / 8;
+        const int pass2 = (h + 3) / 8;
+        const int pass3 = (h + 1) / 4;
+        if (row < pass1)
+            return row * 8;
+        row -= pass1;
+        if (row < pass2)
+            return row * 8 + 4;
+        row -= pass2;
+        if (row < pass3)
+            return row * 4 + 2;
+        row -= pass3;
+        return row * 2 + 1;
+    }
+
+    // short streams are padded with index 0, as most decoders do
+    static bool gif_lzw_decode(const std::vector<unsigned char>& lzw, int min_code_size, size_t count, std::vector<unsigned char>& out)
+    {
+        if (min_code_size < 2 || min_code_size > 8)
+            return false;
+
+        const int clear = 1 << min_code_size;
+        const int eoi = clear + 1;
+
+        unsigned short prefix[4096];
+        unsigned char suffix[4096];
+        unsigned char first[4096];
+        unsigned char stack[4097];
+
+        for (int i = 0; i < clear; i++)
+        {
+            prefix[i] = 0xffff;
+            suffix[i] = (unsigned char)i;
+            first[i] = (unsigned char)i;
+        }
+
+        out.clear();
+        out.reserve(count);
+
+        int code_size = min_code_size + 1;
+        int next = eoi + 1;
+        int prev = -1;
+
+        size_t bitpos = 0;
+        const size_t bits = lzw.size() * 8;
+
+        while (out.size() < count && bitpos + code_size <= bits)
+        {
+            int code = 0;
+            for (int i = 0; i < code_size; i++, bitpos++)
+                code |= ((lzw[bitpos >> 3] >> (bitpos & 7)) & 1) << i;
+
+            if (code == clear)
+            {
+                code_size = min_code_size + 1;
+                next = eoi + 1;
+                prev = -1;
+                continue;
+            }
+            if (code == eoi)
+                break;
+
+            if (prev == -1)
+            {
+                if (code >= clear)
+                    return false;
+                out.push_back((unsigned char)code);
+                prev = code;
+                continue;
+            }
+
+            int emit = code;
+            if (code > next || (code == next && next >= 4096))
+                return false;
+
+            if (next < 4096)
+            {
+                prefix[next] = (unsigned short)prev;
+                suffix[next] = code == next ? first[prev] : first[code];
+                first[next] = first[prev];
+                next++;
+                if (next == (1 << code_size) && code_size < 12)
+                    code_size++;
+            }
+
+            int sp = 0;
+            while (emit != 0xffff && sp < 4097)
+            {
+                stack[sp++] = suffix[emit];
+                emit = prefix[emit];
+            }
+            while (sp > 0 && out.size() < count)
+                out.push_back(stack[--sp]);
+
+            prev = code;
+        }
+
+        out.resize(count, 0);
+        return true;
+    }
+
+    std::vector<unsigned char> data;
+    bool is_gif;
+    WebPAnimDecoder* webp_decoder;
+    int canvas_w;
+    int canvas_h;
+    int loop;
+    int prev_timestamp;
+    bool broken;
+
+    // gif state between frames
+    size_t pos;
+    std::vector<unsigned char> global_palette;
+    cv::Mat canvas;
+    cv::Mat restore;
+    cv::Rect prev_rect;
+    int dispose;
+};
+
+// median cut over a 6 bit per channel histogram of the opaque pixels, palette is rgb
+static void gif_quantize(const cv::Mat& bgra, int max_colors, std::vector<unsigned char>& palette, std::vector<int>& bin_index)
+{
+    struct Bin
+    {
+        int key;
+        long long count;
+        long long sum[3];
+    };
+
+    std::vector<Bin> hist(1 << 18);
+    for (int i = 0; i < (int)hist.size(); i++)
+    {
+        hist[i].key = i;
+        hist[i].count = 0;
+        hist[i].sum[0] = hist[i].sum[1] = hist[i].sum[2] = 0;
+    }
+
+    for (int y = 0; y < bgra.rows; y++)
+    {
+        const unsigned char* p = bgra.ptr<unsigned char>(y);
+        for (int x = 0; x < bgra.cols; x++, p += 4)
+        {
+            if (p[3] < 128)
+                continue;
+            Bin& b = hist[((p[2] >> 2) << 12) | ((p[1] >> 2) << 6) | (p[0] >> 2)];
+            b.count++;
+            b.sum[0] += p[2];
+            b.sum[1] += p[1];
+            b.sum[2] += p[0];
+        }
+    }
+
+    std::vector<Bin> bins;
+    for (int i = 0; i < (int)hist.size(); i++)
+    {
+        if (hist[i].count)
+            bins.push_back(hist[i]);
+    }
+
+    // boxes are ranges of bins, the most populated splittable box is cut at its median
+    std::vector<std::pair<int, int> > boxes;
+    if (!bins.empty())
+        boxes.push_back(std::make_pair(0, (int)bins.size()));
+
+    while ((int)boxes.size() < max_colors)
+    {
+        int best = -1;
+        long long best_count = 0;
+        for (int i = 0; i < (int)boxes.size(); i++)
+        {
+            if (boxes[i].second - boxes[i].first < 2)
+                continue;
+            long long count = 0;
+            for (int j = boxes[i].first; j < boxes[i].second; j++)
+                count += bins[j].count;
+            if (count > best_count)
+            {
+                best = i;
+                best_count = count;
+            }
+        }
+        if (best == -1)
+            break;
+
+        const int begin = boxes[best].first;
+        const int end = boxes[best].second;
+
+        int lo[3] = {63, 63, 63};
+        int hi[3] = {0, 0, 0};
+        for (int j = begin; j < end; j++)
+        {
+            for (int c = 0; c < 3; c++)
+            {
+                const int v = (bins[j].key >> (12 - c * 6)) & 63;
+                lo[c] = std::min(lo[c], v);
+                hi[c] = std::max(hi[c], v);
+            }
+        }
+        int axis = 0;
+        for (int c = 1; c < 3; c++)
+        {
+            if (hi[c] - lo[c] > hi[axis] - lo[axis])
+                axis = c;
+        }
+
+        const int shift = 12 - axis * 6;
+        std::sort(bins.begin() + begin, bins.begin() + end, [shift](const Bin& a, const Bin& b) {
+            return ((a.key >> shift) & 63) < ((b.key >> shift) & 63);
+        });
+
+        long long half = 0;
+        int cut = begin + 1;
+        for (int j = begin; j < end - 1; j++)
+        {
+            half += bins[j].count;
+            cut = j + 1;
+            if (half * 2 >= best_count)
+                break;
+        }
+
+        boxes[best].second = cut;
+        boxes.push_back(std::make_pair(cut, end));
+    }
+
+    palette.assign(3 * std::max((int)boxes.size(), 1), 0);
+    bin_index.assign(hist.size(), 0);
+    for (int i = 0; i < (int)boxes.size(); i++)
+    {
+        long long count = 0;
+        long long sum[3] = {0, 0, 0};
+        for (int j = boxes[i].first; j < boxes[i].second; j++)
+        {
+            count += bins[j].count;
+            for (int c = 0; c < 3; c++)
+                sum[c] += bins[j].sum[c];
+            bin_index[bins[j].key] = i;
+        }
+        for (int c = 0; c < 3; c++)
+            palette[i * 3 + c] = (unsigned char)((sum[c] + count / 2) / count);
+    }
+}
+
+class GifLzwWriter
+{
+public:
+    explicit GifLzwWriter(std::vector<unsigned char>& _out) : out(_out), bitbuf(0), bitcount(0)
+    {
+    }
+
+    // 8 bit indices, the clear and end codes follow the 256 literals
+    void encode(const unsigned char* indices, size_t count)
+    {
+        const int clear = 256;
+        const int eoi = 257;
+
+        std::vector<int> keys(table_size);
+        std::vector<short> codes(table_size);
+
+        int code_size = 9;
+        int next = eoi + 1;
+        std::fill(keys.begin(), keys.end(), -1);
+
+        put(clear, code_size);
+
+        int prefix = indices[0];
+        for (size_t i = 1; i < count; i++)
+        {
+            const int c = indices[i];
+            const int key = (prefix << 8) | c;
+
+            size_t slot = ((size_t)c << 4 ^ prefix) % table_size;
+            while (keys[slot] != -1 && keys[slot] != key)
+                slot = (slot + 1) % table_size;
+
+            if (keys[slot] == key)
+            {
+                prefix = codes[slot];
+                continue;
+            }
+
+            put(prefix, code_size);
+
+            keys[slot] = key;
+            codes[slot] = (short)next++;
+            if (next - 1 >= (1 << code_size))
+                code_size++;
+
+            if (next == 4096)
+            {
+                put(clear, code_size);
+                std::fill(keys.begin(), keys.end(), -1);
+                code_size = 9;
+                next = eoi + 1;
+            }
+
+            prefix = c;
+        }
+
+        put(prefix, code_size);
+        put(eoi, code_size);
+        if (bitcount > 0)
+            out.push_back((unsigned char)bitbuf);
+    }
+
+private:
+    void put(int code, int size)
+    {
+        bitbuf |= (unsigned int)code << bitcount;
+        bitcount += size;
+        while (bitcount >= 8)
+        {
+            out.push_back((unsigned char)bitbuf);
+            bitbuf >>= 8;
+            bitcount -= 8;
+        }
+    }
+
+    static const size_t table_size = 5003;
+
+    std::vector<unsigned char>& out;
+    unsigned int bitbuf;
+    int bitcount;
+};
+
+class AnimWriter
+{
+public:
+    // loop is the number of plays, 0 = forever. Frames held in the reorder buffer are booked on budget
+    AnimWriter(const path_t& _outpath, int _loop, MemoryBudget* _budget = 0) : outpath(_outpath), loop(_loop), budget(_budget),
+        frame_count(0), input_closed(false), next(0), failed(false), finished(false), written(false), gif_fp(0), webp_encoder(0), timestamp(0)
+    {
+        gif = get_lowcase_extension(outpath) == PATHSTR("gif");
+    }
+
+    ~AnimWriter()
+    {
+        // the last task is gone, a frame that never came leaves the file unfinished
+        if (!finished)
+        {
+#if _WIN32
+            fwprintf(stderr, L"encode animation %ls failed, frame %d missing\n", outpath.c_str(), next);
+#else
+            fprintf(stderr, "encode animation %s failed, frame %d missing\n", outpath.c_str(), next);
+#endif
+            discard();
+        }
+        if (webp_encoder)
+            WebPAnimEncoderDelete(webp_encoder);
+    }
+
+    // loader, the upscaled frame size before the first frame is queued. The gif screen and frame
+    // sizes are 16 bit and webp stops at WEBP_MAX_DIMENSION, a larger animation is given up at once
+    bool check_size(int w, int h)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        const int max_size = gif ? 65535 : WEBP_MAX_DIMENSION;
+        if (!failed && (w > max_size || h > max_size))
+        {
+#if _WIN32
+            fwprintf(stderr, L"animation %ls can not be %dx%d, the format allows %d\n", outpath.c_str(), w, h, max_size);
+#else
+            fprintf(stderr, "animation %s can not be %dx%d, the format allows %d\n", outpath.c_str(), w, h, max_size);
+#endif
+            failed = true;
+        }
+        return flush();
+    }
+
+    // loader, once per frame in order
+    void push_frame(int delay_ms)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        delays.push_back(delay_ms);
+        frame_count++;
+    }
+
+    // loader, after the last frame. Writes the file when every frame is already in
+    bool close_input()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        input_closed = true;
+        return flush();
+    }
+
+    // save threads, any order. false once the animation can not be written
+    bool add(int frame, const cv::Mat& image)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (failed)
+            return false;
+
+        // the frame in turn is encoded before this returns, the others may point into task buffers.
+        // A copy outlives its task, it is booked before the task hands its own share back and
+        // without waiting, the frames that would free the budget may queue behind this save thread
+        HeldFrame& held = reorder[frame];
+        if (frame == next)
+        {
+            held.image = image;
+            held.bytes = 0;
+        }
+        else
+        {
+            held.image = image.clone();
+            held.bytes = held.image.total() * held.image.elemSize();
+            if (budget)
+                budget->reserve(held.bytes);
+        }
+        return flush();
+    }
+
+    // save threads and the loader, a frame without a result. The file can not be written without it
+    bool fail_frame(int frame)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        if (!failed)
+        {
+#if _WIN32
+            fwprintf(stderr, L"animation %ls lost frame %d\n", outpath.c_str(), frame);
+#else
+            fprintf(stderr, "animation %s lost frame %d\n", outpath.c_str(), frame);
+#endif
+            failed = true;
+        }
+        return flush();
+    }
+
+private:
+    struct HeldFrame
+    {
+        cv::Mat image;
+        size_t bytes;
+    };
+
+    void drop_first()
+    {
+        if (budget)
+            budget->release(reorder.begin()->second.bytes);
+        reorder.erase(reorder.begin());
+    }
+
+    // hands the held frames back and removes what was written of the file
+    void discard()
+    {
+        while (!reorder.empty())
+            drop_first();
+
+        if (gif_fp)
+        {
+            fclose(gif_fp);
+            gif_fp = 0;
+        }
+
+        if (written)
+        {
+#if _WIN32
+            _wremove(outpath.c_str());
+#else
+            remove(outpath.c_str());
+#endif
+        }
+    }
+
+    bool flush()
+    {
+        while (!failed && !reorder.empty() && reorder.begin()->first == next)
+        {
+            cv::Mat bgra;
+            const cv::Mat& image = reorder.begin()->second.image;
+            if (image.channels() == 4)
+                bgra = image;
+            else
+                cv::cvtColor(image, bgra, image.channels() == 1 ? cv::COLOR_GRAY2BGRA : cv::COLOR_BGR2BGRA);
+
+            failed = !(gif ? gif_add(bgra, delays[next]) : webp_add(bgra, delays[next]));
+            drop_first();
+            next++;
+        }
+
+        if (!failed && !finished && input_closed && next == frame_count && frame_count > 0)
+        {
+            finished = true;
+            failed = !(gif ? gif_finish() : webp_finish());
+        }
+
+        if (failed && !finished)
+        {
+            finished = true;
+#if _WIN32
+            fwprintf(stderr, L"encode animation %ls failed\n", outpath.c_str());
+#else
+            fprintf(stderr, "encode animation %s failed\n", outpath.c_str());
+#endif
+            discard();
+        }
+
+        return !failed;
+    }
+
+    bool gif_add(const cv::Mat& bgra, int delay_ms)
+    {
+        if (!gif_fp)
+        {
+            gif_fp = anim_fopen(outpath, "wb");
+            if (!gif_fp)
+                return false;
+            written = true;
+
+            unsigned char header[13] = {'G', 'I', 'F', '8', '9', 'a'};
+            header[6] = bgra.cols & 255;
+            header[7] = bgra.cols >> 8;
+            header[8] = bgra.rows & 255;
+            header[9] = bgra.rows >> 8;
+            header[10] = 0x70;
+            fwrite(header, 1, sizeof(header), gif_fp);
+
+            if (loop != 1)
+            {
+                const int repeat = loop == 0 ? 0 : loop - 1;
+                unsigned char netscape[19] = {0x21, 0xff, 11, 'N', 'E', 'T', 'S', 'C', 'A', 'P', 'E', '2', '.', '0', 3, 1};
+                netscape[16] = repeat & 255;
+                netscape[17] = repeat >> 8;
+                fwrite(netscape, 1, sizeof(netscape), gif_fp);
+            }
+        }
+
+        bool has_alpha = false;
+        for (int y = 0; y < bgra.rows && !has_alpha; y++)
+        {
+            const unsigned char* p = bgra.ptr<unsigned char>(y);
+            for (int x = 0; x < bgra.cols; x++)
+                has_alpha = has_alpha || p[x * 4 + 3] < 128;
+        }
+
+        std::vector<unsigned char> palette;
+        std::vector<int> bin_index;
+        gif_quantize(bgra, has_alpha ? 255 : 256, palette, bin_index);
+
+        const int transparent = has_alpha ? 255 : 0;
+        std::vector<unsigned char> indices((size_t)bgra.cols * bgra.rows);
+        for (int y = 0; y < bgra.rows; y++)
+        {
+            const unsigned char* p = bgra.ptr<unsigned char>(y);
+            unsigned char* q = indices.data() + (size_t)y * bgra.cols;
+            for (int x = 0; x < bgra.cols; x++, p += 4)
+                q[x] = p[3] < 128 ? transparent : bin_index[((p[2] >> 2) << 12) | ((p[1] >> 2) << 6) | (p[0] >> 2)];
+        }
+
+        // frames cover the whole canvas, so each one is cleared before the next is drawn
+        const int delay_cs = (delay_ms + 5) / 10;
+        unsigned char control[8] = {0x21, 0xf9, 4, (unsigned char)((2 << 2) | (has_alpha ? 1 : 0)),
+                                    (unsigned char)(delay_cs & 255), (unsigned char)(delay_cs >> 8), (unsigned char)transparent, 0};
+        fwrite(control, 1, sizeof(control), gif_fp);
+
+        unsigned char descriptor[10] = {0x2c, 0, 0, 0, 0};
+        descriptor[5] = bgra.cols & 255;
+        descriptor[6] = bgra.cols >> 8;
+        descriptor[7] = bgra.rows & 255;
+        descriptor[8] = bgra.rows >> 8;
+        descriptor[9] = 0x87;
+        fwrite(descriptor, 1, sizeof(descriptor), gif_fp);
+
+        palette.resize(256 * 3, 0);
+        fwrite(palette.data(), 1, palette.size(), gif_fp);
+
+        std::vector<unsigned char> lzw;
+        GifLzwWriter(lzw).encode(indices.data(), indices.size());
+
+        fputc(8, gif_fp);
+        for (size_t i = 0; i < lzw.size(); i += 255)
+        {
+            const size_t n = std::min(lzw.size() - i, (size_t)255);
+            fputc((int)n, gif_fp);
+            fwrite(lzw.data() + i, 1, n, gif_fp);
+        }
+        fputc(0, gif_fp);
+
+        return !ferror(gif_fp);
+    }
+
+    bool gif_finish()
+    {
+        fputc(0x3b, gif_fp);
+        const bool ok = !ferror(gif_fp);
+        const bool closed = fclose(gif_fp) == 0;
+        gif_fp = 0;
+        return ok && closed;
+    }
+
+    bool webp_add(const cv::Mat& bgra, int delay_ms)
+    {
+        if (!webp_encoder)
+        {
+            WebPAnimEncoderOptions options;
+            if (!WebPAnimEncoderOptionsInit(&options))
+                return false;
+            options.anim_params.loop_count = loop;
+
+            webp_encoder = WebPAnimEncoderNew(bgra.cols, bgra.rows, &options);
+            if (!webp_encoder)
+                return false;
+        }
+
+        WebPConfig config;
+        if (!WebPConfigInit(&config))
+            return false;
+        config.lossless = 1;
+
+        WebPPicture picture;
+        if (!WebPPictureInit(&picture))
+            return false;
+        picture.use_argb = 1;
+        picture.width = bgra.cols;
+        picture.height = bgra.rows;
+
+        bool ok = WebPPictureImportBGRA(&picture, bgra.data, (int)bgra.step) != 0;
+        ok = ok && WebPAnimEncoderAdd(webp_encoder, &picture, timestamp, &config) != 0;
+        WebPPictureFree(&picture);
+
+        timestamp += delay_ms;
+        return ok;
+    }
+
+    bool webp_finish()
+    {
+        WebPData webp_data;
+        WebPDataInit(&webp_data);
+
+        bool ok = WebPAnimEncoderAdd(webp_encoder, NULL, timestamp, NULL) != 0;
+        ok = ok && WebPAnimEncoderAssemble(webp_encoder, &webp_data) != 0;
+
+        if (ok)
+        {
+            FILE* fp = anim_fopen(outpath, "wb");
+            written = fp != 0;
+            ok = fp && fwrite(webp_data.bytes, 1, webp_data.size, fp) == webp_data.size;
+            if (fp)
+                ok = fclose(fp) == 0 && ok;
+        }
+
+        WebPDataClear(&webp_data);
+        return ok;
+    }
+
+    std::mutex lock;
+    path_t outpath;
+    bool gif;
+    int loop;
+    MemoryBudget* budget;
+
+    std::vector<int> delays;
+    int frame_count;
+    bool input_closed;
+
+    // frames that came before the ones ahead of them
+    std::map<int, HeldFrame> reorder;
+    int next;
+    bool failed;
+    bool finished;
+
+    // outpath was created, a failed animation removes it
+    bool written;
+
+    FILE* gif_fp;
+    WebPAnimEncoder* webp_encoder;
+    int timestamp;
+};
+
+// the frames of one input for the loader, a still image is a single frame
+class FrameSource
+{
+public:
+    FrameSource(const path_t& _inpath, const path_t& _outpath, MemoryBudget* _budget = 0) : frame(-1), inpath(_inpath), outpath(_outpath), budget(_budget), done(false)
+    {
+        const path_t ext = get_lowcase_extension(outpath);
+        gif_output = ext == PATHSTR("gif");
+        anim_output = gif_output || ext == PATHSTR("webp");
+        animated = reader.open(inpath);
+    }
+
+    ~FrameSource()
+    {
+        if (writer)
+            writer->close_input();
+    }
+
+    // false after the last frame. A frame that fails to decode comes back with inBGR empty
+    bool next(cv::Mat& inBGR, cv::Mat& inAlpha)
+    {
+        if (done)
+            return false;
+        frame++;
+
+        if (animated)
+        {
+            cv::Mat bgra;
+            int delay_ms = 0;
+            if (!reader.next(bgra, delay_ms))
+            {
+                done = true;
+                inBGR = cv::Mat();
+
+                // broken data after the first frame loses a frame of the animation
+                if (writer && reader.error())
+                {
+                    writer->fail_frame(frame);
+                    return true;
+                }
+                return frame == 0;
+            }
+
+            // the gif loop count is read along with the first frame
+            if (frame == 0 && anim_output)
+                writer = std::make_shared<AnimWriter>(outpath, reader.loop_count(), budget);
+
+            // saved as a still format, only the first frame is kept
+            if (writer)
+                writer->push_frame(delay_ms);
+            else
+                done = true;
+
+            anim_split_alpha(bgra, inBGR, inAlpha);
+            return true;
+        }
+
+        done = true;
+        imread(inpath, inBGR, inAlpha);
+        if (gif_output && !inBGR.empty())
+        {
+            writer = std::make_shared<AnimWriter>(outpath, 1, budget);
+            writer->push_frame(0);
+        }
+        return true;
+    }
+
+    // every task of the input carries these to the save stage
+    std::shared_ptr<AnimWriter> writer;
+    int frame;
+
+private:
+    path_t inpath;
+    path_t outpath;
+    MemoryBudget* budget;
+    AnimReader reader;
+    bool animated;
+    bool gif_output;
+    bool anim_output;
+    bool done;
+};
+
+#endif // ANIM_IMAGE_H
@@ -0,0 +1,399 @@
+#ifndef BENCH_MODE_H
+#define BENCH_MODE_H
+
+// -B benchmark mode of the cli front-ends.
+//
+//   -B WxH[a][,WxH[a]...][:iterations[:warmup]]     e.g. -B 256x256,1920x1080a:10:2
+//
+// Every size gets a seeded random image (a = with alpha channel) that is encoded to png in memory
+// once. Each run then goes decode -> alpha split -> engine -> alpha merge -> encode on the calling
+// thread, so the numbers are per image and not hidden behind the load/proc/save overlap. The
+// engine loops book preproc/upload/inference/download/postproc through bench_stats.h.
+//
+// The result is one json document on stdout, or in the file given with -o:
+//   {"engine":..., <engine fields>, "iterations":N, "warmup":W, "results":[
+//     {"width":W, "height":H, "alpha":0, "scale":S, "tiles":T,
+//      "stages":{"decode":{"median":ms, "p95":ms}, ...},
+//      "process":{...}, "total":{...}, "tiles_per_s":x, "mpix_per_s":x}, ...]}
+// process is the wall time of the engine call, total of the whole run. mpix_per_s counts input
+// pixels against the median process time.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+
+#if _WIN32
+#include <windows.h>
+#endif
+
+#include <opencv2/opencv.hpp>
+
+#include "bench_stats.h"
+#include "utils.hpp"
+
+struct BenchSize
+{
+    int w;
+    int h;
+    int alpha;
+};
+
+class BenchOptions
+{
+public:
+    BenchOptions() : iterations(10), warmup(2), split_alpha(true)
+    {
+    }
+
+    std::vector<BenchSize> sizes;
+    int iterations;
+    int warmup;
+
+    // the ncnn/mnn front-ends upscale rgb and resize alpha separately, resize keeps it in the image
+    bool split_alpha;
+
+    // encoder extension, png when empty
+    std::string format;
+};
+
+// utf-8 for the json report
+static std::string bench_path_string(const path_t& path)
+{
+#if _WIN32
+    if (path.empty())
+        return std::string();
+
+    int len = WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), NULL, 0, NULL, NULL);
+    std::string str(len, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, path.c_str(), (int)path.size(), &str[0], len, NULL, NULL);
+    return str;
+#else
+    return path;
+#endif
+}
+
+// parse the -B argument, -1 on a malformed spec
+template<class CharT>
+static int parse_bench_option(const CharT* arg, BenchOptions& options)
+{
+    std::string spec;
+    for (const CharT* p = arg; *p; p++)
+        spec += (char)*p;
+
+    options.sizes.clear();
+
+    std::string sizes = spec;
+    size_t colon = spec.find(':');
+    if (colon != std::string::npos)
+    {
+        sizes = spec.substr(0, colon);
+        if (sscanf(spec.c_str() + colon + 1, "%d:%d", &options.iterations, &options.warmup) < 1)
+            return -1;
+    }
+
+    size_t begin = 0;
+    while (begin < sizes.size())
+    {
+        size_t end = sizes.find(',', begin);
+        if (end == std::string::npos)
+            end = sizes.size();
+
+        BenchSize size;
+        char alpha = 0;
+        int n = sscanf(sizes.substr(begin, end - begin).c_str(), "%dx%d%c", &size.w, &size.h, &alpha);
+        if (n < 2 || size.w < 1 || size.h < 1 || (n == 3 && alpha != 'a'))
+            return -1;
+        size.alpha = n == 3;
+        options.sizes.push_back(size);
+
+        begin = end + 1;
+    }
+
+    if (options.sizes.empty() || options.iterations < 1 || options.warmup < 0)
+        return -1;
+
+    return 0;
+}
+
+// json object members written in order, values are appended as they come
+class BenchJson
+{
+public:
+    BenchJson& add(const char* key, const std::string& value)
+    {
+        key_prefix(key);
+        text += '"';
+        for (size_t i = 0; i < value.size(); i++)
+        {
+            const unsigned char ch = value[i];
+            if (ch == '"' || ch == '\\')
+            {
+                text += '\\';
+                text += (char)ch;
+            }
+            else if (ch < 0x20)
+            {
+                char buf[8];
+                sprintf(buf, "\\u%04x", ch);
+                text += buf;
+            }
+            else
+            {
+                text += (char)ch;
+            }
+        }
+        text += '"';
+        return *this;
+    }
+
+    BenchJson& add(const char* key, int value)
+    {
+        char buf[32];
+        sprintf(buf, "%d", value);
+        return add_raw(key, buf);
+    }
+
+    BenchJson& add(const char* key, double value)
+    {
+        char buf[32];
+        sprintf(buf, "%.4f", value);
+        return add_raw(key, buf);
+    }
+
+    BenchJson& add(const char* key, const std::vector<int>& values)
+    {
+        std::string list = "[";
+        for (size_t i = 0; i < values.size(); i++)
+        {
+            char buf[32];
+            sprintf(buf, i ? ",%d" : "%d", values[i]);
+            list += buf;
+        }
+        list += "]";
+        return add_raw(key, list);
+    }
+
+    // value is already json
+    BenchJson& add_raw(const char* key, const std::string& value)
+    {
+        key_prefix(key);
+        text += value;
+        return *this;
+    }
+
+    std::string str() const
+    {
+        return "{" + text + "}";
+    }
+
+private:
+    void key_prefix(const char* key)
+    {
+        if (!text.empty())
+            text += ',';
+        text += '"';
+        text += key;
+        text += "\":";
+    }
+
+    std::string text;
+};
+
+// nearest-rank percentile of the samples, p in [0, 1]
+static double bench_percentile(std::vector<double> samples, double p)
+{
+    if (samples.empty())
+        return 0;
+
+    std::sort(samples.begin(), samples.end());
+    size_t rank = (size_t)(p * samples.size() + 0.999999);
+    rank = std::min(std::max(rank, (size_t)1), samples.size());
+    return samples[rank - 1];
+}
+
+static std::string bench_summary(const std::vector<double>& seconds)
+{
+    BenchJson json;
+    json.add("median", bench_percentile(seconds, 0.5) * 1000);
+    json.add("p95", bench_percentile(seconds, 0.95) * 1000);
+    return json.str();
+}
+
+// seeded noise with a gradient on top, so neither the codecs nor the engines see a flat image
+static cv::Mat bench_synth_image(const BenchSize& size, unsigned int seed)
+{
+    const int channels = size.alpha ? 4 : 3;
+
+    cv::Mat image(size.h, size.w, CV_8UC(channels));
+    cv::RNG rng(seed);
+    rng.fill(image, cv::RNG::UNIFORM, 0, 64);
+
+    for (int y = 0; y < size.h; y++)
+    {
+        unsigned char* row = image.ptr<unsigned char>(y);
+        for (int x = 0; x < size.w; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                const int gradient = c % 2 ? x * 191 / size.w : y * 191 / size.h;
+                row[x * channels + c] = (unsigned char)(row[x * channels + c] + gradient);
+            }
+        }
+    }
+
+    return image;
+}
+
+// Upscale is int(const cv::Mat& in, cv::Mat& out), in is bgr (bgra when !split_alpha) and out
+// must come back in the same layout scaled by scale. engine_info holds the engine fields of the
+// report, output the -o path or empty for stdout.
+template<class Upscale>
+// append adds the report as another line to output, for runs that differ in engine_info
+static int run_benchmark(const BenchOptions& options, int scale, const BenchJson& engine_info, const path_t& output, Upscale& upscale,
+                         bool append = false)
+{
+    BenchRecorder recorder;
+    bench_recorder_slot().store(&recorder);
+
+    const std::string ext = "." + (options.format.empty() ? std::string("png") : options.format);
+
+    std::string results = "[";
+    int ret = 0;
+
+    for (size_t si = 0; si < options.sizes.size() && ret == 0; si++)
+    {
+        const BenchSize& size = options.sizes[si];
+
+        std::vector<unsigned char> encoded;
+        if (!cv::imencode(".png", bench_synth_image(size, 0x5eed + (unsigned int)si), encoded))
+        {
+            fprintf(stderr, "bench: encode source image %dx%d failed\n", size.w, size.h);
+            ret = -1;
+            break;
+        }
+
+        std::vector<double> stage_seconds[BENCH_STAGE_COUNT];
+        std::vector<double> process_seconds;
+        std::vector<double> total_seconds;
+        int tiles = 0;
+
+        for (int it = 0; it < options.warmup + options.iterations; it++)
+        {
+            recorder.reset();
+            const double begin = bench_now();
+
+            cv::Mat image;
+            {
+                BenchScope bench_decode(BENCH_DECODE);
+                image = cv::imdecode(encoded, cv::IMREAD_UNCHANGED);
+            }
+
+            cv::Mat alpha;
+            if (image.channels() == 4 && options.split_alpha)
+            {
+                BenchScope bench_alpha(BENCH_ALPHA);
+                cv::extractChannel(image, alpha, 3);
+                cv::cvtColor(image, image, cv::COLOR_BGRA2BGR);
+            }
+
+            cv::Mat out;
+            const double process_begin = bench_now();
+            if (upscale(image, out) != 0 || out.empty())
+            {
+                fprintf(stderr, "bench: process %dx%d failed\n", size.w, size.h);
+                ret = -1;
+                break;
+            }
+            const double process_end = bench_now();
+
+            if (!alpha.empty())
+            {
+                BenchScope bench_alpha(BENCH_ALPHA);
+                cv::Mat scaled_alpha = resize_alpha_bicubic(alpha, scale);
+                cv::Mat merged;
+                merge_rgb_alpha(out, scaled_alpha, merged);
+                out = merged;
+            }
+
+            {
+                BenchScope bench_encode(BENCH_ENCODE);
+                std::vector<unsigned char> result;
+                cv::imencode(ext, out, result);
+            }
+
+            const double end = bench_now();
+
+            fprintf(stderr, "bench %dx%d%s %s %d: %.3lfs\n", size.w, size.h, size.alpha ? "a" : "",
+                    it < options.warmup ? "warmup" : "run", it < options.warmup ? it : it - options.warmup, end - begin);
+
+            if (it < options.warmup)
+                continue;
+
+            for (int s = 0; s < BENCH_STAGE_COUNT; s++)
+                stage_seconds[s].push_back(recorder.seconds(s));
+            process_seconds.push_back(process_end - process_begin);
+            total_seconds.push_back(end - begin);
+            tiles = recorder.tile_count();
+        }
+
+        if (ret != 0)
+            break;
+
+        BenchJson stages;
+        for (int s = 0; s < BENCH_STAGE_COUNT; s++)
+            stages.add_raw(bench_stage_name(s), bench_summary(stage_seconds[s]));
+
+        const double process_median = bench_percentile(process_seconds, 0.5);
+
+        BenchJson result;
+        result.add("width", size.w).add("height", size.h).add("alpha", size.alpha).add("scale", scale);
+        result.add("tiles", tiles);
+        result.add_raw("stages", stages.str());
+        result.add_raw("process", bench_summary(process_seconds));
+        result.add_raw("total", bench_summary(total_seconds));
+        result.add("tiles_per_s", process_median > 0 ? tiles / process_median : 0.0);
+        result.add("mpix_per_s", process_median > 0 ? size.w * (double)size.h / 1e6 / process_median : 0.0);
+
+        if (si)
+            results += ",";
+        results += result.str();
+    }
+    results += "]";
+
+    bench_recorder_slot().store(0);
+
+    if (ret != 0)
+        return ret;
+
+    BenchJson report = engine_info;
+    report.add("iterations", options.iterations).add("warmup", options.warmup);
+    report.add_raw("results", results);
+
+    const std::string text = report.str() + "\n";
+
+    if (output.empty())
+    {
+        fputs(text.c_str(), stdout);
+        fflush(stdout);
+        return 0;
+    }
+
+#if _WIN32
+    FILE* fp = _wfopen(output.c_str(), append ? L"ab" : L"wb");
+#else
+    FILE* fp = fopen(output.c_str(), append ? "ab" : "wb");
+#endif
+    if (!fp)
+    {
+        fprintf(stderr, "bench: open output failed\n");
+        return -1;
+    }
+    fwrite(text.data(), 1, text.size(), fp);
+    fclose(fp);
+
+    return 0;
+}
+
+#endif // BENCH_MODE_H
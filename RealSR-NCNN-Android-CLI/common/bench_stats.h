@@ -0,0 +1,193 @@
+#ifndef BENCH_STATS_H
+#define BENCH_STATS_H
+
+// Per-stage timers for the -B benchmark mode (see bench_mode.h).
+//
+// The engine loops wrap their stages in BenchScope. Outside of -B no recorder is installed and a
+// scope costs one relaxed atomic load, so the hooks stay in the release paths. Stage times are
+// summed over all threads touching the recorder, so with parallel cpu tile workers they add up
+// to more than the wall time of the image.
+
+#include <atomic>
+#include <chrono>
+
+enum BenchStage
+{
+    BENCH_DECODE = 0,
+    BENCH_PREPROC,
+    BENCH_UPLOAD,
+    BENCH_INFERENCE,
+    BENCH_DOWNLOAD,
+    BENCH_POSTPROC,
+    BENCH_ALPHA,
+    BENCH_ENCODE,
+    BENCH_STAGE_COUNT
+};
+
+static inline const char* bench_stage_name(int stage)
+{
+    static const char* names[BENCH_STAGE_COUNT] = {
+        "decode", "preproc", "upload", "inference", "download", "postproc", "alpha", "encode"
+    };
+    return names[stage];
+}
+
+static inline double bench_now()
+{
+    return std::chrono::duration_cast<std::chrono::duration<double> >(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class BenchRecorder
+{
+public:
+    BenchRecorder()
+    {
+        reset();
+    }
+
+    void reset()
+    {
+        for (int i = 0; i < BENCH_STAGE_COUNT; i++)
+            ns[i].store(0, std::memory_order_relaxed);
+        tiles.store(0, std::memory_order_relaxed);
+    }
+
+    void add(int stage, double seconds)
+    {
+        ns[stage].fetch_add((long long)(seconds * 1e9), std::memory_order_relaxed);
+    }
+
+    void add_tiles(int n)
+    {
+        tiles.fetch_add(n, std::memory_order_relaxed);
+    }
+
+    double seconds(int stage) const
+    {
+        return ns[stage].load(std::memory_order_relaxed) * 1e-9;
+    }
+
+    int tile_count() const
+    {
+        return tiles.load(std::memory_order_relaxed);
+    }
+
+private:
+    std::atomic<long long> ns[BENCH_STAGE_COUNT];
+    std::atomic<int> tiles;
+};
+
+// recorder of the running benchmark, shared by every translation unit of the executable
+inline std::atomic<BenchRecorder*>& bench_recorder_slot()
+{
+    static std::atomic<BenchRecorder*> recorder(0);
+    return recorder;
+}
+
+static inline BenchRecorder* bench_recorder()
+{
+    return bench_recorder_slot().load(std::memory_order_relaxed);
+}
+
+static inline void bench_tile_done()
+{
+    BenchRecorder* recorder = bench_recorder();
+    if (recorder)
+        recorder->add_tiles(1);
+}
+
+class BenchScope
+{
+public:
+    explicit BenchScope(int _stage) : recorder(bench_recorder()), stage(_stage), begin(0)
+    {
+        if (recorder)
+            begin = bench_now();
+    }
+
+    ~BenchScope()
+    {
+        if (recorder)
+            recorder->add(stage, bench_now() - begin);
+    }
+
+private:
+    BenchRecorder* recorder;
+    int stage;
+    double begin;
+};
+
+// the cpu tile hooks run preproc, inference and postproc back to back on one worker.
+// BenchTile spans the hook and BenchInference the extractor calls inside it, the time before the
+// first and after the last inference is booked as preproc and postproc
+struct BenchTileMarks
+{
+    double inference_begin;
+    double inference_end;
+};
+
+inline BenchTileMarks& bench_tile_marks()
+{
+    thread_local BenchTileMarks marks;
+    return marks;
+}
+
+class BenchTile
+{
+public:
+    BenchTile() : recorder(bench_recorder()), begin(0)
+    {
+        if (recorder)
+        {
+            BenchTileMarks& marks = bench_tile_marks();
+            marks.inference_begin = 0;
+            marks.inference_end = 0;
+            begin = bench_now();
+        }
+    }
+
+    ~BenchTile()
+    {
+        if (!recorder)
+            return;
+
+        const double end = bench_now();
+        const BenchTileMarks& marks = bench_tile_marks();
+        if (marks.inference_begin > 0)
+        {
+            recorder->add(BENCH_PREPROC, marks.inference_begin - begin);
+            recorder->add(BENCH_INFERENCE, marks.inference_end - marks.inference_begin);
+            recorder->add(BENCH_POSTPROC, end - marks.inference_end);
+        }
+        else
+        {
+            recorder->add(BENCH_INFERENCE, end - begin);
+        }
+        recorder->add_tiles(1);
+    }
+
+private:
+    BenchRecorder* recorder;
+    double begin;
+};
+
+class BenchInference
+{
+public:
+    BenchInference() : active(bench_recorder() != 0)
+    {
+        if (active && bench_tile_marks().inference_begin == 0)
+            bench_tile_marks().inference_begin = bench_now();
+    }
+
+    ~BenchInference()
+    {
+        if (active)
+            bench_tile_marks().inference_end = bench_now();
+    }
+
+private:
+    bool active;
+};
+
+#endif // BENCH_STATS_H
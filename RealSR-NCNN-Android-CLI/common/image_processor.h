@@ -14,6 +14,7 @@ struct ImageFile {
     path_t output_abs_path;
 };
 
+// gif only in the programs that include anim_image.h before this header
 #if _WIN32
 static const std::set<path_t> SUPPORTED_DECODE_EXTENSIONS = {
     PATHSTR("jpg"), PATHSTR("jpeg"),
@@ -21,6 +22,9 @@ static const std::set<path_t> SUPPORTED_DECODE_EXTENSIONS = {
     PATHSTR("bmp"),
     PATHSTR("webp"),
     PATHSTR("tif"), PATHSTR("tiff")
+#ifdef ANIM_IMAGE_H
+    , PATHSTR("gif")
+#endif
 };
 
 static const std::set<path_t> SUPPORTED_ENCODE_EXTENSIONS = {
@@ -29,6 +33,9 @@ static const std::set<path_t> SUPPORTED_ENCODE_EXTENSIONS = {
     PATHSTR("webp"),
     PATHSTR("bmp"),
     PATHSTR("tif"), PATHSTR("tiff")
+#ifdef ANIM_IMAGE_H
+    , PATHSTR("gif")
+#endif
 };
 #else
 static const std::set<path_t> SUPPORTED_DECODE_EXTENSIONS = {
@@ -37,6 +44,9 @@ static const std::set<path_t> SUPPORTED_DECODE_EXTENSIONS = {
     PATHSTR("bmp"),
     PATHSTR("webp"),
     PATHSTR("tif"), PATHSTR("tiff")
+#ifdef ANIM_IMAGE_H
+    , PATHSTR("gif")
+#endif
 };
 
 static const std::set<path_t> SUPPORTED_ENCODE_EXTENSIONS = {
@@ -45,6 +55,9 @@ static const std::set<path_t> SUPPORTED_ENCODE_EXTENSIONS = {
     PATHSTR("webp"),
     PATHSTR("bmp"),
     PATHSTR("tif"), PATHSTR("tiff")
+#ifdef ANIM_IMAGE_H
+    , PATHSTR("gif")
+#endif
 };
 #endif
 
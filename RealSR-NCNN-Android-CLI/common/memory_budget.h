@@ -0,0 +1,144 @@
+#ifndef MEMORY_BUDGET_H
+#define MEMORY_BUDGET_H
+
+#include <condition_variable>
+#include <mutex>
+#include <limits.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte budget for the images in flight between the load and save stages.
+// The loader acquires the estimated footprint of a task before building it and the saver
+// releases it once the result is written, so the number of decoded and upscaled images kept
+// in memory depends on their size instead of a fixed queue depth.
+// A task larger than the whole budget is still admitted when nothing else is in flight.
+class MemoryBudget
+{
+public:
+    MemoryBudget() : limit(0), used(0), peak(0)
+    {
+    }
+
+    // 0 = unlimited, call before the pipeline threads start
+    void set_limit(size_t bytes)
+    {
+        limit = bytes;
+    }
+
+    size_t get_limit() const
+    {
+        return limit;
+    }
+
+    void acquire(size_t bytes)
+    {
+        std::unique_lock<std::mutex> lk(lock);
+
+        while (limit && used != 0 && used + bytes > limit)
+        {
+            condition.wait(lk);
+        }
+
+        used += bytes;
+        if (used > peak)
+            peak = used;
+    }
+
+    // books bytes without waiting, for memory that outlives its task while the task still holds
+    // its own share. The stage calling this may be the one the waiting loader depends on
+    void reserve(size_t bytes)
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        used += bytes;
+        if (used > peak)
+            peak = used;
+    }
+
+    void release(size_t bytes)
+    {
+        {
+            std::lock_guard<std::mutex> lk(lock);
+            used = bytes > used ? 0 : used - bytes;
+        }
+
+        condition.notify_all();
+    }
+
+    size_t peak_bytes()
+    {
+        std::lock_guard<std::mutex> lk(lock);
+        return peak;
+    }
+
+private:
+    size_t limit;
+    size_t used;
+    size_t peak;
+    std::mutex lock;
+    std::condition_variable condition;
+};
+
+// parse sizes like 2G, 512M, 64k or plain bytes, returns -1 on bad input or a size that does not
+// fit a size_t
+template <class CharT>
+static long long parse_size_string(const CharT* s)
+{
+    if (!s || !*s)
+        return -1;
+
+    const unsigned long long max_size = (unsigned long long)SIZE_MAX < (unsigned long long)LLONG_MAX ? (unsigned long long)SIZE_MAX : (unsigned long long)LLONG_MAX;
+
+    unsigned long long v = 0;
+    const CharT* p = s;
+    while (*p >= '0' && *p <= '9')
+    {
+        const unsigned int digit = *p - '0';
+        if (v > (max_size - digit) / 10)
+            return -1;
+
+        v = v * 10 + digit;
+        p++;
+    }
+
+    if (p == s)
+        return -1;
+
+    unsigned long long multiplier = 1;
+    switch (*p)
+    {
+    case 'T':
+    case 't':
+        multiplier = 1ull << 40;
+        p++;
+        break;
+    case 'G':
+    case 'g':
+        multiplier = 1ull << 30;
+        p++;
+        break;
+    case 'M':
+    case 'm':
+        multiplier = 1ull << 20;
+        p++;
+        break;
+    case 'K':
+    case 'k':
+        multiplier = 1ull << 10;
+        p++;
+        break;
+    default:
+        break;
+    }
+
+    if (v > max_size / multiplier)
+        return -1;
+    v *= multiplier;
+
+    // optional trailing B, as in 2GB
+    if (*p == 'B' || *p == 'b')
+        p++;
+
+    return *p ? -1 : (long long)v;
+}
+
+#endif // MEMORY_BUDGET_H
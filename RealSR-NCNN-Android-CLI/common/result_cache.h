@@ -0,0 +1,320 @@
+#ifndef RESULT_CACHE_H
+#define RESULT_CACHE_H
+
+// -R cache-dir, results of earlier runs are reused for byte identical inputs.
+//
+// The key is a 128 bit hash over the input file and everything that changes the output pixels: the
+// model files, the settings string of the program (scale, noise, tta, -F ...) and the output format.
+// Tile size, gpu and thread counts are left out. Every result is a file named after its key in the
+// cache dir, and the index file there has one "key\tsuffix\tbytes" line per result, suffix being what
+// the saver appended to the output name (.png for jpg outputs of images with alpha).
+//
+// A hit is reflinked to the output where the filesystem can share extents and copied otherwise,
+// through a temporary file that replaces the output. Hard links are not used, the savers rewrite an
+// existing output in place and would change the cached copy with it.
+
+#include <map>
+#include <string>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#if __linux__
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <linux/fs.h>
+#endif
+
+#include "filesystem_utils.h"
+#include "tile_autotune.h"
+#include "tile_dedup.h"
+
+static bool result_file_stat(const path_t& path, long long& size, time_t& mtime)
+{
+#if _WIN32
+    struct _stat64 st;
+    if (_wstati64(path.c_str(), &st) != 0)
+        return false;
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0)
+        return false;
+#endif
+    size = st.st_size;
+    mtime = st.st_mtime;
+    return true;
+}
+
+static void result_file_remove(const path_t& path)
+{
+#if _WIN32
+    _wremove(path.c_str());
+#else
+    remove(path.c_str());
+#endif
+}
+
+// reflink or copy src to dst, dst is replaced only once the data is complete
+static bool result_file_clone(const path_t& src, const path_t& dst)
+{
+    const path_t tmppath = dst + PATHSTR(".part");
+    bool ok = false;
+
+#if __linux__ && defined(FICLONE)
+    {
+        int in = open(src.c_str(), O_RDONLY);
+        if (in >= 0)
+        {
+            int out = open(tmppath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+            if (out >= 0)
+            {
+                ok = ioctl(out, FICLONE, in) == 0;
+                close(out);
+            }
+            close(in);
+        }
+    }
+#endif
+
+    if (!ok)
+    {
+        FILE* in = tile_cache_fopen(src, "rb");
+        FILE* out = in ? tile_cache_fopen(tmppath, "wb") : 0;
+        if (out)
+        {
+            std::vector<unsigned char> buf(1 << 20);
+            size_t n;
+            ok = true;
+            while (ok && (n = fread(buf.data(), 1, buf.size(), in)) > 0)
+                ok = fwrite(buf.data(), 1, n, out) == n;
+            ok = !ferror(in) && fclose(out) == 0 && ok;
+        }
+        if (in)
+            fclose(in);
+    }
+
+    if (ok)
+    {
+#if _WIN32
+        ok = MoveFileExW(tmppath.c_str(), dst.c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+        ok = rename(tmppath.c_str(), dst.c_str()) == 0;
+#endif
+    }
+
+    if (!ok)
+        result_file_remove(tmppath);
+
+    return ok;
+}
+
+class ResultCache
+{
+public:
+    // settings holds everything besides the model files that changes the output pixels
+    ResultCache(const path_t& _dir, const path_t& parampath, const path_t& modelpath, const std::string& settings)
+        : dir(_dir), total(0), hits(0), stored(0)
+    {
+        config = model_file_hash(parampath, modelpath) + "\t" + settings;
+        start = time(0);
+
+#if _WIN32
+        CreateDirectoryW(dir.c_str(), 0);
+#else
+        mkdir(dir.c_str(), 0755);
+#endif
+
+        read_index();
+    }
+
+    // places the cached results at their outputs and drops those files from the lists
+    void take_hits(std::vector<path_t>& input_files, std::vector<path_t>& output_files, int verbose)
+    {
+        std::vector<path_t> miss_input;
+        std::vector<path_t> miss_output;
+
+        for (size_t i = 0; i < input_files.size(); i++)
+        {
+            total++;
+
+            // unreadable inputs are left to the loader to report
+            std::string key;
+            if (!input_key(input_files[i], output_files[i], key))
+            {
+                miss_input.push_back(input_files[i]);
+                miss_output.push_back(output_files[i]);
+                continue;
+            }
+
+            std::map<std::string, std::string>::const_iterator it = index.find(key);
+            if (it != index.end() && result_file_clone(entry_path(key), output_files[i] + ascii_path(it->second)))
+            {
+                hits++;
+                if (verbose)
+                {
+#if _WIN32
+                    fwprintf(stderr, L"[cache] %ls -> %ls\n", input_files[i].c_str(), output_files[i].c_str());
+#else
+                    fprintf(stderr, "[cache] %s -> %s\n", input_files[i].c_str(), output_files[i].c_str());
+#endif
+                }
+                continue;
+            }
+
+            Pending p;
+            p.key = key;
+            p.output = output_files[i];
+            pending.push_back(p);
+
+            miss_input.push_back(input_files[i]);
+            miss_output.push_back(output_files[i]);
+        }
+
+        input_files.swap(miss_input);
+        output_files.swap(miss_output);
+    }
+
+    // copies the results this run wrote into the cache and appends them to the index
+    void store_results(int verbose)
+    {
+        static const char* suffixes[] = {"", ".png"};
+
+        if (pending.empty())
+            return;
+
+        FILE* fp = tile_cache_fopen(index_path(), "ab");
+        if (!fp)
+        {
+            if (verbose)
+                fprintf(stderr, "result cache is not writable\n");
+            pending.clear();
+            return;
+        }
+
+        for (size_t i = 0; i < pending.size(); i++)
+        {
+            for (int j = 0; j < 2; j++)
+            {
+                const path_t output = pending[i].output + ascii_path(suffixes[j]);
+
+                // an output older than the run is a leftover of a failed save
+                long long size;
+                time_t mtime;
+                if (!result_file_stat(output, size, mtime) || mtime < start || size == 0)
+                    continue;
+
+                if (result_file_clone(output, entry_path(pending[i].key)))
+                {
+                    fprintf(fp, "%s\t%s\t%lld\n", pending[i].key.c_str(), suffixes[j], size);
+                    stored++;
+                }
+                break;
+            }
+        }
+
+        fclose(fp);
+        pending.clear();
+    }
+
+    void print_stats() const
+    {
+        fprintf(stderr, "result cache: %d of %d images reused, %d stored\n", hits, total, stored);
+    }
+
+private:
+    static path_t ascii_path(const std::string& s)
+    {
+        return path_t(s.begin(), s.end());
+    }
+
+    path_t entry_path(const std::string& key) const
+    {
+#if _WIN32
+        return dir + PATHSTR('\\') + ascii_path(key);
+#else
+        return dir + PATHSTR('/') + ascii_path(key);
+#endif
+    }
+
+    path_t index_path() const
+    {
+        return entry_path("index");
+    }
+
+    // later lines win, a key stored twice points to the same file
+    void read_index()
+    {
+        FILE* fp = tile_cache_fopen(index_path(), "rb");
+        if (!fp)
+            return;
+
+        char line[256];
+        while (fgets(line, sizeof(line), fp))
+        {
+            char* suffix = strchr(line, '\t');
+            if (!suffix)
+                continue;
+            *suffix++ = 0;
+
+            char* rest = strchr(suffix, '\t');
+            if (!rest)
+                continue;
+            *rest = 0;
+
+            index[line] = suffix;
+        }
+
+        fclose(fp);
+    }
+
+    bool input_key(const path_t& inputpath, const path_t& outputpath, std::string& key) const
+    {
+        FILE* fp = tile_cache_fopen(inputpath, "rb");
+        if (!fp)
+            return false;
+
+        TileKey h;
+        h.lo = 0x452821e638d01377ull;
+        h.hi = 0xbe5466cf34e90c6cull;
+
+        // the extension picks the encoder, and with it the output bytes
+        const path_t ext = get_lowcase_extension(outputpath);
+        std::string text = config + "\t";
+        for (size_t i = 0; i < ext.size(); i++)
+            text += (char)ext[i];
+        tile_hash_update(h, (const unsigned char*)text.data(), text.size());
+
+        std::vector<unsigned char> buf(65536);
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0)
+            tile_hash_update(h, buf.data(), n);
+
+        const bool ok = !ferror(fp);
+        fclose(fp);
+
+        char hex[33];
+        sprintf(hex, "%016llx%016llx", (unsigned long long)h.hi, (unsigned long long)h.lo);
+        key = hex;
+        return ok;
+    }
+
+    struct Pending
+    {
+        std::string key;
+        path_t output;
+    };
+
+    path_t dir;
+    std::string config;
+    std::map<std::string, std::string> index;
+    std::vector<Pending> pending;
+    time_t start;
+    int total;
+    int hits;
+    int stored;
+};
+
+#endif // RESULT_CACHE_H
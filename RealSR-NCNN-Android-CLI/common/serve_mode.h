@@ -0,0 +1,746 @@
+#ifndef SERVE_MODE_H
+#define SERVE_MODE_H
+
+// --serve mode, keeps the process and its loaded models alive between jobs.
+//
+// Jobs are line-delimited flat json objects read from stdin or from clients of a unix domain socket:
+//   {"id":"1","input":"/sdcard/in.jpg","output":"/sdcard/out.png","scale":4,"tile":0}
+// Every job is answered with one json line carrying the same id:
+//   {"id":"1","status":"ok","done":1,"failed":0,"time":0.412}
+//   {"id":"1","status":"error","error":"input not found"}
+// {"cmd":"ping"} answers status ok and {"cmd":"quit"} stops the server.
+// In stdio mode stdout is handed over to the replies and everything else the program prints is
+// redirected to stderr, so the reply stream stays parseable.
+
+#include <list>
+#include <map>
+#include <string>
+#include <utility>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if _WIN32
+#include <io.h>
+#include <windows.h>
+#else
+#include <errno.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#endif
+
+#include "filesystem_utils.h"
+
+typedef std::map<std::string, std::string> ServeFields;
+
+// --serve or --serve=<socket path> is removed from argv before getopt, which only knows short options.
+// A socket path starting with @ uses the linux abstract namespace.
+template <class CharT>
+static bool take_serve_option(int& argc, CharT** argv, std::string& endpoint)
+{
+    static const char prefix[] = "--serve";
+    const int prefix_len = (int)sizeof(prefix) - 1;
+
+    bool found = false;
+    int j = 1;
+    for (int i = 1; i < argc; i++)
+    {
+        const CharT* a = argv[i];
+        int k = 0;
+        while (k < prefix_len && a[k] == (CharT)prefix[k])
+            k++;
+
+        if (!found && k == prefix_len && (a[k] == 0 || a[k] == '='))
+        {
+            found = true;
+            endpoint.clear();
+            if (a[k] == '=')
+            {
+                for (const CharT* p = a + k + 1; *p; p++)
+                    endpoint += (char)*p;
+            }
+            continue;
+        }
+
+        argv[j++] = argv[i];
+    }
+
+    argc = j;
+    return found;
+}
+
+static void append_utf8(std::string& s, unsigned int cp)
+{
+    if (cp < 0x80)
+    {
+        s += (char)cp;
+    }
+    else if (cp < 0x800)
+    {
+        s += (char)(0xc0 | (cp >> 6));
+        s += (char)(0x80 | (cp & 0x3f));
+    }
+    else if (cp < 0x10000)
+    {
+        s += (char)(0xe0 | (cp >> 12));
+        s += (char)(0x80 | ((cp >> 6) & 0x3f));
+        s += (char)(0x80 | (cp & 0x3f));
+    }
+    else
+    {
+        s += (char)(0xf0 | (cp >> 18));
+        s += (char)(0x80 | ((cp >> 12) & 0x3f));
+        s += (char)(0x80 | ((cp >> 6) & 0x3f));
+        s += (char)(0x80 | (cp & 0x3f));
+    }
+}
+
+static bool parse_json_hex4(const char*& p, unsigned int& v)
+{
+    v = 0;
+    for (int i = 0; i < 4; i++, p++)
+    {
+        const char c = *p;
+        v <<= 4;
+        if (c >= '0' && c <= '9')
+            v |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            v |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            v |= c - 'A' + 10;
+        else
+            return false;
+    }
+    return true;
+}
+
+static bool parse_json_string(const char*& p, std::string& out)
+{
+    if (*p != '"')
+        return false;
+    p++;
+
+    out.clear();
+    while (*p && *p != '"')
+    {
+        if (*p != '\\')
+        {
+            out += *p++;
+            continue;
+        }
+
+        p++;
+        switch (*p++)
+        {
+        case '"':
+            out += '"';
+            break;
+        case '\\':
+            out += '\\';
+            break;
+        case '/':
+            out += '/';
+            break;
+        case 'b':
+            out += '\b';
+            break;
+        case 'f':
+            out += '\f';
+            break;
+        case 'n':
+            out += '\n';
+            break;
+        case 'r':
+            out += '\r';
+            break;
+        case 't':
+            out += '\t';
+            break;
+        case 'u':
+        {
+            unsigned int cp;
+            if (!parse_json_hex4(p, cp))
+                return false;
+            if (cp >= 0xd800 && cp < 0xdc00 && p[0] == '\\' && p[1] == 'u')
+            {
+                const char* q = p + 2;
+                unsigned int lo;
+                if (parse_json_hex4(q, lo) && lo >= 0xdc00 && lo < 0xe000)
+                {
+                    cp = 0x10000 + ((cp - 0xd800) << 10) + (lo - 0xdc00);
+                    p = q;
+                }
+            }
+            append_utf8(out, cp);
+            break;
+        }
+        default:
+            return false;
+        }
+    }
+
+    if (*p != '"')
+        return false;
+    p++;
+    return true;
+}
+
+static void skip_json_space(const char*& p)
+{
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+        p++;
+}
+
+// parse one flat json object, values are kept as their text: strings unescaped, numbers as written,
+// true/false as "true"/"false" and null as an empty string. Nested objects and arrays are rejected.
+static bool parse_json_fields(const std::string& line, ServeFields& fields)
+{
+    fields.clear();
+
+    const char* p = line.c_str();
+    skip_json_space(p);
+    if (*p++ != '{')
+        return false;
+
+    skip_json_space(p);
+    if (*p == '}')
+    {
+        p++;
+    }
+    else
+    {
+        for (;;)
+        {
+            std::string key;
+            std::string value;
+
+            skip_json_space(p);
+            if (!parse_json_string(p, key))
+                return false;
+
+            skip_json_space(p);
+            if (*p++ != ':')
+                return false;
+
+            skip_json_space(p);
+            if (*p == '"')
+            {
+                if (!parse_json_string(p, value))
+                    return false;
+            }
+            else if (strncmp(p, "true", 4) == 0)
+            {
+                value = "true";
+                p += 4;
+            }
+            else if (strncmp(p, "false", 5) == 0)
+            {
+                value = "false";
+                p += 5;
+            }
+            else if (strncmp(p, "null", 4) == 0)
+            {
+                p += 4;
+            }
+            else
+            {
+                const char* begin = p;
+                while ((*p >= '0' && *p <= '9') || *p == '-' || *p == '+' || *p == '.' || *p == 'e' || *p == 'E')
+                    p++;
+                if (p == begin)
+                    return false;
+                value.assign(begin, p);
+            }
+
+            fields[key] = value;
+
+            skip_json_space(p);
+            if (*p == ',')
+            {
+                p++;
+                continue;
+            }
+            if (*p == '}')
+            {
+                p++;
+                break;
+            }
+            return false;
+        }
+    }
+
+    skip_json_space(p);
+    return *p == 0;
+}
+
+static std::string json_escape(const std::string& s)
+{
+    std::string out;
+    for (size_t i = 0; i < s.size(); i++)
+    {
+        const unsigned char c = (unsigned char)s[i];
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += (char)c;
+        }
+        else if (c == '\n')
+        {
+            out += "\\n";
+        }
+        else if (c == '\r')
+        {
+            out += "\\r";
+        }
+        else if (c == '\t')
+        {
+            out += "\\t";
+        }
+        else if (c < 0x20)
+        {
+            char buf[8];
+            sprintf(buf, "\\u%04x", c);
+            out += buf;
+        }
+        else
+        {
+            out += (char)c;
+        }
+    }
+    return out;
+}
+
+// builds the reply line of a job
+class ServeReply
+{
+public:
+    ServeReply& add(const char* key, const std::string& value)
+    {
+        begin_field(key);
+        text += '"';
+        text += json_escape(value);
+        text += '"';
+        return *this;
+    }
+
+    ServeReply& add(const char* key, const char* value)
+    {
+        return add(key, std::string(value));
+    }
+
+    ServeReply& add(const char* key, int value)
+    {
+        char buf[32];
+        sprintf(buf, "%d", value);
+        begin_field(key);
+        text += buf;
+        return *this;
+    }
+
+    ServeReply& add(const char* key, double value)
+    {
+        char buf[32];
+        sprintf(buf, "%.3f", value);
+        begin_field(key);
+        text += buf;
+        return *this;
+    }
+
+    std::string str() const
+    {
+        return "{" + text + "}";
+    }
+
+private:
+    void begin_field(const char* key)
+    {
+        if (!text.empty())
+            text += ',';
+        text += '"';
+        text += json_escape(key);
+        text += "\":";
+    }
+
+    std::string text;
+};
+
+static std::string field_or(const ServeFields& fields, const char* key, const std::string& fallback)
+{
+    ServeFields::const_iterator it = fields.find(key);
+    return it == fields.end() || it->second.empty() ? fallback : it->second;
+}
+
+static int field_or(const ServeFields& fields, const char* key, int fallback)
+{
+    ServeFields::const_iterator it = fields.find(key);
+    if (it == fields.end() || it->second.empty())
+        return fallback;
+    if (it->second == "true")
+        return 1;
+    if (it->second == "false")
+        return 0;
+    return atoi(it->second.c_str());
+}
+
+// json carries utf-8, path_t is utf-16 on windows
+static path_t utf8_to_path(const std::string& s)
+{
+#if _WIN32
+    if (s.empty())
+        return path_t();
+    int n = MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), NULL, 0);
+    std::wstring ws(n, L'\0');
+    MultiByteToWideChar(CP_UTF8, 0, s.c_str(), (int)s.size(), &ws[0], n);
+    return ws;
+#else
+    return s;
+#endif
+}
+
+static std::string path_to_utf8(const path_t& p)
+{
+#if _WIN32
+    if (p.empty())
+        return std::string();
+    int n = WideCharToMultiByte(CP_UTF8, 0, p.c_str(), (int)p.size(), NULL, 0, NULL, NULL);
+    std::string s(n, '\0');
+    WideCharToMultiByte(CP_UTF8, 0, p.c_str(), (int)p.size(), &s[0], n, NULL, NULL);
+    return s;
+#else
+    return p;
+#endif
+}
+
+// Least recently used cache of loaded models, a model and its pipelines are only created again
+// after being evicted. T is owned by the cache and deleted on eviction.
+template <class T>
+class ModelCache
+{
+public:
+    explicit ModelCache(size_t _capacity = 2) : capacity(_capacity)
+    {
+    }
+
+    ~ModelCache()
+    {
+        clear();
+    }
+
+    T* get(const std::string& key)
+    {
+        for (typename std::list<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+        {
+            if (it->first == key)
+            {
+                entries.splice(entries.begin(), entries, it);
+                return entries.front().second;
+            }
+        }
+        return 0;
+    }
+
+    // evict before loading a new model so the old weights are freed first
+    void make_room()
+    {
+        while (!entries.empty() && entries.size() >= capacity)
+        {
+            delete entries.back().second;
+            entries.pop_back();
+        }
+    }
+
+    T* put(const std::string& key, T* v)
+    {
+        make_room();
+        entries.push_front(Entry(key, v));
+        return v;
+    }
+
+    void clear()
+    {
+        for (typename std::list<Entry>::iterator it = entries.begin(); it != entries.end(); ++it)
+            delete it->second;
+        entries.clear();
+    }
+
+private:
+    ModelCache(const ModelCache&);
+    ModelCache& operator=(const ModelCache&);
+
+    typedef std::pair<std::string, T*> Entry;
+    std::list<Entry> entries;
+    size_t capacity;
+};
+
+// job transport, stdin/stdout or a unix domain socket serving one client at a time
+class ServeChannel
+{
+public:
+    ServeChannel() : listen_fd(-1), in_fd(-1), out_fd(-1), stdio(false)
+    {
+    }
+
+    ~ServeChannel()
+    {
+        close();
+    }
+
+    int open(const std::string& endpoint)
+    {
+        if (endpoint.empty())
+        {
+            stdio = true;
+            fflush(stdout);
+            in_fd = 0;
+#if _WIN32
+            out_fd = _dup(1);
+            _dup2(2, 1);
+#else
+            out_fd = dup(1);
+            dup2(2, 1);
+#endif
+            return out_fd < 0 ? -1 : 0;
+        }
+
+#if _WIN32
+        fprintf(stderr, "unix socket serving is not supported on windows, use --serve without a path\n");
+        return -1;
+#else
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        if (endpoint.size() >= sizeof(addr.sun_path))
+        {
+            fprintf(stderr, "socket path too long: %s\n", endpoint.c_str());
+            return -1;
+        }
+        memcpy(addr.sun_path, endpoint.c_str(), endpoint.size());
+
+        socklen_t addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + endpoint.size() + 1);
+        if (endpoint[0] == '@')
+        {
+            // abstract namespace, no file to clean up
+            addr.sun_path[0] = '\0';
+            addr_len = (socklen_t)(offsetof(struct sockaddr_un, sun_path) + endpoint.size());
+        }
+        else
+        {
+            unlink(endpoint.c_str());
+        }
+
+        listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd < 0 || bind(listen_fd, (struct sockaddr*)&addr, addr_len) != 0 || listen(listen_fd, 4) != 0)
+        {
+            fprintf(stderr, "listen on %s failed: %s\n", endpoint.c_str(), strerror(errno));
+            return -1;
+        }
+
+        socket_path = endpoint[0] == '@' ? std::string() : endpoint;
+        fprintf(stderr, "serving on %s\n", endpoint.c_str());
+        return 0;
+#endif
+    }
+
+    // blocks for the next line, a disconnected socket client is replaced by the next one
+    bool read_line(std::string& line)
+    {
+        line.clear();
+        for (;;)
+        {
+            size_t eol = buffer.find('\n');
+            if (eol != std::string::npos)
+            {
+                line = buffer.substr(0, eol);
+                buffer.erase(0, eol + 1);
+                if (!line.empty() && line[line.size() - 1] == '\r')
+                    line.erase(line.size() - 1);
+                return true;
+            }
+
+            if (in_fd < 0 && !accept_client())
+                return false;
+
+            char chunk[4096];
+#if _WIN32
+            int n = _read(in_fd, chunk, sizeof(chunk));
+#else
+            ssize_t n = read(in_fd, chunk, sizeof(chunk));
+            if (n < 0 && errno == EINTR)
+                continue;
+#endif
+            if (n > 0)
+            {
+                buffer.append(chunk, n);
+                continue;
+            }
+
+            // end of stream, a last line without newline still counts
+            if (!buffer.empty())
+            {
+                line.swap(buffer);
+                buffer.clear();
+                return true;
+            }
+
+            if (stdio)
+                return false;
+
+            drop_client();
+        }
+    }
+
+    void write_line(const std::string& line)
+    {
+        if (out_fd < 0)
+            return;
+
+        std::string s = line + "\n";
+        const char* p = s.c_str();
+        size_t left = s.size();
+        while (left > 0)
+        {
+#if _WIN32
+            int n = _write(out_fd, p, (unsigned int)left);
+#elif defined(MSG_NOSIGNAL)
+            ssize_t n = stdio ? write(out_fd, p, left) : send(out_fd, p, left, MSG_NOSIGNAL);
+#else
+            ssize_t n = write(out_fd, p, left);
+#endif
+            if (n <= 0)
+                return;
+            p += n;
+            left -= n;
+        }
+    }
+
+    void close()
+    {
+        if (!stdio)
+            drop_client();
+#if !_WIN32
+        if (listen_fd >= 0)
+        {
+            ::close(listen_fd);
+            listen_fd = -1;
+            if (!socket_path.empty())
+                unlink(socket_path.c_str());
+        }
+#endif
+    }
+
+private:
+    bool accept_client()
+    {
+#if _WIN32
+        return false;
+#else
+        if (listen_fd < 0)
+            return false;
+
+        for (;;)
+        {
+            int fd = accept(listen_fd, NULL, NULL);
+            if (fd >= 0)
+            {
+                in_fd = fd;
+                out_fd = fd;
+                buffer.clear();
+                return true;
+            }
+            if (errno != EINTR)
+                return false;
+        }
+#endif
+    }
+
+    void drop_client()
+    {
+#if !_WIN32
+        if (in_fd >= 0)
+            ::close(in_fd);
+#endif
+        in_fd = -1;
+        out_fd = -1;
+        buffer.clear();
+    }
+
+    int listen_fd;
+    int in_fd;
+    int out_fd;
+    bool stdio;
+    std::string socket_path;
+    std::string buffer;
+};
+
+// run jobs until quit or end of input. handler(fields, reply, error) runs one job, adds its own
+// result fields to reply and returns 0 on success, the id and status fields are added here.
+template <class Handler>
+static int serve_loop(const std::string& endpoint, Handler& handler)
+{
+    ServeChannel channel;
+    if (channel.open(endpoint) != 0)
+        return -1;
+
+    std::string line;
+    while (channel.read_line(line))
+    {
+        if (line.find_first_not_of(" \t") == std::string::npos)
+            continue;
+
+        ServeFields fields;
+        ServeReply reply;
+
+        if (!parse_json_fields(line, fields))
+        {
+            reply.add("status", "error").add("error", "malformed job, expected one flat json object per line");
+            channel.write_line(reply.str());
+            continue;
+        }
+
+        const std::string id = field_or(fields, "id", std::string());
+        if (!id.empty())
+            reply.add("id", id);
+
+        const std::string cmd = field_or(fields, "cmd", std::string("process"));
+        if (cmd == "quit")
+        {
+            reply.add("status", "ok");
+            channel.write_line(reply.str());
+            break;
+        }
+        if (cmd == "ping")
+        {
+            reply.add("status", "ok");
+            channel.write_line(reply.str());
+            continue;
+        }
+        if (cmd != "process")
+        {
+            reply.add("status", "error").add("error", "unknown cmd " + cmd);
+            channel.write_line(reply.str());
+            continue;
+        }
+
+        ServeReply result;
+        std::string error;
+        const int ret = handler(fields, result, error);
+
+        if (ret == 0)
+            reply.add("status", "ok");
+        else
+            reply.add("status", "error").add("error", error.empty() ? std::string("failed") : error);
+
+        std::string text = reply.str();
+        const std::string extra = result.str();
+        if (extra.size() > 2)
+            text = text.substr(0, text.size() - 1) + "," + extra.substr(1);
+        channel.write_line(text);
+    }
+
+    channel.close();
+    return 0;
+}
+
+#endif // SERVE_MODE_H
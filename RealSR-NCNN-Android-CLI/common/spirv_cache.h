@@ -0,0 +1,162 @@
+#ifndef SPIRV_CACHE_H
+#define SPIRV_CACHE_H
+
+// The pre- and postprocess shaders of the engines are glsl, compile_spirv_module runs glslang on
+// them in every process. Since the gui starts a process per job, the spirv is kept next to the
+// model files and later runs load it instead.
+//
+// Every shader variant is a file shader-<hash>.cache, the hash over the glsl source, the ncnn
+// version, the option flags that turn into shader macros and the device: its pipeline cache uuid,
+// vendor, device id and driver version, so a driver update compiles again. The name matches the
+// */*.cache the gui removes on a cache reset, like tilesize.cache. A file that is not spirv is
+// ignored and written anew. The pipelines of the ncnn layers are built inside ncnn and are not
+// covered here.
+
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// ncnn
+#include "gpu.h"
+#include "option.h"
+#include "platform.h"
+
+#include "filesystem_utils.h"
+#include "tile_autotune.h"
+
+struct SpirvCacheStats
+{
+    std::atomic<int> hits;
+    std::atomic<int> compiled;
+};
+
+// counts of the whole executable, for the load time report
+inline SpirvCacheStats& spirv_cache_stats()
+{
+    static SpirvCacheStats stats = {{0}, {0}};
+    return stats;
+}
+
+static path_t spirv_cache_path(const path_t& parampath, const std::string& key)
+{
+    const path_t name = PATHSTR("shader-") + path_t(key.begin(), key.end()) + PATHSTR(".cache");
+
+    size_t sep = parampath.find_last_of(PATHSTR("/\\"));
+    if (sep == path_t::npos)
+        return name;
+    return parampath.substr(0, sep + 1) + name;
+}
+
+static std::string spirv_cache_key(const char* comp_data, int comp_data_size, const ncnn::Option& opt, const ncnn::VulkanDevice* vkdev)
+{
+    uint64_t hash = 14695981039346656037ull;
+    hash = fnv1a_update(hash, (const unsigned char*)comp_data, comp_data_size);
+
+#ifdef NCNN_VERSION_STRING
+    hash = fnv1a_update(hash, (const unsigned char*)NCNN_VERSION_STRING, strlen(NCNN_VERSION_STRING));
+#endif
+
+    const unsigned char flags[] = {
+        opt.use_fp16_packed, opt.use_fp16_storage, opt.use_fp16_arithmetic,
+        opt.use_int8_packed, opt.use_int8_storage, opt.use_int8_arithmetic,
+        opt.use_bf16_storage, opt.use_shader_pack8
+    };
+    hash = fnv1a_update(hash, flags, sizeof(flags));
+
+    if (vkdev)
+    {
+        const ncnn::GpuInfo& info = vkdev->info;
+        const uint32_t ids[] = {info.vendor_id(), info.device_id(), info.driver_version(), info.api_version()};
+        hash = fnv1a_update(hash, info.pipeline_cache_uuid(), 16);
+        hash = fnv1a_update(hash, (const unsigned char*)ids, sizeof(ids));
+    }
+
+    char text[17];
+    sprintf(text, "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+static bool read_spirv_file(const path_t& path, std::vector<uint32_t>& spirv)
+{
+    FILE* fp = tile_cache_fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    fseek(fp, 0, SEEK_END);
+    long size = ftell(fp);
+    rewind(fp);
+
+    // at least the 5 words of the header, starting with the spirv magic
+    bool ok = size >= 20 && size % 4 == 0;
+    if (ok)
+    {
+        spirv.resize(size / 4);
+        ok = fread(spirv.data(), 1, size, fp) == (size_t)size && spirv[0] == 0x07230203;
+    }
+    fclose(fp);
+
+    if (!ok)
+        spirv.clear();
+    return ok;
+}
+
+// through a temporary file, so a process starting at the same time never reads half of it
+static void write_spirv_file(const path_t& path, const std::vector<uint32_t>& spirv)
+{
+    const path_t tmppath = path + PATHSTR(".tmp");
+    FILE* fp = tile_cache_fopen(tmppath, "wb");
+    if (!fp)
+        return;
+
+    const size_t size = spirv.size() * 4;
+    const bool ok = fwrite(spirv.data(), 1, size, fp) == size;
+    fclose(fp);
+
+#if _WIN32
+    if (!ok || !MoveFileExW(tmppath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING))
+        _wremove(tmppath.c_str());
+#else
+    if (!ok || rename(tmppath.c_str(), path.c_str()) != 0)
+        remove(tmppath.c_str());
+#endif
+}
+
+// compile_spirv_module through the shader cache of the model at parampath. The spirv depends on the
+// tta variant, the options and the device, every engine load asks for its own. Engines loading on
+// several threads take turns, they would write the same temporary file
+static int cached_spirv_module(const char* comp_data, int comp_data_size, const ncnn::Option& opt, const ncnn::VulkanDevice* vkdev,
+                               const path_t& parampath, std::vector<uint32_t>& spirv)
+{
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+
+    const path_t path = spirv_cache_path(parampath, spirv_cache_key(comp_data, comp_data_size, opt, vkdev));
+
+    if (read_spirv_file(path, spirv))
+    {
+        spirv_cache_stats().hits++;
+        return 0;
+    }
+
+    int ret = ncnn::compile_spirv_module(comp_data, comp_data_size, opt, spirv);
+    if (ret != 0)
+        return ret;
+
+    spirv_cache_stats().compiled++;
+    write_spirv_file(path, spirv);
+    return 0;
+}
+
+// "shader cache 2 hit, 0 compiled"
+static std::string spirv_cache_summary()
+{
+    char text[64];
+    sprintf(text, "shader cache %d hit, %d compiled", (int)spirv_cache_stats().hits, (int)spirv_cache_stats().compiled);
+    return text;
+}
+
+#endif // SPIRV_CACHE_H
@@ -0,0 +1,505 @@
+#ifndef STREAM_WRITER_H
+#define STREAM_WRITER_H
+
+// Streaming image encoder for row bands.
+// The engines push each finished band of output rows and the band is encoded to disk right away,
+// so the full upscaled image never has to be resident in memory.
+// png goes through zlib deflate (when built with STREAM_WRITER_PNG), tiff is written uncompressed
+// in fixed size strips and bmp top-down, neither needs a third party library.
+// jpeg/webp are not streamed and keep the regular whole image path.
+// A file that fails to open, fails on a row or is never closed with all rows is removed again,
+// so no truncated image is left at the output path.
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <vector>
+
+#include "filesystem_utils.h"
+
+#if STREAM_WRITER_PNG
+#include <zlib.h>
+#endif
+
+static bool is_stream_encode_format(const path_t& ext)
+{
+    path_t lower_ext = ext;
+    std::transform(lower_ext.begin(), lower_ext.end(), lower_ext.begin(), ::tolower);
+#if STREAM_WRITER_PNG
+    if (lower_ext == PATHSTR("png"))
+        return true;
+#endif
+    return lower_ext == PATHSTR("tif") || lower_ext == PATHSTR("tiff") || lower_ext == PATHSTR("bmp");
+}
+
+class StreamImageWriter
+{
+public:
+    StreamImageWriter() : fp(0), format(FORMAT_NONE), w(0), h(0), c(0), bgr(false), rows_written(0), failed(false)
+    {
+    }
+
+    ~StreamImageWriter()
+    {
+        if (fp)
+            discard();
+#if STREAM_WRITER_PNG
+        if (format == FORMAT_PNG)
+            deflateEnd(&zs);
+#endif
+    }
+
+    // pixels are interleaved 8bit with c = 1/3/4 channels, bgr = input is BGR(A) order
+    bool open(const path_t& _path, int _w, int _h, int _c, bool _bgr)
+    {
+        if (_w <= 0 || _h <= 0 || (_c != 1 && _c != 3 && _c != 4))
+            return false;
+
+        path_t ext = get_file_extension(_path);
+        std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+        if (!is_stream_encode_format(ext))
+            return false;
+
+        path = _path;
+        w = _w;
+        h = _h;
+        c = _c;
+        bgr = _bgr;
+        rows_written = 0;
+        failed = false;
+
+#if _WIN32
+        fp = _wfopen(path.c_str(), L"wb");
+#else
+        fp = fopen(path.c_str(), "wb");
+#endif
+        if (!fp)
+            return false;
+
+        if (ext == PATHSTR("bmp"))
+            format = FORMAT_BMP;
+        else if (ext == PATHSTR("png"))
+            format = FORMAT_PNG;
+        else
+            format = FORMAT_TIFF;
+
+        bool ok = false;
+        if (format == FORMAT_PNG)
+            ok = png_begin();
+        if (format == FORMAT_TIFF)
+            ok = tiff_begin();
+        if (format == FORMAT_BMP)
+            ok = bmp_begin();
+
+        if (!ok)
+            discard();
+        return ok;
+    }
+
+    // encode the next rows, stride is the byte distance between two rows in data
+    bool write_rows(const unsigned char* data, int rows, size_t stride)
+    {
+        if (!fp || failed)
+            return false;
+
+        rows = std::min(rows, h - rows_written);
+        for (int i = 0; i < rows && !failed; i++)
+        {
+            const unsigned char* src = data + i * stride;
+
+            // every format here stores samples as RGB(A) except bmp which wants BGR(A)
+            const bool swap = c >= 3 && (format == FORMAT_BMP ? !bgr : bgr);
+            if (swap)
+            {
+                row.assign(src, src + (size_t)w * c);
+                for (int j = 0; j < w; j++)
+                {
+                    std::swap(row[j * c], row[j * c + 2]);
+                }
+                src = row.data();
+            }
+
+            if (format == FORMAT_PNG)
+                failed = !png_row(src);
+            if (format == FORMAT_TIFF)
+                failed = !tiff_row(src);
+            if (format == FORMAT_BMP)
+                failed = !bmp_row(src);
+
+            rows_written++;
+        }
+
+        return !failed;
+    }
+
+    // finish the file, fails if not all rows were written
+    bool close()
+    {
+        if (!fp)
+            return false;
+
+        bool ok = !failed && rows_written == h;
+        if (ok && format == FORMAT_PNG)
+            ok = png_end();
+        if (ok && format == FORMAT_TIFF)
+            ok = tiff_end();
+
+        ok = fclose(fp) == 0 && ok;
+        fp = 0;
+
+        if (!ok)
+            remove_file();
+        return ok;
+    }
+
+private:
+    // close and remove an unfinished file
+    void discard()
+    {
+        fclose(fp);
+        fp = 0;
+        failed = true;
+        remove_file();
+    }
+
+    void remove_file()
+    {
+#if _WIN32
+        _wremove(path.c_str());
+#else
+        remove(path.c_str());
+#endif
+    }
+
+    bool put_bytes(const void* data, size_t size)
+    {
+        return fwrite(data, 1, size, fp) == size;
+    }
+
+    bool put_u16le(uint16_t v)
+    {
+        unsigned char b[2] = {(unsigned char)v, (unsigned char)(v >> 8)};
+        return put_bytes(b, 2);
+    }
+
+    bool put_u32le(uint32_t v)
+    {
+        unsigned char b[4] = {(unsigned char)v, (unsigned char)(v >> 8), (unsigned char)(v >> 16), (unsigned char)(v >> 24)};
+        return put_bytes(b, 4);
+    }
+
+    // png
+#if STREAM_WRITER_PNG
+    static void be32(unsigned char* p, uint32_t v)
+    {
+        p[0] = (unsigned char)(v >> 24);
+        p[1] = (unsigned char)(v >> 16);
+        p[2] = (unsigned char)(v >> 8);
+        p[3] = (unsigned char)v;
+    }
+
+    bool png_chunk(const char* type, const unsigned char* data, uint32_t size)
+    {
+        unsigned char head[8];
+        be32(head, size);
+        memcpy(head + 4, type, 4);
+
+        uLong crc = crc32(0L, head + 4, 4);
+        if (size)
+            crc = crc32(crc, data, size);
+
+        unsigned char tail[4];
+        be32(tail, (uint32_t)crc);
+
+        return put_bytes(head, 8) && (size == 0 || put_bytes(data, size)) && put_bytes(tail, 4);
+    }
+
+    bool png_begin()
+    {
+        static const unsigned char signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+
+        unsigned char ihdr[13];
+        be32(ihdr, (uint32_t)w);
+        be32(ihdr + 4, (uint32_t)h);
+        ihdr[8] = 8;
+        ihdr[9] = c == 1 ? 0 : c == 3 ? 2 : 6;
+        ihdr[10] = 0;
+        ihdr[11] = 0;
+        ihdr[12] = 0;
+
+        memset(&zs, 0, sizeof(zs));
+        // fast level, same tradeoff as the opencv png default
+        if (deflateInit(&zs, 1) != Z_OK)
+            return false;
+
+        prev_row.assign((size_t)w * c, 0);
+        filtered.resize((size_t)w * c + 1);
+        zbuf.resize(256 * 1024);
+
+        return put_bytes(signature, 8) && png_chunk("IHDR", ihdr, 13);
+    }
+
+    bool png_deflate(const unsigned char* data, size_t size, int flush)
+    {
+        zs.next_in = (Bytef*)data;
+        zs.avail_in = (uInt)size;
+        do
+        {
+            zs.next_out = zbuf.data();
+            zs.avail_out = (uInt)zbuf.size();
+
+            int ret = deflate(&zs, flush);
+            if (ret == Z_STREAM_ERROR)
+                return false;
+
+            uint32_t have = (uint32_t)(zbuf.size() - zs.avail_out);
+            if (have && !png_chunk("IDAT", zbuf.data(), have))
+                return false;
+
+            if (flush == Z_FINISH && ret == Z_STREAM_END)
+                break;
+        } while (zs.avail_out == 0 || (flush == Z_FINISH));
+
+        return true;
+    }
+
+    static int paeth(int a, int b, int c)
+    {
+        int p = a + b - c;
+        int pa = abs(p - a);
+        int pb = abs(p - b);
+        int pc = abs(p - c);
+        if (pa <= pb && pa <= pc)
+            return a;
+        return pb <= pc ? b : c;
+    }
+
+    // pick the filter with the smallest sum of absolute residuals, the usual libpng heuristic
+    bool png_row(const unsigned char* src)
+    {
+        const int n = w * c;
+        const unsigned char* up = prev_row.data();
+
+        candidate.resize((size_t)n);
+        unsigned long best_sum = ~0ul;
+        for (int f = 0; f < 5; f++)
+        {
+            unsigned long sum = 0;
+            for (int i = 0; i < n; i++)
+            {
+                const int a = i >= c ? src[i - c] : 0;
+                const int b = up[i];
+                const int d = i >= c ? up[i - c] : 0;
+
+                int pred = 0;
+                if (f == 1)
+                    pred = a;
+                if (f == 2)
+                    pred = b;
+                if (f == 3)
+                    pred = (a + b) >> 1;
+                if (f == 4)
+                    pred = paeth(a, b, d);
+
+                const unsigned char v = (unsigned char)(src[i] - pred);
+                candidate[i] = v;
+                sum += v < 128 ? v : 256 - v;
+            }
+
+            if (sum < best_sum)
+            {
+                best_sum = sum;
+                filtered[0] = (unsigned char)f;
+                memcpy(filtered.data() + 1, candidate.data(), n);
+            }
+        }
+
+        memcpy(prev_row.data(), src, n);
+
+        return png_deflate(filtered.data(), filtered.size(), Z_NO_FLUSH);
+    }
+
+    bool png_end()
+    {
+        return png_deflate(0, 0, Z_FINISH) && png_chunk("IEND", 0, 0);
+    }
+
+    z_stream zs;
+    std::vector<unsigned char> prev_row;
+    std::vector<unsigned char> filtered;
+    std::vector<unsigned char> candidate;
+    std::vector<unsigned char> zbuf;
+#else
+    bool png_begin()
+    {
+        return false;
+    }
+
+    bool png_row(const unsigned char*)
+    {
+        return false;
+    }
+
+    bool png_end()
+    {
+        return false;
+    }
+#endif
+
+    // tiff, little endian, uncompressed, the ifd goes after the pixel data
+    enum { TIFF_ROWS_PER_STRIP = 64 };
+
+    bool tiff_begin()
+    {
+        const uint64_t data_size = (uint64_t)w * h * c;
+        if (data_size > 0xF0000000u)
+            return false;
+
+        // header, ifd offset is patched in tiff_end
+        static const unsigned char header[4] = {'I', 'I', 42, 0};
+        return put_bytes(header, 4) && put_u32le(0);
+    }
+
+    bool tiff_row(const unsigned char* src)
+    {
+        return put_bytes(src, (size_t)w * c);
+    }
+
+    bool tiff_entry(uint16_t tag, uint16_t type, uint32_t count, uint32_t value)
+    {
+        return put_u16le(tag) && put_u16le(type) && put_u32le(count) && put_u32le(value);
+    }
+
+    bool tiff_end()
+    {
+        const uint32_t data_offset = 8;
+        const uint32_t row_bytes = (uint32_t)w * c;
+        const uint32_t strips = (h + TIFF_ROWS_PER_STRIP - 1) / TIFF_ROWS_PER_STRIP;
+
+        uint32_t pos = data_offset + row_bytes * h;
+        if (pos & 1)
+        {
+            // word alignment for the ifd
+            unsigned char pad = 0;
+            if (!put_bytes(&pad, 1))
+                return false;
+            pos++;
+        }
+
+        // extra data first: bits per sample, strip offsets, strip byte counts
+        const uint32_t bits_offset = pos;
+        for (int i = 0; i < c; i++)
+        {
+            if (!put_u16le(8))
+                return false;
+        }
+        pos += c * 2;
+
+        const uint32_t offsets_offset = pos;
+        for (uint32_t i = 0; i < strips; i++)
+        {
+            if (!put_u32le(data_offset + i * TIFF_ROWS_PER_STRIP * row_bytes))
+                return false;
+        }
+        pos += strips * 4;
+
+        const uint32_t counts_offset = pos;
+        for (uint32_t i = 0; i < strips; i++)
+        {
+            const uint32_t strip_rows = std::min((uint32_t)TIFF_ROWS_PER_STRIP, (uint32_t)h - i * TIFF_ROWS_PER_STRIP);
+            if (!put_u32le(strip_rows * row_bytes))
+                return false;
+        }
+        pos += strips * 4;
+
+        const uint32_t ifd_offset = pos;
+        const uint16_t entries = c == 4 ? 11 : 10;
+
+        // TIFF types: 3 = SHORT, 4 = LONG
+        bool ok = put_u16le(entries)
+                  && tiff_entry(256, 4, 1, (uint32_t)w)
+                  && tiff_entry(257, 4, 1, (uint32_t)h)
+                  && tiff_entry(258, 3, c, c <= 2 ? 8 : bits_offset)
+                  && tiff_entry(259, 3, 1, 1)
+                  && tiff_entry(262, 3, 1, c == 1 ? 1 : 2)
+                  && tiff_entry(273, 4, strips, strips == 1 ? data_offset : offsets_offset)
+                  && tiff_entry(277, 3, 1, (uint32_t)c)
+                  && tiff_entry(278, 4, 1, TIFF_ROWS_PER_STRIP)
+                  && tiff_entry(279, 4, strips, strips == 1 ? row_bytes * h : counts_offset)
+                  && tiff_entry(284, 3, 1, 1);
+        if (ok && c == 4)
+            ok = tiff_entry(338, 3, 1, 2); // unassociated alpha
+        ok = ok && put_u32le(0);
+
+        // point the header at the ifd
+        ok = ok && fseek(fp, 4, SEEK_SET) == 0 && put_u32le(ifd_offset);
+
+        return ok;
+    }
+
+    // bmp, top-down rows padded to 4 bytes, gray gets a palette
+    bool bmp_begin()
+    {
+        const uint32_t row_bytes = ((uint32_t)w * c + 3) & ~3u;
+        const uint32_t palette_size = c == 1 ? 256 * 4 : 0;
+        const uint32_t header_size = 14 + 40 + palette_size;
+        const uint64_t file_size = (uint64_t)header_size + (uint64_t)row_bytes * h;
+        if (file_size > 0xFFFFFFFFu)
+            return false;
+
+        bool ok = put_bytes("BM", 2)
+                  && put_u32le((uint32_t)file_size)
+                  && put_u32le(0)
+                  && put_u32le(header_size)
+                  && put_u32le(40)
+                  && put_u32le((uint32_t)w)
+                  && put_u32le((uint32_t)-h)
+                  && put_u16le(1)
+                  && put_u16le((uint16_t)(c * 8))
+                  && put_u32le(0)
+                  && put_u32le((uint32_t)((uint64_t)row_bytes * h))
+                  && put_u32le(2835)
+                  && put_u32le(2835)
+                  && put_u32le(c == 1 ? 256 : 0)
+                  && put_u32le(0);
+
+        for (int i = 0; ok && i < (c == 1 ? 256 : 0); i++)
+        {
+            unsigned char entry[4] = {(unsigned char)i, (unsigned char)i, (unsigned char)i, 0};
+            ok = put_bytes(entry, 4);
+        }
+
+        return ok;
+    }
+
+    bool bmp_row(const unsigned char* src)
+    {
+        static const unsigned char pad[3] = {0, 0, 0};
+        const size_t n = (size_t)w * c;
+        const size_t padding = ((n + 3) & ~(size_t)3) - n;
+        return put_bytes(src, n) && (padding == 0 || put_bytes(pad, padding));
+    }
+
+    enum Format
+    {
+        FORMAT_NONE,
+        FORMAT_PNG,
+        FORMAT_TIFF,
+        FORMAT_BMP
+    };
+
+    FILE* fp;
+    path_t path;
+    Format format;
+    int w;
+    int h;
+    int c;
+    bool bgr;
+    int rows_written;
+    bool failed;
+    std::vector<unsigned char> row;
+};
+
+#endif // STREAM_WRITER_H
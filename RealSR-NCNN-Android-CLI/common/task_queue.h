@@ -0,0 +1,270 @@
+#ifndef TASK_QUEUE_H
+#define TASK_QUEUE_H
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <stddef.h>
+#include <stdint.h>
+
+// Bounded multi-producer multi-consumer ring queue for the load -> proc -> save pipeline.
+//
+// Slots are claimed with a per-cell sequence number, so producers and consumers never take a lock.
+// Items are moved in and out and the slot is reset right after get(), so nothing stays referenced
+// by the ring. put() blocks while the ring is full or while the bytes held by queued items would
+// exceed max_bytes (a single oversized item is still admitted into an empty queue).
+// A waiting thread yields a few times and then sleeps on a condition variable, put(), get() and
+// close() only take its mutex to wake someone while a thread sleeps there.
+// close() replaces the old id == -233 sentinel: put() fails afterwards, get() drains what is left
+// and then returns false.
+template <class T>
+class TaskQueue
+{
+public:
+    explicit TaskQueue(size_t depth = 8, size_t max_bytes = 0)
+    {
+        configure(depth, max_bytes);
+    }
+
+    // not thread safe, call before any thread touches the queue
+    void configure(size_t depth, size_t max_bytes)
+    {
+        size_t capacity = 2;
+        while (capacity < depth)
+            capacity <<= 1;
+
+        cells.reset(new Cell[capacity]);
+        for (size_t i = 0; i < capacity; i++)
+        {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+            cells[i].bytes = 0;
+        }
+
+        mask = capacity - 1;
+        limit_bytes = max_bytes;
+        enqueue_pos.store(0, std::memory_order_relaxed);
+        dequeue_pos.store(0, std::memory_order_relaxed);
+        queued_bytes.store(0, std::memory_order_relaxed);
+        sleepers.store(0, std::memory_order_relaxed);
+        is_closed.store(false, std::memory_order_release);
+    }
+
+    bool put(T&& v, size_t bytes = 0)
+    {
+        int spins = 0;
+
+        // reserve bytes first so concurrent producers can not overshoot the limit together
+        size_t cur = queued_bytes.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            if (is_closed.load(std::memory_order_acquire))
+                return false;
+
+            if (limit_bytes && cur != 0 && cur + bytes > limit_bytes)
+            {
+                wait(spins, [&] {
+                    const size_t now = queued_bytes.load(std::memory_order_relaxed);
+                    return is_closed.load(std::memory_order_acquire) || now == 0 || now + bytes <= limit_bytes;
+                });
+                cur = queued_bytes.load(std::memory_order_relaxed);
+                continue;
+            }
+
+            if (queued_bytes.compare_exchange_weak(cur, cur + bytes, std::memory_order_acq_rel, std::memory_order_relaxed))
+                break;
+        }
+
+        spins = 0;
+        while (!try_put(v, bytes))
+        {
+            if (is_closed.load(std::memory_order_acquire))
+            {
+                queued_bytes.fetch_sub(bytes, std::memory_order_acq_rel);
+                wake();
+                return false;
+            }
+
+            wait(spins, [&] {
+                return is_closed.load(std::memory_order_acquire) || can_put();
+            });
+        }
+
+        wake();
+        return true;
+    }
+
+    bool get(T& v)
+    {
+        int spins = 0;
+        while (!try_get(v))
+        {
+            // recheck after observing close, a producer may have finished right before it
+            if (is_closed.load(std::memory_order_acquire))
+            {
+                if (!try_get(v))
+                    return false;
+                break;
+            }
+
+            wait(spins, [&] {
+                return is_closed.load(std::memory_order_acquire) || can_get();
+            });
+        }
+
+        wake();
+        return true;
+    }
+
+    void close()
+    {
+        is_closed.store(true, std::memory_order_release);
+        wake();
+    }
+
+    size_t size() const
+    {
+        return enqueue_pos.load(std::memory_order_relaxed) - dequeue_pos.load(std::memory_order_relaxed);
+    }
+
+    size_t bytes() const
+    {
+        return queued_bytes.load(std::memory_order_relaxed);
+    }
+
+private:
+    bool try_put(T& v, size_t bytes)
+    {
+        Cell* cell;
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)pos;
+            if (dif == 0)
+            {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+            {
+                // full
+                return false;
+            }
+            else
+            {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->data = std::move(v);
+        cell->bytes = bytes;
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        return true;
+    }
+
+    bool try_get(T& v)
+    {
+        Cell* cell;
+        size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        for (;;)
+        {
+            cell = &cells[pos & mask];
+            size_t seq = cell->sequence.load(std::memory_order_acquire);
+            intptr_t dif = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (dif == 0)
+            {
+                if (dequeue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if (dif < 0)
+            {
+                // empty
+                return false;
+            }
+            else
+            {
+                pos = dequeue_pos.load(std::memory_order_relaxed);
+            }
+        }
+
+        v = std::move(cell->data);
+        cell->data = T();
+        const size_t bytes = cell->bytes;
+        cell->sequence.store(pos + mask + 1, std::memory_order_release);
+
+        queued_bytes.fetch_sub(bytes, std::memory_order_acq_rel);
+
+        return true;
+    }
+
+    // the cell at the enqueue position is free
+    bool can_put() const
+    {
+        const size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos;
+    }
+
+    // the cell at the dequeue position holds an item
+    bool can_get() const
+    {
+        const size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+        return cells[pos & mask].sequence.load(std::memory_order_acquire) == pos + 1;
+    }
+
+    // yield a few times, then sleep until ready() holds, stages may wait seconds for a gpu job
+    template <class Pred>
+    void wait(int& spins, Pred ready)
+    {
+        if (spins < 64)
+        {
+            spins++;
+            std::this_thread::yield();
+            return;
+        }
+
+        std::unique_lock<std::mutex> guard(sleep_lock);
+        sleepers.fetch_add(1, std::memory_order_seq_cst);
+        // pairs with the fence in wake(), either ready() sees the change or wake() sees the sleeper
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        sleep_cond.wait(guard, ready);
+        sleepers.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    // after every change a sleeping thread may wait for
+    void wake()
+    {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (sleepers.load(std::memory_order_relaxed) == 0)
+            return;
+
+        std::lock_guard<std::mutex> guard(sleep_lock);
+        sleep_cond.notify_all();
+    }
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        size_t bytes;
+        T data;
+    };
+
+    std::unique_ptr<Cell[]> cells;
+    size_t mask;
+    size_t limit_bytes;
+
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+    alignas(64) std::atomic<size_t> queued_bytes;
+    std::atomic<bool> is_closed;
+
+    alignas(64) std::atomic<int> sleepers;
+    std::mutex sleep_lock;
+    std::condition_variable sleep_cond;
+};
+
+#endif // TASK_QUEUE_H
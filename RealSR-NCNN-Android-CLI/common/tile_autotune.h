@@ -0,0 +1,319 @@
+#ifndef TILE_AUTOTUNE_H
+#define TILE_AUTOTUNE_H
+
+// -t auto-bench, picks the tilesize by timing the loaded engine instead of trusting the heap_budget
+// ladder alone.
+//
+// The ladder result stays the memory ceiling. One synthetic image of ceiling x ceiling pixels is
+// upscaled with every candidate tilesize up to it, largest first, and the best pixels per second
+// wins. The result is kept in tilesize.cache next to the model files, one line per device, model
+// hash and scale, so later runs skip the timing. A cached value is still clamped to the ceiling of
+// the current run, which is lower when several proc jobs share a gpu heap.
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#if _WIN32
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+// ncnn
+#include "gpu.h"
+#include "mat.h"
+
+#include "bench_stats.h"
+#include "filesystem_utils.h"
+
+template<class CharT>
+static bool is_auto_bench_option(const CharT* arg)
+{
+    static const char name[] = "auto-bench";
+    int i = 0;
+    while (name[i] && arg[i] == (CharT)name[i])
+        i++;
+    return name[i] == 0 && arg[i] == 0;
+}
+
+static uint64_t fnv1a_update(uint64_t hash, const unsigned char* data, size_t size)
+{
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static FILE* tile_cache_fopen(const path_t& path, const char* mode)
+{
+#if _WIN32
+    std::wstring wmode(mode, mode + strlen(mode));
+    return _wfopen(path.c_str(), wmode.c_str());
+#else
+    return fopen(path.c_str(), mode);
+#endif
+}
+
+// the whole param file, the bin size and the first and last 64k of the bin. Cheap enough to run
+// before every job, and a converted or retrained model changes at least one of them
+static std::string model_file_hash(const path_t& parampath, const path_t& modelpath)
+{
+    uint64_t hash = 14695981039346656037ull;
+    std::vector<unsigned char> buf(65536);
+
+    FILE* fp = tile_cache_fopen(parampath, "rb");
+    if (fp)
+    {
+        size_t n;
+        while ((n = fread(buf.data(), 1, buf.size(), fp)) > 0)
+            hash = fnv1a_update(hash, buf.data(), n);
+        fclose(fp);
+    }
+
+    fp = tile_cache_fopen(modelpath, "rb");
+    if (fp)
+    {
+        fseek(fp, 0, SEEK_END);
+        long size = ftell(fp);
+        hash = fnv1a_update(hash, (const unsigned char*)&size, sizeof(size));
+
+        rewind(fp);
+        size_t n = fread(buf.data(), 1, buf.size(), fp);
+        hash = fnv1a_update(hash, buf.data(), n);
+
+        if (size > (long)buf.size() * 2)
+        {
+            fseek(fp, -(long)buf.size(), SEEK_END);
+            n = fread(buf.data(), 1, buf.size(), fp);
+            hash = fnv1a_update(hash, buf.data(), n);
+        }
+        fclose(fp);
+    }
+
+    char text[17];
+    sprintf(text, "%016llx", (unsigned long long)hash);
+    return text;
+}
+
+// cpu throughput depends on the thread count, so it is part of the device name
+static std::string tile_device_name(int gpuid, int num_threads)
+{
+    if (gpuid == -1)
+    {
+        char name[32];
+        sprintf(name, "cpu-%dt", num_threads);
+        return name;
+    }
+
+    std::string name = ncnn::get_gpu_info(gpuid).device_name();
+    for (size_t i = 0; i < name.size(); i++)
+    {
+        if (name[i] == '\t' || name[i] == '\n' || name[i] == '\r')
+            name[i] = ' ';
+    }
+    return name;
+}
+
+static path_t tile_cache_path(const path_t& parampath)
+{
+    size_t sep = parampath.find_last_of(PATHSTR("/\\"));
+    if (sep == path_t::npos)
+        return PATHSTR("tilesize.cache");
+    return parampath.substr(0, sep + 1) + PATHSTR("tilesize.cache");
+}
+
+// lines of "device\tmodel hash\tscale\ttilesize"
+struct TileCacheEntry
+{
+    std::string device;
+    std::string hash;
+    int scale;
+    int tilesize;
+};
+
+static std::vector<TileCacheEntry> read_tile_cache(const path_t& path)
+{
+    std::vector<TileCacheEntry> entries;
+
+    FILE* fp = tile_cache_fopen(path, "rb");
+    if (!fp)
+        return entries;
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        char* hash = strchr(line, '\t');
+        if (!hash)
+            continue;
+        *hash++ = 0;
+
+        char* rest = strchr(hash, '\t');
+        if (!rest)
+            continue;
+        *rest++ = 0;
+
+        TileCacheEntry e;
+        if (sscanf(rest, "%d\t%d", &e.scale, &e.tilesize) != 2 || e.tilesize < 32)
+            continue;
+        e.device = line;
+        e.hash = hash;
+        entries.push_back(e);
+    }
+
+    fclose(fp);
+    return entries;
+}
+
+// rewrite the file with the entry replaced, through a temporary file so a concurrent reader never
+// sees half of it
+static void write_tile_cache(const path_t& path, const TileCacheEntry& entry, int verbose)
+{
+    std::vector<TileCacheEntry> entries = read_tile_cache(path);
+
+    bool found = false;
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].device == entry.device && entries[i].hash == entry.hash && entries[i].scale == entry.scale)
+        {
+            entries[i].tilesize = entry.tilesize;
+            found = true;
+        }
+    }
+    if (!found)
+        entries.push_back(entry);
+
+    const path_t tmppath = path + PATHSTR(".tmp");
+    FILE* fp = tile_cache_fopen(tmppath, "wb");
+    if (!fp)
+    {
+        if (verbose)
+            fprintf(stderr, "tilesize cache is not writable, the next run benchmarks again\n");
+        return;
+    }
+
+    for (size_t i = 0; i < entries.size(); i++)
+        fprintf(fp, "%s\t%s\t%d\t%d\n", entries[i].device.c_str(), entries[i].hash.c_str(), entries[i].scale, entries[i].tilesize);
+    fclose(fp);
+
+#if _WIN32
+    MoveFileExW(tmppath.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING);
+#else
+    rename(tmppath.c_str(), path.c_str());
+#endif
+}
+
+// time the candidates on engine, which is left with the winner as its tilesize.
+// Engine needs the tilesize and scale members and process(const ncnn::Mat&, ncnn::Mat&)
+template<class Engine>
+static int benchmark_tilesize(Engine* engine, int ceiling, int verbose)
+{
+    static const int candidates[] = {400, 300, 256, 200, 160, 128, 100, 64, 32};
+
+    // noise, so no engine can shortcut a flat image
+    ncnn::Mat inimage(ceiling, ceiling, (size_t)3, 3);
+    {
+        unsigned int seed = 0x5eed;
+        unsigned char* p = (unsigned char*)inimage.data;
+        for (int i = 0; i < ceiling * ceiling * 3; i++)
+        {
+            seed = seed * 1664525 + 1013904223;
+            p[i] = (unsigned char)(seed >> 24);
+        }
+    }
+    ncnn::Mat outimage(ceiling * engine->scale, ceiling * engine->scale, (size_t)3, 3);
+
+    // first run builds the pipelines and allocators, it is not timed
+    engine->tilesize = ceiling;
+    engine->process(inimage, outimage);
+
+    int best = 0;
+    double best_rate = 0;
+    for (size_t i = 0; i < sizeof(candidates) / sizeof(candidates[0]); i++)
+    {
+        const int t = candidates[i];
+        // tiles below a quarter of the ceiling spend most of their time on padding
+        if (t > ceiling || t * 4 < ceiling)
+            continue;
+
+        engine->tilesize = t;
+
+        // short runs are repeated and the fastest counts, long ones are stable enough
+        double seconds = 0;
+        int ret = 0;
+        for (int run = 0; run < 3 && ret == 0; run++)
+        {
+            const double begin = bench_now();
+            ret = engine->process(inimage, outimage);
+            const double elapsed = bench_now() - begin;
+            seconds = run == 0 ? elapsed : std::min(seconds, elapsed);
+            if (elapsed > 0.5)
+                break;
+        }
+        if (ret != 0 || seconds <= 0)
+            continue;
+
+        const double rate = ceiling * (double)ceiling / seconds;
+        if (verbose)
+            fprintf(stderr, "auto-bench tilesize %d: %.3lfs, %.2lf Mpix/s\n", t, seconds, rate / 1e6);
+
+        if (rate > best_rate)
+        {
+            best = t;
+            best_rate = rate;
+        }
+        else if (rate < best_rate * 0.75)
+        {
+            // smaller tiles only add more padding from here on
+            break;
+        }
+    }
+
+    if (best == 0)
+        best = ceiling;
+
+    engine->tilesize = best;
+    return best;
+}
+
+// tilesize for -t auto-bench, from the cache or by benchmarking engine. ceiling is the heap_budget
+// tilesize of the device, num_threads the cpu threads of the engine
+template<class Engine>
+static int autotune_tilesize(Engine* engine, int gpuid, int num_threads, const path_t& parampath, const path_t& modelpath,
+                             int scale, int ceiling, int verbose)
+{
+    TileCacheEntry entry;
+    entry.device = tile_device_name(gpuid, num_threads);
+    entry.hash = model_file_hash(parampath, modelpath);
+    entry.scale = scale;
+    entry.tilesize = 0;
+
+    const path_t cachepath = tile_cache_path(parampath);
+
+    std::vector<TileCacheEntry> entries = read_tile_cache(cachepath);
+    for (size_t i = 0; i < entries.size(); i++)
+    {
+        if (entries[i].device == entry.device && entries[i].hash == entry.hash && entries[i].scale == entry.scale)
+        {
+            engine->tilesize = std::min(entries[i].tilesize, ceiling);
+            if (verbose)
+                fprintf(stderr, "auto-bench tilesize %d from cache (%s)\n", engine->tilesize, entry.device.c_str());
+            return engine->tilesize;
+        }
+    }
+
+    fprintf(stderr, "auto-bench: timing tilesizes up to %d on %s\n", ceiling, entry.device.c_str());
+
+    entry.tilesize = benchmark_tilesize(engine, ceiling, verbose);
+    write_tile_cache(cachepath, entry, verbose);
+
+    fprintf(stderr, "auto-bench tilesize %d\n", entry.tilesize);
+    return entry.tilesize;
+}
+
+#endif // TILE_AUTOTUNE_H
@@ -0,0 +1,188 @@
+#ifndef TILE_DEDUP_H
+#define TILE_DEDUP_H
+
+// -D, output tiles of byte identical input tiles are reused.
+//
+// The key is a 128 bit hash over the padded input tile the model sees, mixed with the tile size
+// and how much of the padding is cut off at the image border. Output tiles are kept in one cache
+// per run, shared by every engine and image, and the least recently used ones are dropped above
+// the byte limit. Only engines of the same model, noise and scale may share a cache.
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct TileKey
+{
+    uint64_t lo;
+    uint64_t hi;
+
+    bool operator==(const TileKey& other) const
+    {
+        return lo == other.lo && hi == other.hi;
+    }
+};
+
+struct TileKeyHash
+{
+    size_t operator()(const TileKey& key) const
+    {
+        return (size_t)(key.lo ^ (key.hi * 0x9e3779b97f4a7c15ull));
+    }
+};
+
+static inline uint64_t tile_hash_rotl(uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+// two independent 64 bit lanes over 8 byte words, the tail is zero padded
+static void tile_hash_update(TileKey& key, const unsigned char* data, size_t size)
+{
+    uint64_t a = key.lo;
+    uint64_t b = key.hi;
+
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        a = tile_hash_rotl((a ^ word) * 0x87c37b91114253d5ull, 31);
+        b = (b + word) * 0x4cf5ad432745937full;
+        b ^= b >> 29;
+    }
+    if (i < size)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        a = tile_hash_rotl((a ^ word) * 0x87c37b91114253d5ull, 31);
+        b = (b + word) * 0x4cf5ad432745937full;
+        b ^= b >> 29;
+    }
+
+    key.lo = a;
+    key.hi = b;
+}
+
+// x0..x1, y0..y1 is the tile without padding
+static TileKey hash_tile(const unsigned char* pixels, int w, int h, int channels, int x0, int y0, int x1, int y1, int prepadding)
+{
+    const int px0 = std::max(x0 - prepadding, 0);
+    const int py0 = std::max(y0 - prepadding, 0);
+    const int px1 = std::min(x1 + prepadding, w);
+    const int py1 = std::min(y1 + prepadding, h);
+
+    TileKey key;
+    key.lo = 0x243f6a8885a308d3ull;
+    key.hi = 0x13198a2e03707344ull;
+
+    const int geometry[6] = {x1 - x0, y1 - y0, x0 - px0, y0 - py0, px1 - x1, py1 - y1};
+    tile_hash_update(key, (const unsigned char*)geometry, sizeof(geometry));
+
+    for (int y = py0; y < py1; y++)
+    {
+        tile_hash_update(key, pixels + ((size_t)y * w + px0) * channels, (size_t)(px1 - px0) * channels);
+    }
+
+    return key;
+}
+
+class TileDedupCache
+{
+public:
+    typedef std::shared_ptr<const std::vector<unsigned char> > Tile;
+
+    explicit TileDedupCache(size_t _limit) : limit(_limit), bytes(0), hits(0), misses(0)
+    {
+    }
+
+    // the cached output tile or null, counts as a hit or miss
+    Tile get(const TileKey& key)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+
+        Index::iterator it = index.find(key);
+        if (it == index.end())
+        {
+            misses++;
+            return Tile();
+        }
+
+        entries.splice(entries.begin(), entries, it->second);
+        hits++;
+        return it->second->tile;
+    }
+
+    // a tile copied from an identical one computed alongside it
+    void add_hit()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        hits++;
+    }
+
+    // nrows rows of row_bytes, stride apart
+    void put(const TileKey& key, const unsigned char* rows, size_t row_bytes, size_t stride, int nrows)
+    {
+        const size_t size = row_bytes * nrows;
+        if (size > limit)
+            return;
+
+        std::shared_ptr<std::vector<unsigned char> > tile = std::make_shared<std::vector<unsigned char> >(size);
+        for (int y = 0; y < nrows; y++)
+        {
+            memcpy(tile->data() + y * row_bytes, rows + y * stride, row_bytes);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        if (index.find(key) != index.end())
+            return;
+
+        Entry entry;
+        entry.key = key;
+        entry.tile = tile;
+        entries.push_front(entry);
+        index[key] = entries.begin();
+        bytes += size;
+
+        while (bytes > limit)
+        {
+            bytes -= entries.back().tile->size();
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    void print_stats()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        const long long lookups = hits + misses;
+        fprintf(stderr, "tile cache: %lld hits of %lld tiles (%.1f%%), %d tiles / %.1f MB kept\n", hits, lookups,
+                lookups ? hits * 100.0 / lookups : 0.0, (int)entries.size(), bytes / 1048576.0);
+    }
+
+private:
+    struct Entry
+    {
+        TileKey key;
+        Tile tile;
+    };
+
+    typedef std::unordered_map<TileKey, std::list<Entry>::iterator, TileKeyHash> Index;
+
+    std::mutex lock;
+    std::list<Entry> entries;
+    Index index;
+    size_t limit;
+    size_t bytes;
+    long long hits;
+    long long misses;
+};
+
+#endif // TILE_DEDUP_H
@@ -0,0 +1,416 @@
+#ifndef TILE_KERNELS_H
+#define TILE_KERNELS_H
+
+// Vectorized cpu pre/post-processing for the ncnn upscalers.
+//
+// The cpu tile path spends a visible share of time outside the network with small models:
+// scaling pixels to and from [0,1], building the 8 tta directions and averaging them back.
+// NEON is used on arm, SSE2 on x86 with an AVX path for the element-wise loops picked at runtime.
+// Every kernel keeps the operation order of the scalar loop it replaces, additions are not
+// reassociated and the multiply and add of the denormalization stay separate instructions.
+
+#include <stdint.h>
+#include <string.h>
+
+// ncnn
+#include "mat.h"
+#include "cpu.h"
+
+#if __ARM_NEON
+#include <arm_neon.h>
+#define TILE_KERNELS_V4 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#include <immintrin.h>
+#define TILE_KERNELS_V4 1
+#define TILE_KERNELS_X86 1
+#endif
+
+#if TILE_KERNELS_X86
+#if defined(_MSC_VER) && !defined(__clang__)
+#define TILE_KERNELS_TARGET_AVX
+#else
+#define TILE_KERNELS_TARGET_AVX __attribute__((target("avx")))
+#endif
+#endif
+
+#if TILE_KERNELS_V4
+#if __ARM_NEON
+typedef float32x4_t tk_v4;
+
+static inline tk_v4 tk_load(const float* p)
+{
+    return vld1q_f32(p);
+}
+
+static inline void tk_store(float* p, tk_v4 v)
+{
+    vst1q_f32(p, v);
+}
+
+static inline tk_v4 tk_set1(float v)
+{
+    return vdupq_n_f32(v);
+}
+
+static inline tk_v4 tk_add(tk_v4 a, tk_v4 b)
+{
+    return vaddq_f32(a, b);
+}
+
+static inline tk_v4 tk_mul(tk_v4 a, tk_v4 b)
+{
+    return vmulq_f32(a, b);
+}
+
+static inline tk_v4 tk_reverse(tk_v4 v)
+{
+    v = vrev64q_f32(v);
+    return vcombine_f32(vget_high_f32(v), vget_low_f32(v));
+}
+
+static inline void tk_transpose(tk_v4& r0, tk_v4& r1, tk_v4& r2, tk_v4& r3)
+{
+    float32x4x2_t t01 = vtrnq_f32(r0, r1);
+    float32x4x2_t t23 = vtrnq_f32(r2, r3);
+    r0 = vcombine_f32(vget_low_f32(t01.val[0]), vget_low_f32(t23.val[0]));
+    r1 = vcombine_f32(vget_low_f32(t01.val[1]), vget_low_f32(t23.val[1]));
+    r2 = vcombine_f32(vget_high_f32(t01.val[0]), vget_high_f32(t23.val[0]));
+    r3 = vcombine_f32(vget_high_f32(t01.val[1]), vget_high_f32(t23.val[1]));
+}
+#else
+typedef __m128 tk_v4;
+
+static inline tk_v4 tk_load(const float* p)
+{
+    return _mm_loadu_ps(p);
+}
+
+static inline void tk_store(float* p, tk_v4 v)
+{
+    _mm_storeu_ps(p, v);
+}
+
+static inline tk_v4 tk_set1(float v)
+{
+    return _mm_set1_ps(v);
+}
+
+static inline tk_v4 tk_add(tk_v4 a, tk_v4 b)
+{
+    return _mm_add_ps(a, b);
+}
+
+static inline tk_v4 tk_mul(tk_v4 a, tk_v4 b)
+{
+    return _mm_mul_ps(a, b);
+}
+
+static inline tk_v4 tk_reverse(tk_v4 v)
+{
+    return _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 1, 2, 3));
+}
+
+static inline void tk_transpose(tk_v4& r0, tk_v4& r1, tk_v4& r2, tk_v4& r3)
+{
+    _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+}
+#endif
+#endif // TILE_KERNELS_V4
+
+#if TILE_KERNELS_X86
+static bool tk_cpu_support_avx()
+{
+    static const bool avx = ncnn::cpu_support_x86_avx() != 0;
+    return avx;
+}
+
+TILE_KERNELS_TARGET_AVX static int tile_scale_bias_avx(const float* ptr, float* outptr, int size, float a, float b)
+{
+    const __m256 _a = _mm256_set1_ps(a);
+    const __m256 _b = _mm256_set1_ps(b);
+
+    int i = 0;
+    for (; i + 7 < size; i += 8)
+    {
+        __m256 _p = _mm256_loadu_ps(ptr + i);
+        _mm256_storeu_ps(outptr + i, _mm256_add_ps(_mm256_mul_ps(_p, _a), _b));
+    }
+
+    return i;
+}
+
+TILE_KERNELS_TARGET_AVX static int tile_scale_avx(const float* ptr, float* outptr, int size, float a)
+{
+    const __m256 _a = _mm256_set1_ps(a);
+
+    int i = 0;
+    for (; i + 7 < size; i += 8)
+    {
+        _mm256_storeu_ps(outptr + i, _mm256_mul_ps(_mm256_loadu_ps(ptr + i), _a));
+    }
+
+    return i;
+}
+#endif // TILE_KERNELS_X86
+
+// outptr[i] = ptr[i] * a, the 1/255 normalization
+static void tile_scale(const float* ptr, float* outptr, int size, float a)
+{
+    int i = 0;
+#if TILE_KERNELS_X86
+    if (tk_cpu_support_avx())
+        i = tile_scale_avx(ptr, outptr, size, a);
+#endif
+#if TILE_KERNELS_V4
+    const tk_v4 _a = tk_set1(a);
+    for (; i + 3 < size; i += 4)
+    {
+        tk_store(outptr + i, tk_mul(tk_load(ptr + i), _a));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        outptr[i] = ptr[i] * a;
+    }
+}
+
+// outptr[i] = ptr[i] * a + b, the *255 + 0.5 denormalization
+static void tile_scale_bias(const float* ptr, float* outptr, int size, float a, float b)
+{
+    int i = 0;
+#if TILE_KERNELS_X86
+    if (tk_cpu_support_avx())
+        i = tile_scale_bias_avx(ptr, outptr, size, a, b);
+#endif
+#if TILE_KERNELS_V4
+    const tk_v4 _a = tk_set1(a);
+    const tk_v4 _b = tk_set1(b);
+    for (; i + 3 < size; i += 4)
+    {
+        tk_store(outptr + i, tk_add(tk_mul(tk_load(ptr + i), _a), _b));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        const float v = ptr[i] * a;
+        outptr[i] = v + b;
+    }
+}
+
+// outptr[size - 1 - i] = ptr[i]
+static void tile_reverse_copy(const float* ptr, float* outptr, int size)
+{
+    int i = 0;
+#if TILE_KERNELS_V4
+    for (; i + 3 < size; i += 4)
+    {
+        tk_store(outptr + size - 4 - i, tk_reverse(tk_load(ptr + i)));
+    }
+#endif
+    for (; i < size; i++)
+    {
+        outptr[size - 1 - i] = ptr[i];
+    }
+}
+
+// tta, fill in_tile[1..7] with the flipped and transposed copies of the first 3 channels of in_tile[0].
+// The transposes run on 4x4 blocks so both the reads and the writes stay on a few cache lines.
+static void tta_expand_8(ncnn::Mat in_tile[8])
+{
+    const int w = in_tile[0].w;
+    const int h = in_tile[0].h;
+
+    in_tile[1].create(w, h, 3);
+    in_tile[2].create(w, h, 3);
+    in_tile[3].create(w, h, 3);
+    in_tile[4].create(h, w, 3);
+    in_tile[5].create(h, w, 3);
+    in_tile[6].create(h, w, 3);
+    in_tile[7].create(h, w, 3);
+
+    for (int q = 0; q < 3; q++)
+    {
+        const ncnn::Mat in_tile_0 = in_tile[0].channel(q);
+        ncnn::Mat in_tile_1 = in_tile[1].channel(q);
+        ncnn::Mat in_tile_2 = in_tile[2].channel(q);
+        ncnn::Mat in_tile_3 = in_tile[3].channel(q);
+        ncnn::Mat in_tile_4 = in_tile[4].channel(q);
+        ncnn::Mat in_tile_5 = in_tile[5].channel(q);
+        ncnn::Mat in_tile_6 = in_tile[6].channel(q);
+        ncnn::Mat in_tile_7 = in_tile[7].channel(q);
+
+        // flips
+        for (int i = 0; i < h; i++)
+        {
+            const float* ptr = in_tile_0.row(i);
+
+            memcpy(in_tile_1.row(h - 1 - i), ptr, w * sizeof(float));
+            tile_reverse_copy(ptr, in_tile_2.row(i), w);
+            tile_reverse_copy(ptr, in_tile_3.row(h - 1 - i), w);
+        }
+
+        // transposes
+        int i = 0;
+#if TILE_KERNELS_V4
+        for (; i + 3 < h; i += 4)
+        {
+            const float* ptr0 = in_tile_0.row(i);
+            const float* ptr1 = in_tile_0.row(i + 1);
+            const float* ptr2 = in_tile_0.row(i + 2);
+            const float* ptr3 = in_tile_0.row(i + 3);
+
+            int j = 0;
+            for (; j + 3 < w; j += 4)
+            {
+                tk_v4 _r[4];
+                _r[0] = tk_load(ptr0 + j);
+                _r[1] = tk_load(ptr1 + j);
+                _r[2] = tk_load(ptr2 + j);
+                _r[3] = tk_load(ptr3 + j);
+                tk_transpose(_r[0], _r[1], _r[2], _r[3]);
+
+                for (int k = 0; k < 4; k++)
+                {
+                    const tk_v4 _rr = tk_reverse(_r[k]);
+                    tk_store(in_tile_4.row(j + k) + i, _r[k]);
+                    tk_store(in_tile_5.row(w - 1 - j - k) + i, _r[k]);
+                    tk_store(in_tile_6.row(j + k) + h - 4 - i, _rr);
+                    tk_store(in_tile_7.row(w - 1 - j - k) + h - 4 - i, _rr);
+                }
+            }
+            for (; j < w; j++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    const float v = in_tile_0.row(i + k)[j];
+                    in_tile_4.row(j)[i + k] = v;
+                    in_tile_5.row(w - 1 - j)[i + k] = v;
+                    in_tile_6.row(j)[h - 1 - i - k] = v;
+                    in_tile_7.row(w - 1 - j)[h - 1 - i - k] = v;
+                }
+            }
+        }
+#endif
+        for (; i < h; i++)
+        {
+            const float* ptr = in_tile_0.row(i);
+
+            for (int j = 0; j < w; j++)
+            {
+                const float v = ptr[j];
+                in_tile_4.row(j)[i] = v;
+                in_tile_5.row(w - 1 - j)[i] = v;
+                in_tile_6.row(j)[h - 1 - i] = v;
+                in_tile_7.row(w - 1 - j)[h - 1 - i] = v;
+            }
+        }
+    }
+}
+
+// tta, undo the 8 flips, average and denormalize into the first 3 channels of out:
+//   out = (t0 + t1 + ... + t7) / 8 * a + b
+// offset skips the padding border of the outputs
+static void tta_merge_8(const ncnn::Mat out_tile[8], ncnn::Mat& out, int offset, float a, float b)
+{
+    const int tw = out_tile[0].w;
+    const int th = out_tile[0].h;
+
+    for (int q = 0; q < 3; q++)
+    {
+        const ncnn::Mat out_tile_0 = out_tile[0].channel(q);
+        const ncnn::Mat out_tile_1 = out_tile[1].channel(q);
+        const ncnn::Mat out_tile_2 = out_tile[2].channel(q);
+        const ncnn::Mat out_tile_3 = out_tile[3].channel(q);
+        const ncnn::Mat out_tile_4 = out_tile[4].channel(q);
+        const ncnn::Mat out_tile_5 = out_tile[5].channel(q);
+        const ncnn::Mat out_tile_6 = out_tile[6].channel(q);
+        const ncnn::Mat out_tile_7 = out_tile[7].channel(q);
+        ncnn::Mat outm = out.channel(q);
+
+        int i = 0;
+#if TILE_KERNELS_V4
+        const tk_v4 _eighth = tk_set1(0.125f);
+        const tk_v4 _a = tk_set1(a);
+        const tk_v4 _b = tk_set1(b);
+
+        for (; i + 3 < out.h; i += 4)
+        {
+            int j = 0;
+            for (; j + 3 < out.w; j += 4)
+            {
+                // the transposed directions, as 4 rows of output i .. i+3
+                tk_v4 _p4[4], _p5[4], _p6[4], _p7[4];
+                for (int k = 0; k < 4; k++)
+                {
+                    _p4[k] = tk_load(out_tile_4.row(j + k + offset) + i + offset);
+                    _p5[k] = tk_load(out_tile_5.row(tw - 1 - j - k - offset) + i + offset);
+                    _p6[k] = tk_reverse(tk_load(out_tile_6.row(j + k + offset) + th - 4 - i - offset));
+                    _p7[k] = tk_reverse(tk_load(out_tile_7.row(tw - 1 - j - k - offset) + th - 4 - i - offset));
+                }
+                tk_transpose(_p4[0], _p4[1], _p4[2], _p4[3]);
+                tk_transpose(_p5[0], _p5[1], _p5[2], _p5[3]);
+                tk_transpose(_p6[0], _p6[1], _p6[2], _p6[3]);
+                tk_transpose(_p7[0], _p7[1], _p7[2], _p7[3]);
+
+                for (int k = 0; k < 4; k++)
+                {
+                    const int ii = i + k;
+                    tk_v4 _v = tk_load(out_tile_0.row(ii + offset) + offset + j);
+                    _v = tk_add(_v, tk_load(out_tile_1.row(th - 1 - ii - offset) + offset + j));
+                    _v = tk_add(_v, tk_reverse(tk_load(out_tile_2.row(ii + offset) + tw - 4 - offset - j)));
+                    _v = tk_add(_v, tk_reverse(tk_load(out_tile_3.row(th - 1 - ii - offset) + tw - 4 - offset - j)));
+                    _v = tk_add(_v, _p4[k]);
+                    _v = tk_add(_v, _p5[k]);
+                    _v = tk_add(_v, _p6[k]);
+                    _v = tk_add(_v, _p7[k]);
+                    _v = tk_mul(_v, _eighth);
+
+                    tk_store(outm.row(ii) + j, tk_add(tk_mul(_v, _a), _b));
+                }
+            }
+            for (; j < out.w; j++)
+            {
+                for (int k = 0; k < 4; k++)
+                {
+                    const int ii = i + k;
+                    float v = (out_tile_0.row(ii + offset)[offset + j]
+                               + out_tile_1.row(th - 1 - ii - offset)[offset + j]
+                               + out_tile_2.row(ii + offset)[tw - 1 - offset - j]
+                               + out_tile_3.row(th - 1 - ii - offset)[tw - 1 - offset - j]
+                               + out_tile_4.row(j + offset)[ii + offset]
+                               + out_tile_5.row(tw - 1 - j - offset)[ii + offset]
+                               + out_tile_6.row(j + offset)[th - 1 - ii - offset]
+                               + out_tile_7.row(tw - 1 - j - offset)[th - 1 - ii - offset])
+                              / 8;
+                    v = v * a;
+                    outm.row(ii)[j] = v + b;
+                }
+            }
+        }
+#endif
+        for (; i < out.h; i++)
+        {
+            const float* ptr0 = out_tile_0.row(i + offset) + offset;
+            const float* ptr1 = out_tile_1.row(th - 1 - i - offset) + offset;
+            const float* ptr2 = out_tile_2.row(i + offset) + tw - 1 - offset;
+            const float* ptr3 = out_tile_3.row(th - 1 - i - offset) + tw - 1 - offset;
+            float* outptr = outm.row(i);
+
+            for (int j = 0; j < out.w; j++)
+            {
+                const float* ptr4 = out_tile_4.row(j + offset) + i + offset;
+                const float* ptr5 = out_tile_5.row(tw - 1 - j - offset) + i + offset;
+                const float* ptr6 = out_tile_6.row(j + offset) + th - 1 - i - offset;
+                const float* ptr7 = out_tile_7.row(tw - 1 - j - offset) + th - 1 - i - offset;
+
+                float v = (*ptr0++ + *ptr1++ + *ptr2-- + *ptr3-- + *ptr4 + *ptr5 + *ptr6 + *ptr7) / 8;
+                v = v * a;
+
+                *outptr++ = v + b;
+            }
+        }
+    }
+}
+
+#endif // TILE_KERNELS_H
@@ -0,0 +1,125 @@
+#ifndef TILE_SKIP_H
+#define TILE_SKIP_H
+
+// -F, tiles that are filled on the host instead of running the model.
+//
+// A tile is looked at together with its prepadding ring, the pixels the model would see. When
+// every channel stays within range levels (0 = one constant colour), or the image has alpha and
+// the alpha of the whole ring is 0, the model output would be flat or invisible, so the tile is
+// upscaled with bilinear interpolation straight from the input pixels. The fill keeps the channel
+// order of the input, which is the order the engines write back.
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+
+enum TileClass
+{
+    TILE_INFER = 0,
+    TILE_FLAT,
+    TILE_TRANSPARENT
+};
+
+class TileSkipStats
+{
+public:
+    TileSkipStats() : flat(0), transparent(0)
+    {
+    }
+
+    void add(int tile_class)
+    {
+        if (tile_class == TILE_FLAT)
+            flat.fetch_add(1, std::memory_order_relaxed);
+        if (tile_class == TILE_TRANSPARENT)
+            transparent.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void print(int tiles) const
+    {
+        const int skipped = flat.load() + transparent.load();
+        fprintf(stderr, "skipped tiles: %d of %d (%d flat, %d transparent)\n", skipped, tiles, flat.load(), transparent.load());
+    }
+
+private:
+    std::atomic<int> flat;
+    std::atomic<int> transparent;
+};
+
+// x0..x1, y0..y1 is the tile without padding, w/h/channels describe the interleaved pixels
+static int classify_tile(const unsigned char* pixels, int w, int h, int channels, int x0, int y0, int x1, int y1, int prepadding, int range)
+{
+    if (range < 0)
+        return TILE_INFER;
+
+    x0 = std::max(x0 - prepadding, 0);
+    y0 = std::max(y0 - prepadding, 0);
+    x1 = std::min(x1 + prepadding, w);
+    y1 = std::min(y1 + prepadding, h);
+
+    unsigned char lo[4] = {255, 255, 255, 255};
+    unsigned char hi[4] = {0, 0, 0, 0};
+    bool flat = true;
+
+    for (int y = y0; y < y1; y++)
+    {
+        const unsigned char* p = pixels + ((size_t)y * w + x0) * channels;
+        for (int x = x0; x < x1; x++)
+        {
+            for (int c = 0; c < channels; c++)
+            {
+                lo[c] = std::min(lo[c], p[c]);
+                hi[c] = std::max(hi[c], p[c]);
+            }
+            p += channels;
+        }
+
+        // keep scanning only while one of the two outcomes is still possible
+        flat = true;
+        for (int c = 0; c < channels; c++)
+            flat = flat && hi[c] - lo[c] <= range;
+
+        if (!flat && !(channels == 4 && hi[3] == 0))
+            return TILE_INFER;
+    }
+
+    if (channels == 4 && hi[3] == 0)
+        return TILE_TRANSPARENT;
+
+    return flat ? TILE_FLAT : TILE_INFER;
+}
+
+// bilinear upscale of the input tile x0..x1, y0..y1 into outrows, which holds output row
+// y0 * scale and is out_row_bytes wide
+static void fill_tile_bilinear(const unsigned char* pixels, int w, int h, int channels, int x0, int y0, int x1, int y1, int scale,
+                               unsigned char* outrows, size_t out_row_bytes)
+{
+    for (int oy = y0 * scale; oy < y1 * scale; oy++)
+    {
+        const float sy = std::min(std::max((oy + 0.5f) / scale - 0.5f, 0.f), (float)(h - 1));
+        const int iy0 = (int)sy;
+        const int iy1 = std::min(iy0 + 1, h - 1);
+        const float fy = sy - iy0;
+
+        const unsigned char* row0 = pixels + (size_t)iy0 * w * channels;
+        const unsigned char* row1 = pixels + (size_t)iy1 * w * channels;
+        unsigned char* outp = outrows + (size_t)(oy - y0 * scale) * out_row_bytes + (size_t)x0 * scale * channels;
+
+        for (int ox = x0 * scale; ox < x1 * scale; ox++)
+        {
+            const float sx = std::min(std::max((ox + 0.5f) / scale - 0.5f, 0.f), (float)(w - 1));
+            const int ix0 = (int)sx;
+            const int ix1 = std::min(ix0 + 1, w - 1);
+            const float fx = sx - ix0;
+
+            for (int c = 0; c < channels; c++)
+            {
+                const float top = row0[ix0 * channels + c] + (row0[ix1 * channels + c] - row0[ix0 * channels + c]) * fx;
+                const float bottom = row1[ix0 * channels + c] + (row1[ix1 * channels + c] - row1[ix0 * channels + c]) * fx;
+                *outp++ = (unsigned char)(top + (bottom - top) * fy + 0.5f);
+            }
+        }
+    }
+}
+
+#endif // TILE_SKIP_H
@@ -0,0 +1,194 @@
+#ifndef TILE_TEMPORAL_H
+#define TILE_TEMPORAL_H
+
+// -T, in a frame sequence only the tiles that changed since the previous frame run the model.
+//
+// For every tile position the cache keeps the padded input the model saw last and its output. A
+// tile whose padded input stays within tolerance levels of the stored one on every channel
+// (0 = identical) takes the stored output. The stored tile is only replaced by a tile that ran, so
+// slow changes cannot drift further than the tolerance from the pixels the output was made from.
+// The frames of gif and webp animations and the images of a batch (a video extracted to a
+// directory) go through one cache per run. Positions are kept per frame size for the few sizes
+// seen last, a tile of another size or position never matches.
+
+#include <algorithm>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tile_dedup.h"
+
+class TemporalTileCache
+{
+public:
+    typedef TileDedupCache::Tile Tile;
+
+    explicit TemporalTileCache(int _tolerance) : tolerance(_tolerance), frames(0), tiles(0), reused(0)
+    {
+    }
+
+    // x0..x1, y0..y1 is tile index of count tiles without padding, w/h/channels describe the pixels.
+    // The stored output when the padded input is within tolerance, null otherwise
+    Tile match(const unsigned char* pixels, int w, int h, int channels, int count, int index, int x0, int y0, int x1, int y1, int prepadding)
+    {
+        Region r = region(w, h, channels, x0, y0, x1, y1, prepadding);
+
+        Slot slot;
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            slot = frame(r, count).slots[index];
+        }
+
+        if (!slot.output || memcmp(slot.region, r.bounds, sizeof(r.bounds)) != 0)
+            return Tile();
+
+        const size_t row_bytes = (size_t)(r.bounds[2] - r.bounds[0]) * channels;
+        for (int y = r.bounds[1]; y < r.bounds[3]; y++)
+        {
+            const unsigned char* a = pixels + ((size_t)y * w + r.bounds[0]) * channels;
+            const unsigned char* b = slot.input->data() + (y - r.bounds[1]) * row_bytes;
+            if (!within(a, b, row_bytes))
+                return Tile();
+        }
+
+        return slot.output;
+    }
+
+    // nrows output rows of row_bytes, stride apart
+    void store(const unsigned char* pixels, int w, int h, int channels, int count, int index, int x0, int y0, int x1, int y1, int prepadding,
+               const unsigned char* rows, size_t out_row_bytes, size_t stride, int nrows)
+    {
+        Region r = region(w, h, channels, x0, y0, x1, y1, prepadding);
+
+        const size_t row_bytes = (size_t)(r.bounds[2] - r.bounds[0]) * channels;
+        std::shared_ptr<std::vector<unsigned char> > input = std::make_shared<std::vector<unsigned char> >(row_bytes * (r.bounds[3] - r.bounds[1]));
+        for (int y = r.bounds[1]; y < r.bounds[3]; y++)
+        {
+            memcpy(input->data() + (y - r.bounds[1]) * row_bytes, pixels + ((size_t)y * w + r.bounds[0]) * channels, row_bytes);
+        }
+
+        std::shared_ptr<std::vector<unsigned char> > output = std::make_shared<std::vector<unsigned char> >(out_row_bytes * nrows);
+        for (int y = 0; y < nrows; y++)
+        {
+            memcpy(output->data() + y * out_row_bytes, rows + y * stride, out_row_bytes);
+        }
+
+        std::lock_guard<std::mutex> guard(lock);
+
+        Slot& slot = frame(r, count).slots[index];
+        memcpy(slot.region, r.bounds, sizeof(r.bounds));
+        slot.input = input;
+        slot.output = output;
+    }
+
+    // one upscaled frame, prints its reuse ratio
+    void frame_done(int frame_reused, int frame_tiles)
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            frames++;
+            tiles += frame_tiles;
+            reused += frame_reused;
+        }
+
+        fprintf(stderr, "temporal: %d of %d tiles reused (%.1f%%)\n", frame_reused, frame_tiles,
+                frame_tiles ? frame_reused * 100.0 / frame_tiles : 0.0);
+    }
+
+    void print_stats()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        fprintf(stderr, "temporal cache: %lld of %lld tiles reused over %d frames (%.1f%%)\n", reused, tiles, frames,
+                tiles ? reused * 100.0 / tiles : 0.0);
+    }
+
+private:
+    // frame size, then the padded tile px0, py0, px1, py1
+    struct Region
+    {
+        int size[3];
+        int bounds[4];
+    };
+
+    struct Slot
+    {
+        int region[4];
+        std::shared_ptr<const std::vector<unsigned char> > input;
+        Tile output;
+    };
+
+    struct Frame
+    {
+        int size[3];
+        std::vector<Slot> slots;
+    };
+
+    static Region region(int w, int h, int channels, int x0, int y0, int x1, int y1, int prepadding)
+    {
+        Region r;
+        r.size[0] = w;
+        r.size[1] = h;
+        r.size[2] = channels;
+        r.bounds[0] = std::max(x0 - prepadding, 0);
+        r.bounds[1] = std::max(y0 - prepadding, 0);
+        r.bounds[2] = std::min(x1 + prepadding, w);
+        r.bounds[3] = std::min(y1 + prepadding, h);
+        return r;
+    }
+
+    bool within(const unsigned char* a, const unsigned char* b, size_t size) const
+    {
+        if (tolerance == 0)
+            return memcmp(a, b, size) == 0;
+
+        for (size_t i = 0; i < size; i++)
+        {
+            if (abs((int)a[i] - (int)b[i]) > tolerance)
+                return false;
+        }
+        return true;
+    }
+
+    // slots of the frame size, the least recently used size is dropped beyond max_frames.
+    // Called with the lock held
+    Frame& frame(const Region& r, int count)
+    {
+        static const size_t max_frames = 4;
+
+        std::list<Frame>::iterator it = sizes.begin();
+        while (it != sizes.end() && memcmp(it->size, r.size, sizeof(r.size)) != 0)
+            it++;
+
+        if (it == sizes.end())
+        {
+            Frame f;
+            memcpy(f.size, r.size, sizeof(r.size));
+            sizes.push_front(f);
+            if (sizes.size() > max_frames)
+                sizes.pop_back();
+        }
+        else
+        {
+            sizes.splice(sizes.begin(), sizes, it);
+        }
+
+        // another tilesize changes the count, the region check tells the slots apart
+        Frame& f = sizes.front();
+        if ((int)f.slots.size() < count)
+            f.slots.resize(count);
+        return f;
+    }
+
+    std::mutex lock;
+    std::list<Frame> sizes;
+    int tolerance;
+    int frames;
+    long long tiles;
+    long long reused;
+};
+
+#endif // TILE_TEMPORAL_H
@@ -0,0 +1,998 @@
+#ifndef TILED_UPSCALER_H
+#define TILED_UPSCALER_H
+
+// Shared tile loop for the ncnn upscalers (realsr, realcugan, waifu2x, srmd).
+//
+// TiledUpscaler<Engine> owns the parts every engine used to carry its own copy of: the vulkan
+// row band upload/download, the cpu tile scheduler, streaming to a StreamImageWriter and the
+// progress/ETA line. The engine derives from it, befriends it and provides the model hooks:
+//   void process_gpu_tile(ncnn::VkCompute& cmd, const ncnn::VkMat& in_gpu, ncnn::VkMat& out_gpu,
+//                         const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
+//       preproc, inference and postproc of tile (xi, yi) into the row band out_gpu
+//   int process_cpu_tile(const ncnn::Mat& inimage, unsigned char* outrows,
+//                        const TileGrid& grid, int xi, int yi, const ncnn::Option& opt) const;
+//       same on cpu, writing pixels at outrows, the first output row of tile row yi
+// The geometry hooks below have defaults and are shadowed by engines that pad differently.
+// process_tiled_shared splits the tile rows of one image across engines on several devices (-G),
+// each claims rows from a TileRowQueue at its own pace. With flat_tile_range >= 0 (-F) flat and
+// fully transparent tiles skip the model and are filled on the host, see tile_skip.h. With a
+// tile_cache (-D) tiles whose padded input was seen before take the stored output, see tile_dedup.h.
+// With a temporal_cache (-T) tiles that did not change since the previous frame take the output of
+// the last run at their position, see tile_temporal.h.
+// The gpu loop runs the upload of the next row band and the download of the previous one on two
+// worker threads that live as long as the loop, each with its own command stream, while the
+// current band is inferred. Under -B the loops book their stages with bench_stats.h and the gpu
+// loop submits every tile on its own; the overlapping transfer stages are booked in full, so the
+// stages add up to more than the wall time.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <string.h>
+
+// ncnn
+#include "net.h"
+#include "gpu.h"
+
+#include "bench_stats.h"
+#include "stream_writer.h"
+#include "tile_dedup.h"
+#include "tile_kernels.h"
+#include "tile_skip.h"
+#include "tile_temporal.h"
+
+struct TileGrid
+{
+    int w;
+    int h;
+    int channels;
+    int xtiles;
+    int ytiles;
+};
+
+// progress line shared by the tile loops, safe to call from the cpu tile workers
+class TileProgress
+{
+public:
+    explicit TileProgress(int _total) : total(_total), done(0)
+    {
+        begin = std::chrono::high_resolution_clock::now();
+    }
+
+    void tile_done()
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        done++;
+
+        std::chrono::high_resolution_clock::time_point end = std::chrono::high_resolution_clock::now();
+        double time_span_print_progress = std::chrono::duration_cast<std::chrono::duration<double> >(end - time_print_progress).count();
+        if (time_span_print_progress > 0.5 || done + 2 > total)
+        {
+            double progress = (double)done / total;
+            double time_span = elapsed();
+            fprintf(stderr, "%5.2f%%\t[%5.2fs /%5.2f ETA]\n", progress * 100, time_span, time_span / progress - time_span);
+            time_print_progress = end;
+        }
+    }
+
+    double elapsed() const
+    {
+        return std::chrono::duration_cast<std::chrono::duration<double> >(std::chrono::high_resolution_clock::now() - begin).count();
+    }
+
+private:
+    int total;
+    int done;
+    std::mutex lock;
+    std::chrono::high_resolution_clock::time_point begin;
+    std::chrono::high_resolution_clock::time_point time_print_progress;
+};
+
+// what happens to the tiles of one gpu band in flight
+struct TileBandPlan
+{
+    // TileClass from -F
+    std::vector<unsigned char> classes;
+
+    // -D, key of every tile, the cached output, or the tile of the same band with identical input
+    std::vector<TileKey> keys;
+    std::vector<TileDedupCache::Tile> cached;
+    std::vector<int> source;
+
+    // -T, the cached output is the one of the previous frame
+    std::vector<unsigned char> reused;
+
+    bool infer(int xi) const
+    {
+        return classes[xi] == TILE_INFER && !cached[xi] && source[xi] == -1;
+    }
+};
+
+// tile rows of one image shared by several engines. Each engine claims the next row when it is
+// ready for one, so a faster device ends up with more rows. Rows are claimed whole because the gpu
+// loop moves full row bands
+class TileRowQueue
+{
+public:
+    TileRowQueue(int _rows, int tiles) : progress(tiles), temporal_reused(0), rows(_rows), next(0)
+    {
+    }
+
+    // -1 when every row is taken
+    int claim()
+    {
+        const int yi = next.fetch_add(1);
+        return yi < rows ? yi : -1;
+    }
+
+    TileProgress progress;
+
+    // -T, tiles reused by all engines, the frame is reported once
+    std::atomic<int> temporal_reused;
+
+private:
+    int rows;
+    std::atomic<int> next;
+};
+
+// thread of the gpu loop that runs one band job at a time. The upload and the download worker
+// live as long as the loop, a step hands each its band with start() and waits for it at the end
+class BandWorker
+{
+public:
+    BandWorker() : pending(false), quit(false), thread(&BandWorker::run, this)
+    {
+    }
+
+    ~BandWorker()
+    {
+        {
+            std::lock_guard<std::mutex> guard(lock);
+            quit = true;
+        }
+        cond.notify_all();
+        thread.join();
+    }
+
+    void start(const std::function<void()>& _job)
+    {
+        std::lock_guard<std::mutex> guard(lock);
+        job = _job;
+        pending = true;
+        cond.notify_all();
+    }
+
+    // returns at once when no job was started
+    void wait()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        cond.wait(guard, [this]() { return !pending; });
+    }
+
+private:
+    void run()
+    {
+        std::unique_lock<std::mutex> guard(lock);
+        for (;;)
+        {
+            cond.wait(guard, [this]() { return pending || quit; });
+            if (!pending)
+                return;
+
+            guard.unlock();
+            job();
+            guard.lock();
+
+            job = std::function<void()>();
+            pending = false;
+            cond.notify_all();
+        }
+    }
+
+    std::mutex lock;
+    std::condition_variable cond;
+    std::function<void()> job;
+    bool pending;
+    bool quit;
+
+    // last, it runs as soon as it is constructed
+    std::thread thread;
+};
+
+template <class Engine>
+class TiledUpscaler
+{
+public:
+    TiledUpscaler() : flat_tile_range(-1), tile_cache(0), temporal_cache(0)
+    {
+    }
+
+    // -F, channel spread up to which a tile counts as flat, -1 runs the model on every tile
+    int flat_tile_range;
+
+    // -D, output tiles shared across the images of a run, owned by the caller
+    TileDedupCache* tile_cache;
+
+    // -T, last output of every tile position shared across the frames of a run, owned by the caller
+    TemporalTileCache* temporal_cache;
+
+    // engines of the same model on different devices upscale inimage together, outimage is
+    // written by all of them. The engines must share the tile grid, so the same tilesize
+    static int process_tiled_shared(const std::vector<const Engine*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage);
+
+protected:
+    // with a queue only the rows claimed from it are processed
+    int process_tiled_gpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0, TileRowQueue* queue = 0) const;
+
+    int process_tiled_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer = 0, TileRowQueue* queue = 0) const;
+
+    // noise -1 at scale 1 leaves the image as it is
+    static int process_unscaled(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer)
+    {
+        if (!writer)
+        {
+            outimage = inimage;
+            return 0;
+        }
+
+        return writer->write_rows((const unsigned char*)inimage.data, inimage.h, (size_t)inimage.w * inimage.elemsize) ? 0 : -1;
+    }
+
+    // tile count, w/h/channels are already filled in
+    void tile_grid(TileGrid& grid) const
+    {
+        const int tilesize = engine().tilesize;
+        grid.xtiles = (grid.w + tilesize - 1) / tilesize;
+        grid.ytiles = (grid.h + tilesize - 1) / tilesize;
+    }
+
+    // input rows of band yi including prepadding, standard_h is the height of a full interior band
+    void band_input_rows(const TileGrid& grid, int yi, int& y0, int& y1, int& standard_h) const
+    {
+        const int tilesize = engine().tilesize;
+        const int prepadding = engine().prepadding;
+        y0 = std::max(yi * tilesize - prepadding, 0);
+        y1 = std::min((yi + 1) * tilesize + prepadding, grid.h);
+        standard_h = tilesize + 2 * prepadding;
+    }
+
+    // output rows of band yi before scaling
+    void band_output_rows(const TileGrid& grid, int yi, int& y0, int& y1) const
+    {
+        const int tilesize = engine().tilesize;
+        y0 = yi * tilesize;
+        y1 = std::min((yi + 1) * tilesize, grid.h);
+    }
+
+    // output columns of tile xi before scaling
+    void tile_output_columns(const TileGrid& grid, int xi, int& x0, int& x1) const
+    {
+        const int tilesize = engine().tilesize;
+        x0 = xi * tilesize;
+        x1 = std::min((xi + 1) * tilesize, grid.w);
+    }
+
+    // bands are moved as raw 8bit pixels and converted by the shaders
+    bool band_int8(const ncnn::Option& opt) const
+    {
+        return opt.use_fp16_storage && opt.use_int8_storage;
+    }
+
+private:
+    const Engine& engine() const
+    {
+        return *static_cast<const Engine*>(this);
+    }
+
+    int classify(const ncnn::Mat& inimage, const TileGrid& grid, int xi, int yi) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+        return classify_tile((const unsigned char*)inimage.data, grid.w, grid.h, grid.channels, x0, y0, x1, y1, e.prepadding, flat_tile_range);
+    }
+
+    // byte span of tile xi within the output rows of its band
+    void tile_output_span(const TileGrid& grid, int xi, int yi, size_t& offset, size_t& row_bytes, int& rows) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+        offset = (size_t)x0 * e.scale * grid.channels;
+        row_bytes = (size_t)(x1 - x0) * e.scale * grid.channels;
+        rows = (y1 - y0) * e.scale;
+    }
+
+    TileKey tile_key(const ncnn::Mat& inimage, const TileGrid& grid, int xi, int yi) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+        return hash_tile((const unsigned char*)inimage.data, grid.w, grid.h, grid.channels, x0, y0, x1, y1, e.prepadding);
+    }
+
+    void load_cached(const TileDedupCache::Tile& tile, const TileGrid& grid, int xi, int yi, unsigned char* outrows, size_t out_row_bytes) const
+    {
+        size_t offset, row_bytes;
+        int rows;
+        tile_output_span(grid, xi, yi, offset, row_bytes, rows);
+        for (int y = 0; y < rows; y++)
+        {
+            memcpy(outrows + y * out_row_bytes + offset, tile->data() + y * row_bytes, row_bytes);
+        }
+    }
+
+    void copy_tile(const TileGrid& grid, int from_xi, int xi, int yi, unsigned char* outrows, size_t out_row_bytes) const
+    {
+        size_t from_offset, offset, row_bytes;
+        int rows;
+        tile_output_span(grid, from_xi, yi, from_offset, row_bytes, rows);
+        tile_output_span(grid, xi, yi, offset, row_bytes, rows);
+        for (int y = 0; y < rows; y++)
+        {
+            memcpy(outrows + y * out_row_bytes + offset, outrows + y * out_row_bytes + from_offset, row_bytes);
+        }
+    }
+
+    void store_tile(const TileKey& key, const TileGrid& grid, int xi, int yi, const unsigned char* outrows, size_t out_row_bytes) const
+    {
+        size_t offset, row_bytes;
+        int rows;
+        tile_output_span(grid, xi, yi, offset, row_bytes, rows);
+        tile_cache->put(key, outrows + offset, row_bytes, out_row_bytes, rows);
+    }
+
+    TemporalTileCache::Tile temporal_match(const ncnn::Mat& inimage, const TileGrid& grid, int xi, int yi) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+        return temporal_cache->match((const unsigned char*)inimage.data, grid.w, grid.h, grid.channels, grid.xtiles * grid.ytiles,
+                                     yi * grid.xtiles + xi, x0, y0, x1, y1, e.prepadding);
+    }
+
+    void temporal_store(const ncnn::Mat& inimage, const TileGrid& grid, int xi, int yi, const unsigned char* outrows, size_t out_row_bytes) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+
+        size_t offset, row_bytes;
+        int rows;
+        tile_output_span(grid, xi, yi, offset, row_bytes, rows);
+        temporal_cache->store((const unsigned char*)inimage.data, grid.w, grid.h, grid.channels, grid.xtiles * grid.ytiles,
+                              yi * grid.xtiles + xi, x0, y0, x1, y1, e.prepadding, outrows + offset, row_bytes, out_row_bytes, rows);
+    }
+
+    // a whole frame is reported once, the engines sharing one add up in the queue
+    void temporal_frame_done(int reused, int tiles, TileRowQueue* queue) const
+    {
+        if (queue)
+            queue->temporal_reused += reused;
+        else
+            temporal_cache->frame_done(reused, tiles);
+    }
+
+    // outrows holds the first output row of band yi
+    void fill_skipped(const ncnn::Mat& inimage, const TileGrid& grid, int xi, int yi, unsigned char* outrows, size_t out_row_bytes) const
+    {
+        const Engine& e = engine();
+        int x0, x1, y0, y1;
+        e.tile_output_columns(grid, xi, x0, x1);
+        e.band_output_rows(grid, yi, y0, y1);
+        fill_tile_bilinear((const unsigned char*)inimage.data, grid.w, grid.h, grid.channels, x0, y0, x1, y1, e.scale, outrows, out_row_bytes);
+    }
+};
+
+template <class Engine>
+int TiledUpscaler<Engine>::process_tiled_gpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer, TileRowQueue* queue) const
+{
+    const Engine& e = engine();
+    const ncnn::VulkanDevice* vkdev = e.net.vulkan_device();
+
+    const unsigned char* pixeldata = (const unsigned char*)inimage.data;
+
+    TileGrid grid;
+    grid.w = inimage.w;
+    grid.h = inimage.h;
+    grid.channels = inimage.elempack;
+    e.tile_grid(grid);
+
+    const int w = grid.w;
+    const int channels = grid.channels;
+    const int scale = e.scale;
+    const size_t out_row_bytes = (size_t)w * scale * channels;
+
+    ncnn::VkAllocator* blob_vkallocator = vkdev->acquire_blob_allocator();
+    ncnn::VkAllocator* staging_vkallocator = vkdev->acquire_staging_allocator();
+    ncnn::VkAllocator* upload_staging_vkallocator = vkdev->acquire_staging_allocator();
+    ncnn::VkAllocator* download_staging_vkallocator = vkdev->acquire_staging_allocator();
+
+    ncnn::Option opt = e.net.opt;
+    opt.blob_vkallocator = blob_vkallocator;
+    opt.workspace_vkallocator = blob_vkallocator;
+    opt.staging_vkallocator = staging_vkallocator;
+
+    // the transfer threads stage through their own allocators, vulkan allocators are not thread safe
+    ncnn::Option upload_opt = opt;
+    upload_opt.staging_vkallocator = upload_staging_vkallocator;
+
+    ncnn::Option download_opt = opt;
+    download_opt.staging_vkallocator = download_staging_vkallocator;
+
+    const bool int8_band = e.band_int8(opt);
+
+    // submit per tile so the benchmark can tell the tiles apart
+    const bool split_submit = grid.xtiles > 1 || bench_recorder() != 0;
+
+    TileProgress own_progress(grid.xtiles * grid.ytiles);
+    TileProgress& progress = queue ? queue->progress : own_progress;
+
+    // Double buffered row bands. Step s uploads band s, infers band s - 1 and downloads band s - 2,
+    // the transfers on the two BandWorker threads and each on its own command stream, so host
+    // packing and the transfers of the neighbour bands overlap the inference. Every band buffer
+    // is allocated on this thread before the step starts; record_clone keeps a preallocated
+    // destination of the same shape and allocator, so the upload thread never touches the blob
+    // allocator.
+    ncnn::VkMat in_gpu[2];
+    ncnn::VkMat out_gpu[2];
+
+    // -F, -D and -T plans of the bands in flight, three steps use them
+    TileBandPlan plans[3];
+    TileSkipStats skip_stats;
+
+    // only the upload thread counts, one band at a time
+    int temporal_reused = 0;
+
+    auto upload_band = [&](int yi, int slot, TileBandPlan& plan) {
+        plan.classes.assign(grid.xtiles, (unsigned char)TILE_INFER);
+        plan.keys.resize(grid.xtiles);
+        plan.cached.assign(grid.xtiles, TileDedupCache::Tile());
+        plan.source.assign(grid.xtiles, -1);
+        plan.reused.assign(grid.xtiles, 0);
+
+        for (int xi = 0; xi < grid.xtiles; xi++)
+        {
+            if (flat_tile_range >= 0)
+            {
+                plan.classes[xi] = (unsigned char)classify(inimage, grid, xi, yi);
+                skip_stats.add(plan.classes[xi]);
+            }
+
+            if (temporal_cache && plan.classes[xi] == TILE_INFER)
+            {
+                plan.cached[xi] = temporal_match(inimage, grid, xi, yi);
+                if (plan.cached[xi])
+                {
+                    plan.reused[xi] = 1;
+                    temporal_reused++;
+                    continue;
+                }
+            }
+
+            if (!tile_cache || plan.classes[xi] != TILE_INFER)
+                continue;
+
+            // the tiles of this band are not in the cache before the download, so look at them first
+            plan.keys[xi] = tile_key(inimage, grid, xi, yi);
+            for (int j = 0; j < xi && plan.source[xi] == -1; j++)
+            {
+                if (plan.infer(j) && plan.keys[j] == plan.keys[xi])
+                    plan.source[xi] = j;
+            }
+
+            if (plan.source[xi] != -1)
+                tile_cache->add_hit();
+            else
+                plan.cached[xi] = tile_cache->get(plan.keys[xi]);
+        }
+
+        int in_tile_y0, in_tile_y1, standard_h;
+        e.band_input_rows(grid, yi, in_tile_y0, in_tile_y1, standard_h);
+
+        ncnn::Mat in;
+        {
+            BenchScope bench_preproc(BENCH_PREPROC);
+
+            if (int8_band)
+            {
+                const int safe_tile_h = in_tile_y1 - in_tile_y0;
+                if (safe_tile_h == standard_h)
+                {
+                    in = ncnn::Mat(w, safe_tile_h, (unsigned char*)pixeldata + in_tile_y0 * w * channels, (size_t)channels, 1);
+                }
+                else
+                {
+                    in.create(w, safe_tile_h, (size_t)channels, 1);
+                    const unsigned char* src = (unsigned char*)pixeldata + in_tile_y0 * w * channels;
+                    memcpy(in.data, src, (size_t)w * safe_tile_h * channels);
+                }
+            }
+            else
+            {
+                if (channels == 3)
+                {
+#if _WIN32
+                    in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGR2RGB, w, (in_tile_y1 - in_tile_y0));
+#else
+                    in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGB, w, (in_tile_y1 - in_tile_y0));
+#endif
+                }
+                if (channels == 4)
+                {
+#if _WIN32
+                    in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_BGRA2RGBA, w, (in_tile_y1 - in_tile_y0));
+#else
+                    in = ncnn::Mat::from_pixels(pixeldata + in_tile_y0 * w * channels, ncnn::Mat::PIXEL_RGBA, w, (in_tile_y1 - in_tile_y0));
+#endif
+                }
+            }
+        }
+
+        BenchScope bench_upload(BENCH_UPLOAD);
+
+        ncnn::VkCompute cmd(vkdev);
+        cmd.record_clone(in, in_gpu[slot], upload_opt);
+        cmd.submit_and_wait();
+    };
+
+    auto infer_band = [&](int yi, int slot, const TileBandPlan& plan) {
+        ncnn::VkCompute cmd(vkdev);
+
+        for (int xi = 0; xi < grid.xtiles; xi++)
+        {
+            if (plan.infer(xi))
+            {
+                BenchScope bench_inference(BENCH_INFERENCE);
+
+                e.process_gpu_tile(cmd, in_gpu[slot], out_gpu[slot], grid, xi, yi, opt);
+
+                if (split_submit)
+                {
+                    cmd.submit_and_wait();
+                    cmd.reset();
+                }
+            }
+
+            bench_tile_done();
+            progress.tile_done();
+        }
+
+        if (!split_submit)
+        {
+            cmd.submit_and_wait();
+        }
+    };
+
+    auto download_band = [&](int yi, int slot, const TileBandPlan& plan) -> int {
+        const ncnn::VkMat& band_gpu = out_gpu[slot];
+
+        int out_tile_y0, out_tile_y1;
+        e.band_output_rows(grid, yi, out_tile_y0, out_tile_y1);
+
+        ncnn::Mat out;
+
+        // row band, either the slice of outimage or a scratch band for the writer
+        ncnn::Mat band;
+        unsigned char* outrows = (unsigned char*)outimage.data + out_tile_y0 * scale * out_row_bytes;
+        if (writer)
+        {
+            band.create(band_gpu.w, band_gpu.h, (size_t)channels, 1);
+            outrows = (unsigned char*)band.data;
+        }
+
+        if (int8_band)
+        {
+            out = ncnn::Mat(band_gpu.w, band_gpu.h, outrows, (size_t)channels, 1);
+        }
+
+        {
+            BenchScope bench_download(BENCH_DOWNLOAD);
+
+            ncnn::VkCompute cmd(vkdev);
+            cmd.record_clone(band_gpu, out, download_opt);
+            cmd.submit_and_wait();
+        }
+
+        BenchScope bench_postproc(BENCH_POSTPROC);
+
+        if (!int8_band)
+        {
+            if (channels == 3)
+            {
+#if _WIN32
+                out.to_pixels(outrows, ncnn::Mat::PIXEL_RGB2BGR);
+#else
+                out.to_pixels(outrows, ncnn::Mat::PIXEL_RGB);
+#endif
+            }
+            if (channels == 4)
+            {
+#if _WIN32
+                out.to_pixels(outrows, ncnn::Mat::PIXEL_RGBA2BGRA);
+#else
+                out.to_pixels(outrows, ncnn::Mat::PIXEL_RGBA);
+#endif
+            }
+        }
+
+        for (int xi = 0; xi < grid.xtiles; xi++)
+        {
+            if (plan.classes[xi] != TILE_INFER)
+                fill_skipped(inimage, grid, xi, yi, outrows, out_row_bytes);
+            else if (plan.cached[xi])
+                load_cached(plan.cached[xi], grid, xi, yi, outrows, out_row_bytes);
+        }
+
+        if (tile_cache)
+        {
+            for (int xi = 0; xi < grid.xtiles; xi++)
+            {
+                if (plan.source[xi] != -1)
+                    copy_tile(grid, plan.source[xi], xi, yi, outrows, out_row_bytes);
+                else if (plan.infer(xi))
+                    store_tile(plan.keys[xi], grid, xi, yi, outrows, out_row_bytes);
+            }
+        }
+
+        if (temporal_cache)
+        {
+            for (int xi = 0; xi < grid.xtiles; xi++)
+            {
+                if (plan.classes[xi] == TILE_INFER && !plan.reused[xi])
+                    temporal_store(inimage, grid, xi, yi, outrows, out_row_bytes);
+            }
+        }
+
+        if (writer && !writer->write_rows(outrows, band_gpu.h, out_row_bytes))
+        {
+            fprintf(stderr, "stream write failed at tile row %d\n", yi);
+            return -1;
+        }
+
+        return 0;
+    };
+
+    // tile row of every band in the order it was taken
+    std::vector<int> bands;
+    bool bands_done = false;
+
+    BandWorker uploader;
+    BandWorker downloader;
+
+    int ret = 0;
+
+    for (int s = 0; ret == 0; s++)
+    {
+        int upload_yi = -1;
+        if (!bands_done)
+        {
+            upload_yi = queue ? queue->claim() : s < grid.ytiles ? s : -1;
+            if (upload_yi == -1)
+                bands_done = true;
+            else
+                bands.push_back(upload_yi);
+        }
+
+        const int band_count = (int)bands.size();
+        const int infer_yi = s >= 1 && s - 1 < band_count ? bands[s - 1] : -1;
+        const int download_yi = s >= 2 && s - 2 < band_count ? bands[s - 2] : -1;
+
+        if (upload_yi == -1 && infer_yi == -1 && download_yi == -1)
+            break;
+
+        if (upload_yi != -1)
+        {
+            int in_tile_y0, in_tile_y1, standard_h;
+            e.band_input_rows(grid, upload_yi, in_tile_y0, in_tile_y1, standard_h);
+
+            if (int8_band)
+            {
+                in_gpu[s % 2].create(w, in_tile_y1 - in_tile_y0, (size_t)channels, 1, blob_vkallocator);
+            }
+            else
+            {
+                in_gpu[s % 2].create(w, in_tile_y1 - in_tile_y0, channels, (size_t)4u, 1, blob_vkallocator);
+            }
+        }
+
+        if (infer_yi != -1)
+        {
+            int out_tile_y0, out_tile_y1;
+            e.band_output_rows(grid, infer_yi, out_tile_y0, out_tile_y1);
+
+            if (int8_band)
+            {
+                out_gpu[(s - 1) % 2].create(w * scale, (out_tile_y1 - out_tile_y0) * scale, (size_t)channels, 1, blob_vkallocator);
+            }
+            else
+            {
+                out_gpu[(s - 1) % 2].create(w * scale, (out_tile_y1 - out_tile_y0) * scale, channels, (size_t)4u, 1, blob_vkallocator);
+            }
+        }
+
+        if (upload_yi != -1)
+        {
+            uploader.start([&, upload_yi, s]() { upload_band(upload_yi, s % 2, plans[s % 3]); });
+        }
+
+        int download_ret = 0;
+        if (download_yi != -1)
+        {
+            downloader.start([&, download_yi, s]() { download_ret = download_band(download_yi, (s - 2) % 2, plans[(s - 2) % 3]); });
+        }
+
+        if (infer_yi != -1)
+        {
+            infer_band(infer_yi, (s - 1) % 2, plans[(s - 1) % 3]);
+        }
+
+        uploader.wait();
+        downloader.wait();
+
+        ret = download_ret;
+    }
+
+    if (flat_tile_range >= 0)
+    {
+        skip_stats.print(grid.xtiles * (int)bands.size());
+    }
+
+    if (temporal_cache)
+    {
+        temporal_frame_done(temporal_reused, grid.xtiles * grid.ytiles, queue);
+    }
+
+    in_gpu[0].release();
+    in_gpu[1].release();
+    out_gpu[0].release();
+    out_gpu[1].release();
+
+    vkdev->reclaim_blob_allocator(blob_vkallocator);
+    vkdev->reclaim_staging_allocator(staging_vkallocator);
+    vkdev->reclaim_staging_allocator(upload_staging_vkallocator);
+    vkdev->reclaim_staging_allocator(download_staging_vkallocator);
+
+    return ret;
+}
+
+template <class Engine>
+int TiledUpscaler<Engine>::process_tiled_cpu(const ncnn::Mat& inimage, ncnn::Mat& outimage, StreamImageWriter* writer, TileRowQueue* queue) const
+{
+    const Engine& e = engine();
+
+    TileGrid grid;
+    grid.w = inimage.w;
+    grid.h = inimage.h;
+    grid.channels = inimage.elempack;
+    e.tile_grid(grid);
+
+    const int xtiles = grid.xtiles;
+    const int ytiles = grid.ytiles;
+    const int tiles = xtiles * ytiles;
+    const int scale = e.scale;
+
+    // tiles are independent and write to disjoint slices of outimage,
+    // so run them on a pool of extractors instead of one big extractor.
+    // when streaming or sharing rows only one tile row is in flight, its band is encoded before the next row starts
+    const int num_threads = std::max(e.net.opt.num_threads, 1);
+    const int tile_workers = std::min(num_threads, writer || queue ? xtiles : tiles);
+    const int tile_threads = std::max(num_threads / tile_workers, 1);
+
+    const size_t out_row_bytes = (size_t)grid.w * scale * grid.channels;
+    ncnn::Mat band;
+
+    TileProgress own_progress(tiles);
+    TileProgress& progress = queue ? queue->progress : own_progress;
+
+    TileSkipStats skip_stats;
+    std::atomic<int> temporal_reused(0);
+
+    auto run_tiles = [&](int first_tile, int last_tile) {
+        std::atomic<int> next_tile(first_tile);
+
+        auto worker = [&]() {
+            // per-thread allocators, blob pool is only touched by this thread
+            ncnn::UnlockedPoolAllocator blob_allocator;
+            ncnn::PoolAllocator workspace_allocator;
+
+            ncnn::Option opt = e.net.opt;
+            opt.lightmode = true;
+            opt.num_threads = tile_threads;
+            opt.blob_allocator = &blob_allocator;
+            opt.workspace_allocator = &workspace_allocator;
+
+            for (;;)
+            {
+                const int ti = next_tile.fetch_add(1);
+                if (ti >= last_tile)
+                    break;
+
+                const int xi = ti % xtiles;
+                const int yi = ti / xtiles;
+
+                unsigned char* outrows = (unsigned char*)band.data;
+                if (!writer)
+                {
+                    int out_tile_y0, out_tile_y1;
+                    e.band_output_rows(grid, yi, out_tile_y0, out_tile_y1);
+                    outrows = (unsigned char*)outimage.data + out_tile_y0 * scale * out_row_bytes;
+                }
+
+                const int tile_class = flat_tile_range >= 0 ? classify(inimage, grid, xi, yi) : TILE_INFER;
+
+                TileDedupCache::Tile previous;
+                if (temporal_cache && tile_class == TILE_INFER)
+                    previous = temporal_match(inimage, grid, xi, yi);
+
+                TileKey key;
+                TileDedupCache::Tile cached;
+                if (tile_cache && tile_class == TILE_INFER && !previous)
+                {
+                    key = tile_key(inimage, grid, xi, yi);
+                    cached = tile_cache->get(key);
+                }
+
+                if (tile_class != TILE_INFER)
+                {
+                    skip_stats.add(tile_class);
+                    fill_skipped(inimage, grid, xi, yi, outrows, out_row_bytes);
+                }
+                else if (previous)
+                {
+                    temporal_reused++;
+                    load_cached(previous, grid, xi, yi, outrows, out_row_bytes);
+                }
+                else if (cached)
+                {
+                    load_cached(cached, grid, xi, yi, outrows, out_row_bytes);
+                }
+                else
+                {
+                    {
+                        BenchTile bench_tile;
+
+                        e.process_cpu_tile(inimage, outrows, grid, xi, yi, opt);
+                    }
+
+                    if (tile_cache)
+                        store_tile(key, grid, xi, yi, outrows, out_row_bytes);
+                }
+
+                if (temporal_cache && tile_class == TILE_INFER && !previous)
+                    temporal_store(inimage, grid, xi, yi, outrows, out_row_bytes);
+
+                progress.tile_done();
+            }
+        };
+
+        std::vector<std::thread> workers;
+        for (int i = 1; i < tile_workers; i++)
+        {
+            workers.emplace_back(worker);
+        }
+        worker();
+        for (size_t i = 0; i < workers.size(); i++)
+        {
+            workers[i].join();
+        }
+    };
+
+    int ret = 0;
+    int done_tiles = tiles;
+    if (queue)
+    {
+        done_tiles = 0;
+        for (int yi = queue->claim(); yi != -1; yi = queue->claim())
+        {
+            run_tiles(yi * xtiles, (yi + 1) * xtiles);
+            done_tiles += xtiles;
+        }
+    }
+    else if (!writer)
+    {
+        run_tiles(0, tiles);
+    }
+    else
+    {
+        for (int yi = 0; yi < ytiles; yi++)
+        {
+            int out_tile_y0, out_tile_y1;
+            e.band_output_rows(grid, yi, out_tile_y0, out_tile_y1);
+
+            const int band_h = (out_tile_y1 - out_tile_y0) * scale;
+            band.create(grid.w * scale, band_h, (size_t)grid.channels, 1);
+
+            run_tiles(yi * xtiles, (yi + 1) * xtiles);
+
+            if (!writer->write_rows((const unsigned char*)band.data, band_h, out_row_bytes))
+            {
+                fprintf(stderr, "stream write failed at tile row %d\n", yi);
+                ret = -1;
+                break;
+            }
+        }
+    }
+
+    if (flat_tile_range >= 0)
+    {
+        skip_stats.print(done_tiles);
+    }
+
+    if (temporal_cache)
+    {
+        temporal_frame_done(temporal_reused.load(), tiles, queue);
+    }
+
+    double time_span = progress.elapsed();
+    fprintf(stderr, "cpu tiles: %d, workers: %d x %d threads, %.2f tiles/s\n", done_tiles, tile_workers, tile_threads,
+            time_span > 0 ? done_tiles / time_span : 0.0);
+
+    return ret;
+}
+
+template <class Engine>
+int TiledUpscaler<Engine>::process_tiled_shared(const std::vector<const Engine*>& engines, const ncnn::Mat& inimage, ncnn::Mat& outimage)
+{
+    TileGrid grid;
+    grid.w = inimage.w;
+    grid.h = inimage.h;
+    grid.channels = inimage.elempack;
+    engines[0]->tile_grid(grid);
+
+    for (size_t i = 1; i < engines.size(); i++)
+    {
+        TileGrid other = grid;
+        engines[i]->tile_grid(other);
+        if (other.xtiles != grid.xtiles || other.ytiles != grid.ytiles || engines[i]->tilesize != engines[0]->tilesize)
+        {
+            fprintf(stderr, "tile sharing needs the same tilesize on every device\n");
+            return -1;
+        }
+    }
+
+    TileRowQueue queue(grid.ytiles, grid.xtiles * grid.ytiles);
+
+    std::vector<int> rets(engines.size(), 0);
+    auto run_engine = [&](size_t i) {
+        const Engine& e = *engines[i];
+        rets[i] = e.vkdev ? e.process_tiled_gpu(inimage, outimage, 0, &queue) : e.process_tiled_cpu(inimage, outimage, 0, &queue);
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < engines.size(); i++)
+    {
+        workers.emplace_back(run_engine, i);
+    }
+    run_engine(0);
+    for (size_t i = 0; i < workers.size(); i++)
+    {
+        workers[i].join();
+    }
+
+    for (size_t i = 0; i < rets.size(); i++)
+    {
+        if (rets[i] != 0)
+            return rets[i];
+    }
+
+    if (engines[0]->temporal_cache)
+    {
+        engines[0]->temporal_cache->frame_done(queue.temporal_reused.load(), grid.xtiles * grid.ytiles);
+    }
+
+    return 0;
+}
+
+#endif // TILED_UPSCALER_H
@@ -0,0 +1,123 @@
+#ifndef TILE_PARITY_GLSL_COMPAT_H
+#define TILE_PARITY_GLSL_COMPAT_H
+
+// What the pre- and postprocess glsl of the engines needs to run as c++, one invocation at a time.
+// shader_gen turns every layout declaration into a member of a glsl::Invocation and keeps the rest
+// of the source as it is, the statements of these shaders are valid c++ already.
+
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <vector>
+
+#include "mock_shaders.h"
+
+namespace glsl {
+
+typedef unsigned int uint;
+typedef _Float16 float16_t;
+
+using std::abs;
+using std::floor;
+
+template <typename T, typename L, typename H>
+inline T clamp(T x, L lo, H hi)
+{
+    return std::min(std::max(x, (T)lo), (T)hi);
+}
+
+// accesses outside of the bound buffer, robust buffer access makes them read 0 and drops the write
+std::atomic<long>& out_of_bounds();
+
+template <typename T>
+class Buf
+{
+public:
+    Buf(T* _data, size_t _count) : data(_data), count(_count), sink(0) {}
+
+    T& operator[](int i)
+    {
+        if (i < 0 || (size_t)i >= count)
+        {
+            out_of_bounds()++;
+            sink = T(0);
+            return sink;
+        }
+        return data[i];
+    }
+
+private:
+    T* data;
+    size_t count;
+    T sink;
+};
+
+struct UVec3
+{
+    uint x;
+    uint y;
+    uint z;
+};
+
+class Invocation
+{
+public:
+    explicit Invocation(const MockShaderArgs& _args) : args(_args) {}
+
+    UVec3 gl_GlobalInvocationID;
+
+protected:
+    template <typename T>
+    T spec(int id, T def) const
+    {
+        if ((size_t)id >= args.specializations->size())
+            return def;
+        return (T)(*args.specializations)[id].i;
+    }
+
+    // an empty binding is a null descriptor, every access is out of bounds
+    template <typename T>
+    Buf<T> binding(int id) const
+    {
+        if ((size_t)id >= args.bindings->size())
+            return Buf<T>(0, 0);
+        const ncnn::VkMat& m = (*args.bindings)[id];
+        return Buf<T>((T*)m.data, m.size_in_bytes() / sizeof(T));
+    }
+
+    void push_constants(void* p, size_t size) const
+    {
+        memset(p, 0, size);
+        memcpy(p, args.constants->data(), std::min(size, args.constants->size() * sizeof(ncnn::vk_constant_type)));
+    }
+
+    const MockShaderArgs& args;
+};
+
+// every invocation of the dispatch in order, the shaders write disjoint elements
+template <typename S>
+void dispatch(const MockShaderArgs& args)
+{
+    S s(args);
+    s.load();
+    for (int z = 0; z < args.c; z++)
+    {
+        for (int y = 0; y < args.h; y++)
+        {
+            for (int x = 0; x < args.w; x++)
+            {
+                s.gl_GlobalInvocationID.x = x;
+                s.gl_GlobalInvocationID.y = y;
+                s.gl_GlobalInvocationID.z = z;
+                s.main();
+            }
+        }
+    }
+}
+
+} // namespace glsl
+
+#endif // TILE_PARITY_GLSL_COMPAT_H
@@ -0,0 +1,13 @@
+#ifndef TILE_PARITY_MOCK_MODEL_H
+#define TILE_PARITY_MOCK_MODEL_H
+
+// The network every mock ncnn::Net runs instead of its model, the same on the cpu and the gpu.
+//
+// The image output is an asymmetric 5x5 stencil over the input for every output subpixel, so a
+// tile placed one pixel off or a wrong padding shows up in the output. Any other output blob is a
+// feature blob of channel means, like the se blocks of realcugan, and every extra input blob nudges
+// the image output. A model crops crop input pixels on each side and upscales by scale.
+
+void mock_model_configure(int scale, int crop);
+
+#endif // TILE_PARITY_MOCK_MODEL_H
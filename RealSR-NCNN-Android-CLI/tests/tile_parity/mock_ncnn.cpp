@@ -0,0 +1,1589 @@
+// The subset of ncnn the engines use, functional enough to run the tiling of the cpu and the gpu
+// path. The device is host memory: a VkCompute records what the engine asks for and runs it in
+// submit_and_wait(), the pre- and postprocess shaders run as translated glsl (mock_shaders.h) and
+// every net runs the stand-in model of mock_model.h.
+
+#include <math.h>
+#include <algorithm>
+#include <chrono>
+#include <map>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "benchmark.h"
+#include "command.h"
+#include "cpu.h"
+#include "gpu.h"
+#include "layer.h"
+#include "net.h"
+#include "pipeline.h"
+
+#include "glsl_compat.h"
+#include "mock_model.h"
+#include "mock_shaders.h"
+
+static int g_scale = 2;
+static int g_crop = 0;
+
+void mock_model_configure(int scale, int crop)
+{
+    g_scale = scale;
+    g_crop = crop;
+}
+
+namespace glsl {
+
+std::atomic<long>& out_of_bounds()
+{
+    static std::atomic<long> count(0);
+    return count;
+}
+
+} // namespace glsl
+
+namespace ncnn {
+
+static size_t align_size(size_t sz, int n)
+{
+    return (sz + n - 1) & -n;
+}
+
+// Mat
+
+Mat::Mat()
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+}
+
+Mat::Mat(int _w, int _h, size_t _elemsize, Allocator* _allocator)
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+    create(_w, _h, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, size_t _elemsize, Allocator* _allocator)
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+    create(_w, _h, _c, _elemsize, _allocator);
+}
+
+Mat::Mat(int _w, int _h, size_t _elemsize, int _elempack, Allocator* _allocator)
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+    create(_w, _h, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, int _c, size_t _elemsize, int _elempack, Allocator* _allocator)
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+    create(_w, _h, _c, _elemsize, _elempack, _allocator);
+}
+
+Mat::Mat(int _w, int _h, void* _data, size_t _elemsize, Allocator* _allocator)
+    : data(_data), refcount(0), elemsize(_elemsize), elempack(1), allocator(_allocator), dims(2), w(_w), h(_h), d(1), c(1)
+{
+    cstep = (size_t)w * h;
+}
+
+Mat::Mat(int _w, int _h, void* _data, size_t _elemsize, int _elempack, Allocator* _allocator)
+    : data(_data), refcount(0), elemsize(_elemsize), elempack(_elempack), allocator(_allocator), dims(2), w(_w), h(_h), d(1), c(1)
+{
+    cstep = (size_t)w * h;
+}
+
+Mat::Mat(int _w, int _h, int _c, void* _data, size_t _elemsize, Allocator* _allocator)
+    : data(_data), refcount(0), elemsize(_elemsize), elempack(1), allocator(_allocator), dims(3), w(_w), h(_h), d(1), c(_c)
+{
+    cstep = align_size((size_t)w * h * elemsize, 16) / elemsize;
+}
+
+Mat::Mat(int _w, int _h, int _c, void* _data, size_t _elemsize, int _elempack, Allocator* _allocator)
+    : data(_data), refcount(0), elemsize(_elemsize), elempack(_elempack), allocator(_allocator), dims(3), w(_w), h(_h), d(1), c(_c)
+{
+    cstep = align_size((size_t)w * h * elemsize, 16) / elemsize;
+}
+
+Mat::Mat(const Mat& m)
+    : data(m.data), refcount(m.refcount), elemsize(m.elemsize), elempack(m.elempack), allocator(m.allocator), dims(m.dims), w(m.w), h(m.h), d(m.d), c(m.c), cstep(m.cstep)
+{
+    if (refcount)
+        __atomic_add_fetch(refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+Mat::~Mat()
+{
+    release();
+}
+
+Mat& Mat::operator=(const Mat& m)
+{
+    if (this == &m)
+        return *this;
+
+    if (m.refcount)
+        __atomic_add_fetch(m.refcount, 1, __ATOMIC_SEQ_CST);
+
+    release();
+
+    data = m.data;
+    refcount = m.refcount;
+    elemsize = m.elemsize;
+    elempack = m.elempack;
+    allocator = m.allocator;
+    dims = m.dims;
+    w = m.w;
+    h = m.h;
+    d = m.d;
+    c = m.c;
+    cstep = m.cstep;
+    return *this;
+}
+
+void Mat::fill(float v)
+{
+    float* ptr = (float*)data;
+    for (size_t i = 0; i < total(); i++)
+        ptr[i] = v;
+}
+
+Mat Mat::clone(Allocator* _allocator) const
+{
+    if (empty())
+        return Mat();
+
+    Mat m;
+    if (dims == 2)
+        m.create(w, h, elemsize, elempack, _allocator);
+    else
+        m.create(w, h, c, elemsize, elempack, _allocator);
+
+    if (m.cstep == cstep)
+        memcpy(m.data, data, total() * elemsize);
+    else
+    {
+        for (int q = 0; q < c; q++)
+            memcpy((unsigned char*)m.data + m.cstep * q * elemsize, (const unsigned char*)data + cstep * q * elemsize, (size_t)w * h * elemsize);
+    }
+    return m;
+}
+
+void Mat::create(int _w, int _h, size_t _elemsize, Allocator* _allocator)
+{
+    create(_w, _h, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, int _h, int _c, size_t _elemsize, Allocator* _allocator)
+{
+    create(_w, _h, _c, _elemsize, 1, _allocator);
+}
+
+void Mat::create(int _w, int _h, size_t _elemsize, int _elempack, Allocator* _allocator)
+{
+    if (dims == 2 && w == _w && h == _h && elemsize == _elemsize && elempack == _elempack && allocator == _allocator)
+        return;
+
+    release();
+
+    elemsize = _elemsize;
+    elempack = _elempack;
+    allocator = _allocator;
+    dims = 2;
+    w = _w;
+    h = _h;
+    d = 1;
+    c = 1;
+    cstep = (size_t)w * h;
+
+    if (total() > 0)
+    {
+        data = calloc(align_size(total() * elemsize, 4), 1);
+        refcount = new int(1);
+    }
+}
+
+void Mat::create(int _w, int _h, int _c, size_t _elemsize, int _elempack, Allocator* _allocator)
+{
+    if (dims == 3 && w == _w && h == _h && c == _c && elemsize == _elemsize && elempack == _elempack && allocator == _allocator)
+        return;
+
+    release();
+
+    elemsize = _elemsize;
+    elempack = _elempack;
+    allocator = _allocator;
+    dims = 3;
+    w = _w;
+    h = _h;
+    d = 1;
+    c = _c;
+    cstep = align_size((size_t)w * h * elemsize, 16) / elemsize;
+
+    if (total() > 0)
+    {
+        data = calloc(align_size(total() * elemsize, 4), 1);
+        refcount = new int(1);
+    }
+}
+
+void Mat::create_like(const Mat& m, Allocator* _allocator)
+{
+    if (m.dims == 2)
+        create(m.w, m.h, m.elemsize, m.elempack, _allocator);
+    else
+        create(m.w, m.h, m.c, m.elemsize, m.elempack, _allocator);
+}
+
+void Mat::release()
+{
+    if (refcount && __atomic_sub_fetch(refcount, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        free(data);
+        delete refcount;
+    }
+
+    data = 0;
+    refcount = 0;
+    elemsize = 0;
+    elempack = 0;
+    dims = 0;
+    w = 0;
+    h = 0;
+    d = 0;
+    c = 0;
+    cstep = 0;
+}
+
+bool Mat::empty() const
+{
+    return data == 0 || total() == 0;
+}
+
+size_t Mat::total() const
+{
+    return cstep * c;
+}
+
+int Mat::elembits() const
+{
+    return elempack ? (int)(elemsize * 8) / elempack : 0;
+}
+
+Mat Mat::channel(int _c)
+{
+    Mat m(w, h, (unsigned char*)data + cstep * _c * elemsize, elemsize, elempack, allocator);
+    m.dims = dims - 1;
+    return m;
+}
+
+const Mat Mat::channel(int _c) const
+{
+    Mat m(w, h, (unsigned char*)data + cstep * _c * elemsize, elemsize, elempack, allocator);
+    m.dims = dims - 1;
+    return m;
+}
+
+Mat Mat::channel_range(int _c, int channels)
+{
+    Mat m(w, h, channels, (unsigned char*)data + cstep * _c * elemsize, elemsize, elempack, allocator);
+    m.cstep = cstep;
+    return m;
+}
+
+const Mat Mat::channel_range(int _c, int channels) const
+{
+    Mat m(w, h, channels, (unsigned char*)data + cstep * _c * elemsize, elemsize, elempack, allocator);
+    m.cstep = cstep;
+    return m;
+}
+
+float* Mat::row(int y)
+{
+    return (float*)((unsigned char*)data + (size_t)w * y * elemsize);
+}
+
+const float* Mat::row(int y) const
+{
+    return (const float*)((unsigned char*)data + (size_t)w * y * elemsize);
+}
+
+static void pixel_format(int type, int& src_c, int& dst_c, bool& swap)
+{
+    const int from = type & Mat::PIXEL_FORMAT_MASK;
+    const int to = type >> Mat::PIXEL_CONVERT_SHIFT ? type >> Mat::PIXEL_CONVERT_SHIFT : from;
+
+    src_c = (from == Mat::PIXEL_RGBA || from == Mat::PIXEL_BGRA) ? 4 : from == Mat::PIXEL_GRAY ? 1 : 3;
+    dst_c = (to == Mat::PIXEL_RGBA || to == Mat::PIXEL_BGRA) ? 4 : to == Mat::PIXEL_GRAY ? 1 : 3;
+
+    const bool from_rgb = from == Mat::PIXEL_RGB || from == Mat::PIXEL_RGBA;
+    const bool to_rgb = to == Mat::PIXEL_RGB || to == Mat::PIXEL_RGBA;
+    swap = from_rgb != to_rgb && src_c > 1 && dst_c > 1;
+}
+
+Mat Mat::from_pixels_roi(const unsigned char* pixels, int type, int /*w*/, int /*h*/, int stride, int roix, int roiy, int roiw, int roih, Allocator* allocator)
+{
+    int src_c, dst_c;
+    bool swap;
+    pixel_format(type, src_c, dst_c, swap);
+
+    Mat m(roiw, roih, dst_c, 4u, allocator);
+    for (int q = 0; q < dst_c; q++)
+    {
+        const int sq = swap && q < 3 ? 2 - q : q;
+        float* outptr = m.channel(q);
+        for (int y = 0; y < roih; y++)
+        {
+            for (int x = 0; x < roiw; x++)
+                *outptr++ = pixels[(size_t)(roiy + y) * stride + (size_t)(roix + x) * src_c + sq];
+        }
+    }
+    return m;
+}
+
+Mat Mat::from_pixels_roi(const unsigned char* pixels, int type, int w, int h, int roix, int roiy, int roiw, int roih, Allocator* allocator)
+{
+    int src_c, dst_c;
+    bool swap;
+    pixel_format(type, src_c, dst_c, swap);
+    return from_pixels_roi(pixels, type, w, h, w * src_c, roix, roiy, roiw, roih, allocator);
+}
+
+Mat Mat::from_pixels(const unsigned char* pixels, int type, int w, int h, int stride, Allocator* allocator)
+{
+    return from_pixels_roi(pixels, type, w, h, stride, 0, 0, w, h, allocator);
+}
+
+Mat Mat::from_pixels(const unsigned char* pixels, int type, int w, int h, Allocator* allocator)
+{
+    return from_pixels_roi(pixels, type, w, h, 0, 0, w, h, allocator);
+}
+
+void Mat::to_pixels(unsigned char* pixels, int type, int stride) const
+{
+    int src_c, dst_c;
+    bool swap;
+    pixel_format(type, src_c, dst_c, swap);
+
+    for (int q = 0; q < dst_c; q++)
+    {
+        const int sq = swap && q < 3 ? 2 - q : q;
+        const float* ptr = channel(sq);
+        for (int y = 0; y < h; y++)
+        {
+            for (int x = 0; x < w; x++)
+            {
+                const int v = (int)*ptr++;
+                pixels[(size_t)y * stride + (size_t)x * dst_c + q] = (unsigned char)std::min(std::max(v, 0), 255);
+            }
+        }
+    }
+}
+
+void Mat::to_pixels(unsigned char* pixels, int type) const
+{
+    int src_c, dst_c;
+    bool swap;
+    pixel_format(type, src_c, dst_c, swap);
+    to_pixels(pixels, type, w * dst_c);
+}
+
+// VkMat
+
+VkMat::VkMat()
+    : data(0), refcount(0), elemsize(0), elempack(0), allocator(0), dims(0), w(0), h(0), d(0), c(0), cstep(0)
+{
+}
+
+VkMat::VkMat(const VkMat& m)
+    : data(m.data), refcount(m.refcount), elemsize(m.elemsize), elempack(m.elempack), allocator(m.allocator), dims(m.dims), w(m.w), h(m.h), d(m.d), c(m.c), cstep(m.cstep)
+{
+    if (refcount)
+        __atomic_add_fetch(refcount, 1, __ATOMIC_SEQ_CST);
+}
+
+VkMat::~VkMat()
+{
+    release();
+}
+
+VkMat& VkMat::operator=(const VkMat& m)
+{
+    if (this == &m)
+        return *this;
+
+    if (m.refcount)
+        __atomic_add_fetch(m.refcount, 1, __ATOMIC_SEQ_CST);
+
+    release();
+
+    data = m.data;
+    refcount = m.refcount;
+    elemsize = m.elemsize;
+    elempack = m.elempack;
+    allocator = m.allocator;
+    dims = m.dims;
+    w = m.w;
+    h = m.h;
+    d = m.d;
+    c = m.c;
+    cstep = m.cstep;
+    return *this;
+}
+
+// device memory is not cleared, a pattern stands in for what an earlier tile left behind
+static void* vk_alloc(size_t size)
+{
+    void* ptr = malloc(align_size(size, 4));
+    memset(ptr, 0x5a, align_size(size, 4));
+    return ptr;
+}
+
+void VkMat::create(int _w, int _h, size_t _elemsize, VkAllocator* _allocator)
+{
+    create(_w, _h, _elemsize, 1, _allocator);
+}
+
+void VkMat::create(int _w, int _h, int _c, size_t _elemsize, VkAllocator* _allocator)
+{
+    create(_w, _h, _c, _elemsize, 1, _allocator);
+}
+
+void VkMat::create(int _w, int _h, size_t _elemsize, int _elempack, VkAllocator* _allocator)
+{
+    if (dims == 2 && w == _w && h == _h && elemsize == _elemsize && elempack == _elempack && allocator == _allocator)
+        return;
+
+    release();
+
+    if (!_allocator)
+        return;
+
+    elemsize = _elemsize;
+    elempack = _elempack;
+    allocator = _allocator;
+    dims = 2;
+    w = _w;
+    h = _h;
+    d = 1;
+    c = 1;
+    cstep = (size_t)w * h;
+
+    if (total() > 0)
+    {
+        data = vk_alloc(total() * elemsize);
+        refcount = new int(1);
+    }
+}
+
+void VkMat::create(int _w, int _h, int _c, size_t _elemsize, int _elempack, VkAllocator* _allocator)
+{
+    if (dims == 3 && w == _w && h == _h && c == _c && elemsize == _elemsize && elempack == _elempack && allocator == _allocator)
+        return;
+
+    release();
+
+    if (!_allocator)
+        return;
+
+    elemsize = _elemsize;
+    elempack = _elempack;
+    allocator = _allocator;
+    dims = 3;
+    w = _w;
+    h = _h;
+    d = 1;
+    c = _c;
+    cstep = align_size((size_t)w * h * elemsize, 16) / elemsize;
+
+    if (total() > 0)
+    {
+        data = vk_alloc(total() * elemsize);
+        refcount = new int(1);
+    }
+}
+
+void VkMat::create_like(const Mat& m, VkAllocator* _allocator)
+{
+    if (m.dims == 2)
+        create(m.w, m.h, m.elemsize, m.elempack, _allocator);
+    else
+        create(m.w, m.h, m.c, m.elemsize, m.elempack, _allocator);
+}
+
+void VkMat::create_like(const VkMat& m, VkAllocator* _allocator)
+{
+    if (m.dims == 2)
+        create(m.w, m.h, m.elemsize, m.elempack, _allocator);
+    else
+        create(m.w, m.h, m.c, m.elemsize, m.elempack, _allocator);
+}
+
+void VkMat::release()
+{
+    if (refcount && __atomic_sub_fetch(refcount, 1, __ATOMIC_SEQ_CST) == 0)
+    {
+        free(data);
+        delete refcount;
+    }
+
+    data = 0;
+    refcount = 0;
+    elemsize = 0;
+    elempack = 0;
+    allocator = 0;
+    dims = 0;
+    w = 0;
+    h = 0;
+    d = 0;
+    c = 0;
+    cstep = 0;
+}
+
+bool VkMat::empty() const
+{
+    return data == 0 || total() == 0;
+}
+
+size_t VkMat::total() const
+{
+    return cstep * c;
+}
+
+int VkMat::elembits() const
+{
+    return elempack ? (int)(elemsize * 8) / elempack : 0;
+}
+
+size_t VkMat::size_in_bytes() const
+{
+    return data ? total() * elemsize : 0;
+}
+
+// element i of a fp32, fp16 or uint8 blob
+static float load_element(const void* data, size_t elemsize, size_t i)
+{
+    if (elemsize == 2)
+        return (float)((const _Float16*)data)[i];
+    if (elemsize == 1)
+        return (float)((const unsigned char*)data)[i];
+    return ((const float*)data)[i];
+}
+
+static void store_element(void* data, size_t elemsize, size_t i, float v)
+{
+    if (elemsize == 2)
+        ((_Float16*)data)[i] = (_Float16)v;
+    else if (elemsize == 1)
+        ((unsigned char*)data)[i] = (unsigned char)std::min(std::max((int)v, 0), 255);
+    else
+        ((float*)data)[i] = v;
+}
+
+// fp32 copy of a device blob
+static Mat vk_to_mat(const VkMat& m)
+{
+    Mat out(m.w, m.h, m.c, 4u);
+    for (int q = 0; q < m.c; q++)
+    {
+        float* outptr = out.channel(q);
+        for (size_t i = 0; i < (size_t)m.w * m.h; i++)
+            outptr[i] = load_element(m.data, m.elemsize, m.cstep * q + i);
+    }
+    return out;
+}
+
+static void mat_to_vk(const Mat& m, const VkMat& dst)
+{
+    for (int q = 0; q < m.c; q++)
+    {
+        const float* ptr = m.channel(q);
+        for (size_t i = 0; i < (size_t)m.w * m.h; i++)
+            store_element(dst.data, dst.elemsize, dst.cstep * q + i, ptr[i]);
+    }
+}
+
+// border and casting
+
+static int border_index(int i, int n, int type)
+{
+    if (type == BORDER_REPLICATE)
+        return std::min(std::max(i, 0), n - 1);
+
+    // reflect101, clamped for pads larger than the image
+    for (int k = 0; k < 4 && (i < 0 || i >= n); k++)
+        i = i < 0 ? -i : 2 * (n - 1) - i;
+    return std::min(std::max(i, 0), n - 1);
+}
+
+void copy_make_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, int type, float v, const Option&)
+{
+    Mat m(src.w + left + right, src.h + top + bottom, src.c);
+    for (int q = 0; q < src.c; q++)
+    {
+        const Mat s = src.channel(q);
+        float* outptr = m.channel(q);
+        for (int y = 0; y < m.h; y++)
+        {
+            for (int x = 0; x < m.w; x++)
+            {
+                const int sy = y - top;
+                const int sx = x - left;
+                if (type == BORDER_CONSTANT && (sy < 0 || sy >= src.h || sx < 0 || sx >= src.w))
+                    *outptr++ = v;
+                else
+                    *outptr++ = s.row(border_index(sy, src.h, type))[border_index(sx, src.w, type)];
+            }
+        }
+    }
+    dst = m;
+}
+
+void copy_make_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, int type, float v)
+{
+    copy_make_border(src, dst, top, bottom, left, right, type, v, Option());
+}
+
+void copy_cut_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, const Option&)
+{
+    Mat m(src.w - left - right, src.h - top - bottom, src.c);
+    for (int q = 0; q < src.c; q++)
+    {
+        const Mat s = src.channel(q);
+        float* outptr = m.channel(q);
+        for (int y = 0; y < m.h; y++)
+        {
+            for (int x = 0; x < m.w; x++)
+                *outptr++ = s.row(y + top)[x + left];
+        }
+    }
+    dst = m;
+}
+
+void copy_cut_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right)
+{
+    copy_cut_border(src, dst, top, bottom, left, right, Option());
+}
+
+// everything is elempack 1
+void convert_packing(const Mat& src, Mat& dst, int, const Option&)
+{
+    dst = src;
+}
+
+void cast_float32_to_float16(const Mat& src, Mat& dst, const Option&)
+{
+    Mat m;
+    if (src.dims == 2)
+        m.create(src.w, src.h, 2u, 1);
+    else
+        m.create(src.w, src.h, src.c, 2u, 1);
+
+    for (size_t i = 0; i < src.total(); i++)
+        ((_Float16*)m.data)[i] = (_Float16)((const float*)src.data)[i];
+    dst = m;
+}
+
+void cast_float16_to_float32(const Mat& src, Mat& dst, const Option&)
+{
+    Mat m;
+    if (src.dims == 2)
+        m.create(src.w, src.h, 4u, 1);
+    else
+        m.create(src.w, src.h, src.c, 4u, 1);
+
+    for (size_t i = 0; i < src.total(); i++)
+        ((float*)m.data)[i] = (float)((const _Float16*)src.data)[i];
+    dst = m;
+}
+
+// allocators
+
+Allocator::~Allocator()
+{
+}
+
+void PoolAllocator::set_size_compare_ratio(float)
+{
+}
+
+void PoolAllocator::clear()
+{
+}
+
+void* PoolAllocator::fastMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void PoolAllocator::fastFree(void* ptr)
+{
+    free(ptr);
+}
+
+void UnlockedPoolAllocator::set_size_compare_ratio(float)
+{
+}
+
+void UnlockedPoolAllocator::clear()
+{
+}
+
+void* UnlockedPoolAllocator::fastMalloc(size_t size)
+{
+    return malloc(size);
+}
+
+void UnlockedPoolAllocator::fastFree(void* ptr)
+{
+    free(ptr);
+}
+
+VkAllocator::~VkAllocator()
+{
+}
+
+Option::Option()
+{
+    lightmode = true;
+    num_threads = 1;
+    blob_allocator = 0;
+    workspace_allocator = 0;
+    blob_vkallocator = 0;
+    workspace_vkallocator = 0;
+    staging_vkallocator = 0;
+    pipeline_cache = 0;
+    openmp_blocktime = 20;
+    use_winograd_convolution = true;
+    use_sgemm_convolution = true;
+    use_int8_inference = true;
+    use_vulkan_compute = false;
+    use_bf16_storage = false;
+    use_fp16_packed = true;
+    use_fp16_storage = true;
+    use_fp16_arithmetic = true;
+    use_int8_packed = true;
+    use_int8_storage = true;
+    use_int8_arithmetic = false;
+    use_packing_layout = true;
+    use_shader_pack8 = false;
+    use_subgroup_basic = false;
+    use_local_pool_allocator = true;
+    use_tensor_storage = false;
+}
+
+Mutex::Mutex()
+{
+    pthread_mutex_init(&mutex, 0);
+}
+
+Mutex::~Mutex()
+{
+    pthread_mutex_destroy(&mutex);
+}
+
+void Mutex::lock()
+{
+    pthread_mutex_lock(&mutex);
+}
+
+void Mutex::unlock()
+{
+    pthread_mutex_unlock(&mutex);
+}
+
+// gpu
+
+int create_gpu_instance(const char*)
+{
+    return 0;
+}
+
+void destroy_gpu_instance()
+{
+}
+
+uint32_t GpuInfo::api_version() const
+{
+    return (1u << 22) | (2u << 12);
+}
+
+uint32_t GpuInfo::driver_version() const
+{
+    return 1;
+}
+
+uint32_t GpuInfo::vendor_id() const
+{
+    return 0x10005;
+}
+
+uint32_t GpuInfo::device_id() const
+{
+    return 0;
+}
+
+const char* GpuInfo::device_name() const
+{
+    return "tile-parity mock device";
+}
+
+const uint8_t* GpuInfo::pipeline_cache_uuid() const
+{
+    static const uint8_t uuid[16] = {'t', 'i', 'l', 'e', '-', 'p', 'a', 'r', 'i', 't', 'y', 0, 0, 0, 0, 1};
+    return uuid;
+}
+
+uint32_t GpuInfo::compute_queue_count() const
+{
+    return 2;
+}
+
+int GpuInfo::type() const
+{
+    return 2;
+}
+
+bool GpuInfo::support_fp16_storage() const
+{
+    return true;
+}
+
+bool GpuInfo::support_int8_storage() const
+{
+    return true;
+}
+
+int get_gpu_count()
+{
+    return 1;
+}
+
+int get_default_gpu_index()
+{
+    return 0;
+}
+
+const GpuInfo& get_gpu_info(int)
+{
+    static GpuInfo info;
+    return info;
+}
+
+VulkanDevice::VulkanDevice(int device_index)
+    : info(get_gpu_info(device_index))
+{
+}
+
+VulkanDevice::~VulkanDevice()
+{
+    for (size_t i = 0; i < owned.size(); i++)
+        delete owned[i];
+}
+
+uint32_t VulkanDevice::get_heap_budget() const
+{
+    return 4096;
+}
+
+VkAllocator* VulkanDevice::acquire_blob_allocator() const
+{
+    MutexLockGuard guard(lock);
+
+    if (!blob_allocators.empty())
+    {
+        VkAllocator* allocator = blob_allocators.back();
+        blob_allocators.pop_back();
+        return allocator;
+    }
+
+    VkAllocator* allocator = new VkAllocator;
+    owned.push_back(allocator);
+    return allocator;
+}
+
+void VulkanDevice::reclaim_blob_allocator(VkAllocator* allocator) const
+{
+    MutexLockGuard guard(lock);
+    blob_allocators.push_back(allocator);
+}
+
+VkAllocator* VulkanDevice::acquire_staging_allocator() const
+{
+    MutexLockGuard guard(lock);
+
+    if (!staging_allocators.empty())
+    {
+        VkAllocator* allocator = staging_allocators.back();
+        staging_allocators.pop_back();
+        return allocator;
+    }
+
+    VkAllocator* allocator = new VkAllocator;
+    owned.push_back(allocator);
+    return allocator;
+}
+
+void VulkanDevice::reclaim_staging_allocator(VkAllocator* allocator) const
+{
+    MutexLockGuard guard(lock);
+    staging_allocators.push_back(allocator);
+}
+
+VulkanDevice* get_gpu_device(int device_index)
+{
+    static VulkanDevice vkdev(device_index);
+    return &vkdev;
+}
+
+int compile_spirv_module(const char* comp_data, int comp_data_size, const Option& opt, std::vector<uint32_t>& spirv)
+{
+    const std::vector<MockShader>& shaders = mock_shaders();
+    for (size_t i = 0; i < shaders.size(); i++)
+    {
+        if (shaders[i].comp_data_size == comp_data_size && memcmp(shaders[i].comp_data, comp_data, comp_data_size) == 0)
+        {
+            spirv.resize(5);
+            spirv[0] = MOCK_SPIRV_MAGIC;
+            spirv[1] = MOCK_SPIRV_TAG;
+            spirv[2] = (uint32_t)i;
+            spirv[3] = opt.use_fp16_storage ? 1 : 0;
+            spirv[4] = opt.use_int8_storage ? 1 : 0;
+            return 0;
+        }
+    }
+
+    fprintf(stderr, "compile_spirv_module: unknown shader source\n");
+    spirv.clear();
+    return -1;
+}
+
+Pipeline::Pipeline(const VulkanDevice*)
+    : shader(0), variant(0)
+{
+}
+
+Pipeline::~Pipeline()
+{
+}
+
+void Pipeline::set_optimal_local_size_xyz(int, int, int)
+{
+}
+
+int Pipeline::create(const uint32_t* spv_data, size_t spv_data_size, const std::vector<vk_specialization_type>& _specializations)
+{
+    specializations = _specializations;
+
+    const std::vector<MockShader>& shaders = mock_shaders();
+
+    if (spv_data_size == 20 && spv_data[0] == MOCK_SPIRV_MAGIC && spv_data[1] == MOCK_SPIRV_TAG && spv_data[2] < shaders.size())
+    {
+        shader = &shaders[spv_data[2]];
+        variant = spv_data[3] * 2 + spv_data[4];
+        return 0;
+    }
+
+    const std::vector<MockPrebuiltShader>& prebuilt = mock_prebuilt_shaders();
+    for (size_t i = 0; i < prebuilt.size(); i++)
+    {
+        if (prebuilt[i].spv_data_size != spv_data_size || memcmp(prebuilt[i].spv_data, spv_data, spv_data_size) != 0)
+            continue;
+
+        for (size_t j = 0; j < shaders.size(); j++)
+        {
+            if (strcmp(shaders[j].name, prebuilt[i].shader_name) == 0)
+            {
+                shader = &shaders[j];
+                variant = prebuilt[i].variant;
+                return 0;
+            }
+        }
+    }
+
+    fprintf(stderr, "Pipeline::create: unknown spirv module of %d bytes\n", (int)spv_data_size);
+    return -1;
+}
+
+// command stream
+
+VkCompute::VkCompute(const VulkanDevice*)
+{
+}
+
+VkCompute::~VkCompute()
+{
+}
+
+void VkCompute::record_upload(const Mat& src, VkMat& dst, const Option& opt)
+{
+    // the staging copy is taken now, the device blob is fp16 with fp16 storage
+    Mat staging = src.clone();
+    if (opt.use_fp16_storage && staging.elembits() == 32)
+        cast_float32_to_float16(staging, staging, opt);
+
+    dst.create_like(staging, opt.blob_vkallocator);
+
+    VkMat dst_gpu = dst;
+    commands.push_back([staging, dst_gpu]() {
+        for (int q = 0; q < staging.c; q++)
+            memcpy((unsigned char*)dst_gpu.data + dst_gpu.cstep * q * dst_gpu.elemsize, (const unsigned char*)staging.data + staging.cstep * q * staging.elemsize, (size_t)staging.w * staging.h * staging.elemsize);
+    });
+}
+
+void VkCompute::record_download(const VkMat& src, Mat& dst, const Option& opt)
+{
+    // fp16 comes back as fp32 on a cpu without fp16 arithmetic
+    if (src.dims == 2)
+        dst.create(src.w, src.h, 4u, 1, opt.blob_allocator);
+    else
+        dst.create(src.w, src.h, src.c, 4u, 1, opt.blob_allocator);
+
+    VkMat src_gpu = src;
+    Mat dst_cpu = dst;
+    commands.push_back([src_gpu, dst_cpu]() {
+        for (int q = 0; q < src_gpu.c; q++)
+        {
+            float* outptr = (float*)dst_cpu.data + dst_cpu.cstep * q;
+            for (size_t i = 0; i < (size_t)src_gpu.w * src_gpu.h; i++)
+                outptr[i] = load_element(src_gpu.data, src_gpu.elemsize, src_gpu.cstep * q + i);
+        }
+    });
+}
+
+// a host visible destination is written right away, like ncnn does for mappable memory
+void VkCompute::record_clone(const Mat& src, VkMat& dst, const Option& opt)
+{
+    dst.create_like(src, opt.blob_vkallocator);
+    if (dst.empty())
+        return;
+
+    for (int q = 0; q < src.c; q++)
+        memcpy((unsigned char*)dst.data + dst.cstep * q * dst.elemsize, (const unsigned char*)src.data + src.cstep * q * src.elemsize, (size_t)src.w * src.h * src.elemsize);
+}
+
+void VkCompute::record_clone(const VkMat& src, Mat& dst, const Option& opt)
+{
+    if (src.dims == 2)
+        dst.create(src.w, src.h, src.elemsize, src.elempack, opt.blob_allocator);
+    else
+        dst.create(src.w, src.h, src.c, src.elemsize, src.elempack, opt.blob_allocator);
+
+    VkMat src_gpu = src;
+    Mat dst_cpu = dst;
+    commands.push_back([src_gpu, dst_cpu]() {
+        for (int q = 0; q < src_gpu.c; q++)
+            memcpy((unsigned char*)dst_cpu.data + dst_cpu.cstep * q * dst_cpu.elemsize, (const unsigned char*)src_gpu.data + src_gpu.cstep * q * src_gpu.elemsize, (size_t)src_gpu.w * src_gpu.h * src_gpu.elemsize);
+    });
+}
+
+void VkCompute::record_clone(const VkMat& src, VkMat& dst, const Option& opt)
+{
+    dst.create_like(src, opt.blob_vkallocator);
+
+    VkMat src_gpu = src;
+    VkMat dst_gpu = dst;
+    commands.push_back([src_gpu, dst_gpu]() {
+        memcpy(dst_gpu.data, src_gpu.data, src_gpu.size_in_bytes());
+    });
+}
+
+void VkCompute::record_pipeline(const Pipeline* pipeline, const std::vector<VkMat>& bindings, const std::vector<vk_constant_type>& constants, const VkMat& dispatcher)
+{
+    const MockShaderEntry entry = pipeline->shader ? pipeline->shader->entry[pipeline->variant] : 0;
+    const std::vector<vk_specialization_type> specializations = pipeline->specializations;
+    const int w = dispatcher.w;
+    const int h = dispatcher.h;
+    const int c = dispatcher.c;
+
+    commands.push_back([entry, bindings, constants, specializations, w, h, c]() {
+        if (!entry)
+            return;
+
+        MockShaderArgs args;
+        args.bindings = &bindings;
+        args.constants = &constants;
+        args.specializations = &specializations;
+        args.w = w;
+        args.h = h;
+        args.c = c;
+        entry(args);
+    });
+}
+
+void VkCompute::record_host(const std::function<void()>& work)
+{
+    commands.push_back(work);
+}
+
+int VkCompute::submit_and_wait()
+{
+    for (size_t i = 0; i < commands.size(); i++)
+        commands[i]();
+    commands.clear();
+    return 0;
+}
+
+int VkCompute::reset()
+{
+    commands.clear();
+    return 0;
+}
+
+// layers
+
+ParamDict::ParamDict()
+{
+}
+
+int ParamDict::get(int id, int def) const
+{
+    std::map<int, int>::const_iterator it = ints.find(id);
+    return it == ints.end() ? def : it->second;
+}
+
+float ParamDict::get(int id, float def) const
+{
+    std::map<int, float>::const_iterator it = floats.find(id);
+    return it == floats.end() ? def : it->second;
+}
+
+void ParamDict::set(int id, int i)
+{
+    ints[id] = i;
+}
+
+void ParamDict::set(int id, float f)
+{
+    floats[id] = f;
+}
+
+Layer::Layer()
+    : support_vulkan(false), vkdev(0)
+{
+}
+
+Layer::~Layer()
+{
+}
+
+int Layer::load_param(const ParamDict&)
+{
+    return 0;
+}
+
+int Layer::create_pipeline(const Option&)
+{
+    return 0;
+}
+
+int Layer::destroy_pipeline(const Option&)
+{
+    return 0;
+}
+
+int Layer::forward(const Mat&, Mat&, const Option&) const
+{
+    return -1;
+}
+
+int Layer::forward(const std::vector<Mat>&, std::vector<Mat>&, const Option&) const
+{
+    return -1;
+}
+
+int Layer::forward(const VkMat&, VkMat&, VkCompute&, const Option&) const
+{
+    return -1;
+}
+
+int Layer::forward(const std::vector<VkMat>&, std::vector<VkMat>&, VkCompute&, const Option&) const
+{
+    return -1;
+}
+
+// nearest upscale with a little left/right asymmetry, for the alpha channel
+class MockInterp : public Layer
+{
+public:
+    MockInterp()
+        : s(1)
+    {
+        support_vulkan = true;
+    }
+
+    virtual int load_param(const ParamDict& pd)
+    {
+        s = (int)pd.get(1, 1.f);
+        return 0;
+    }
+
+    virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option&) const
+    {
+        Mat m(bottom_blob.w * s, bottom_blob.h * s, bottom_blob.c);
+        for (int q = 0; q < bottom_blob.c; q++)
+        {
+            const Mat in = bottom_blob.channel(q);
+            float* outptr = m.channel(q);
+            for (int y = 0; y < m.h; y++)
+            {
+                for (int x = 0; x < m.w; x++)
+                    *outptr++ = in.row(y / s)[x / s] * 0.9f + (x % s) * 3.f + (y % s);
+            }
+        }
+        top_blob = m;
+        return 0;
+    }
+
+    virtual int forward(const VkMat& bottom_blob, VkMat& top_blob, VkCompute& cmd, const Option& opt) const
+    {
+        top_blob.create(bottom_blob.w * s, bottom_blob.h * s, bottom_blob.c, bottom_blob.elemsize, 1, opt.blob_vkallocator);
+
+        VkMat in_gpu = bottom_blob;
+        VkMat out_gpu = top_blob;
+        const MockInterp* layer = this;
+        cmd.record_host([layer, in_gpu, out_gpu]() {
+            Mat out;
+            layer->forward(vk_to_mat(in_gpu), out, Option());
+            mat_to_vk(out, out_gpu);
+        });
+        return 0;
+    }
+
+private:
+    int s;
+};
+
+Layer* create_layer(const char*)
+{
+    return new MockInterp;
+}
+
+// net
+
+Net::Net()
+    : vkdev(0)
+{
+}
+
+Net::~Net()
+{
+}
+
+void Net::set_vulkan_device(int device_index)
+{
+    vkdev = get_gpu_device(device_index);
+}
+
+void Net::set_vulkan_device(const VulkanDevice* _vkdev)
+{
+    vkdev = _vkdev;
+}
+
+const VulkanDevice* Net::vulkan_device() const
+{
+    return vkdev;
+}
+
+int Net::load_param(const char*)
+{
+    return 0;
+}
+
+int Net::load_param(FILE*)
+{
+    return 0;
+}
+
+int Net::load_model(const char*)
+{
+    return 0;
+}
+
+int Net::load_model(FILE*)
+{
+    return 0;
+}
+
+static bool is_image_input(const std::string& name)
+{
+    return name == "data" || name == "in0" || name == "Input1" || name == "input";
+}
+
+static bool is_image_output(const std::string& name)
+{
+    return name == "output" || name == "out0" || name == "Eltwise4";
+}
+
+const std::vector<const char*>& Net::input_names() const
+{
+    static const std::vector<const char*> names = {"data", "in0", "Input1", "input"};
+    return names;
+}
+
+const std::vector<const char*>& Net::output_names() const
+{
+    static const std::vector<const char*> names = {"output", "out0", "Eltwise4"};
+    return names;
+}
+
+void Net::clear()
+{
+}
+
+Extractor Net::create_extractor() const
+{
+    return Extractor(this, 0);
+}
+
+Extractor::Extractor(const Net* _net, size_t)
+    : net(_net), blob_vkallocator(0)
+{
+}
+
+Extractor::~Extractor()
+{
+}
+
+Extractor::Extractor(const Extractor& rhs)
+    : net(rhs.net), inputs(rhs.inputs), vk_inputs(rhs.vk_inputs), blob_vkallocator(rhs.blob_vkallocator)
+{
+}
+
+Extractor& Extractor::operator=(const Extractor& rhs)
+{
+    net = rhs.net;
+    inputs = rhs.inputs;
+    vk_inputs = rhs.vk_inputs;
+    blob_vkallocator = rhs.blob_vkallocator;
+    return *this;
+}
+
+void Extractor::clear()
+{
+    inputs.clear();
+    vk_inputs.clear();
+}
+
+void Extractor::set_light_mode(bool)
+{
+}
+
+void Extractor::set_num_threads(int)
+{
+}
+
+void Extractor::set_blob_allocator(Allocator*)
+{
+}
+
+void Extractor::set_workspace_allocator(Allocator*)
+{
+}
+
+void Extractor::set_blob_vkallocator(VkAllocator* allocator)
+{
+    blob_vkallocator = allocator;
+}
+
+void Extractor::set_workspace_vkallocator(VkAllocator*)
+{
+}
+
+void Extractor::set_staging_vkallocator(VkAllocator*)
+{
+}
+
+int Extractor::input(const char* blob_name, const Mat& in)
+{
+    inputs[blob_name] = in;
+    return 0;
+}
+
+int Extractor::input(const char* blob_name, const VkMat& in)
+{
+    vk_inputs[blob_name] = in;
+    return 0;
+}
+
+// asymmetric stencil per output subpixel, radius 2, clamped at the tile edge; the planes past the
+// image (the srmd degradation maps) add a little of their centre value
+static float model_pixel(const Mat& in, int q, int X, int Y)
+{
+    const int s = g_scale;
+    const int x = g_crop + X / s;
+    const int y = g_crop + Y / s;
+
+    float sum = 0.f;
+    for (int dy = -2; dy <= 2; dy++)
+    {
+        for (int dx = -2; dx <= 2; dx++)
+        {
+            const int sy = std::min(std::max(y + dy, 0), in.h - 1);
+            const int sx = std::min(std::max(x + dx, 0), in.w - 1);
+            const float weight = (dx == 0 && dy == 0) ? 0.6f : 0.4f * ((dx + 3) * 7 + (dy + 3) * 3 + q + (X % s) * 5 + (Y % s) * 11) / (24.f * 90.f);
+            sum += weight * in.channel(q).row(sy)[sx];
+        }
+    }
+
+    const int cy = std::min(std::max(y, 0), in.h - 1);
+    const int cx = std::min(std::max(x, 0), in.w - 1);
+    for (int e = 3; e < in.c; e++)
+        sum += 0.002f * (e - 2) * in.channel(e).row(cy)[cx];
+
+    return sum;
+}
+
+static int run_model(const std::map<std::string, Mat>& blobs, const std::string& name, Mat& out)
+{
+    Mat in;
+    float feat = 0.f;
+    for (std::map<std::string, Mat>::const_iterator it = blobs.begin(); it != blobs.end(); ++it)
+    {
+        if (is_image_input(it->first))
+        {
+            in = it->second;
+            continue;
+        }
+
+        // realcugan se features, every extra input nudges the output
+        const Mat& f = it->second;
+        for (int q = 0; q < f.c; q++)
+            feat += f.channel(q)[0] * (q + 1);
+    }
+
+    if (in.empty())
+        return -1;
+
+    if (!is_image_output(name))
+    {
+        // a feature blob, channel means of the input
+        Mat f(1, 1, 4);
+        for (int q = 0; q < 4; q++)
+        {
+            const Mat c = in.channel(q % in.c);
+            double sum = 0;
+            for (int i = 0; i < in.w * in.h; i++)
+                sum += c[i];
+            f.channel(q)[0] = (float)(sum / (in.w * in.h)) + feat * 0.5f + name.size() * 0.001f;
+        }
+        out = f;
+        return 0;
+    }
+
+    const int outw = (in.w - 2 * g_crop) * g_scale;
+    const int outh = (in.h - 2 * g_crop) * g_scale;
+    Mat m(outw, outh, 3);
+    for (int q = 0; q < 3; q++)
+    {
+        float* outptr = m.channel(q);
+        for (int Y = 0; Y < outh; Y++)
+        {
+            for (int X = 0; X < outw; X++)
+                *outptr++ = model_pixel(in, q, X, Y) + feat * 0.01f;
+        }
+    }
+    out = m;
+    return 0;
+}
+
+int Extractor::extract(const char* blob_name, Mat& feat, int)
+{
+    return run_model(inputs, blob_name, feat);
+}
+
+// the output blob is allocated now and filled when the stream runs, like a recorded forward
+int Extractor::extract(const char* blob_name, VkMat& feat, VkCompute& cmd)
+{
+    const std::string name = blob_name;
+
+    VkMat in;
+    for (std::map<std::string, VkMat>::const_iterator it = vk_inputs.begin(); it != vk_inputs.end(); ++it)
+    {
+        if (is_image_input(it->first))
+            in = it->second;
+    }
+
+    if (in.empty())
+        return -1;
+
+    VkAllocator* allocator = blob_vkallocator ? blob_vkallocator : net->vulkan_device()->acquire_blob_allocator();
+    if (is_image_output(name))
+        feat.create((in.w - 2 * g_crop) * g_scale, (in.h - 2 * g_crop) * g_scale, 3, in.elemsize, 1, allocator);
+    else
+        feat.create(1, 1, 4, in.elemsize, 1, allocator);
+
+    const std::map<std::string, VkMat> blobs = vk_inputs;
+    const VkMat out_gpu = feat;
+    cmd.record_host([blobs, name, out_gpu]() {
+        std::map<std::string, Mat> mats;
+        for (std::map<std::string, VkMat>::const_iterator it = blobs.begin(); it != blobs.end(); ++it)
+        {
+            if (!it->second.empty())
+                mats[it->first] = vk_to_mat(it->second);
+        }
+
+        Mat out;
+        if (run_model(mats, name, out) == 0)
+            mat_to_vk(out, out_gpu);
+    });
+    return 0;
+}
+
+// cpu
+
+int get_cpu_count()
+{
+    return std::max(1, (int)std::thread::hardware_concurrency());
+}
+
+int get_little_cpu_count()
+{
+    return 0;
+}
+
+int get_big_cpu_count()
+{
+    return get_cpu_count();
+}
+
+int get_physical_cpu_count()
+{
+    return get_cpu_count();
+}
+
+int cpu_support_arm_neon()
+{
+    return 0;
+}
+
+int cpu_support_arm_asimdhp()
+{
+    return 0;
+}
+
+int cpu_support_x86_avx()
+{
+    return __builtin_cpu_supports("avx");
+}
+
+int cpu_support_x86_avx2()
+{
+    return __builtin_cpu_supports("avx2");
+}
+
+int cpu_support_x86_fma()
+{
+    return __builtin_cpu_supports("fma");
+}
+
+int cpu_support_x86_sse41()
+{
+    return __builtin_cpu_supports("sse4.1");
+}
+
+double get_current_time()
+{
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace ncnn
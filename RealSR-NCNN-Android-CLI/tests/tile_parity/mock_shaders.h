@@ -0,0 +1,55 @@
+#ifndef TILE_PARITY_MOCK_SHADERS_H
+#define TILE_PARITY_MOCK_SHADERS_H
+
+// The pre- and postprocess shaders as c++. shader_gen translates the glsl of the engines (and the
+// srmd stand-ins in srmd/) into mock_shaders.cpp, one entry per storage variant.
+//
+// compile_spirv_module hands out a 5 word module that names the shader and the variant, the
+// prebuilt srmd modules are recognized by their words.
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "gpu.h"
+#include "mat.h"
+
+struct MockShaderArgs
+{
+    const std::vector<ncnn::VkMat>* bindings;
+    const std::vector<ncnn::vk_constant_type>* constants;
+    const std::vector<ncnn::vk_specialization_type>* specializations;
+
+    // the dispatcher
+    int w;
+    int h;
+    int c;
+};
+
+typedef void (*MockShaderEntry)(const MockShaderArgs& args);
+
+// entry[fp16_storage * 2 + int8_storage]
+struct MockShader
+{
+    const char* name;
+    const char* comp_data;
+    int comp_data_size;
+    MockShaderEntry entry[4];
+};
+
+// a prebuilt srmd module and the glsl variant that stands in for it
+struct MockPrebuiltShader
+{
+    const uint32_t* spv_data;
+    size_t spv_data_size;
+    const char* shader_name;
+    int variant;
+};
+
+const std::vector<MockShader>& mock_shaders();
+const std::vector<MockPrebuiltShader>& mock_prebuilt_shaders();
+
+static const uint32_t MOCK_SPIRV_MAGIC = 0x07230203;
+static const uint32_t MOCK_SPIRV_TAG = 0x6b636f6d; // "mock"
+
+#endif // TILE_PARITY_MOCK_SHADERS_H
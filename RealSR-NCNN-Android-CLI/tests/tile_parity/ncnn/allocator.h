@@ -0,0 +1,43 @@
+#ifndef TILE_PARITY_NCNN_ALLOCATOR_H
+#define TILE_PARITY_NCNN_ALLOCATOR_H
+
+#include <stddef.h>
+
+namespace ncnn {
+
+class Allocator
+{
+public:
+    virtual ~Allocator();
+    virtual void* fastMalloc(size_t size) = 0;
+    virtual void fastFree(void* ptr) = 0;
+};
+
+class PoolAllocator : public Allocator
+{
+public:
+    void set_size_compare_ratio(float scr);
+    void clear();
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+};
+
+class UnlockedPoolAllocator : public Allocator
+{
+public:
+    void set_size_compare_ratio(float scr);
+    void clear();
+    virtual void* fastMalloc(size_t size);
+    virtual void fastFree(void* ptr);
+};
+
+// only the identity matters, VkMat::create keeps its data for the same shape and allocator
+class VkAllocator
+{
+public:
+    virtual ~VkAllocator();
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_ALLOCATOR_H
@@ -0,0 +1,10 @@
+#ifndef TILE_PARITY_NCNN_BENCHMARK_H
+#define TILE_PARITY_NCNN_BENCHMARK_H
+
+namespace ncnn {
+
+double get_current_time();
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_BENCHMARK_H
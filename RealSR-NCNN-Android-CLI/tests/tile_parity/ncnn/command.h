@@ -0,0 +1,41 @@
+#ifndef TILE_PARITY_NCNN_COMMAND_H
+#define TILE_PARITY_NCNN_COMMAND_H
+
+#include <functional>
+#include <vector>
+
+#include "gpu.h"
+#include "mat.h"
+#include "pipeline.h"
+
+namespace ncnn {
+
+// Records every command and runs them in order in submit_and_wait(), so a band or tile read before
+// its stream was submitted comes out stale like on a device. Host data handed to an upload is
+// copied when it is recorded, a download fills its Mat when the stream runs.
+class VkCompute
+{
+public:
+    explicit VkCompute(const VulkanDevice* vkdev);
+    virtual ~VkCompute();
+
+    void record_upload(const Mat& src, VkMat& dst, const Option& opt);
+    void record_download(const VkMat& src, Mat& dst, const Option& opt);
+    void record_clone(const Mat& src, VkMat& dst, const Option& opt);
+    void record_clone(const VkMat& src, Mat& dst, const Option& opt);
+    void record_clone(const VkMat& src, VkMat& dst, const Option& opt);
+    void record_pipeline(const Pipeline* pipeline, const std::vector<VkMat>& bindings, const std::vector<vk_constant_type>& constants, const VkMat& dispatcher);
+
+    // the mock layers and extractor queue their work here
+    void record_host(const std::function<void()>& work);
+
+    int submit_and_wait();
+    int reset();
+
+private:
+    std::vector<std::function<void()> > commands;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_COMMAND_H
@@ -0,0 +1,19 @@
+#ifndef TILE_PARITY_NCNN_CPU_H
+#define TILE_PARITY_NCNN_CPU_H
+
+namespace ncnn {
+
+int get_cpu_count();
+int get_little_cpu_count();
+int get_big_cpu_count();
+int get_physical_cpu_count();
+int cpu_support_arm_neon();
+int cpu_support_arm_asimdhp();
+int cpu_support_x86_avx();
+int cpu_support_x86_avx2();
+int cpu_support_x86_fma();
+int cpu_support_x86_sse41();
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_CPU_H
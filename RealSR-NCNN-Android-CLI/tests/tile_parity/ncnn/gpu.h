@@ -0,0 +1,81 @@
+#ifndef TILE_PARITY_NCNN_GPU_H
+#define TILE_PARITY_NCNN_GPU_H
+
+#include <stdint.h>
+#include <vector>
+
+#include "allocator.h"
+#include "mat.h"
+#include "option.h"
+#include "platform.h"
+
+namespace ncnn {
+
+int create_gpu_instance(const char* driver_path = 0);
+void destroy_gpu_instance();
+
+class GpuInfo
+{
+public:
+    uint32_t api_version() const;
+    uint32_t driver_version() const;
+    uint32_t vendor_id() const;
+    uint32_t device_id() const;
+    const char* device_name() const;
+    const uint8_t* pipeline_cache_uuid() const;
+    uint32_t compute_queue_count() const;
+    int type() const;
+    bool support_fp16_storage() const;
+    bool support_int8_storage() const;
+};
+
+int get_gpu_count();
+int get_default_gpu_index();
+const GpuInfo& get_gpu_info(int device_index = get_default_gpu_index());
+
+class PipelineCache;
+
+// the allocators are pooled and handed out again, their identity is what VkMat::create compares
+class VulkanDevice
+{
+public:
+    explicit VulkanDevice(int device_index);
+    ~VulkanDevice();
+
+    const GpuInfo& info;
+
+    uint32_t get_heap_budget() const;
+
+    VkAllocator* acquire_blob_allocator() const;
+    void reclaim_blob_allocator(VkAllocator* allocator) const;
+    VkAllocator* acquire_staging_allocator() const;
+    void reclaim_staging_allocator(VkAllocator* allocator) const;
+
+private:
+    mutable Mutex lock;
+    mutable std::vector<VkAllocator*> blob_allocators;
+    mutable std::vector<VkAllocator*> staging_allocators;
+    mutable std::vector<VkAllocator*> owned;
+};
+
+VulkanDevice* get_gpu_device(int device_index = get_default_gpu_index());
+
+// the mock spirv names the glsl source and the storage macros, see mock_shaders.h
+int compile_spirv_module(const char* comp_data, int comp_data_size, const Option& opt, std::vector<uint32_t>& spirv);
+
+union vk_specialization_type
+{
+    int i;
+    float f;
+    uint32_t u32;
+};
+
+union vk_constant_type
+{
+    int i;
+    float f;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_GPU_H
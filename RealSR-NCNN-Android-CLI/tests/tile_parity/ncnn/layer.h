@@ -0,0 +1,39 @@
+#ifndef TILE_PARITY_NCNN_LAYER_H
+#define TILE_PARITY_NCNN_LAYER_H
+
+#include <vector>
+
+#include "command.h"
+#include "mat.h"
+#include "option.h"
+#include "paramdict.h"
+
+namespace ncnn {
+
+class VulkanDevice;
+
+class Layer
+{
+public:
+    Layer();
+    virtual ~Layer();
+
+    virtual int load_param(const ParamDict& pd);
+    virtual int create_pipeline(const Option& opt);
+    virtual int destroy_pipeline(const Option& opt);
+
+    virtual int forward(const Mat& bottom_blob, Mat& top_blob, const Option& opt) const;
+    virtual int forward(const std::vector<Mat>& bottom_blobs, std::vector<Mat>& top_blobs, const Option& opt) const;
+    virtual int forward(const VkMat& bottom_blob, VkMat& top_blob, VkCompute& cmd, const Option& opt) const;
+    virtual int forward(const std::vector<VkMat>& bottom_blobs, std::vector<VkMat>& top_blobs, VkCompute& cmd, const Option& opt) const;
+
+    bool support_vulkan;
+    const VulkanDevice* vkdev;
+};
+
+// "Interp" is the only layer the engines create, see mock_ncnn.cpp
+Layer* create_layer(const char* type);
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_LAYER_H
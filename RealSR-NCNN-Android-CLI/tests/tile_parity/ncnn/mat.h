@@ -0,0 +1,182 @@
+#ifndef TILE_PARITY_NCNN_MAT_H
+#define TILE_PARITY_NCNN_MAT_H
+
+// The parts of ncnn::Mat and ncnn::VkMat the engines touch. Both live in host memory, a VkMat is
+// only ever read and written by the mock VkCompute when a command stream is submitted.
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "allocator.h"
+
+namespace ncnn {
+
+struct Option;
+
+class Mat
+{
+public:
+    Mat();
+    Mat(int w, int h, size_t elemsize = 4u, Allocator* allocator = 0);
+    Mat(int w, int h, int c, size_t elemsize = 4u, Allocator* allocator = 0);
+    Mat(int w, int h, size_t elemsize, int elempack, Allocator* allocator = 0);
+    Mat(int w, int h, int c, size_t elemsize, int elempack, Allocator* allocator = 0);
+    Mat(int w, int h, void* data, size_t elemsize = 4u, Allocator* allocator = 0);
+    Mat(int w, int h, void* data, size_t elemsize, int elempack, Allocator* allocator = 0);
+    Mat(int w, int h, int c, void* data, size_t elemsize = 4u, Allocator* allocator = 0);
+    Mat(int w, int h, int c, void* data, size_t elemsize, int elempack, Allocator* allocator = 0);
+    Mat(const Mat& m);
+    ~Mat();
+    Mat& operator=(const Mat& m);
+
+    void fill(float v);
+    Mat clone(Allocator* allocator = 0) const;
+
+    // same shape and allocator keeps the current data, like ncnn
+    void create(int w, int h, size_t elemsize = 4u, Allocator* allocator = 0);
+    void create(int w, int h, int c, size_t elemsize = 4u, Allocator* allocator = 0);
+    void create(int w, int h, size_t elemsize, int elempack, Allocator* allocator = 0);
+    void create(int w, int h, int c, size_t elemsize, int elempack, Allocator* allocator = 0);
+    void create_like(const Mat& m, Allocator* allocator = 0);
+
+    void release();
+    bool empty() const;
+    size_t total() const;
+    int elembits() const;
+
+    Mat channel(int q);
+    const Mat channel(int q) const;
+    Mat channel_range(int q, int channels);
+    const Mat channel_range(int q, int channels) const;
+    float* row(int y);
+    const float* row(int y) const;
+    template <typename T>
+    T* row(int y)
+    {
+        return (T*)((unsigned char*)data + (size_t)w * y * elemsize);
+    }
+    template <typename T>
+    const T* row(int y) const
+    {
+        return (const T*)((const unsigned char*)data + (size_t)w * y * elemsize);
+    }
+
+    template <typename T>
+    operator T*()
+    {
+        return (T*)data;
+    }
+    template <typename T>
+    operator const T*() const
+    {
+        return (const T*)data;
+    }
+
+    float& operator[](size_t i)
+    {
+        return ((float*)data)[i];
+    }
+    const float& operator[](size_t i) const
+    {
+        return ((const float*)data)[i];
+    }
+
+    enum PixelType
+    {
+        PIXEL_CONVERT_SHIFT = 16,
+        PIXEL_FORMAT_MASK = 0x0000ffff,
+        PIXEL_CONVERT_MASK = 0xffff0000,
+
+        PIXEL_RGB = 1,
+        PIXEL_BGR = 2,
+        PIXEL_GRAY = 3,
+        PIXEL_RGBA = 4,
+        PIXEL_BGRA = 5,
+
+        PIXEL_RGB2BGR = PIXEL_RGB | (PIXEL_BGR << PIXEL_CONVERT_SHIFT),
+        PIXEL_BGR2RGB = PIXEL_BGR | (PIXEL_RGB << PIXEL_CONVERT_SHIFT),
+        PIXEL_RGBA2BGRA = PIXEL_RGBA | (PIXEL_BGRA << PIXEL_CONVERT_SHIFT),
+        PIXEL_BGRA2RGBA = PIXEL_BGRA | (PIXEL_RGBA << PIXEL_CONVERT_SHIFT),
+        PIXEL_RGBA2RGB = PIXEL_RGBA | (PIXEL_RGB << PIXEL_CONVERT_SHIFT),
+        PIXEL_RGB2RGBA = PIXEL_RGB | (PIXEL_RGBA << PIXEL_CONVERT_SHIFT),
+        PIXEL_BGRA2BGR = PIXEL_BGRA | (PIXEL_BGR << PIXEL_CONVERT_SHIFT),
+        PIXEL_BGR2BGRA = PIXEL_BGR | (PIXEL_BGRA << PIXEL_CONVERT_SHIFT),
+    };
+
+    static Mat from_pixels(const unsigned char* pixels, int type, int w, int h, Allocator* allocator = 0);
+    static Mat from_pixels(const unsigned char* pixels, int type, int w, int h, int stride, Allocator* allocator = 0);
+    static Mat from_pixels_roi(const unsigned char* pixels, int type, int w, int h, int roix, int roiy, int roiw, int roih, Allocator* allocator = 0);
+    static Mat from_pixels_roi(const unsigned char* pixels, int type, int w, int h, int stride, int roix, int roiy, int roiw, int roih, Allocator* allocator = 0);
+    void to_pixels(unsigned char* pixels, int type) const;
+    void to_pixels(unsigned char* pixels, int type, int stride) const;
+
+    void* data;
+    int* refcount;
+    size_t elemsize;
+    int elempack;
+    Allocator* allocator;
+    int dims;
+    int w;
+    int h;
+    int d;
+    int c;
+    size_t cstep;
+};
+
+class VkMat
+{
+public:
+    VkMat();
+    VkMat(const VkMat& m);
+    ~VkMat();
+    VkMat& operator=(const VkMat& m);
+
+    // nothing is allocated without an allocator, like ncnn
+    void create(int w, int h, size_t elemsize, VkAllocator* allocator);
+    void create(int w, int h, int c, size_t elemsize, VkAllocator* allocator);
+    void create(int w, int h, size_t elemsize, int elempack, VkAllocator* allocator);
+    void create(int w, int h, int c, size_t elemsize, int elempack, VkAllocator* allocator);
+    void create_like(const Mat& m, VkAllocator* allocator);
+    void create_like(const VkMat& m, VkAllocator* allocator);
+
+    void release();
+    bool empty() const;
+    size_t total() const;
+    int elembits() const;
+
+    // bytes behind data, 0 when empty
+    size_t size_in_bytes() const;
+
+    void* data;
+    int* refcount;
+    size_t elemsize;
+    int elempack;
+    VkAllocator* allocator;
+    int dims;
+    int w;
+    int h;
+    int d;
+    int c;
+    size_t cstep;
+};
+
+enum BorderType
+{
+    BORDER_CONSTANT = 0,
+    BORDER_REPLICATE = 1,
+    BORDER_REFLECT = 2,
+    BORDER_TRANSPARENT = -233,
+};
+
+void copy_make_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, int type, float v, const Option& opt);
+void copy_make_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, int type, float v);
+void copy_cut_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right, const Option& opt);
+void copy_cut_border(const Mat& src, Mat& dst, int top, int bottom, int left, int right);
+void convert_packing(const Mat& src, Mat& dst, int elempack, const Option& opt);
+void cast_float32_to_float16(const Mat& src, Mat& dst, const Option& opt);
+void cast_float16_to_float32(const Mat& src, Mat& dst, const Option& opt);
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_MAT_H
@@ -0,0 +1,83 @@
+#ifndef TILE_PARITY_NCNN_NET_H
+#define TILE_PARITY_NCNN_NET_H
+
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "command.h"
+#include "gpu.h"
+#include "layer.h"
+#include "mat.h"
+#include "option.h"
+#include "platform.h"
+
+namespace ncnn {
+
+class Extractor;
+
+// loads nothing, every net runs the stand-in model of mock_model.h
+class Net
+{
+public:
+    Net();
+    virtual ~Net();
+
+    Option opt;
+
+    void set_vulkan_device(int device_index);
+    void set_vulkan_device(const VulkanDevice* vkdev);
+    const VulkanDevice* vulkan_device() const;
+
+    int load_param(const char* protopath);
+    int load_param(FILE* fp);
+    int load_model(const char* modelpath);
+    int load_model(FILE* fp);
+
+    const std::vector<const char*>& input_names() const;
+    const std::vector<const char*>& output_names() const;
+
+    void clear();
+
+    Extractor create_extractor() const;
+
+private:
+    const VulkanDevice* vkdev;
+};
+
+class Extractor
+{
+public:
+    virtual ~Extractor();
+    Extractor(const Extractor& rhs);
+    Extractor& operator=(const Extractor& rhs);
+
+    void clear();
+    void set_light_mode(bool enable);
+    void set_num_threads(int num_threads);
+    void set_blob_allocator(Allocator* allocator);
+    void set_workspace_allocator(Allocator* allocator);
+    void set_blob_vkallocator(VkAllocator* allocator);
+    void set_workspace_vkallocator(VkAllocator* allocator);
+    void set_staging_vkallocator(VkAllocator* allocator);
+
+    int input(const char* blob_name, const Mat& in);
+    int input(const char* blob_name, const VkMat& in);
+    int extract(const char* blob_name, Mat& feat, int type = 0);
+    int extract(const char* blob_name, VkMat& feat, VkCompute& cmd);
+
+protected:
+    friend Extractor Net::create_extractor() const;
+    Extractor(const Net* net, size_t blob_count);
+
+private:
+    const Net* net;
+    std::map<std::string, Mat> inputs;
+    std::map<std::string, VkMat> vk_inputs;
+    VkAllocator* blob_vkallocator;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_NET_H
@@ -0,0 +1,43 @@
+#ifndef TILE_PARITY_NCNN_OPTION_H
+#define TILE_PARITY_NCNN_OPTION_H
+
+namespace ncnn {
+
+class Allocator;
+class VkAllocator;
+class PipelineCache;
+
+struct Option
+{
+    Option();
+
+    bool lightmode;
+    int num_threads;
+    Allocator* blob_allocator;
+    Allocator* workspace_allocator;
+    VkAllocator* blob_vkallocator;
+    VkAllocator* workspace_vkallocator;
+    VkAllocator* staging_vkallocator;
+    PipelineCache* pipeline_cache;
+    int openmp_blocktime;
+    bool use_winograd_convolution;
+    bool use_sgemm_convolution;
+    bool use_int8_inference;
+    bool use_vulkan_compute;
+    bool use_bf16_storage;
+    bool use_fp16_packed;
+    bool use_fp16_storage;
+    bool use_fp16_arithmetic;
+    bool use_int8_packed;
+    bool use_int8_storage;
+    bool use_int8_arithmetic;
+    bool use_packing_layout;
+    bool use_shader_pack8;
+    bool use_subgroup_basic;
+    bool use_local_pool_allocator;
+    bool use_tensor_storage;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_OPTION_H
@@ -0,0 +1,28 @@
+#ifndef TILE_PARITY_NCNN_PARAMDICT_H
+#define TILE_PARITY_NCNN_PARAMDICT_H
+
+#include <map>
+
+#include "mat.h"
+
+namespace ncnn {
+
+class ParamDict
+{
+public:
+    ParamDict();
+
+    int get(int id, int def) const;
+    float get(int id, float def) const;
+
+    void set(int id, int i);
+    void set(int id, float f);
+
+private:
+    std::map<int, int> ints;
+    std::map<int, float> floats;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_PARAMDICT_H
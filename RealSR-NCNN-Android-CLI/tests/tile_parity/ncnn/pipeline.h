@@ -0,0 +1,31 @@
+#ifndef TILE_PARITY_NCNN_PIPELINE_H
+#define TILE_PARITY_NCNN_PIPELINE_H
+
+#include <vector>
+
+#include "gpu.h"
+
+struct MockShader;
+
+namespace ncnn {
+
+class Pipeline
+{
+public:
+    explicit Pipeline(const VulkanDevice* vkdev);
+    virtual ~Pipeline();
+
+    void set_optimal_local_size_xyz(int w = 4, int h = 4, int c = 4);
+
+    // takes the spirv of compile_spirv_module or one of the prebuilt srmd modules
+    int create(const uint32_t* spv_data, size_t spv_data_size, const std::vector<vk_specialization_type>& specializations);
+
+    // the translated shader and its storage variant, see mock_shaders.h
+    const ::MockShader* shader;
+    int variant;
+    std::vector<vk_specialization_type> specializations;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_PIPELINE_H
@@ -0,0 +1,41 @@
+#ifndef TILE_PARITY_NCNN_PLATFORM_H
+#define TILE_PARITY_NCNN_PLATFORM_H
+
+#include <pthread.h>
+
+#define NCNN_VULKAN 1
+#define NCNN_VERSION_STRING "tile-parity-mock"
+
+namespace ncnn {
+
+class Mutex
+{
+public:
+    Mutex();
+    ~Mutex();
+    void lock();
+    void unlock();
+
+private:
+    pthread_mutex_t mutex;
+};
+
+class MutexLockGuard
+{
+public:
+    MutexLockGuard(Mutex& _mutex) : mutex(_mutex)
+    {
+        mutex.lock();
+    }
+    ~MutexLockGuard()
+    {
+        mutex.unlock();
+    }
+
+private:
+    Mutex& mutex;
+};
+
+} // namespace ncnn
+
+#endif // TILE_PARITY_NCNN_PLATFORM_H
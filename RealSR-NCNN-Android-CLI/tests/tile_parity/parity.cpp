@@ -0,0 +1,260 @@
+// Runs an engine over images around its tile boundaries and compares the output digests with the
+// ones of the engine before the shared tile loop (golden/<engine>.txt).
+//
+//   tile_parity_<engine> <tta> <golden.txt>          compare, exits 1 if any run differs
+//   tile_parity_<engine> --write <tta> <golden.txt>  write the digests of every run
+//
+// The cpu path runs when the engine has one, the gpu path always; a run is named by its
+// parameters, so a sampled run compares against a golden file of the full sweep. Set
+// TILE_PARITY_FULL=1 for every run, it takes a few minutes.
+//
+// One process runs one tta mode. The engines before the shared tile loop compile their shaders
+// into function statics once per process, so the first engine would decide the tta mode of all.
+// The oob count of a run is part of its result: the gpu postproc of realcugan and waifu2x reads
+// its empty alpha binding at four channels, the checked buffers read that as zero.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+#include <string>
+#include <vector>
+
+#include ENGINE_H
+
+#include "glsl_compat.h"
+#include "mock_model.h"
+
+#define ENGINE_REALSR 0
+#define ENGINE_REALCUGAN 1
+#define ENGINE_WAIFU2X 2
+#define ENGINE_SRMD 3
+
+struct Config
+{
+    int scale;
+    int prepadding;
+    int noise;
+};
+
+static uint64_t fnv1a(const unsigned char* data, size_t size)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; i++)
+    {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static unsigned int seed = 0;
+
+static unsigned char rnd()
+{
+    seed = seed * 1103515245 + 12345;
+    return (seed >> 16) & 255;
+}
+
+static bool read_golden(const char* path, std::map<std::string, std::string>& golden)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    char line[512];
+    while (fgets(line, sizeof(line), fp))
+    {
+        // "<run> | <result>"
+        char* sep = strstr(line, " | ");
+        if (!sep)
+            continue;
+
+        line[strcspn(line, "\r\n")] = 0;
+        *sep = 0;
+        golden[line] = sep + 3;
+    }
+
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    const bool write = argc == 4 && strcmp(argv[1], "--write") == 0;
+    if ((argc != 3 && !write) || (strcmp(argv[argc - 2], "0") != 0 && strcmp(argv[argc - 2], "1") != 0))
+    {
+        fprintf(stderr, "usage: %s [--write] <tta> <golden.txt>\n", argv[0]);
+        return 2;
+    }
+
+    const int tta = atoi(argv[argc - 2]);
+
+    const char* golden_path = argv[argc - 1];
+    const bool full = write || (getenv("TILE_PARITY_FULL") && atoi(getenv("TILE_PARITY_FULL")));
+
+    std::map<std::string, std::string> golden;
+    if (!write && !read_golden(golden_path, golden))
+    {
+        fprintf(stderr, "open %s failed\n", golden_path);
+        return 2;
+    }
+
+    FILE* out = 0;
+    if (write)
+    {
+        out = fopen(golden_path, "wb");
+        if (!out)
+        {
+            fprintf(stderr, "open %s failed\n", golden_path);
+            return 2;
+        }
+    }
+
+#if ENGINE_ID == ENGINE_REALSR
+    const std::vector<Config> configs = {{4, 10, 0}, {2, 10, 0}};
+    const int gpuids[] = {-1, 0};
+#elif ENGINE_ID == ENGINE_REALCUGAN
+    const std::vector<Config> configs = {{2, 18, 0}, {3, 14, 0}, {4, 19, 0}};
+    const int gpuids[] = {-1, 0};
+#elif ENGINE_ID == ENGINE_WAIFU2X
+    const std::vector<Config> configs = {{2, 7, 0}, {2, 18, 1}, {1, 28, 2}};
+    const int gpuids[] = {-1, 0};
+#else
+    const std::vector<Config> configs = {{2, 12, 3}, {3, 12, -1}, {4, 12, 10}};
+    const int gpuids[] = {0};
+#endif
+
+    const int tilesizes[] = {32, 48};
+
+#if ENGINE_ID == ENGINE_REALCUGAN
+    const int syncgaps = 4;
+#else
+    const int syncgaps = 1;
+#endif
+
+    int runs = 0;
+    int compared = 0;
+    int failed = 0;
+    int index = 0;
+
+    for (int gpuid : gpuids)
+    for (const Config& cfg : configs)
+    for (int tilesize : tilesizes)
+    for (int syncgap = 0; syncgap < syncgaps; syncgap++)
+    for (int c = 3; c <= 4; c++)
+    {
+#if ENGINE_ID == ENGINE_WAIFU2X
+        // the cpu path of waifu2x has no alpha channel
+        if (gpuid == -1 && c == 4)
+            continue;
+#endif
+
+        std::vector<int> sizes;
+        for (int k = 1; k <= 2; k++)
+        {
+            sizes.push_back(k * tilesize + 1);
+            sizes.push_back(k * tilesize + cfg.prepadding);
+            sizes.push_back(k * tilesize + cfg.prepadding + 1);
+            sizes.push_back(k * tilesize);
+        }
+        sizes.push_back(tilesize - 3);
+
+        for (size_t wi = 0; wi < sizes.size(); wi++)
+        for (size_t hi = 0; hi < sizes.size(); hi += 2)
+        {
+            // the rough syncgap modes run a lot more tiles, a third of the sizes do
+            if (syncgap && (wi + hi) % 3)
+                continue;
+
+            const int w = sizes[wi];
+            const int h = sizes[(hi + wi) % sizes.size()];
+
+            // very rough averages 32px tiles in steps of 3 and has nothing to average below 3x3 of them
+            if (syncgap == 3 && (w < 96 || h < 96))
+                continue;
+
+            if (!full && index++ % 5 != 0)
+                continue;
+
+            char run[256];
+            sprintf(run, "gpu %d scale %d pad %d noise %d tile %d tta %d syncgap %d c %d %dx%d", gpuid, cfg.scale, cfg.prepadding, cfg.noise, tilesize, tta, syncgap, c, w, h);
+
+            // the pixels of a run depend on its name only, a sampled run sees the ones of the full sweep
+            seed = (unsigned int)fnv1a((const unsigned char*)run, strlen(run));
+
+            mock_model_configure(cfg.scale, ENGINE_ID == ENGINE_REALSR || ENGINE_ID == ENGINE_SRMD ? 0 : cfg.prepadding);
+
+#if ENGINE_ID == ENGINE_SRMD
+            ENGINE e(gpuid, tta);
+#else
+            ENGINE e(gpuid, tta, 2);
+#endif
+            e.scale = cfg.scale;
+            e.tilesize = tilesize;
+            e.prepadding = cfg.prepadding;
+#if ENGINE_ID != ENGINE_REALSR
+            e.noise = cfg.noise;
+#endif
+#if ENGINE_ID == ENGINE_REALCUGAN
+            e.syncgap = syncgap;
+#endif
+            e.load("param", "model");
+
+            std::vector<unsigned char> pixels((size_t)w * h * c);
+            for (size_t i = 0; i < pixels.size(); i++)
+                pixels[i] = rnd();
+
+            // a few flat areas
+            for (int y = 0; y < h / 3; y++)
+            {
+                for (int x = 0; x < w / 2; x++)
+                {
+                    for (int q = 0; q < c; q++)
+                        pixels[((size_t)y * w + x) * c + q] = 40 + q;
+                }
+            }
+
+            ncnn::Mat inimage(w, h, (void*)pixels.data(), (size_t)c, c);
+            ncnn::Mat outimage(w * cfg.scale, h * cfg.scale, (size_t)c, c);
+            memset(outimage.data, 0xcd, (size_t)outimage.w * outimage.h * c);
+
+            const long oob = glsl::out_of_bounds();
+            const int ret = e.process(inimage, outimage);
+
+            char result[128];
+            sprintf(result, "ret %d oob %ld digest %016llx", ret, glsl::out_of_bounds() - oob,
+                    (unsigned long long)fnv1a((const unsigned char*)outimage.data, (size_t)outimage.w * outimage.h * c));
+
+            runs++;
+
+            if (write)
+            {
+                fprintf(out, "%s | %s\n", run, result);
+                continue;
+            }
+
+            std::map<std::string, std::string>::const_iterator it = golden.find(run);
+            if (it == golden.end())
+            {
+                fprintf(stderr, "%s: not in %s\n", run, golden_path);
+                failed++;
+                continue;
+            }
+
+            compared++;
+            if (it->second != result)
+            {
+                fprintf(stderr, "%s: %s, expected %s\n", run, result, it->second.c_str());
+                failed++;
+            }
+        }
+    }
+
+    if (out)
+        fclose(out);
+
+    fprintf(stderr, "%d runs, %d compared, %d failed\n", runs, compared, failed);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,247 @@
+// Translates the pre- and postprocess glsl into c++ for the mock VkCompute.
+//
+//   shader_gen <out.cpp> [stand-in.comp ...]
+//
+// The engine shaders come from their .comp.hex.h, the srmd stand-ins from files. Only the layout
+// declarations need rewriting: a specialization constant becomes a member read from the pipeline,
+// a buffer a bounds checked view of the bound VkMat and the push constant block a struct filled
+// from the constants. Everything else is kept, the statements of these shaders are c++ already.
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <regex>
+#include <string>
+#include <vector>
+
+#include "realcugan_4x_postproc.comp.hex.h"
+#include "realcugan_4x_postproc_tta.comp.hex.h"
+#include "realcugan_postproc.comp.hex.h"
+#include "realcugan_postproc_tta.comp.hex.h"
+#include "realcugan_preproc.comp.hex.h"
+#include "realcugan_preproc_tta.comp.hex.h"
+#include "realsr_postproc.comp.hex.h"
+#include "realsr_postproc_tta.comp.hex.h"
+#include "realsr_preproc.comp.hex.h"
+#include "realsr_preproc_tta.comp.hex.h"
+#include "waifu2x_postproc.comp.hex.h"
+#include "waifu2x_postproc_tta.comp.hex.h"
+#include "waifu2x_preproc.comp.hex.h"
+#include "waifu2x_preproc_tta.comp.hex.h"
+
+struct Source
+{
+    std::string name;
+    std::string glsl;
+    bool engine;
+};
+
+#define ENGINE_SOURCE(x) {#x, std::string(x##_comp_data, sizeof(x##_comp_data)), true}
+
+static const char* const srmd_modules[] = {"srmd_preproc", "srmd_postproc", "srmd_preproc_tta", "srmd_postproc_tta"};
+
+// the postprocess of srmd takes the same bindings and constants as the one of realsr
+static std::string srmd_stand_in(const std::string& module)
+{
+    if (module == "srmd_postproc")
+        return "realsr_postproc";
+    if (module == "srmd_postproc_tta")
+        return "realsr_postproc_tta";
+    return module;
+}
+
+static bool translate(const Source& src, int variant, std::string& out)
+{
+    static const std::regex constant_re("^\\s*layout\\s*\\(\\s*constant_id\\s*=\\s*(\\d+)\\s*\\)\\s*const\\s+(\\w+)\\s+(\\w+)\\s*=\\s*([^;]+);\\s*$");
+    static const std::regex buffer_re("^\\s*layout\\s*\\(\\s*binding\\s*=\\s*(\\d+)\\s*\\)\\s*(?:(?:readonly|writeonly)\\s+)*buffer\\s+\\w+\\s*\\{\\s*(\\w+)\\s+(\\w+)\\s*\\[\\s*\\]\\s*;\\s*\\}\\s*;\\s*$");
+    static const std::regex push_re("^\\s*layout\\s*\\(\\s*push_constant\\s*\\)\\s*uniform\\s+(\\w+)\\s*$");
+    static const std::regex define_re("^\\s*#\\s*define\\s+(\\w+)");
+    static const std::regex skip_re("^\\s*#\\s*(version|extension)\\b");
+
+    const std::string ns = src.name + "_" + std::to_string(variant);
+
+    out += "namespace " + ns + " {\n\n";
+    out += "#define NCNN_fp16_storage " + std::to_string(variant >> 1) + "\n";
+    out += "#define NCNN_int8_storage " + std::to_string(variant & 1) + "\n\n";
+    out += "struct Shader : Invocation\n{\n";
+    out += "explicit Shader(const MockShaderArgs& _args) : Invocation(_args) {}\n\n";
+
+    std::vector<std::string> defines;
+    size_t pos = 0;
+    int lineno = 0;
+    while (pos < src.glsl.size())
+    {
+        size_t end = src.glsl.find('\n', pos);
+        if (end == std::string::npos)
+            end = src.glsl.size();
+
+        std::string line = src.glsl.substr(pos, end - pos);
+        pos = end + 1;
+        lineno++;
+
+        line.erase(std::remove(line.begin(), line.end(), '\r'), line.end());
+        line.erase(std::remove(line.begin(), line.end(), '\0'), line.end());
+
+        std::smatch m;
+        if (std::regex_search(line, skip_re))
+            continue;
+
+        if (std::regex_match(line, m, constant_re))
+        {
+            out += m[2].str() + " " + m[3].str() + " = spec<" + m[2].str() + ">(" + m[1].str() + ", " + m[4].str() + ");\n";
+        }
+        else if (std::regex_match(line, m, buffer_re))
+        {
+            out += "Buf<" + m[2].str() + "> " + m[3].str() + " = binding<" + m[2].str() + ">(" + m[1].str() + ");\n";
+        }
+        else if (std::regex_match(line, m, push_re))
+        {
+            out += "struct " + m[1].str() + "\n";
+        }
+        else if (line.find("layout") != std::string::npos)
+        {
+            fprintf(stderr, "%s:%d: unsupported declaration: %s\n", src.name.c_str(), lineno, line.c_str());
+            return false;
+        }
+        else
+        {
+            if (std::regex_search(line, m, define_re))
+                defines.push_back(m[1].str());
+            out += line + "\n";
+        }
+    }
+
+    out += "\nvoid load()\n{\npush_constants(&p, sizeof(p));\n}\n";
+    out += "};\n\n";
+    for (size_t i = 0; i < defines.size(); i++)
+        out += "#undef " + defines[i] + "\n";
+    out += "#undef NCNN_fp16_storage\n#undef NCNN_int8_storage\n\n";
+    out += "void entry(const MockShaderArgs& args)\n{\ndispatch<Shader>(args);\n}\n\n";
+    out += "} // namespace " + ns + "\n\n";
+    return true;
+}
+
+static bool read_file(const char* path, std::string& text)
+{
+    FILE* fp = fopen(path, "rb");
+    if (!fp)
+        return false;
+
+    char buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), fp)) > 0)
+        text.append(buf, n);
+
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 2)
+    {
+        fprintf(stderr, "usage: %s out.cpp [stand-in.comp ...]\n", argv[0]);
+        return 1;
+    }
+
+    std::vector<Source> sources = {
+        ENGINE_SOURCE(realsr_preproc),
+        ENGINE_SOURCE(realsr_postproc),
+        ENGINE_SOURCE(realsr_preproc_tta),
+        ENGINE_SOURCE(realsr_postproc_tta),
+        ENGINE_SOURCE(realcugan_preproc),
+        ENGINE_SOURCE(realcugan_postproc),
+        ENGINE_SOURCE(realcugan_4x_postproc),
+        ENGINE_SOURCE(realcugan_preproc_tta),
+        ENGINE_SOURCE(realcugan_postproc_tta),
+        ENGINE_SOURCE(realcugan_4x_postproc_tta),
+        ENGINE_SOURCE(waifu2x_preproc),
+        ENGINE_SOURCE(waifu2x_postproc),
+        ENGINE_SOURCE(waifu2x_preproc_tta),
+        ENGINE_SOURCE(waifu2x_postproc_tta),
+    };
+
+    for (int i = 2; i < argc; i++)
+    {
+        std::string name = argv[i];
+        size_t sep = name.find_last_of("/\\");
+        if (sep != std::string::npos)
+            name = name.substr(sep + 1);
+        name = name.substr(0, name.find('.'));
+
+        Source src = {name, "", false};
+        if (!read_file(argv[i], src.glsl))
+        {
+            fprintf(stderr, "open %s failed\n", argv[i]);
+            return 1;
+        }
+        sources.push_back(src);
+    }
+
+    std::string out;
+    out += "// generated by shader_gen, do not edit\n\n";
+    out += "#include \"glsl_compat.h\"\n\n";
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        if (sources[i].engine)
+            out += "#include \"" + sources[i].name + ".comp.hex.h\"\n";
+    }
+    out += "\n";
+
+    const char* const suffixes[] = {"", "_fp16s", "_int8s"};
+    for (const char* module : srmd_modules)
+    {
+        for (const char* suffix : suffixes)
+        {
+            const std::string name = std::string(module) + suffix + "_spv_data";
+            out += "static const uint32_t " + name + "[] = {\n#include \"" + module + suffix + ".spv.hex.h\"\n};\n";
+        }
+    }
+    out += "\nnamespace glsl {\n\n";
+
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        for (int variant = 0; variant < 4; variant++)
+        {
+            if (!translate(sources[i], variant, out))
+                return 1;
+        }
+    }
+
+    out += "} // namespace glsl\n\n";
+
+    out += "const std::vector<MockShader>& mock_shaders()\n{\n";
+    out += "static const std::vector<MockShader> shaders = {\n";
+    for (size_t i = 0; i < sources.size(); i++)
+    {
+        const std::string& n = sources[i].name;
+        const std::string data = sources[i].engine ? n + "_comp_data" : "0";
+        const std::string size = sources[i].engine ? "sizeof(" + n + "_comp_data)" : "0";
+        out += "{\"" + n + "\", " + data + ", " + size + ", {glsl::" + n + "_0::entry, glsl::" + n + "_1::entry, glsl::" + n + "_2::entry, glsl::" + n + "_3::entry}},\n";
+    }
+    out += "};\nreturn shaders;\n}\n\n";
+
+    // the srmd modules are built for fp32, fp16 storage and fp16 with int8 storage
+    const int variants[] = {0, 2, 3};
+    out += "const std::vector<MockPrebuiltShader>& mock_prebuilt_shaders()\n{\n";
+    out += "static const std::vector<MockPrebuiltShader> shaders = {\n";
+    for (const char* module : srmd_modules)
+    {
+        for (int i = 0; i < 3; i++)
+        {
+            const std::string name = std::string(module) + suffixes[i] + "_spv_data";
+            out += "{" + name + ", sizeof(" + name + "), \"" + srmd_stand_in(module) + "\", " + std::to_string(variants[i]) + "},\n";
+        }
+    }
+    out += "};\nreturn shaders;\n}\n";
+
+    FILE* fp = fopen(argv[1], "wb");
+    if (!fp)
+    {
+        fprintf(stderr, "open %s failed\n", argv[1]);
+        return 1;
+    }
+    fwrite(out.data(), 1, out.size(), fp);
+    fclose(fp);
+    return 0;
+}
@@ -0,0 +1,54 @@
+// Runs the realsr cpu tile loop on the mock net over a fixed 512x512 image, the tiles/s line of
+// every run shows how the tile workers scale, like -g -1 -j 1:N:1 would with a real model.
+//
+//   tile_rate_realsr <threads> [runs]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+
+#include "realsr.h"
+
+#include "mock_model.h"
+
+int main(int argc, char** argv)
+{
+    if (argc < 2 || atoi(argv[1]) < 1)
+    {
+        fprintf(stderr, "usage: %s <threads> [runs]\n", argv[0]);
+        return 2;
+    }
+
+    const int threads = atoi(argv[1]);
+    const int runs = argc > 2 ? atoi(argv[2]) : 3;
+
+    const int w = 512;
+    const int h = 512;
+    const int c = 3;
+
+    std::vector<unsigned char> pixels((size_t)w * h * c);
+    unsigned int seed = 12345;
+    for (size_t i = 0; i < pixels.size(); i++)
+    {
+        seed = seed * 1103515245 + 12345;
+        pixels[i] = (seed >> 16) & 255;
+    }
+
+    mock_model_configure(4, 0);
+
+    RealSR e(-1, false, threads);
+    e.scale = 4;
+    e.tilesize = 64;
+    e.prepadding = 10;
+    e.load("param", "model");
+
+    for (int i = 0; i < runs; i++)
+    {
+        ncnn::Mat inimage(w, h, (void*)pixels.data(), (size_t)c, c);
+        ncnn::Mat outimage(w * 4, h * 4, (size_t)c, c);
+        if (e.process(inimage, outimage) != 0)
+            return 1;
+    }
+
+    return 0;
+}